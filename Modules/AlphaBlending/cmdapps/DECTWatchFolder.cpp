@@ -0,0 +1,112 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include <mitkCommandLineParser.h>
+#include <mitkDECTWatchFolderService.h>
+#include <mitkException.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	std::atomic<bool> StopRequested(false);
+
+	void RequestStop(int)
+	{
+		StopRequested = true;
+	}
+
+	void PrintStage(const char* name, const mitk::DECTWatchFolderService::StageStatistics& stage,
+		const mitk::DECTWatchFolderService::QueueStatistics& queue)
+	{
+		std::cout << "  " << name << ": " << stage.m_Processed << " done, " << stage.m_Failed << " failed, mean "
+			<< stage.GetMeanSeconds() << " s, max " << stage.m_MaximumSeconds << " s, queue " << queue.m_Depth << "/"
+			<< queue.m_Capacity << " (peak " << queue.m_PeakDepth << ")" << std::endl;
+	}
+
+	void PrintStatistics(const mitk::DECTWatchFolderService::Statistics& statistics)
+	{
+		std::cout << statistics.m_Discovered << " cases discovered" << std::endl;
+		PrintStage("read", statistics.m_Read, statistics.m_ReadQueue);
+		PrintStage("blend", statistics.m_Compute, statistics.m_ComputeQueue);
+		PrintStage("write", statistics.m_Write, statistics.m_WriteQueue);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	mitkCommandLineParser parser;
+	parser.setTitle("DECT Watch Folder");
+	parser.setCategory("Dual Energy CT");
+	parser.setDescription("Blends DECT series into HU and rED volumes as soon as they arrive in a directory.");
+	parser.setContributor("German Cancer Research Center (DKFZ)");
+	parser.setArgumentPrefix("--", "-");
+
+	parser.addArgument("input", "i", mitkCommandLineParser::Directory, "Input directory", "Watched directory, its subdirectories are scanned as well.", us::Any(), false);
+	parser.addArgument("output", "o", mitkCommandLineParser::Directory, "Output directory", "Every case is written to its own subdirectory.", us::Any(), false);
+	parser.addArgument("mode", "m", mitkCommandLineParser::String, "Mode", "Alpha value descriptor, the first matching mode is used if not given.", us::Any(), true);
+	parser.addArgument("alpha-file", "a", mitkCommandLineParser::File, "Alpha value file", "External alpha value XML file, appended to the built in values.", us::Any(), true);
+	parser.addArgument("interval", "t", mitkCommandLineParser::Int, "Poll interval", "Milliseconds between two scans of the input directory.", 2000, true);
+	parser.addArgument("no-red", "", mitkCommandLineParser::Bool, "No rED", "Write the HU volume only.", false, true);
+	parser.addArgument("status", "s", mitkCommandLineParser::Int, "Status interval", "Seconds between two status reports, 0 disables them.", 60, true);
+
+	auto arguments = parser.parseArguments(argc, argv);
+	if (arguments.empty())
+		return EXIT_FAILURE;
+
+	mitk::DECTWatchFolderService service;
+	service.m_InputDirectory = us::any_cast<std::string>(arguments["input"]);
+	service.m_OutputDirectory = us::any_cast<std::string>(arguments["output"]);
+	if (arguments.count("mode"))
+		service.m_Mode = us::any_cast<std::string>(arguments["mode"]);
+	if (arguments.count("interval"))
+		service.m_PollInterval = static_cast<unsigned int>(us::any_cast<int>(arguments["interval"]));
+	if (arguments.count("no-red"))
+		service.m_WriteRED = !us::any_cast<bool>(arguments["no-red"]);
+	const int statusInterval = arguments.count("status") ? us::any_cast<int>(arguments["status"]) : 60;
+
+	try
+	{
+		service.GetTool().Initialize();
+		if (arguments.count("alpha-file"))
+			service.GetTool().ReadExternalResource(us::any_cast<std::string>(arguments["alpha-file"]), true);
+		service.Start();
+	}
+	catch (const mitk::Exception& e)
+	{
+		std::cerr << e.GetDescription() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::signal(SIGINT, RequestStop);
+	std::signal(SIGTERM, RequestStop);
+	std::cout << "Watching " << service.m_InputDirectory << ", press Ctrl+C to stop." << std::endl;
+
+	auto lastStatus = std::chrono::steady_clock::now();
+	while (!StopRequested)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		if (statusInterval > 0 && std::chrono::steady_clock::now() - lastStatus >= std::chrono::seconds(statusInterval))
+		{
+			PrintStatistics(service.GetStatistics());
+			lastStatus = std::chrono::steady_clock::now();
+		}
+	}
+
+	std::cout << "Finishing the cases in the pipeline..." << std::endl;
+	service.Stop();
+	PrintStatistics(service.GetStatistics());
+	return EXIT_SUCCESS;
+}
@@ -1,6 +1,27 @@
 set(CPP_FILES
   mitkAlphaBlending.cpp
+  mitkAlphaBlendingFilter.cpp
   mitkAlphaBlendingtool.cpp
+  mitkAdaptiveAlphaBlending.cpp
+  mitkAutoTuner.cpp
+  mitkBodyMask.cpp
+  mitkBrickedVolume.cpp
+  mitkBufferPool.cpp
+  mitkCompressedVolumeWriter.cpp
+  mitkDECTImageFilter.cpp
+  mitkDECTKernels.cpp
+  mitkDECTSeriesLoader.cpp
+  mitkDECTWatchFolderService.cpp
+  mitkExecutionPlanner.cpp
+  mitkFixedPointAlphaBlending.cpp
+  mitkImagePyramid.cpp
+  mitkNumaTopology.cpp
+  mitkREDConversionFilter.cpp
+  mitkRigidAlignment.cpp
+  mitkSlabParallelFor.cpp
+  mitkSlabThreadPool.cpp
+  mitkVoxelKernels.cpp
+  mitkVoxelStatistics.cpp
 )
 
 set(RESOURCE_FILES
@@ -0,0 +1,77 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkAdaptiveAlphaBlending_h
+#define mitkAdaptiveAlphaBlending_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Locally noise adaptive alpha blending.
+	 *
+	 * The variance of both inputs is estimated in a box window of radius m_Radius around every voxel.
+	 * The noise optimal weight of the high energy image is w = var_low / (var_high + var_low), which minimizes
+	 * alpha^2 * var_high + (1 - alpha)^2 * var_low. The voxel wise alpha moves from the global alpha towards w
+	 * by m_Strength: alpha(x) = (1 - m_Strength) * alpha + m_Strength * w(x).
+	 *
+	 * The windowed statistics are computed with separable running sums, so the cost does not depend on the radius.
+	 * All passes run slab wise in parallel. 2D and 3D images of any pixel type are supported.
+	 */
+	class MITKALPHABLENDING_EXPORT AdaptiveAlphaBlending
+	{
+	public:
+
+		double m_AlphaValue = 1.;       // global alpha value
+		unsigned int m_Radius = 2;      // radius of the statistics window in voxels
+		double m_Strength = 1.;         // 0 gives the global blend, 1 the noise optimal blend
+
+		/**
+		 * @brief      Blends two given mitk images with the voxel wise alpha value.
+		 *
+		 * @param      imageHigh  image with higher voltage level
+		 * @param      imageLow   image with lower voltage level
+		 *
+		 * @return     double mitk image of same dimensions
+		 */
+		mitk::Image::Pointer Blend(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow);
+
+		/**
+		 * @brief      Replaces every value of a volume by the mean of its box neighbourhood, the window is truncated at the borders.
+		 *
+		 * @param      data    contiguous volume, x is the fastest index
+		 * @param[in]  size    size of the volume in x, y and z
+		 * @param[in]  radius  radius of the box window
+		 */
+		static void BoxMean(double* data, const std::size_t size[3], unsigned int radius);
+
+	private:
+
+		template <unsigned int VDimension>
+		mitk::Image::Pointer BlendFixedDimension(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow);
+
+		/**
+		 * @brief      Running mean over rowCount rows of rowLength contiguous values that lie rowStride apart.
+		 * Rows are processed together so that the inner loop is contiguous even for the y and z axis.
+		 */
+		static void BoxMeanRows(double* data, std::size_t rowCount, std::size_t rowStride, std::size_t rowLength, unsigned int radius,
+			std::vector<double>& copy, std::vector<double>& sum);
+	};
+}
+
+#endif
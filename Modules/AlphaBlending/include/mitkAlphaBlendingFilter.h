@@ -0,0 +1,54 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkAlphaBlendingFilter_h
+#define mitkAlphaBlendingFilter_h
+
+#include <mitkDECTImageFilter.h>
+
+namespace mitk
+{
+	/**
+	 * @brief      Pipeline version of mitk::AlphaBlendingTool::AlphaBlending, output = alpha * high + (1 - alpha) * low
+	 * in HU as double, without statistics and pyramid levels. Changing alpha marks the filter as modified.
+	 */
+	class MITKALPHABLENDING_EXPORT AlphaBlendingFilter : public DECTImageFilter
+	{
+	public:
+		mitkClassMacro(AlphaBlendingFilter, DECTImageFilter);
+		itkFactorylessNewMacro(Self);
+
+		/**
+		 * @brief      Image with the higher voltage level, input 0.
+		 */
+		void SetHighEnergyImage(const mitk::Image* image);
+
+		/**
+		 * @brief      Image with the lower voltage level, input 1.
+		 */
+		void SetLowEnergyImage(const mitk::Image* image);
+
+		itkSetMacro(Alpha, double);
+		itkGetConstMacro(Alpha, double);
+
+	protected:
+		AlphaBlendingFilter();
+		~AlphaBlendingFilter() override;
+
+		void GenerateSlices(const std::vector<DECTKernels::BufferView>& inputs, const DECTKernels::BufferView& output) override;
+
+	private:
+		double m_Alpha = 0.5;
+	};
+}
+
+#endif
@@ -14,13 +14,21 @@ found in the LICENSE file.
 #define AlphaBlendingTool_h
 
 #include <mitkImage.h>
-#include <mitkImageAccessByItk.h>
-#include <mitkImageCast.h>
+#include <mitkWeakPointer.h>
 
 #include <usModuleResource.h>
 
 #include <MitkAlphaBlendingExports.h>
-
+#include <mitkStoppingPowerRatioFunctors.h>
+#include <mitkExecutionPlanner.h>
+#include <mitkBodyMask.h>
+#include <mitkBufferPool.h>
+#include <mitkDECTKernels.h>
+#include <mitkFixedPointAlphaBlending.h>
+#include <mitkRigidAlignment.h>
+
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
@@ -35,6 +43,13 @@ namespace mitk{
 	{
 	public:
 
+		/**
+		 * @brief      Called when a time step of an output is complete, with the output image.
+		 */
+		typedef std::function<void(unsigned int timeStep, const mitk::Image::Pointer& output)> TimeStepCallback;
+		// progress of Autotune, called before every operation and pixel type is tuned and once at the end, false cancels
+		typedef std::function<bool(std::size_t tuned, std::size_t total)> AutotuneCallback;
+
 		AlphaBlendingTool() = default;
 		~AlphaBlendingTool() = default;
 
@@ -48,6 +63,7 @@ namespace mitk{
 		void Reset();
 
 		std::map<std::string, double> m_AlphaValueMap; // std::map which contain all the alpha values and their fitting descriptors
+		std::map<std::string, std::vector<double>> m_WeightVectorMap; // energy bin weights of photon counting modes, lowest energy first
 
 		/**
 		 * @brief      Blends two given mitk images, with a given alpha value 
@@ -56,19 +72,295 @@ namespace mitk{
 		 * @param      imageLow   image with lower voltage level
 		 * @param[in]  alpha      alpha value
 		 *
-		 * @return     double mitk image of same dimensions
+		 * @return     double mitk image of same dimensions, with mitk::VoxelStatistics and mitk::ImagePyramid levels attached
 		 */
 		mitk::Image::Pointer AlphaBlending(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha);
 
+		/**
+		 * @brief      Blends two given mitk images into an existing double image of their size, e.g. the result of an
+		 * earlier AlphaBlending of the same pair, without allocating a new image. With difference caching enabled the
+		 * blend of a cached pair is a single multiply add pass over the low image and the cached difference.
+		 *
+		 * @param      output     double image of the size of the inputs, overwritten and marked as modified
+		 * @param      imageHigh  image with higher voltage level
+		 * @param      imageLow   image with lower voltage level
+		 * @param[in]  alpha      alpha value
+		 */
+		void AlphaBlendingInto(mitk::Image::Pointer& output, mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha);
+
+		/**
+		 * @brief      Blends two given mitk images only inside a body mask, all voxels outside are set to a constant.
+		 *
+		 * @param      imageHigh     image with higher voltage level
+		 * @param      imageLow      image with lower voltage level
+		 * @param[in]  alpha         alpha value
+		 * @param[in]  mask          body mask of the size of the images, see mitk::BodyMask
+		 * @param[in]  outsideValue  HU value outside of the mask, air by default
+		 *
+		 * @return     double mitk image of same dimensions
+		 */
+		mitk::Image::Pointer AlphaBlending(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha,
+			const BodyMask& mask, double outsideValue = -1000.);
+
+		/**
+		 * @brief      Blends two given mitk images after correcting the patient motion between both scans. The high energy
+		 * image is sampled trilinearly at the positions given by the transform of the alignment inside the blending loop,
+		 * no resampled copy of it is written.
+		 *
+		 * @param      imageHigh     image with higher voltage level, the moving image of the alignment
+		 * @param      imageLow      image with lower voltage level, the fixed image of the alignment
+		 * @param[in]  alpha         alpha value
+		 * @param[in]  alignment     result of mitk::RigidAlignment::Align(imageLow, imageHigh)
+		 * @param[in]  mask          optional body mask of the size of imageLow, voxels outside are set to outsideValue
+		 * @param[in]  outsideValue  HU value outside of the mask, air by default
+		 *
+		 * @return     double mitk image in the geometry of imageLow, with mitk::VoxelStatistics and mitk::ImagePyramid levels attached
+		 */
+		mitk::Image::Pointer AlphaBlending(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha,
+			const RigidAlignment& alignment, const BodyMask* mask = nullptr, double outsideValue = -1000.);
+
+		/**
+		 * @brief      Blends two given mitk images with a spatially varying alpha, output = alpha * high + (1 - alpha) * low.
+		 * The alpha map may be on the grid of the images or on a coarser grid covering the same region, e.g. a few
+		 * centimeters per voxel. It is interpolated trilinearly on the fly inside the blending pass, no alpha volume of
+		 * the image size is created.
+		 *
+		 * @param      imageHigh  image with higher voltage level
+		 * @param      imageLow   image with lower voltage level
+		 * @param      alphaMap   scalar image of alpha values, with one time step or as many as the images
+		 *
+		 * @return     double mitk image of same dimensions, with mitk::VoxelStatistics and mitk::ImagePyramid levels attached
+		 */
+		mitk::Image::Pointer AlphaBlending(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, mitk::Image::Pointer& alphaMap);
+
+		/**
+		 * @brief      Blends two given 8 or 16 bit integer images in fixed point arithmetic into an int16 HU image.
+		 * The result is bit identical for any number of threads, see mitk::FixedPointAlphaBlending.
+		 *
+		 * @param      imageHigh  image with higher voltage level
+		 * @param      imageLow   image with lower voltage level
+		 * @param[in]  alpha      alpha value
+		 *
+		 * @return     short mitk image of same dimensions
+		 */
+		mitk::Image::Pointer FixedPointAlphaBlending(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha);
+
+		/**
+		 * @brief      Blends two given mitk images with a voxel wise alpha value adapted to the local noise of both images.
+		 * See mitk::AdaptiveAlphaBlending for details.
+		 *
+		 * @param      imageHigh  image with higher voltage level
+		 * @param      imageLow   image with lower voltage level
+		 * @param[in]  alpha      global alpha value
+		 * @param[in]  radius     radius of the noise estimation window in voxels
+		 * @param[in]  strength   0 gives the global blend, 1 the noise optimal blend
+		 *
+		 * @return     double mitk image of same dimensions
+		 */
+		mitk::Image::Pointer AdaptiveAlphaBlending(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha,
+			unsigned int radius = 2, double strength = 1.);
+
 		/**
 		 * @brief      Convert given HU image to an RED image
 		 *
 		 * @param      huCube  The hu image
 		 *
-		 * @return     mitk image 
+		 * @return     mitk image with mitk::VoxelStatistics and mitk::ImagePyramid levels attached
 		 */
 		mitk::Image::Pointer ConvertToRED(mitk::Image::Pointer& huCube);
 
+		/**
+		 * @brief      Convert given HU image to an RED image only inside a body mask, all voxels outside are set to a constant.
+		 *
+		 * @param      huCube        The hu image
+		 * @param[in]  mask          body mask of the size of the image, see mitk::BodyMask
+		 * @param[in]  outsideValue  RED value outside of the mask
+		 *
+		 * @return     double mitk image
+		 */
+		mitk::Image::Pointer ConvertToRED(mitk::Image::Pointer& huCube, const BodyMask& mask, double outsideValue = 0.);
+
+		/**
+		 * @brief      Name of the double property holding the energy of an energy bin image in keV, e.g. the lower
+		 * threshold of a photon counting bin. Images without it fall back to their DICOM KVP (0018,0060).
+		 */
+		static const char* const BinEnergyPropertyName;
+
+		/**
+		 * @brief      Order of energy bin images from the lowest to the highest energy, see BinEnergyPropertyName.
+		 * Throws an mitk::Exception if a bin has no energy or two bins have the same energy.
+		 *
+		 * @return     indices into binImages, lowest energy first
+		 */
+		static std::vector<std::size_t> SortEnergyBins(const std::vector<const mitk::Image*>& binImages);
+
+		/**
+		 * @brief      Combines the energy bin images of a photon counting scan with one weight per bin,
+		 * e.g. a weight vector of m_WeightVectorMap.
+		 *
+		 * @param[in]  binImages  energy bin images of the same size, lowest energy first
+		 * @param[in]  weights    one weight per bin
+		 *
+		 * @return     double mitk image with mitk::VoxelStatistics and mitk::ImagePyramid levels attached
+		 */
+		mitk::Image::Pointer WeightedCombination(const std::vector<mitk::Image::Pointer>& binImages, const std::vector<double>& weights);
+
+		/**
+		 * @brief      Combines the energy bin images with several weight sets in one pass, every bin is read once.
+		 *
+		 * @param[in]  binImages   energy bin images of the same size, lowest energy first
+		 * @param[in]  weightSets  weight sets with one weight per bin
+		 *
+		 * @return     one double mitk image per weight set, throws an mitk::Exception if the energies of the bins are
+		 * known and not ascending
+		 */
+		std::vector<mitk::Image::Pointer> WeightedCombination(const std::vector<mitk::Image::Pointer>& binImages,
+			const std::vector<std::vector<double>>& weightSets);
+
+		/**
+		 * @brief      Convert given HU image to a proton stopping power ratio image in one pass,
+		 * assuming the mean excitation energy defined in the SPR parameters for every voxel.
+		 *
+		 * @param      huCube  The hu image
+		 *
+		 * @return     double mitk image
+		 */
+		mitk::Image::Pointer ConvertToSPR(mitk::Image::Pointer& huCube);
+
+		/**
+		 * @brief      Convert given HU image to a proton stopping power ratio image in one pass,
+		 * deriving the mean excitation energy per voxel from an effective atomic number image.
+		 *
+		 * @param      huCube      The hu image
+		 * @param      zEffImage   effective atomic number image on the same grid
+		 *
+		 * @return     double mitk image
+		 */
+		mitk::Image::Pointer ConvertToSPR(mitk::Image::Pointer& huCube, mitk::Image::Pointer& zEffImage);
+
+		/**
+		 * @brief      Blends two given mitk images and converts the result directly into a stopping power ratio image.
+		 * Blending, RED and SPR conversion are fused into a single pass, no HU or RED image is created.
+		 *
+		 * @param      imageHigh  image with higher voltage level
+		 * @param      imageLow   image with lower voltage level
+		 * @param[in]  alpha      alpha value
+		 *
+		 * @return     double mitk image of same dimensions
+		 */
+		mitk::Image::Pointer AlphaBlendingToSPR(mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow, double alpha);
+
+		/**
+		 * @brief      Write a HU image as int16 NRRD volume with parallel chunked compression.
+		 * Throws an mitk::Exception on failure. See mitk::CompressedVolumeWriter.
+		 *
+		 * @param      huCube    The hu image
+		 * @param[in]  filename  target file, should end with .nrrd
+		 */
+		void ExportHU(mitk::Image::Pointer& huCube, const std::string& filename);
+
+		/**
+		 * @brief      Write a RED or SPR image as uint16 NRRD volume scaled by 1e-4 with parallel chunked compression.
+		 * Throws an mitk::Exception on failure. See mitk::CompressedVolumeWriter.
+		 *
+		 * @param      redCube   The red image
+		 * @param[in]  filename  target file, should end with .nrrd
+		 */
+		void ExportRED(mitk::Image::Pointer& redCube, const std::string& filename);
+
+		/**
+		 * @brief      Set the memory budget in bytes for all operations, 0 means unlimited.
+		 * Operations which do not fit in memory are streamed slab by slab or refused with an mitk::Exception.
+		 */
+		void SetMemoryBudget(std::size_t bytes) { m_Planner.m_MemoryBudget = bytes; }
+		std::size_t GetMemoryBudget() const { return m_Planner.m_MemoryBudget; }
+
+		/**
+		 * @brief      Predict the peak memory of an operation and the strategy it will be executed with.
+		 * Can be used to warn before an operation is started.
+		 *
+		 * @param[in]  operation  the operation
+		 * @param[in]  imageA     first input image
+		 * @param[in]  imageB     second input image of binary operations
+		 *
+		 * @return     the execution plan
+		 */
+		ExecutionPlan Plan(ExecutionPlanner::Operation operation, const mitk::Image* imageA, const mitk::Image* imageB = nullptr) const;
+
+		/**
+		 * @brief      Predict an operation with any number of inputs and outputs, e.g. the weighted combination of energy bins.
+		 */
+		ExecutionPlan Plan(ExecutionPlanner::Operation operation, const std::vector<const mitk::Image*>& inputs, std::size_t numberOfOutputs = 1) const;
+
+		/**
+		 * @brief      Tunes the thread count and slab size of the operations for the pixel types by short calibration
+		 * runs on synthetic data, see mitk::AutoTuner, and uses the results in all later operations. Takes a few
+		 * seconds per operation and pixel type. Without operations AlphaBlending, ConvertToRED, ConvertToSPR and
+		 * AlphaBlendingToSPR are tuned, without pixel types short and double inputs.
+		 *
+		 * @return     false if the progress callback canceled the tuning, the tuning of this call is discarded then
+		 */
+		bool Autotune(const std::vector<ExecutionPlanner::Operation>& operations = std::vector<ExecutionPlanner::Operation>(),
+			const std::vector<mitk::PixelType>& pixelTypes = std::vector<mitk::PixelType>(),
+			const AutotuneCallback& progress = AutotuneCallback());
+
+		/**
+		 * @brief      Tuned parameters by mitk::ExecutionPlanner::GetTuningKey, applied when the operations are planned.
+		 */
+		const std::map<std::string, TunedParameters>& GetTuning() const { return m_Planner.m_Tuning; }
+		void SetTunedParameters(ExecutionPlanner::Operation operation, const mitk::PixelType& pixelType, const TunedParameters& parameters);
+		void RemoveTunedParameters(ExecutionPlanner::Operation operation, const mitk::PixelType& pixelType);
+		void ClearTuning() { m_Planner.m_Tuning.clear(); }
+
+		/**
+		 * @brief      The tuning as a single line for persisting it, e.g. in the preferences of the plugin. Setting a tuning
+		 * of another machine clears it and returns false, see mitk::ExecutionPlanner::SetTuningString.
+		 */
+		std::string GetTuningString() const { return m_Planner.GetTuningString(); }
+		bool SetTuningString(const std::string& tuning) { return m_Planner.SetTuningString(tuning); }
+
+		/**
+		 * @brief      Set the number of pyramid levels computed by AlphaBlending and ConvertToRED, 3 gives 2x, 4x and 8x.
+		 * 0 disables the pyramid, the slabs are aligned to 2^levels slices otherwise.
+		 */
+		void SetPyramidLevels(unsigned int levels) { m_PyramidLevels = levels; }
+		unsigned int GetPyramidLevels() const { return m_PyramidLevels; }
+
+		/**
+		 * @brief      Set the maximum number of time steps of 4D images processed at the same time by AlphaBlending,
+		 * ConvertToRED and WeightedCombination, 0 for the number of threads. See mitk::TimeStepParallelFor.
+		 */
+		void SetMaxConcurrentTimeSteps(unsigned int timeSteps) { m_MaxConcurrentTimeSteps = timeSteps; }
+		unsigned int GetMaxConcurrentTimeSteps() const { return m_MaxConcurrentTimeSteps; }
+
+		/**
+		 * @brief      Set a function called on the calling thread whenever a time step of an output is complete, e.g. to
+		 * show the first time step of a dynamic series while the others are processed. The output may be read
+		 * in the completed time steps only, its statistics and pyramid are attached when the operation returns.
+		 */
+		void SetTimeStepCallback(const TimeStepCallback& callback) { m_TimeStepCallback = callback; }
+		const TimeStepCallback& GetTimeStepCallback() const { return m_TimeStepCallback; }
+
+		/**
+		 * @brief      Keep high - low of the last pair blended by AlphaBlending, so that blending the same pair with
+		 * another alpha only reads the low image and the difference. The difference is stored as float with
+		 * reducedPrecision, which is exact for integer HU inputs, and dropped when another pair is blended or an
+		 * input is modified. Disabled by default since the cache costs one volume of memory.
+		 */
+		void SetDifferenceCaching(bool enable, bool reducedPrecision = false);
+		bool GetDifferenceCaching() const { return m_DifferenceCaching; }
+
+		/**
+		 * @brief      If the difference of the pair is cached and the next blend of it is a single multiply add pass.
+		 */
+		bool IsDifferenceCached(const mitk::Image* imageHigh, const mitk::Image* imageLow) const;
+
+		/**
+		 * @brief      Set the parameters of the Bethe formula used by the SPR conversions.
+		 */
+		void SetSPRParameters(const SPRParameters& parameters) { m_SPRParameters = parameters; }
+		const SPRParameters& GetSPRParameters() const { return m_SPRParameters; }
+
 		/**
 		 * @brief Read external resource defined in filepath and either append or overwrite the existing data.
 		 * The data from the xml file get's written into m_AlphaValueMap 
@@ -102,17 +394,55 @@ namespace mitk{
 		 */
 		void AddConfig(std::string& xmlData);
 
+		/**
+		 * @brief      Adds a mode read from xml, to m_WeightVectorMap if weights are given and to m_AlphaValueMap otherwise.
+		 *
+		 * @param[in]  description  mode descriptor
+		 * @param[in]  alphaValue   alpha value attribute or nullptr
+		 * @param[in]  weights      whitespace separated bin weights attribute or nullptr
+		 */
+		void AddMode(const char* description, const char* alphaValue, const char* weights);
+
+		/**
+		 * @brief      Plan an operation and throw an mitk::Exception if it is refused.
+		 */
+		ExecutionPlan PlanOrThrow(ExecutionPlanner::Operation operation, const mitk::Image* imageA, const mitk::Image* imageB = nullptr) const;
+		ExecutionPlan PlanOrThrow(ExecutionPlanner::Operation operation, const std::vector<const mitk::Image*>& inputs, std::size_t numberOfOutputs = 1) const;
+
+		/**
+		 * @brief      Blends into output, or a new image if output is null, and fills or uses the difference cache.
+		 */
+		mitk::Image::Pointer BlendWithDifferenceCache(mitk::Image::Pointer output, mitk::Image::Pointer& imageHigh, mitk::Image::Pointer& imageLow,
+			double alpha);
+
+		// difference of the last blended pair, the inputs are identified by weak pointers, which expire when an input
+		// is deleted, and their modification times
+		struct DifferenceCache
+		{
+			mitk::WeakPointer<mitk::Image> m_High;
+			mitk::WeakPointer<mitk::Image> m_Low;
+			itk::ModifiedTimeType m_HighTime = 0;
+			itk::ModifiedTimeType m_LowTime = 0;
+			std::shared_ptr<BufferPool::Lease> m_Buffer; // high - low, returned to the pool when the pair is replaced
+			DECTKernels::BufferView m_Difference;         // view of m_Buffer
+		};
+
+		SPRParameters m_SPRParameters; // parameters for the stopping power ratio conversions
+		ExecutionPlanner m_Planner; // picks the execution strategy within the memory budget
+		unsigned int m_PyramidLevels = 3; // downsampled levels attached to blended and RED images
+		unsigned int m_MaxConcurrentTimeSteps = 0; // time steps of 4D images in flight, 0 for the number of threads
+		TimeStepCallback m_TimeStepCallback; // notified about completed time steps
+		bool m_DifferenceCaching = false; // cache high - low for re-blending with another alpha
+		bool m_ReducedPrecisionDifference = false; // store the cached difference as float
+		DifferenceCache m_DifferenceCache;
+
 	};
 
-	// helper class for the arithmetic operations
+	// helper class for the arithmetic operations, see mitk::ImageExpression for fused arithmetic
 	class MITKALPHABLENDING_EXPORT AlphaBlendingHelper
 	{
 
 	public:
-		//Arithmetic part
-		double m_AlphaValue;
-		mitk::Image::Pointer m_ResultImage;
-
 		/**
 		 * @brief      Perform pixel wise addition between and image and a scaler
 		 *
@@ -144,7 +474,7 @@ namespace mitk{
 		mitk::Image::Pointer Div(mitk::Image::Pointer& image, double v);
 
 		/**
-		 * @brief      Adds two images together, pixel wise operation. Calls the AccessTwoImagesFixedDimensionByItk for the specific dimension.
+		 * @brief      Adds two images together, pixel wise operation.
 		 *
 		 * @param      imageA  The image a
 		 * @param      imageB  The image b
@@ -153,20 +483,6 @@ namespace mitk{
 		 */
 		mitk::Image::Pointer Add(mitk::Image::Pointer& imageA, mitk::Image::Pointer& imageB);
 
-		/**
-		 * @brief      Add two image functor for AccessTwoImagesFixedDimensionByItk.
-		 *
-		 * @param[in]  imageA            image a
-		 * @param[in]  imageB            image b
-		 *
-		 * @tparam     TPixel1           pixel type of image one
-		 * @tparam     VImageDimension1  dimension of image one
-		 * @tparam     TPixel2           pixel type of image two
-		 * @tparam     VImageDimension2  dimension of image two
-		 */
-		template<typename TPixel1, unsigned int VImageDimension1, typename TPixel2, unsigned int VImageDimension2 >
-		void Add2Functor(const itk::Image<TPixel1, VImageDimension1>* imageA, const itk::Image<TPixel2, VImageDimension2>* imageB);
-
 	};
 	
 }
@@ -0,0 +1,65 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkAutoTuner_h
+#define mitkAutoTuner_h
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkExecutionPlanner.h>
+#include <mitkImage.h>
+
+#include <vector>
+
+namespace mitk
+{
+	class AlphaBlendingTool;
+
+	/**
+	 * @brief      Finds the fastest thread count and slab size of an operation and input pixel type on this machine by
+	 * short calibration runs on a synthetic volume.
+	 *
+	 * Every candidate is set as the tuned parameters of the tool and the operation is run through the tool, so the
+	 * calibration measures exactly what later runs execute. The search is coordinate wise: the thread count first, then
+	 * the slab size, keeping the best thread count. Every candidate is run once to warm up and m_Repetitions times
+	 * timed, the fastest run counts.
+	 */
+	class MITKALPHABLENDING_EXPORT AutoTuner
+	{
+	public:
+
+		unsigned int m_Size[3] = { 256, 256, 32 };                // calibration volume in voxels
+		unsigned int m_Repetitions = 3;                           // timed runs per candidate
+		std::vector<unsigned int> m_SlabSizes = { 1, 2, 4, 8, 16, 32 };
+		std::vector<unsigned int> m_ThreadCounts;                 // empty for powers of two up to all threads
+
+		/**
+		 * @brief      Tunes an operation on the tool, whose tuned parameters of the operation and pixel type are
+		 * restored afterwards.
+		 *
+		 * @param      tool        tool running the operation with its memory budget and pyramid levels
+		 * @param[in]  operation   the operation
+		 * @param[in]  pixelType   scalar pixel type of the synthetic inputs
+		 * @param[out] parameters  the fastest configuration
+		 *
+		 * @return     false if the operation does not support the pixel type or every candidate was refused
+		 */
+		bool Tune(AlphaBlendingTool& tool, ExecutionPlanner::Operation operation, const mitk::PixelType& pixelType,
+			TunedParameters& parameters) const;
+
+		/**
+		 * @brief      Synthetic calibration input of m_Size, a water cylinder with a bone core in air.
+		 */
+		mitk::Image::Pointer CreateVolume(const mitk::PixelType& pixelType, double tissue, double bone) const;
+	};
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkBodyMask_h
+#define mitkBodyMask_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Run length encoded region of interest, e.g. the body of the patient.
+	 *
+	 * The mask is stored as sorted runs of linear voxel indices, grouped by slice. Voxel wise operations
+	 * only compute inside the runs and fill everything else with a constant, so air around the patient is skipped.
+	 * Slices continue over the time steps of 4D images like in mitk::VoxelKernels.
+	 */
+	class MITKALPHABLENDING_EXPORT BodyMask
+	{
+	public:
+
+		struct Span
+		{
+			std::size_t m_Begin; // first linear voxel index inside the mask
+			std::size_t m_End;   // one past the last linear voxel index inside the mask
+		};
+
+		std::vector<Span> m_Spans;                // sorted and non overlapping runs of all slices
+		std::vector<std::size_t> m_SliceOffsets;  // runs of slice s are m_Spans[m_SliceOffsets[s], m_SliceOffsets[s + 1])
+		std::size_t m_SliceSize = 0;              // voxels per slice
+		std::size_t m_NumberOfVoxels = 0;         // voxels of the masked image
+
+		/**
+		 * @brief      Creates the mask from a segmentation, every non zero voxel is inside.
+		 *
+		 * @param[in]  segmentation  binary or label image, e.g. a body contour from the data storage
+		 *
+		 * @return     the mask
+		 */
+		static BodyMask FromSegmentation(const mitk::Image* segmentation);
+
+		/**
+		 * @brief      Creates a body mask by thresholding a HU image.
+		 * Every image row is closed between its first and last voxel above the threshold,
+		 * so air inside the body like lungs or bowel gas stays inside the mask.
+		 *
+		 * @param[in]  image      HU image
+		 * @param[in]  threshold  HU value separating air from tissue
+		 *
+		 * @return     the mask
+		 */
+		static BodyMask FromThreshold(const mitk::Image* image, double threshold = -500.);
+
+		/**
+		 * @brief      Number of voxels inside the mask.
+		 */
+		std::size_t GetNumberOfMaskedVoxels() const;
+
+		/**
+		 * @brief      Number of slices, i.e. slices of all time steps.
+		 */
+		unsigned int GetNumberOfSlices() const { return static_cast<unsigned int>(m_SliceOffsets.empty() ? 0 : m_SliceOffsets.size() - 1); }
+
+		/**
+		 * @brief      Throws an mitk::Exception if the mask does not fit to the image.
+		 */
+		void CheckCompatibility(const mitk::Image* image) const;
+
+		/**
+		 * @brief      Walks over the voxels of the slices [firstSlice, lastSlice) in order and calls
+		 * inside(begin, end) for every run of the mask and outside(begin, end) for every gap in between.
+		 */
+		template <typename TInside, typename TOutside>
+		void ForEachRun(unsigned int firstSlice, unsigned int lastSlice, const TInside& inside, const TOutside& outside) const
+		{
+			std::size_t position = firstSlice * m_SliceSize;
+			const std::size_t last = std::min(m_NumberOfVoxels, lastSlice * m_SliceSize);
+
+			for (std::size_t s = m_SliceOffsets[firstSlice]; s < m_SliceOffsets[lastSlice]; ++s)
+			{
+				const Span& span = m_Spans[s];
+				if (position < span.m_Begin)
+					outside(position, span.m_Begin);
+				inside(span.m_Begin, span.m_End);
+				position = span.m_End;
+			}
+			if (position < last)
+				outside(position, last);
+		}
+
+	private:
+
+		/**
+		 * @brief      Builds the slice index from the runs found per slice.
+		 */
+		static BodyMask FromSliceRuns(std::vector<std::vector<Span>>& sliceRuns, std::size_t sliceSize, std::size_t numberOfVoxels);
+	};
+}
+
+#endif
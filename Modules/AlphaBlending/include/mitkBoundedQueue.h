@@ -0,0 +1,110 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkBoundedQueue_h
+#define mitkBoundedQueue_h
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace mitk
+{
+	/**
+	 * @brief      Thread safe FIFO queue with a maximum size, connects the stages of a pipeline.
+	 *
+	 * Push blocks while the queue is full, so a fast stage cannot run ahead of a slow one by more than the capacity.
+	 * After Close, Push fails and Pop returns the remaining items before it fails.
+	 */
+	template <typename T>
+	class BoundedQueue
+	{
+	public:
+
+		explicit BoundedQueue(std::size_t capacity) : m_Capacity(std::max<std::size_t>(1, capacity)) {}
+
+		/**
+		 * @brief      Appends an item, waits while the queue is full.
+		 *
+		 * @return     false if the queue has been closed
+		 */
+		bool Push(T item)
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_NotFull.wait(lock, [this]() { return m_Closed || m_Items.size() < m_Capacity; });
+			if (m_Closed)
+				return false;
+
+			m_Items.push_back(std::move(item));
+			m_PeakSize = std::max(m_PeakSize, m_Items.size());
+			m_NotEmpty.notify_one();
+			return true;
+		}
+
+		/**
+		 * @brief      Removes the oldest item, waits while the queue is empty.
+		 *
+		 * @return     false if the queue has been closed and is empty
+		 */
+		bool Pop(T& item)
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_NotEmpty.wait(lock, [this]() { return m_Closed || !m_Items.empty(); });
+			if (m_Items.empty())
+				return false;
+
+			item = std::move(m_Items.front());
+			m_Items.pop_front();
+			m_NotFull.notify_one();
+			return true;
+		}
+
+		/**
+		 * @brief      Wakes all waiting threads, no more items are accepted.
+		 */
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Closed = true;
+			m_NotEmpty.notify_all();
+			m_NotFull.notify_all();
+		}
+
+		std::size_t GetSize() const
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_Items.size();
+		}
+
+		std::size_t GetPeakSize() const
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_PeakSize;
+		}
+
+		std::size_t GetCapacity() const { return m_Capacity; }
+
+	private:
+
+		const std::size_t m_Capacity;
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_NotEmpty;
+		std::condition_variable m_NotFull;
+		std::deque<T> m_Items;
+		std::size_t m_PeakSize = 0;
+		bool m_Closed = false;
+	};
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkBrickedVolume_h
+#define mitkBrickedVolume_h
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkDataNode.h>
+#include <mitkImage.h>
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Block compressed in memory copy of a derived HU, RED or SPR volume, lossless unless quantized.
+	 *
+	 * The volume is split into cubic bricks of m_BrickSize voxels per edge, per time step. Bricks of a single value,
+	 * e.g. air around the patient, are stored as that value. All other bricks are compressed independently: the bytes
+	 * of the voxels are regrouped into byte planes, which turns the equal exponents and high order bytes of
+	 * neighbouring values into long runs, and the planes are deflated with zlib level 1.
+	 *
+	 * Noise fills the mantissa of floating point volumes, which then hardly compress losslessly. With a quantization
+	 * step, float and double bricks are stored as integer multiples of the step relative to their minimum, in 1, 2 or 4
+	 * bytes per voxel depending on their range, and every value is restored with an error of at most half the step.
+	 * Steps of 0.1 HU or 1e-4 RED, as in mitk::CompressedVolumeWriter, reduce noisy derived double volumes to a
+	 * fourth to a sixth. Bricks with non finite values or a range beyond 4 bytes stay lossless.
+	 *
+	 * Voxels are decompressed on access. The most recently used bricks are kept decompressed in a small cache, so
+	 * reading neighbouring voxels or consecutive slices decompresses every brick once. ToImage restores the full
+	 * image in parallel. All const methods may be called from several threads at once.
+	 *
+	 * CompressNode keeps the image of a data node in this form, DecompressNode restores it on the first access or when
+	 * the node is to be rendered. The image properties, e.g. the statistics, are kept with the bricks.
+	 */
+	class MITKALPHABLENDING_EXPORT BrickedVolume
+	{
+	public:
+
+		struct Statistics
+		{
+			std::size_t m_Bricks = 0;
+			std::size_t m_ConstantBricks = 0;
+			std::size_t m_UncompressedBytes = 0;
+			std::size_t m_StoredBytes = 0;     // compressed bricks, constant values and brick headers
+			std::size_t m_CachedBytes = 0;     // decompressed bricks in the cache
+			std::size_t m_CacheHits = 0;
+			std::size_t m_CacheMisses = 0;
+
+			/**
+			 * @brief      Uncompressed size relative to the resident size, stored and cached bytes.
+			 */
+			double GetCompressionRatio() const;
+		};
+
+		/**
+		 * @brief      Compresses a scalar 2D to 4D image in parallel. Throws an mitk::Exception for other images,
+		 * a brick size of 0, a negative quantization step or if a brick cannot be compressed.
+		 *
+		 * @param[in]  image             the image, it is not referenced afterwards
+		 * @param[in]  quantizationStep  step of float and double values, 0 keeps them lossless, ignored for integer images
+		 * @param[in]  brickSize         voxels per brick edge
+		 * @param[in]  compressionLevel  zlib level, 1 is the fastest
+		 */
+		explicit BrickedVolume(const mitk::Image* image, double quantizationStep = 0., unsigned int brickSize = 32, int compressionLevel = 1);
+
+		BrickedVolume(const BrickedVolume&) = delete;
+		BrickedVolume& operator=(const BrickedVolume&) = delete;
+
+		/**
+		 * @brief      Decompresses all bricks into a new image with the geometry of the compressed one.
+		 */
+		mitk::Image::Pointer ToImage() const;
+
+		/**
+		 * @brief      Value of a voxel. Throws an mitk::Exception outside of the volume.
+		 */
+		double GetValue(unsigned int x, unsigned int y, unsigned int z, unsigned int timeStep = 0) const;
+
+		/**
+		 * @brief      Copies a slice in the pixel type of the volume into slice, which holds the size of the first two
+		 * dimensions. Throws an mitk::Exception outside of the volume.
+		 */
+		void ReadSlice(unsigned int z, unsigned int timeStep, void* slice) const;
+
+		const mitk::PixelType& GetPixelType() const { return m_PixelType; }
+		unsigned int GetDimension() const { return m_Dimension; }
+		unsigned int GetDimension(unsigned int i) const { return i < 4 ? m_Dimensions[i] : 1; }
+		unsigned int GetBrickSize() const { return m_BrickSize; }
+		double GetQuantizationStep() const { return m_QuantizationStep; }
+
+		/**
+		 * @brief      Maximum number of decompressed bricks kept, 0 disables the cache. Trims the cache if necessary.
+		 */
+		void SetCacheCapacity(std::size_t bricks);
+		std::size_t GetCacheCapacity() const;
+
+		Statistics GetStatistics() const;
+
+		/**
+		 * @brief      Name of the node property holding the bricked image of a compressed node.
+		 */
+		static const char* const NodePropertyName;
+
+		/**
+		 * @brief      Replaces the image of a node by its bricked form. The node holds no data and is hidden until
+		 * DecompressNode restores the image. Throws an mitk::Exception if the node holds no image or the image cannot
+		 * be compressed.
+		 */
+		static void CompressNode(mitk::DataNode* node, double quantizationStep = 0., unsigned int brickSize = 32);
+
+		/**
+		 * @brief      Image of a node. The image of a compressed node is restored and set as node data first, which
+		 * drops the bricked form. Returns nullptr if the node holds no image.
+		 */
+		static mitk::Image* DecompressNode(mitk::DataNode* node);
+
+		/**
+		 * @brief      Bricked form of a compressed node, nullptr for other nodes.
+		 */
+		static std::shared_ptr<const BrickedVolume> GetFromNode(const mitk::DataNode* node);
+
+	private:
+
+		struct Brick
+		{
+			bool m_Constant = false;
+			unsigned char m_Width = 0;          // bytes per quantized voxel, 0 for the voxels as they are
+			long long m_Minimum = 0;            // quantized minimum, added to every quantized voxel
+			std::vector<unsigned char> m_Data;  // the value of constant bricks, the compressed planes otherwise
+		};
+
+		using DecodedBrick = std::shared_ptr<const std::vector<unsigned char>>;
+		using CacheList = std::list<std::pair<std::size_t, DecodedBrick>>;
+
+		std::size_t GetNumberOfBricks() const { return m_Bricks.size(); }
+		std::size_t GetBrickIndex(unsigned int x, unsigned int y, unsigned int z, unsigned int timeStep) const;
+
+		/**
+		 * @brief      First voxel, extent and time step of a brick.
+		 */
+		void GetBrickRegion(std::size_t brick, unsigned int origin[3], unsigned int extent[3], unsigned int& timeStep) const;
+
+		void DecodeBrick(std::size_t brick, unsigned char* voxels) const;
+		DecodedBrick GetDecodedBrick(std::size_t brick) const;
+		void TrimCacheLocked(std::size_t maximumBricks) const;
+
+		mitk::PixelType m_PixelType;
+		unsigned int m_Dimension = 3;
+		unsigned int m_Dimensions[4] = { 1, 1, 1, 1 };
+		mitk::TimeGeometry::Pointer m_TimeGeometry;
+		mitk::PropertyList::Pointer m_Properties;
+		unsigned int m_BrickSize = 32;
+		double m_QuantizationStep = 0.;
+		unsigned int m_BricksPerAxis[3] = { 1, 1, 1 };
+		std::vector<Brick> m_Bricks;
+
+		mutable std::mutex m_CacheMutex;
+		mutable CacheList m_Cache;  // most recently used first
+		mutable std::unordered_map<std::size_t, CacheList::iterator> m_CacheIndex;
+		std::size_t m_CacheCapacity = 64;
+		mutable std::size_t m_CacheHits = 0;
+		mutable std::size_t m_CacheMisses = 0;
+	};
+}
+
+#endif
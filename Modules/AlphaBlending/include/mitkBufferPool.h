@@ -0,0 +1,148 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkBufferPool_h
+#define mitkBufferPool_h
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Module wide pool of 64 byte aligned buffers for kernel temporaries.
+	 *
+	 * Requests are rounded up to size classes, eight classes per power of two, so at most 12.5% are wasted.
+	 * Released buffers are kept per size class and handed out again, their pages are already mapped and need no
+	 * page faults. Idle buffers are freed, largest first, as soon as they exceed the capacity.
+	 * Buffers of at least 2 MB can be backed by transparent huge pages on Linux.
+	 *
+	 * Buffers are handed out through a Lease only and never leave the module: the rows and scratch of the slab
+	 * kernels, the blocks of mitk::ImageExpression, the moments of the adaptive blending and the cached difference
+	 * of mitk::AlphaBlendingTool. Output images own their memory, since vtk images, ITK views and data items may
+	 * alias it beyond the lifetime of the mitk::Image. The capacity is DefaultCapacity until it is derived from a
+	 * memory budget by SetCapacityForMemoryBudget.
+	 */
+	class MITKALPHABLENDING_EXPORT BufferPool
+	{
+	public:
+
+		static const std::size_t Alignment = 64;
+		static const std::size_t DefaultCapacity = std::size_t(256) << 20;  // idle bytes kept without a memory budget
+
+		struct Statistics
+		{
+			std::size_t m_Requests = 0;
+			std::size_t m_Hits = 0;               // requests served by an idle buffer
+			std::size_t m_BytesInUse = 0;         // bytes of the size classes currently handed out
+			std::size_t m_BytesPooled = 0;        // bytes of idle buffers
+			std::size_t m_BytesTrimmed = 0;       // bytes freed because the pool exceeded its capacity
+			std::size_t m_PageFaultsAvoided = 0;  // 4 KB pages of reused buffers, which would have been faulted in otherwise
+		};
+
+		/**
+		 * @brief      Buffer handed out by Acquire.
+		 */
+		struct Buffer
+		{
+			void* m_Data = nullptr;
+			std::size_t m_Size = 0;   // size class, at least the requested size
+			bool m_Reused = false;    // the pages are already mapped
+		};
+
+		/**
+		 * @brief      Owns a pooled buffer and releases it on destruction, for temporaries of a kernel.
+		 */
+		class MITKALPHABLENDING_EXPORT Lease
+		{
+		public:
+			explicit Lease(std::size_t bytes);
+			~Lease();
+			Lease(const Lease&) = delete;
+			Lease& operator=(const Lease&) = delete;
+
+			template <typename T>
+			T* Get() const { return static_cast<T*>(m_Buffer.m_Data); }
+
+			const Buffer& GetBuffer() const { return m_Buffer; }
+
+		private:
+			Buffer m_Buffer;
+		};
+
+		/**
+		 * @brief      The pool of the module, it lives until the process ends.
+		 */
+		static BufferPool& GetInstance();
+
+		/**
+		 * @brief      Size class a request of the given size is rounded up to.
+		 */
+		static std::size_t GetSizeClass(std::size_t bytes);
+
+		/**
+		 * @brief      Hands out an uninitialized buffer of at least the given size.
+		 * Throws an mitk::Exception if the memory cannot be allocated.
+		 */
+		Buffer Acquire(std::size_t bytes);
+
+		/**
+		 * @brief      Returns a buffer of Acquire to the pool, may be called from any thread.
+		 */
+		void Release(const Buffer& buffer);
+
+		/**
+		 * @brief      Frees idle buffers, largest first, until at most maximumBytes are pooled.
+		 */
+		void Trim(std::size_t maximumBytes = 0);
+
+		/**
+		 * @brief      Maximum bytes of idle buffers, 0 disables pooling. Trims the pool if necessary.
+		 */
+		void SetCapacity(std::size_t bytes);
+		std::size_t GetCapacity() const;
+
+		/**
+		 * @brief      Sets the capacity to an eighth of a memory budget in bytes, or DefaultCapacity for 0, i.e. no budget.
+		 */
+		void SetCapacityForMemoryBudget(std::size_t memoryBudget);
+
+		/**
+		 * @brief      Back buffers of at least 2 MB by transparent huge pages, only effective on Linux.
+		 * Applies to buffers allocated afterwards.
+		 */
+		void SetUseHugePages(bool useHugePages);
+		bool GetUseHugePages() const;
+
+		Statistics GetStatistics() const;
+
+	private:
+
+		BufferPool() = default;
+
+		static void* AllocateAligned(std::size_t bytes, bool hugePages);
+		static void FreeAligned(void* data);
+		void TrimLocked(std::size_t maximumBytes);
+
+		mutable std::mutex m_Mutex;
+		std::map<std::size_t, std::vector<void*>> m_Idle;  // idle buffers per size class
+		std::size_t m_Capacity = DefaultCapacity;
+		bool m_UseHugePages = false;
+		Statistics m_Statistics;
+	};
+}
+
+#endif
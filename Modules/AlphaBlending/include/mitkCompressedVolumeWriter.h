@@ -0,0 +1,90 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkCompressedVolumeWriter_h
+#define mitkCompressedVolumeWriter_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Writes derived HU, RED or SPR images as compact 16 bit NRRD volumes with parallel chunked gzip compression.
+	 *
+	 * The voxel values are stored as round((value - intercept) / slope), the rescale parameters are written to the
+	 * header as "RescaleSlope" and "RescaleIntercept" key value pairs. Values outside of the storage type are clamped,
+	 * NaN is stored as the lowest value of the storage type. The data is split into chunks which are quantized and
+	 * compressed independently on all cores. Every chunk is a complete gzip member; concatenated gzip members form one
+	 * valid gzip stream, so the files can be read by every NRRD reader.
+	 */
+	class MITKALPHABLENDING_EXPORT CompressedVolumeWriter
+	{
+	public:
+
+		enum class StorageType
+		{
+			Int16,
+			UInt16
+		};
+
+		StorageType m_StorageType = StorageType::Int16;
+		double m_RescaleSlope = 1.;
+		double m_RescaleIntercept = 0.;
+		std::size_t m_ChunkSize = 1 << 20;   // uncompressed bytes per chunk
+		int m_CompressionLevel = 1;          // zlib level, 1 is the fastest
+
+		/**
+		 * @brief      Name of the string property stating the quantity of an image, "HU", "RED" or "SPR".
+		 */
+		static const char* const QuantityPropertyName;
+
+		/**
+		 * @brief      Writer storing HU values as int16 without rescaling.
+		 */
+		static CompressedVolumeWriter ForHU();
+
+		/**
+		 * @brief      Writer storing RED or SPR values as uint16 with a slope of 1e-4, i.e. values up to 6.5535.
+		 */
+		static CompressedVolumeWriter ForRED();
+
+		/**
+		 * @brief      Writer for the quantity property of an image, images without it are written as HU images.
+		 */
+		static CompressedVolumeWriter ForImage(const mitk::Image* image);
+
+		/**
+		 * @brief      Writes a scalar 2D to 4D image. Throws an mitk::Exception on failure.
+		 *
+		 * @param[in]  image     image of any scalar pixel type
+		 * @param[in]  filename  target file, should end with .nrrd
+		 */
+		void Write(const mitk::Image* image, const std::string& filename) const;
+
+		/**
+		 * @brief      Compresses a buffer into one complete gzip member.
+		 */
+		static std::vector<unsigned char> CompressChunk(const unsigned char* data, std::size_t size, int level);
+
+	private:
+
+		std::string CreateHeader(const mitk::Image* image) const;
+	};
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkDECTImageFilter_h
+#define mitkDECTImageFilter_h
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkDECTKernels.h>
+#include <mitkImageToImageFilter.h>
+
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Base of the pipeline filters running a voxel wise raw buffer kernel of mitk::DECTKernels on scalar
+	 * inputs of equal size into a double output with the geometry of the first input.
+	 *
+	 * The requested region of the output is propagated to the inputs, so a reslicer or writer requesting a few slices
+	 * gets only these slices computed and upstream filters are asked for the same slices only. Requests for whole
+	 * volumes are written in place, one time step after another, partial requests slice by slice with the slices in
+	 * parallel. All kernels run through mitk::SlabParallelFor with the priority of the calling thread. As usual for
+	 * ITK pipelines, Update does nothing while neither the filter nor its inputs have been modified.
+	 */
+	class MITKALPHABLENDING_EXPORT DECTImageFilter : public ImageToImageFilter
+	{
+	public:
+		mitkClassMacro(DECTImageFilter, ImageToImageFilter);
+
+	protected:
+		explicit DECTImageFilter(unsigned int numberOfInputs);
+		~DECTImageFilter() override;
+
+		void GenerateInputRequestedRegion() override;
+		void GenerateOutputInformation() override;
+		void GenerateData() override;
+
+		/**
+		 * @brief      Computes a block of slices of one time step, inputs and output are views of the same slices.
+		 * May be called concurrently for different slices.
+		 */
+		virtual void GenerateSlices(const std::vector<DECTKernels::BufferView>& inputs, const DECTKernels::BufferView& output) = 0;
+
+	private:
+		unsigned int m_NumberOfInputs;
+	};
+}
+
+#endif
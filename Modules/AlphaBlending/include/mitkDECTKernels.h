@@ -0,0 +1,208 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkDECTKernels_h
+#define mitkDECTKernels_h
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <stddef.h>
+
+/*
+ * Raw buffer interface of the DECT kernels for embedding them without mitk::Image, e.g. in scanner reconstruction
+ * pipelines or other toolkits. The kernels read the inputs and write the output in place through the given pointers
+ * and strides, nothing is copied or allocated besides one row of doubles per input and worker.
+ *
+ * A buffer has up to four dimensions x, y, z and t, unused dimensions have the size 1. Strides are given in bytes and
+ * may be negative, a stride of 0 means the buffer is contiguous in that dimension. The output may be the same buffer as
+ * an input if both have the same pixel type and strides. Integer outputs are rounded half away from zero and saturated.
+ *
+ * This header can be included from C, the C++ interface is below the C interface.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	mitkDECTInt8 = 0,
+	mitkDECTUInt8,
+	mitkDECTInt16,
+	mitkDECTUInt16,
+	mitkDECTInt32,
+	mitkDECTUInt32,
+	mitkDECTInt64,
+	mitkDECTUInt64,
+	mitkDECTFloat,
+	mitkDECTDouble
+} mitkDECTPixelType;
+
+typedef enum
+{
+	mitkDECTSuccess = 0,
+	mitkDECTInvalidArgument,  /* null pointers, mismatching sizes or unsupported pixel types */
+	mitkDECTFailure           /* any other error, see mitkDECTGetLastError */
+} mitkDECTStatus;
+
+typedef struct
+{
+	void* data;                  /* first voxel */
+	mitkDECTPixelType pixelType;
+	size_t size[4];              /* x, y, z, t */
+	ptrdiff_t stride[4];         /* bytes between neighbors in x, y, z and t, 0 for contiguous */
+} mitkDECTBuffer;
+
+/* output = alpha * high + (1 - alpha) * low */
+MITKALPHABLENDING_EXPORT mitkDECTStatus mitkDECTAlphaBlending(const mitkDECTBuffer* high, const mitkDECTBuffer* low, double alpha,
+	const mitkDECTBuffer* output);
+
+/* output = hu / 1000 + 1 */
+MITKALPHABLENDING_EXPORT mitkDECTStatus mitkDECTConvertToRED(const mitkDECTBuffer* hu, const mitkDECTBuffer* output);
+
+/* output = (alpha * high + (1 - alpha) * low) / 1000 + 1 without the HU intermediate */
+MITKALPHABLENDING_EXPORT mitkDECTStatus mitkDECTAlphaBlendingToRED(const mitkDECTBuffer* high, const mitkDECTBuffer* low, double alpha,
+	const mitkDECTBuffer* output);
+
+/* bit exact blending of 8 and 16 bit integer inputs into an int16 output, see mitk::FixedPointAlphaBlending */
+MITKALPHABLENDING_EXPORT mitkDECTStatus mitkDECTFixedPointAlphaBlending(const mitkDECTBuffer* high, const mitkDECTBuffer* low, double alpha,
+	const mitkDECTBuffer* output);
+
+/* combines the energy bins of a photon counting scan, output s = sum over b of weights[s * numberOfBins + b] * bins[b],
+ * all numberOfWeightSets outputs are computed in one pass over the bins */
+MITKALPHABLENDING_EXPORT mitkDECTStatus mitkDECTWeightedCombination(const mitkDECTBuffer* bins, size_t numberOfBins, const double* weights,
+	size_t numberOfWeightSets, const mitkDECTBuffer* outputs);
+
+/* description of the last error of the calling thread, empty after a successful call */
+MITKALPHABLENDING_EXPORT const char* mitkDECTGetLastError(void);
+
+#ifdef __cplusplus
+}
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      C++ interface of the raw buffer kernels, used by mitk::AlphaBlendingTool as well.
+	 *
+	 * The buffers are processed in slabs of slabSize z slices which do not cross time steps, the slabs run in parallel
+	 * through mitk::SlabParallelFor. Invalid arguments throw an mitk::Exception.
+	 */
+	namespace DECTKernels
+	{
+		typedef mitkDECTPixelType PixelType;
+
+		struct MITKALPHABLENDING_EXPORT BufferView
+		{
+			void* m_Data = nullptr;
+			PixelType m_PixelType = mitkDECTDouble;
+			std::size_t m_Size[4] = { 1, 1, 1, 1 };       // x, y, z, t
+			std::ptrdiff_t m_Stride[4] = { 0, 0, 0, 0 };  // bytes, 0 for contiguous
+
+			BufferView() = default;
+			BufferView(const mitkDECTBuffer& buffer);
+			BufferView(void* data, PixelType pixelType, std::size_t x, std::size_t y, std::size_t z = 1, std::size_t t = 1);
+
+			/**
+			 * @brief      Strides with the contiguous defaults filled in.
+			 */
+			void GetStrides(std::ptrdiff_t strides[4]) const;
+
+			std::size_t GetNumberOfVoxels() const { return m_Size[0] * m_Size[1] * m_Size[2] * m_Size[3]; }
+
+			/**
+			 * @brief      View of a single time step with the strides of this buffer.
+			 */
+			BufferView GetTimeStep(std::size_t timeStep) const;
+		};
+
+		/**
+		 * @brief      Called after a slab has been written with the range [begin, end) of linear voxel indices
+		 * of the slab, counted as if the output was contiguous. Slabs may be reported concurrently.
+		 */
+		typedef std::function<void(unsigned int slab, std::size_t begin, std::size_t end)> SlabCallback;
+
+		MITKALPHABLENDING_EXPORT std::size_t GetPixelSize(PixelType pixelType);
+
+		/**
+		 * @brief      Number of slabs of slabSize slices covering the buffer, slabs do not cross time steps.
+		 */
+		MITKALPHABLENDING_EXPORT unsigned int GetNumberOfSlabs(const BufferView& buffer, unsigned int slabSize);
+
+		MITKALPHABLENDING_EXPORT void AlphaBlending(const BufferView& high, const BufferView& low, double alpha, const BufferView& output,
+			unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Blends like AlphaBlending and writes difference = high - low in the same pass, for later re-blending
+		 * with AlphaBlendingFromDifference.
+		 */
+		MITKALPHABLENDING_EXPORT void AlphaBlendingWithDifference(const BufferView& high, const BufferView& low, double alpha, const BufferView& output,
+			const BufferView& difference, unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Blends with output = low + alpha * difference, one multiply add per voxel.
+		 */
+		MITKALPHABLENDING_EXPORT void AlphaBlendingFromDifference(const BufferView& low, const BufferView& difference, double alpha,
+			const BufferView& output, unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Blends like AlphaBlending with high sampled trilinearly at the continuous index
+		 * matrix * (x, y, z) + offset of every low voxel, e.g. to correct patient motion with mitk::RigidAlignment.
+		 * highIndexTransform holds the rows of the 3x4 matrix with the offset in the last column. high may have another
+		 * size than low and output but the same number of time steps, positions outside of it are clamped to its border.
+		 */
+		MITKALPHABLENDING_EXPORT void AlphaBlendingResampled(const BufferView& high, const double highIndexTransform[12], const BufferView& low,
+			double alpha, const BufferView& output, unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Blends with a voxel wise alpha, output = alpha * high + (1 - alpha) * low, where alpha is sampled
+		 * trilinearly from alphaMap at the continuous index matrix * (x, y, z) + offset of every voxel, with the matrix
+		 * given like for AlphaBlendingResampled. alphaMap may be a coarse grid, it is interpolated row by row on the fly
+		 * and positions outside of it are clamped to its border. A map with as many time steps as the output is sampled
+		 * per time step, otherwise its first time step is used for all of them.
+		 */
+		MITKALPHABLENDING_EXPORT void AlphaMapBlending(const BufferView& high, const BufferView& low, const BufferView& alphaMap,
+			const double alphaIndexTransform[12], const BufferView& output, unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Trilinear samples of the first time step at count continuous indices given as x, y, z triples.
+		 * Positions outside of the buffer are clamped to its border.
+		 */
+		MITKALPHABLENDING_EXPORT void Sample(const BufferView& buffer, const double* positions, std::size_t count, double* values);
+
+		MITKALPHABLENDING_EXPORT void ConvertToRED(const BufferView& hu, const BufferView& output, unsigned int slabSize = 1,
+			const SlabCallback& slabDone = SlabCallback());
+
+		MITKALPHABLENDING_EXPORT void AlphaBlendingToRED(const BufferView& high, const BufferView& low, double alpha, const BufferView& output,
+			unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Weighted sums of N energy bins, outputs[s] = sum over b of weightSets[s][b] * bins[b].
+		 * Every bin is read once for all weight sets, every weight set needs one weight per bin.
+		 */
+		MITKALPHABLENDING_EXPORT void WeightedCombination(const std::vector<BufferView>& bins, const std::vector<std::vector<double>>& weightSets,
+			const std::vector<BufferView>& outputs, unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+
+		/**
+		 * @brief      Inputs have to be 8 or 16 bit integers and the output int16, see mitk::FixedPointAlphaBlending.
+		 */
+		MITKALPHABLENDING_EXPORT void FixedPointAlphaBlending(const BufferView& high, const BufferView& low, double alpha, const BufferView& output,
+			unsigned int slabSize = 1, const SlabCallback& slabDone = SlabCallback());
+	}
+}
+
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkDECTSeriesLoader_h
+#define mitkDECTSeriesLoader_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Loads dual energy CT DICOM series and pairs the low and high kVp acquisitions automatically.
+	 *
+	 * ScanDirectory reads the headers of all files of a directory in parallel and groups them by series.
+	 * PairSeries groups the series by study and frame of reference and pairs the lowest with the highest KVP (0018,0060)
+	 * if both series share the voxel grid, i.e. size, spacing, origin and orientation.
+	 * The alpha blending modes matching the kVp combination are looked up from descriptors like "DECT80kv/140kv".
+	 * LoadPair decodes the slices of both series in parallel and blends every slice as soon as it is decoded in both series.
+	 * The images are of type short, or float if the rescaled values of a series do not fit into short, e.g. unsigned
+	 * 16 bit data above 32767.
+	 */
+	class MITKALPHABLENDING_EXPORT DECTSeriesLoader
+	{
+	public:
+
+		struct SeriesInfo
+		{
+			std::string m_SeriesInstanceUID;
+			std::string m_StudyInstanceUID;
+			std::string m_FrameOfReferenceUID;
+			std::string m_Description;
+			double m_KVP = 0.;
+			unsigned int m_Columns = 0;
+			unsigned int m_Rows = 0;
+			double m_PixelSpacing[2] = { 1., 1. };
+			double m_Orientation[6] = { 1., 0., 0., 0., 1., 0. };  // row and column direction cosines
+			double m_Origin[3] = { 0., 0., 0. };                    // position of the first slice
+			double m_SliceSpacing = 1.;
+			bool m_ShortPixels = true;                              // the rescaled values fit into short, otherwise float is used
+			std::vector<std::string> m_Files;                       // sorted along the slice normal
+		};
+
+		struct SeriesPair
+		{
+			SeriesInfo m_Low;
+			SeriesInfo m_High;
+			std::vector<std::string> m_Modes;                       // matching descriptors of the alpha value map
+		};
+
+		struct LoadResult
+		{
+			mitk::Image::Pointer m_LowImage;
+			mitk::Image::Pointer m_HighImage;
+			mitk::Image::Pointer m_BlendedImage;                    // only set when blending was requested
+		};
+
+		/**
+		 * @brief      Reads the DICOM headers of all files in a directory in parallel and groups them into series.
+		 *
+		 * @param[in]  directory  directory containing the DICOM files, not searched recursively
+		 *
+		 * @return     all series found, with their files sorted along the slice normal
+		 */
+		std::vector<SeriesInfo> ScanDirectory(const std::string& directory);
+
+		/**
+		 * @brief      Pairs low and high kVp series of the same study and frame of reference with the same voxel grid.
+		 *
+		 * @param[in]  series         series as returned by ScanDirectory
+		 * @param[in]  alphaValueMap  alpha values of mitk::AlphaBlendingTool, used to find the matching modes
+		 *
+		 * @return     all pairs found
+		 */
+		std::vector<SeriesPair> PairSeries(const std::vector<SeriesInfo>& series, const std::map<std::string, double>& alphaValueMap);
+
+		/**
+		 * @brief      Returns all mode descriptors of the form "<prefix><low>kv/<high>kv" matching the given kVp values.
+		 */
+		static std::vector<std::string> FindModes(double lowKVP, double highKVP, const std::map<std::string, double>& alphaValueMap);
+
+		/**
+		 * @brief      Decodes the slices of both series in parallel and optionally blends them in the same pass.
+		 *
+		 * @param[in]  pair   the series pair
+		 * @param[in]  blend  if the blended HU image should be computed
+		 * @param[in]  alpha  alpha value used for blending
+		 *
+		 * @return     low, high and blended image
+		 *
+		 * Throws an mitk::Exception if the voxel grids of the series differ or a slice cannot be decoded.
+		 */
+		LoadResult LoadPair(const SeriesPair& pair, bool blend, double alpha);
+	};
+}
+
+#endif
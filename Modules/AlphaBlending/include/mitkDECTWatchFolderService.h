@@ -0,0 +1,188 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkDECTWatchFolderService_h
+#define mitkDECTWatchFolderService_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkAlphaBlendingTool.h>
+#include <mitkBoundedQueue.h>
+#include <mitkBrickedVolume.h>
+#include <mitkDECTSeriesLoader.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Converts DECT series automatically as they arrive in a watched directory.
+	 *
+	 * The watched directory and each of its subdirectories are scanned for DICOM files. A directory is complete once
+	 * its files have not changed for m_StableScans polls, then its low and high kVp series are paired with
+	 * mitk::DECTSeriesLoader. Every new pair runs through a pipeline of three threads connected by bounded queues:
+	 * the reader decodes the next case while the current case is blended and the previous case is written.
+	 *
+	 * The results of a case are written to <output>/<study>_<low series>/hu.nrrd and red.nrrd. hu.nrrd is written last
+	 * and renamed into place when complete, cases with an existing hu.nrrd are not converted again. A case that fails in
+	 * any stage is forgotten and converted again once the files of its directory change, e.g. when missing slices
+	 * arrive or a damaged series is replaced.
+	 *
+	 * Results waiting for the writer are kept as mitk::BrickedVolume, quantized to the step of the file they are written
+	 * to, so a full write queue holds compressed bricks instead of double volumes. The writer restores them with ToImage.
+	 */
+	class MITKALPHABLENDING_EXPORT DECTWatchFolderService
+	{
+	public:
+
+		struct StageStatistics
+		{
+			std::size_t m_Processed = 0;
+			std::size_t m_Failed = 0;
+			double m_LastSeconds = 0.;
+			double m_TotalSeconds = 0.;
+			double m_MaximumSeconds = 0.;
+
+			double GetMeanSeconds() const { return m_Processed + m_Failed > 0 ? m_TotalSeconds / (m_Processed + m_Failed) : 0.; }
+		};
+
+		struct QueueStatistics
+		{
+			std::size_t m_Depth = 0;
+			std::size_t m_PeakDepth = 0;
+			std::size_t m_Capacity = 0;
+		};
+
+		struct Statistics
+		{
+			std::size_t m_Discovered = 0;   // pairs handed to the pipeline
+			StageStatistics m_Read;
+			StageStatistics m_Compute;
+			StageStatistics m_Write;
+			QueueStatistics m_ReadQueue;    // pairs waiting to be read
+			QueueStatistics m_ComputeQueue; // cases waiting to be blended
+			QueueStatistics m_WriteQueue;   // cases waiting to be written
+		};
+
+		std::string m_InputDirectory;
+		std::string m_OutputDirectory;
+		std::string m_Mode;                       // descriptor of the alpha value, empty selects the first mode matching the kVp pair
+		bool m_WriteRED = true;
+		unsigned int m_PollInterval = 2000;       // milliseconds between two scans of the input directory
+		unsigned int m_StableScans = 2;           // polls without file changes before a directory is complete
+		std::size_t m_QueueCapacity = 1;          // cases per queue between two stages
+
+		DECTWatchFolderService();
+		~DECTWatchFolderService();
+
+		/**
+		 * @brief      The tool used for blending, e.g. to read external alpha values or set the memory budget before Start.
+		 */
+		AlphaBlendingTool& GetTool() { return m_Tool; }
+
+		/**
+		 * @brief      Starts watching and the pipeline threads. Throws an mitk::Exception if the directories are not valid.
+		 */
+		void Start();
+
+		/**
+		 * @brief      Stops watching, finishes the cases already in the pipeline and joins all threads.
+		 */
+		void Stop();
+
+		bool IsRunning() const { return m_Running; }
+
+		/**
+		 * @brief      Scans the input directory once and hands new complete pairs to the pipeline.
+		 * Called periodically by the watcher thread while running.
+		 *
+		 * @return     number of pairs handed to the pipeline
+		 */
+		std::size_t Poll();
+
+		Statistics GetStatistics() const;
+
+	private:
+
+		struct Case
+		{
+			DECTSeriesLoader::SeriesPair m_Pair;
+			double m_Alpha = 0.;
+			std::string m_OutputDirectory;
+			mitk::Image::Pointer m_LowImage;
+			mitk::Image::Pointer m_HighImage;
+			std::unique_ptr<BrickedVolume> m_HUVolume;    // bricked results waiting for the writer
+			std::unique_ptr<BrickedVolume> m_REDVolume;
+		};
+
+		typedef std::shared_ptr<Case> CasePointer;
+
+		struct DirectoryState
+		{
+			std::string m_Signature;          // names, sizes and modification times of the files
+			unsigned int m_UnchangedScans = 0;
+			bool m_Scanned = false;           // the series of the current signature have been paired
+		};
+
+		void Watch();
+		void Read();
+		void Compute();
+		void Write();
+
+		/**
+		 * @brief      Lets the next poll convert a failed case again when its directory changes. Called by the stages.
+		 */
+		void ForgetCase(const Case& failedCase);
+
+		std::size_t ScanCompleteDirectory(const std::string& directory);
+		void RecordStage(StageStatistics& stage, double seconds, bool failed);
+
+		AlphaBlendingTool m_Tool;
+		DECTSeriesLoader m_Loader;
+
+		std::unique_ptr<BoundedQueue<CasePointer>> m_ReadQueue;
+		std::unique_ptr<BoundedQueue<CasePointer>> m_ComputeQueue;
+		std::unique_ptr<BoundedQueue<CasePointer>> m_WriteQueue;
+		std::thread m_WatchThread;
+		std::thread m_ReadThread;
+		std::thread m_ComputeThread;
+		std::thread m_WriteThread;
+
+		std::atomic<bool> m_Running;
+		std::mutex m_WatchMutex;
+		std::condition_variable m_WatchCondition;
+
+		std::mutex m_PollMutex;
+		std::map<std::string, DirectoryState> m_Directories;
+		std::set<std::string> m_KnownCases;       // output directories of all cases handed to the pipeline or skipped
+
+		// failed cases are removed from m_KnownCases by the next poll, a stage cannot take m_PollMutex since a poll
+		// may wait for the read queue
+		std::mutex m_FailedMutex;
+		std::vector<std::string> m_FailedCases;
+
+		mutable std::mutex m_StatisticsMutex;
+		Statistics m_Statistics;
+	};
+}
+
+#endif
@@ -0,0 +1,144 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkExecutionPlanner_h
+#define mitkExecutionPlanner_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Result of mitk::ExecutionPlanner, describes how an operation is going to be executed.
+	 */
+	struct MITKALPHABLENDING_EXPORT ExecutionPlan
+	{
+		enum class Strategy
+		{
+			InMemory,       // whole volume at once, adaptive blending holds full size intermediates
+			SlabStreamed,   // DECTKernels write the output slab by slab, no intermediates, inputs and output stay whole
+			Refused         // does not fit into the memory budget
+		};
+
+		Strategy m_Strategy = Strategy::InMemory;
+		std::size_t m_InputMemory = 0;   // bytes of the inputs, already resident
+		std::size_t m_PeakMemory = 0;    // predicted peak in bytes of the chosen strategy, including the inputs
+		unsigned int m_SlabSize = 0;     // slices per slab for the slab streamed strategy
+		unsigned int m_NumberOfThreads = 0; // threads of the slab loops, 0 for all, see mitk::SlabThreadLimit
+		std::string m_Message;           // human readable description of the plan
+	};
+
+	/**
+	 * @brief      Fastest configuration of an operation and input pixel type on this machine, see mitk::AutoTuner.
+	 */
+	struct MITKALPHABLENDING_EXPORT TunedParameters
+	{
+		unsigned int m_NumberOfThreads = 0;  // 0 for all threads
+		unsigned int m_SlabSize = 0;         // slices per slab, 0 for the planned size
+		double m_Throughput = 0.;            // megavoxels per second measured in the calibration
+	};
+
+	/**
+	 * @brief      Predicts the peak memory of the operations of mitk::AlphaBlendingTool and picks an execution strategy
+	 * that fits into a memory budget.
+	 *
+	 * Blending, RED, SPR conversion and the weighted combination always run the slab kernels of mitk::DECTKernels and
+	 * mitk::VoxelKernels, which write the output directly, so both strategies only need the output and differ in the
+	 * slab size. The in memory strategy of adaptive blending additionally holds its moment images, it cannot be
+	 * streamed. If neither fits, the operation is refused with a message stating the required memory. Tuned parameters
+	 * of the operation and input pixel type replace the default thread count and slab size as far as the memory budget
+	 * allows.
+	 *
+	 * Slab streaming only bounds the intermediates and the working set of a slab, it is no out of core processing: the
+	 * inputs are loaded completely and the output is allocated completely before the first slab, so the predicted peak
+	 * of both strategies always includes the whole inputs and output. Volumes whose inputs and output do not fit into
+	 * the budget are refused.
+	 */
+	class MITKALPHABLENDING_EXPORT ExecutionPlanner
+	{
+	public:
+
+		enum class Operation
+		{
+			AlphaBlending,
+			AdaptiveAlphaBlending,
+			ConvertToRED,
+			ConvertToSPR,
+			AlphaBlendingToSPR,
+			FixedPointAlphaBlending,
+			WeightedCombination
+		};
+
+		std::size_t m_MemoryBudget = 0;              // bytes, 0 means unlimited
+		std::size_t m_SlabMemoryTarget = 8 << 20;    // working set of one slab in bytes
+		std::map<std::string, TunedParameters> m_Tuning; // by GetTuningKey, applied to the plans within the memory budget
+
+		/**
+		 * @brief      Plans an operation.
+		 *
+		 * @param[in]  operation        the operation
+		 * @param[in]  inputs           all input images of the operation
+		 * @param[in]  outputPixelSize  bytes per output voxel
+		 *
+		 * @return     the execution plan
+		 */
+		ExecutionPlan Plan(Operation operation, const std::vector<const mitk::Image*>& inputs, std::size_t outputPixelSize = sizeof(double)) const;
+
+		/**
+		 * @brief      Number of full size double volumes held at the peak of the in memory strategy, excluding the inputs.
+		 */
+		static unsigned int GetInMemoryVolumeCount(Operation operation);
+
+		/**
+		 * @brief      If the operation is voxel wise and can be streamed slab by slab.
+		 */
+		static bool IsStreamable(Operation operation);
+
+		/**
+		 * @brief      Bytes of the pixel data of all time steps.
+		 */
+		static std::size_t GetImageMemory(const mitk::Image* image);
+
+		static std::string GetName(Operation operation);
+
+		/**
+		 * @brief      Key of m_Tuning, the operation name and the component type of the first input, e.g. "AlphaBlending short".
+		 */
+		static std::string GetTuningKey(Operation operation, const mitk::PixelType& pixelType);
+
+		/**
+		 * @brief      Identifies the machine a tuning was measured on by the processor model and the number of threads,
+		 * e.g. "cpu=Intel(R) Xeon(R) Gold 6248 CPU @ 2.50GHz;threads=40".
+		 */
+		static std::string GetMachineFingerprint();
+
+		/**
+		 * @brief      m_Tuning as a single line for storing it, e.g. in the preferences, starting with GetMachineFingerprint.
+		 */
+		std::string GetTuningString() const;
+
+		/**
+		 * @brief      Replaces m_Tuning by a string of GetTuningString. The tuning is cleared and false returned if the
+		 * string is malformed or was tuned on a machine with another processor or number of threads.
+		 */
+		bool SetTuningString(const std::string& tuning);
+	};
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkFixedPointAlphaBlending_h
+#define mitkFixedPointAlphaBlending_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstdint>
+
+namespace mitk
+{
+	/**
+	 * @brief      Deterministic alpha blending of 8 and 16 bit integer images in fixed point arithmetic.
+	 *
+	 * Alpha is quantized to w_high = round(alpha * 2^f) and w_low = 2^f - w_high, so both weights sum up to one exactly.
+	 * Every voxel is blended as (w_high * high + w_low * low) / 2^f with int32 accumulation, rounded half away from zero
+	 * and saturated to int16. The number of fraction bits f is the largest one that cannot overflow the accumulator.
+	 *
+	 * Only integer operations are used per voxel, so the result is bit identical for any number of threads and any CPU.
+	 * The difference to the double blend is bounded by GetErrorBound plus 0.5 for the final rounding.
+	 */
+	class MITKALPHABLENDING_EXPORT FixedPointAlphaBlending
+	{
+	public:
+
+		struct Weights
+		{
+			std::int32_t m_High = 0;          // quantized weight of the high energy image
+			std::int32_t m_Low = 0;           // quantized weight of the low energy image
+			unsigned int m_FractionBits = 0;  // fixed point position of the weights
+		};
+
+		double m_AlphaValue = 1.; // alpha value
+
+		/**
+		 * @brief      Blends two given integer images into an int16 HU image.
+		 *
+		 * @param[in]  imageHigh  image with higher voltage level, char, short or their unsigned variants
+		 * @param[in]  imageLow   image with lower voltage level, char, short or their unsigned variants
+		 * @param[in]  slabSize   number of slices per slab
+		 *
+		 * @return     short mitk image of same dimensions
+		 */
+		mitk::Image::Pointer Blend(const mitk::Image* imageHigh, const mitk::Image* imageLow, unsigned int slabSize = 1) const;
+
+		/**
+		 * @brief      Quantizes alpha with as many fraction bits as the int32 accumulator allows for inputs up to maxMagnitude.
+		 * Throws an mitk::Exception if alpha is too large to be represented.
+		 */
+		static Weights ComputeWeights(double alpha, std::int32_t maxMagnitude);
+
+		/**
+		 * @brief      Maximum absolute difference between the fixed point blend and the exact blend of inputs up to maxMagnitude
+		 * caused by the quantization of alpha, before rounding to int16.
+		 */
+		static double GetErrorBound(double alpha, std::int32_t maxMagnitude);
+
+		/**
+		 * @brief      Blends one voxel.
+		 */
+		static std::int16_t BlendVoxel(const Weights& weights, std::int32_t high, std::int32_t low)
+		{
+			const std::int32_t sum = weights.m_High * high + weights.m_Low * low;
+			const std::int32_t half = weights.m_FractionBits > 0 ? std::int32_t(1) << (weights.m_FractionBits - 1) : 0;
+			// division of the magnitude keeps the rounding symmetric and avoids shifting negative values
+			std::int32_t value = sum >= 0 ? (sum + half) >> weights.m_FractionBits : -((half - sum) >> weights.m_FractionBits);
+			if (value > INT16_MAX)
+				value = INT16_MAX;
+			else if (value < INT16_MIN)
+				value = INT16_MIN;
+			return static_cast<std::int16_t>(value);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,315 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkImageExpression_h
+#define mitkImageExpression_h
+
+#include <mitkImage.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+#include <mitkExceptionMacro.h>
+
+#include <mitkBufferPool.h>
+#include <mitkPixelTypeDispatch.h>
+#include <mitkSlabParallelFor.h>
+#include <mitkImagePyramid.h>
+#include <mitkVoxelKernels.h>
+#include <mitkVoxelStatistics.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Lazy voxel wise arithmetic on images.
+	 *
+	 * Arithmetic on Input(image) terms and scalars only builds an expression tree, nothing is computed.
+	 * Evaluate fuses the whole tree into one parallel pass over the output: every slab is processed in blocks
+	 * of BlockSize voxels, the inputs of a block are converted to double once and the tree is evaluated per voxel.
+	 * No full size intermediate image is created, inputs may have any scalar pixel type. The tree is shared read only
+	 * by all threads, the converted blocks live in a scratch buffer of each slab leased from mitk::BufferPool.
+	 *
+	 * The DECT operations of mitk::AlphaBlendingTool run on mitk::DECTKernels, the expressions back its generic
+	 * arithmetic helpers and custom voxel wise combinations.
+	 *
+	 * using namespace mitk::ImageExpression;
+	 * mitk::Image::Pointer hu = Evaluate(alpha * Input(high) + (1. - alpha) * Input(low));
+	 * mitk::Image::Pointer red = Evaluate(Input(hu) / 1000. + 1.);
+	 *
+	 * Apply(functor, ...) inserts a custom voxel wise function with one or two arguments into the tree.
+	 */
+	namespace ImageExpression
+	{
+		const std::size_t BlockSize = 4096; // voxels converted and evaluated at once, small enough to stay in the cache
+
+		/**
+		 * @brief      Base of all expression nodes, TDerived is the node type itself.
+		 */
+		template <typename TDerived>
+		struct Expression
+		{
+			const TDerived& Derived() const { return static_cast<const TDerived&>(*this); }
+		};
+
+		/**
+		 * @brief      Leaf referencing an image, its current block is converted to double into slot m_Slot of the scratch buffer.
+		 */
+		class InputTerm : public Expression<InputTerm>
+		{
+		public:
+			explicit InputTerm(const mitk::Image* image) : m_Image(image)
+			{
+				if (nullptr == image)
+				{
+					mitkThrow() << "Image expressions need valid input images.";
+				}
+			}
+
+			template <typename TFunction>
+			void ForEachInput(TFunction&& function) { function(*this); }
+
+			void Load(std::size_t begin, std::size_t count, double* scratch) const
+			{
+				double* block = scratch + m_Slot * BlockSize;
+				DispatchScalarPixelType(m_Image->GetPixelType(), [&](auto tag)
+				{
+					using TPixel = PixelTypeOfTag<decltype(tag)>;
+					const TPixel* data = static_cast<const TPixel*>(m_Data) + begin;
+					for (std::size_t k = 0; k < count; ++k)
+						block[k] = static_cast<double>(data[k]);
+				});
+			}
+
+			double Value(const double* scratch, std::size_t k) const { return scratch[m_Slot * BlockSize + k]; }
+
+			const mitk::Image* m_Image;
+			const void* m_Data = nullptr;   // buffer of m_Image, set by Evaluate while the image is locked
+			std::size_t m_Slot = 0;         // block of the scratch buffer, set by Evaluate
+		};
+
+		/**
+		 * @brief      Leaf with a constant value.
+		 */
+		class ScalarTerm : public Expression<ScalarTerm>
+		{
+		public:
+			explicit ScalarTerm(double value) : m_Value(value) {}
+
+			template <typename TFunction>
+			void ForEachInput(TFunction&&) {}
+
+			void Load(std::size_t, std::size_t, double*) const {}
+
+			double Value(const double*, std::size_t) const { return m_Value; }
+
+			double m_Value;
+		};
+
+		/**
+		 * @brief      Node applying a function with one argument.
+		 */
+		template <typename TFunctor, typename TArgument>
+		class UnaryNode : public Expression<UnaryNode<TFunctor, TArgument>>
+		{
+		public:
+			UnaryNode(const TFunctor& functor, const TArgument& argument) : m_Functor(functor), m_Argument(argument) {}
+
+			template <typename TFunction>
+			void ForEachInput(TFunction&& function) { m_Argument.ForEachInput(function); }
+
+			void Load(std::size_t begin, std::size_t count, double* scratch) const { m_Argument.Load(begin, count, scratch); }
+
+			double Value(const double* scratch, std::size_t k) const { return m_Functor(m_Argument.Value(scratch, k)); }
+
+			TFunctor m_Functor;
+			TArgument m_Argument;
+		};
+
+		/**
+		 * @brief      Node applying a function with two arguments.
+		 */
+		template <typename TFunctor, typename TLeft, typename TRight>
+		class BinaryNode : public Expression<BinaryNode<TFunctor, TLeft, TRight>>
+		{
+		public:
+			BinaryNode(const TFunctor& functor, const TLeft& left, const TRight& right) : m_Functor(functor), m_Left(left), m_Right(right) {}
+
+			template <typename TFunction>
+			void ForEachInput(TFunction&& function)
+			{
+				m_Left.ForEachInput(function);
+				m_Right.ForEachInput(function);
+			}
+
+			void Load(std::size_t begin, std::size_t count, double* scratch) const
+			{
+				m_Left.Load(begin, count, scratch);
+				m_Right.Load(begin, count, scratch);
+			}
+
+			double Value(const double* scratch, std::size_t k) const { return m_Functor(m_Left.Value(scratch, k), m_Right.Value(scratch, k)); }
+
+			TFunctor m_Functor;
+			TLeft m_Left;
+			TRight m_Right;
+		};
+
+		/**
+		 * @brief      Creates the leaf of an image.
+		 */
+		inline InputTerm Input(const mitk::Image* image) { return InputTerm(image); }
+
+		/**
+		 * @brief      Applies functor double(double) voxel wise.
+		 */
+		template <typename TFunctor, typename TArgument>
+		UnaryNode<TFunctor, TArgument> Apply(const TFunctor& functor, const Expression<TArgument>& argument)
+		{
+			return UnaryNode<TFunctor, TArgument>(functor, argument.Derived());
+		}
+
+		/**
+		 * @brief      Applies functor double(double, double) voxel wise.
+		 */
+		template <typename TFunctor, typename TLeft, typename TRight>
+		BinaryNode<TFunctor, TLeft, TRight> Apply(const TFunctor& functor, const Expression<TLeft>& left, const Expression<TRight>& right)
+		{
+			return BinaryNode<TFunctor, TLeft, TRight>(functor, left.Derived(), right.Derived());
+		}
+
+#define mitkImageExpressionOperatorMacro(op, functor)                                                                     \
+		template <typename TLeft, typename TRight>                                                                          \
+		BinaryNode<functor<double>, TLeft, TRight> operator op(const Expression<TLeft>& left, const Expression<TRight>& right) \
+		{                                                                                                                   \
+			return BinaryNode<functor<double>, TLeft, TRight>(functor<double>(), left.Derived(), right.Derived());            \
+		}                                                                                                                   \
+		template <typename TLeft>                                                                                           \
+		BinaryNode<functor<double>, TLeft, ScalarTerm> operator op(const Expression<TLeft>& left, double right)             \
+		{                                                                                                                   \
+			return BinaryNode<functor<double>, TLeft, ScalarTerm>(functor<double>(), left.Derived(), ScalarTerm(right));      \
+		}                                                                                                                   \
+		template <typename TRight>                                                                                          \
+		BinaryNode<functor<double>, ScalarTerm, TRight> operator op(double left, const Expression<TRight>& right)           \
+		{                                                                                                                   \
+			return BinaryNode<functor<double>, ScalarTerm, TRight>(functor<double>(), ScalarTerm(left), right.Derived());     \
+		}
+
+		mitkImageExpressionOperatorMacro(+, std::plus)
+		mitkImageExpressionOperatorMacro(-, std::minus)
+		mitkImageExpressionOperatorMacro(*, std::multiplies)
+		mitkImageExpressionOperatorMacro(/, std::divides)
+
+#undef mitkImageExpressionOperatorMacro
+
+		template <typename TArgument>
+		UnaryNode<std::negate<double>, TArgument> operator-(const Expression<TArgument>& argument)
+		{
+			return UnaryNode<std::negate<double>, TArgument>(std::negate<double>(), argument.Derived());
+		}
+
+		/**
+		 * @brief      Evaluates an expression in one parallel pass.
+		 * All input images need the same number of voxels, the output gets the geometry of the first input.
+		 *
+		 * @param[in]  expression  the expression, it has to contain at least one input image
+		 * @param[in]  slabSize    number of slices per slab
+		 * @param      statistics  if given, the statistics of the output are accumulated in the same pass and merged
+		 * @param      pyramid     if given, the pyramid levels of the output are computed in the same pass,
+		 *                         the slabs are enlarged to the alignment of the pyramid
+		 *
+		 * @return     double mitk image
+		 */
+		template <typename TExpression>
+		mitk::Image::Pointer Evaluate(const Expression<TExpression>& expression, unsigned int slabSize = 1, VoxelStatistics* statistics = nullptr,
+			ImagePyramid* pyramid = nullptr)
+		{
+			TExpression prepared = expression.Derived();
+
+			// lock all inputs for the whole evaluation
+			std::vector<std::unique_ptr<mitk::ImageReadAccessor>> accessors;
+			const mitk::Image* reference = nullptr;
+			prepared.ForEachInput([&](InputTerm& input)
+			{
+				if (nullptr == reference)
+				{
+					reference = input.m_Image;
+				}
+				else if (VoxelKernels::GetNumberOfVoxels(input.m_Image) != VoxelKernels::GetNumberOfVoxels(reference))
+				{
+					mitkThrow() << "Voxel wise operations between images of different size are not supported.";
+				}
+				accessors.emplace_back(new mitk::ImageReadAccessor(input.m_Image));
+				input.m_Data = accessors.back()->GetData();
+				input.m_Slot = accessors.size() - 1;
+			});
+
+			if (nullptr == reference)
+			{
+				mitkThrow() << "An image expression needs at least one input image.";
+			}
+
+			const std::size_t n = VoxelKernels::GetNumberOfVoxels(reference);
+			const std::size_t slabVoxels = VoxelKernels::GetSliceSize(reference) * std::max(1u, slabSize);
+
+			unsigned int numberOfSlabs = VoxelKernels::GetNumberOfSlabs(reference, slabSize);
+			if (nullptr != pyramid)
+			{
+				pyramid->Initialize(reference);
+				slabSize = pyramid->GetAlignedSlabSize(slabSize);
+				numberOfSlabs = pyramid->GetNumberOfSlabs(slabSize);
+			}
+
+			auto output = VoxelKernels::AllocateLike(reference, mitk::MakeScalarPixelType<double>(), slabSize);
+			mitk::ImageWriteAccessor outputAccessor(output);
+			double* out = static_cast<double*>(outputAccessor.GetData());
+			if (nullptr != statistics)
+				statistics->Reset(numberOfSlabs);
+
+			// all threads read the same tree, only the converted blocks are per slab
+			const TExpression& tree = prepared;
+			const std::size_t numberOfInputs = accessors.size();
+			SlabParallelFor(numberOfSlabs, [&](unsigned int slab)
+			{
+				BufferPool::Lease scratchBuffer(numberOfInputs * BlockSize * sizeof(double));
+				double* scratch = scratchBuffer.Get<double>();
+				std::size_t first = slab * slabVoxels;
+				std::size_t last = std::min(n, first + slabVoxels);
+				if (nullptr != pyramid)
+					pyramid->GetSlabRange(slab, slabSize, first, last);
+
+				for (std::size_t begin = first; begin < last; begin += BlockSize)
+				{
+					const std::size_t count = std::min(BlockSize, last - begin);
+					tree.Load(begin, count, scratch);
+					for (std::size_t k = 0; k < count; ++k)
+						out[begin + k] = tree.Value(scratch, k);
+					if (nullptr != statistics)
+						statistics->Accumulate(slab, out + begin, count);
+				}
+
+				if (nullptr != pyramid)
+					pyramid->Downsample(slab, slabSize, out);
+			});
+
+			if (nullptr != statistics)
+				statistics->Merge();
+
+			return output;
+		}
+	}
+}
+
+#endif
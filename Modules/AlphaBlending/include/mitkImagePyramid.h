@@ -0,0 +1,101 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkImagePyramid_h
+#define mitkImagePyramid_h
+
+#include <mitkImage.h>
+#include <mitkImageWriteAccessor.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Downsampled float copies of an output image with 2x, 4x, 8x, ... larger voxels, built while the output is written.
+	 *
+	 * Every level averages 2|2|2 voxels of the level before, z is kept for single slice images. Kernels process the
+	 * output in slabs aligned to 2^m_NumberOfLevels slices within a time step and call Downsample right after a slab
+	 * is written, so the voxels are still in the cache and the full resolution volume is never read again.
+	 * The levels are attached to the output image, overview rendering and thumbnails can use GetLevel.
+	 */
+	class MITKALPHABLENDING_EXPORT ImagePyramid
+	{
+	public:
+
+		unsigned int m_NumberOfLevels = 3;           // 2x, 4x and 8x
+		std::vector<mitk::Image::Pointer> m_Levels;  // m_Levels[l] is downsampled by 2^(l + 1)
+
+		/**
+		 * @brief      Allocates the levels for an output with the size and geometry of reference.
+		 */
+		void Initialize(const mitk::Image* reference);
+
+		/**
+		 * @brief      Smallest multiple of the slab alignment not below slabSize.
+		 */
+		unsigned int GetAlignedSlabSize(unsigned int slabSize) const;
+
+		/**
+		 * @brief      Number of slabs of an aligned slab size, slabs do not cross time steps.
+		 */
+		unsigned int GetNumberOfSlabs(unsigned int slabSize) const;
+
+		/**
+		 * @brief      Linear voxel range [begin, end) of a slab.
+		 */
+		void GetSlabRange(unsigned int slab, unsigned int slabSize, std::size_t& begin, std::size_t& end) const;
+
+		/**
+		 * @brief      Computes all levels of a slab which has been written to output. Slabs may be processed concurrently.
+		 */
+		void Downsample(unsigned int slab, unsigned int slabSize, const double* output);
+
+		/**
+		 * @brief      Releases the levels and stores them as properties of the image.
+		 */
+		void AttachTo(mitk::Image* image);
+
+		/**
+		 * @brief      Level attached to an image by AttachTo.
+		 *
+		 * @param[in]  image  the full resolution image
+		 * @param[in]  level  1 for 2x, 2 for 4x, ...
+		 *
+		 * @return     the level or nullptr if it does not exist
+		 */
+		static mitk::Image::Pointer GetLevel(const mitk::Image* image, unsigned int level);
+
+	private:
+
+		struct LevelSize
+		{
+			std::size_t m_Size[3];
+			std::size_t GetVolume() const { return m_Size[0] * m_Size[1] * m_Size[2]; }
+		};
+
+		template <typename TSource>
+		static void DownsampleLevel(const TSource* source, const LevelSize& sourceSize, float* target, const LevelSize& targetSize,
+			unsigned int timeStep, std::size_t firstSlice, std::size_t lastSlice);
+
+		std::vector<LevelSize> m_Sizes;  // m_Sizes[0] is the full resolution
+		unsigned int m_TimeSteps = 1;
+		std::vector<std::shared_ptr<mitk::ImageWriteAccessor>> m_Accessors;
+		std::vector<float*> m_Buffers;
+	};
+}
+
+#endif
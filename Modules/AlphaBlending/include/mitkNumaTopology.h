@@ -0,0 +1,117 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkNumaTopology_h
+#define mitkNumaTopology_h
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      NUMA nodes and their logical cpus, used by mitk::SlabParallelFor to place threads and memory.
+	 *
+	 * With more than one node the slabs are distributed statically: the workers get consecutive ranges of slabs,
+	 * the range of worker w is processed on the cpus of node GetNodeOfWorker(w). Output buffers are first touched
+	 * with the same distribution (see FirstTouch), so every slab is computed on the node its memory lives on.
+	 * The ranges run as chunks of mitk::SlabThreadPool, whose workers bind themselves to the node of a chunk.
+	 *
+	 * The current topology is detected from the online nodes in /sys/devices/system/node on Linux and is a single node
+	 * elsewhere.
+	 * Setting the environment variable MITK_DECT_NUMA_NODES to n > 1 or calling SetCurrent(Simulate(n)) splits the
+	 * logical cpus into n simulated nodes, so the placement can be tested on single node machines.
+	 */
+	class MITKALPHABLENDING_EXPORT NumaTopology
+	{
+	public:
+
+		std::vector<std::vector<unsigned int>> m_NodeCpus;  // logical cpus of every node
+		bool m_Simulated = false;
+
+		unsigned int GetNumberOfNodes() const { return static_cast<unsigned int>(m_NodeCpus.size()); }
+
+		/**
+		 * @brief      Parses the number lists of sysfs, e.g. "0-1,3" gives 0, 1 and 3.
+		 */
+		static std::vector<unsigned int> ParseList(const std::string& list);
+
+		/**
+		 * @brief      Topology of the machine, a single node with all cpus if it cannot be read.
+		 */
+		static NumaTopology Detect();
+
+		/**
+		 * @brief      Splits the logical cpus of the machine into numberOfNodes consecutive groups.
+		 */
+		static NumaTopology Simulate(unsigned int numberOfNodes);
+
+		/**
+		 * @brief      Topology used by all parallel execution of the module.
+		 */
+		static NumaTopology GetCurrent();
+
+		/**
+		 * @brief      Replaces the current topology, must not be called while slabs are processed.
+		 */
+		static void SetCurrent(const NumaTopology& topology);
+
+		/**
+		 * @brief      Node of the calling thread while it processes slabs, -1 outside of NUMA aware execution.
+		 */
+		static int GetCurrentNode();
+
+		/**
+		 * @brief      Number of workers processing numberOfSlabs slabs.
+		 */
+		static unsigned int GetNumberOfWorkers(unsigned int numberOfSlabs);
+
+		/**
+		 * @brief      Worker processing a slab, workers get consecutive ranges of slabs.
+		 */
+		static unsigned int GetWorkerOfSlab(unsigned int slab, unsigned int numberOfSlabs, unsigned int numberOfWorkers);
+
+		/**
+		 * @brief      Node a worker is bound to, workers are spread evenly and in order over the nodes.
+		 */
+		unsigned int GetNodeOfWorker(unsigned int worker, unsigned int numberOfWorkers) const;
+
+		/**
+		 * @brief      Node a slab is processed on.
+		 */
+		unsigned int GetNodeOfSlab(unsigned int slab, unsigned int numberOfSlabs) const;
+
+		/**
+		 * @brief      Binds the calling thread to the cpus of a node and makes it the current node of the thread.
+		 *
+		 * @return     false if the thread could not be bound, the current node is set anyway
+		 */
+		bool BindCurrentThread(unsigned int node) const;
+
+		/**
+		 * @brief      Restores the affinity the calling thread had before it was bound and clears its current node.
+		 */
+		static bool UnbindCurrentThread();
+
+		/**
+		 * @brief      Touches every page of a fresh buffer from the worker that will process it, so the operating
+		 * system places the pages on the node of that worker. Slab s covers the bytes [s, s + 1) * slabBytes.
+		 * Does nothing for a single node.
+		 */
+		static void FirstTouch(void* buffer, std::size_t bytes, std::size_t slabBytes);
+	};
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkPixelTypeDispatch_h
+#define mitkPixelTypeDispatch_h
+
+#include <mitkPixelType.h>
+#include <mitkExceptionMacro.h>
+
+#include <type_traits>
+
+namespace mitk
+{
+	/**
+	 * @brief      Calls function with a null pointer of the scalar component type of pixelType, i.e. function(static_cast<short*>(nullptr)).
+	 * Unlike mitkPixelTypeMultiplex this works with generic lambdas, so several images can be dispatched in a nested way:
+	 *
+	 * DispatchScalarPixelType(image->GetPixelType(), [&](auto tag) { using TPixel = PixelTypeOfTag<decltype(tag)>; ... });
+	 */
+	template <typename TFunction>
+	void DispatchScalarPixelType(const mitk::PixelType& pixelType, TFunction&& function)
+	{
+		if (pixelType.GetNumberOfComponents() != 1)
+		{
+			mitkThrow() << "Only scalar pixel types are supported, got " << pixelType.GetPixelTypeAsString();
+		}
+
+		switch (pixelType.GetComponentType())
+		{
+		case itk::ImageIOBase::CHAR:
+			function(static_cast<char*>(nullptr));
+			break;
+		case itk::ImageIOBase::UCHAR:
+			function(static_cast<unsigned char*>(nullptr));
+			break;
+		case itk::ImageIOBase::SHORT:
+			function(static_cast<short*>(nullptr));
+			break;
+		case itk::ImageIOBase::USHORT:
+			function(static_cast<unsigned short*>(nullptr));
+			break;
+		case itk::ImageIOBase::INT:
+			function(static_cast<int*>(nullptr));
+			break;
+		case itk::ImageIOBase::UINT:
+			function(static_cast<unsigned int*>(nullptr));
+			break;
+		case itk::ImageIOBase::LONG:
+			function(static_cast<long*>(nullptr));
+			break;
+		case itk::ImageIOBase::ULONG:
+			function(static_cast<unsigned long*>(nullptr));
+			break;
+		case itk::ImageIOBase::FLOAT:
+			function(static_cast<float*>(nullptr));
+			break;
+		case itk::ImageIOBase::DOUBLE:
+			function(static_cast<double*>(nullptr));
+			break;
+		default:
+			mitkThrow() << "Pixel type " << pixelType.GetComponentTypeAsString() << " is not supported by the alpha blending module.";
+		}
+	}
+
+	/**
+	 * @brief      Component type belonging to a tag passed by DispatchScalarPixelType.
+	 */
+	template <typename TTag>
+	using PixelTypeOfTag = typename std::remove_pointer<TTag>::type;
+}
+
+#endif
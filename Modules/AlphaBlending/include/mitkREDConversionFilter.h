@@ -0,0 +1,38 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkREDConversionFilter_h
+#define mitkREDConversionFilter_h
+
+#include <mitkDECTImageFilter.h>
+
+namespace mitk
+{
+	/**
+	 * @brief      Pipeline version of mitk::AlphaBlendingTool::ConvertToRED, converts a HU image, e.g. the output of
+	 * mitk::AlphaBlendingFilter, into relative electron densities as double, without statistics and pyramid levels.
+	 */
+	class MITKALPHABLENDING_EXPORT REDConversionFilter : public DECTImageFilter
+	{
+	public:
+		mitkClassMacro(REDConversionFilter, DECTImageFilter);
+		itkFactorylessNewMacro(Self);
+
+	protected:
+		REDConversionFilter();
+		~REDConversionFilter() override;
+
+		void GenerateSlices(const std::vector<DECTKernels::BufferView>& inputs, const DECTKernels::BufferView& output) override;
+	};
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkRigidAlignment_h
+#define mitkRigidAlignment_h
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkDECTKernels.h>
+#include <mitkImage.h>
+
+namespace mitk
+{
+	/**
+	 * @brief      Rigid registration of the high to the low energy image of sequentially acquired DECT scans,
+	 * which are misaligned by patient motion between the acquisitions.
+	 *
+	 * The images are aligned coarse to fine on a pyramid of 2x downsampled levels. On every level a resilient
+	 * gradient descent (Rprop) with one step per parameter maximizes the normalized cross correlation of
+	 * m_NumberOfSamples randomly sampled voxels of the fixed image, which is insensitive to the different contrast of
+	 * both energies. The samples are evaluated in parallel through mitk::SlabParallelFor. Only the first time step of
+	 * 4D images is aligned.
+	 *
+	 * The result is a rotation around the center of the fixed image and a translation in mm. GetIndexTransform maps
+	 * the voxels of the fixed image into the moving image for mitk::DECTKernels::AlphaBlendingResampled, so the moving
+	 * image is never resampled into a copy.
+	 */
+	class MITKALPHABLENDING_EXPORT RigidAlignment
+	{
+	public:
+
+		struct Transform
+		{
+			double m_Angles[3] = { 0., 0., 0. };       // radians around x, y and z, applied in this order
+			double m_Translation[3] = { 0., 0., 0. };  // mm
+		};
+
+		unsigned int m_NumberOfLevels = 3;      // pyramid levels, the coarsest is downsampled by 2^(m_NumberOfLevels - 1)
+		unsigned int m_NumberOfSamples = 20000; // sampled fixed voxels per level
+		unsigned int m_MaximumIterations = 100; // optimizer iterations per level
+		double m_MaximumStep = 4.;              // mm, largest step on the coarsest level, halved for every finer level
+		double m_MinimumStep = 0.05;            // mm, a level is done once all steps are below this times its downsampling
+
+		Transform m_Transform;      // result of the last Align
+		double m_Correlation = 0.;  // normalized cross correlation at the result on the finest level
+
+		/**
+		 * @brief      Aligns moving to fixed and stores the result in m_Transform, starting from the current m_Transform.
+		 * Throws an mitk::Exception for images without voxels or of other than scalar pixel type.
+		 */
+		void Align(const mitk::Image* fixed, const mitk::Image* moving);
+
+		/**
+		 * @brief      Raw buffer variant, the geometries are given as 3x4 index to world matrices with the offset in the
+		 * last column.
+		 */
+		void Align(const DECTKernels::BufferView& fixed, const double fixedIndexToWorld[12], const DECTKernels::BufferView& moving,
+			const double movingIndexToWorld[12]);
+
+		/**
+		 * @brief      3x4 matrix mapping fixed to continuous moving voxel indices with m_Transform,
+		 * see mitk::DECTKernels::AlphaBlendingResampled.
+		 */
+		void GetIndexTransform(const mitk::Image* fixed, const mitk::Image* moving, double matrix[12]) const;
+		void GetIndexTransform(const DECTKernels::BufferView& fixed, const double fixedIndexToWorld[12], const double movingIndexToWorld[12],
+			double matrix[12]) const;
+
+		/**
+		 * @brief      Index to world matrix of the geometry of an image.
+		 */
+		static void GetIndexToWorld(const mitk::Image* image, double matrix[12]);
+	};
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkSlabParallelFor_h
+#define mitkSlabParallelFor_h
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <functional>
+
+namespace mitk
+{
+	/**
+	 * @brief      Calls slabFunction once for every slab index in [0, numberOfSlabs), distributed over the shared
+	 * mitk::SlabThreadPool with the priority of the calling thread, see mitk::SlabPriorityScope.
+	 * All parallel work of the alpha blending module goes through this function, so the slab functions must not
+	 * depend on the order in which the slabs are processed. Returns once all slabs are done.
+	 * On NUMA machines the slabs are distributed statically over the nodes and run on pool workers bound to them, see
+	 * mitk::NumaTopology.
+	 *
+	 * @param[in]  numberOfSlabs  number of independent work items, typically the number of z slices
+	 * @param[in]  slabFunction   function processing one slab
+	 */
+	MITKALPHABLENDING_EXPORT void SlabParallelFor(unsigned int numberOfSlabs, const std::function<void(unsigned int)>& slabFunction);
+
+	/**
+	 * @brief      Limits the threads of SlabParallelFor and TimeStepParallelFor started from the calling thread while the
+	 * limit is in scope, e.g. to the tuned thread count of an operation. A limit of 0 keeps the current one.
+	 */
+	class MITKALPHABLENDING_EXPORT SlabThreadLimit
+	{
+	public:
+		explicit SlabThreadLimit(unsigned int numberOfThreads);
+		~SlabThreadLimit();
+
+		SlabThreadLimit(const SlabThreadLimit&) = delete;
+		SlabThreadLimit& operator=(const SlabThreadLimit&) = delete;
+
+	private:
+		unsigned int m_Previous;
+	};
+
+	/**
+	 * @brief      Number of threads SlabParallelFor uses on the calling thread, the ITK default or the current limit.
+	 */
+	MITKALPHABLENDING_EXPORT unsigned int GetNumberOfSlabThreads();
+
+	/**
+	 * @brief      Calls timeStepFunction once for every time step of a 4D image and timeStepDone on the calling thread
+	 * as soon as a time step is complete, e.g. for a preview.
+	 *
+	 * The first time step is processed alone, so its slabs use all threads and it is done after about 1 / numberOfTimeSteps
+	 * of the runtime. The other time steps are processed in waves of maxConcurrentTimeSteps, one time step per worker.
+	 * SlabParallelFor calls within a worker run serially, so per time step temporaries are bounded by the wave size.
+	 * Waves smaller than the number of threads process their time steps one after another with parallel slabs.
+	 *
+	 * @param[in]  numberOfTimeSteps      number of time steps
+	 * @param[in]  maxConcurrentTimeSteps maximum number of time steps in flight, 0 for the number of threads
+	 * @param[in]  timeStepFunction       function processing one time step
+	 * @param[in]  timeStepDone           optional function called after a time step is complete, in time step order
+	 */
+	MITKALPHABLENDING_EXPORT void TimeStepParallelFor(unsigned int numberOfTimeSteps, unsigned int maxConcurrentTimeSteps,
+		const std::function<void(unsigned int)>& timeStepFunction, const std::function<void(unsigned int)>& timeStepDone = nullptr);
+}
+
+#endif
@@ -0,0 +1,174 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkSlabThreadPool_h
+#define mitkSlabThreadPool_h
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkNumaTopology.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Priority classes of the slab loops, in descending order.
+	 */
+	enum class SlabPriority
+	{
+		Interactive,  // previews the user is waiting for, e.g. re-blending while alpha is changed
+		Normal,       // operations started in the view
+		Batch         // background work, e.g. the watch folder service
+	};
+
+	const unsigned int NumberOfSlabPriorities = 3;
+
+	/**
+	 * @brief      Sets the priority of the slab loops started from the calling thread while it is in scope.
+	 */
+	class MITKALPHABLENDING_EXPORT SlabPriorityScope
+	{
+	public:
+		explicit SlabPriorityScope(SlabPriority priority);
+		~SlabPriorityScope();
+
+		SlabPriorityScope(const SlabPriorityScope&) = delete;
+		SlabPriorityScope& operator=(const SlabPriorityScope&) = delete;
+
+	private:
+		SlabPriority m_Previous;
+	};
+
+	/**
+	 * @brief      Priority of the slab loops started from the calling thread, Normal by default.
+	 */
+	MITKALPHABLENDING_EXPORT SlabPriority GetCurrentSlabPriority();
+
+	/**
+	 * @brief      Module wide work stealing thread pool running the slab loops of all concurrent callers, see
+	 * mitk::SlabParallelFor.
+	 *
+	 * A loop is split into chunks of consecutive slabs, which are spread over the deques of the workers. Workers
+	 * pop chunks from the front of their own deque and steal from the back of the others once it is empty. Every
+	 * worker takes the highest priority chunk available whenever it finishes a chunk, so an interactive loop
+	 * preempts queued batch chunks after at most one chunk per worker, without interrupting running chunks. The
+	 * chunks of a loop are at most a quarter of its share per worker, which bounds that delay.
+	 *
+	 * Chunks are at least a slice, so a single lock over all deques is not contended. The pool starts the ITK
+	 * default number of workers on first use and lives until the process ends.
+	 *
+	 * Loops with a NUMA topology of several nodes keep the static slab placement of mitk::NumaTopology: the slab
+	 * ranges of its workers are split into chunks which remember their node, and a pool worker binds itself to that
+	 * node before running such a chunk. These chunks are scheduled and stolen like all others, so priorities and
+	 * thread limits hold on NUMA machines as well.
+	 */
+	class MITKALPHABLENDING_EXPORT SlabThreadPool
+	{
+	public:
+
+		/**
+		 * @brief      Queue depth and latencies of a priority class. Latencies are measured from the submission of a
+		 * loop, the wait ends when its first chunk starts.
+		 */
+		struct Metrics
+		{
+			std::size_t m_QueuedLoops = 0;     // loops with chunks not started yet
+			std::size_t m_QueuedChunks = 0;    // chunks not started yet
+			std::size_t m_RunningChunks = 0;
+			std::size_t m_StartedLoops = 0;
+			std::size_t m_CompletedLoops = 0;
+			std::size_t m_CompletedChunks = 0;
+			double m_MeanWait = 0.;            // seconds until the first chunk starts
+			double m_MaxWait = 0.;
+			double m_MeanLatency = 0.;         // seconds until the loop is complete
+			double m_MaxLatency = 0.;
+		};
+
+		/**
+		 * @brief      The pool of the module, it is never destroyed.
+		 */
+		static SlabThreadPool& GetInstance();
+
+		/**
+		 * @brief      Calls slabFunction for every slab in [0, numberOfSlabs) on at most maxThreads workers at once and
+		 * returns once all slabs are done. The calling thread waits, calls from a worker run serially on it. The first
+		 * exception of a slab function is rethrown, the remaining chunks of the loop are skipped.
+		 *
+		 * @param[in]  maxThreads  maximum number of workers running chunks of the loop at once, 0 for all
+		 * @param[in]  topology    nodes to place the slabs on, see mitk::NumaTopology, nullptr or a single node for none
+		 */
+		void ParallelFor(unsigned int numberOfSlabs, unsigned int maxThreads, SlabPriority priority,
+			const std::function<void(unsigned int)>& slabFunction, const NumaTopology* topology = nullptr);
+
+		unsigned int GetNumberOfWorkers() const { return m_NumberOfWorkers; }
+
+		Metrics GetMetrics(SlabPriority priority) const;
+
+		/**
+		 * @brief      Clears the completed counts and latencies of all priorities.
+		 */
+		void ResetMetrics();
+
+	private:
+
+		using Clock = std::chrono::steady_clock;
+
+		struct Loop;
+
+		struct Chunk
+		{
+			std::shared_ptr<Loop> m_Loop;
+			unsigned int m_First = 0;
+			unsigned int m_Last = 0;
+			int m_Node = -1;  // node the worker is bound to while running the chunk, -1 for any cpu
+		};
+
+		struct Accumulated
+		{
+			std::size_t m_StartedLoops = 0;
+			std::size_t m_Loops = 0;
+			std::size_t m_Chunks = 0;
+			double m_WaitSum = 0.;
+			double m_MaxWait = 0.;
+			double m_LatencySum = 0.;
+			double m_MaxLatency = 0.;
+		};
+
+		explicit SlabThreadPool(unsigned int numberOfWorkers);
+
+		void Work(unsigned int worker);
+		bool TakeChunkLocked(unsigned int worker, Chunk& chunk);
+		void FinishChunkLocked(const Chunk& chunk);
+
+		const unsigned int m_NumberOfWorkers;
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_WorkAvailable;
+		std::condition_variable m_LoopDone;
+		std::vector<std::thread> m_Workers;
+		std::vector<std::deque<Chunk>> m_Deques[NumberOfSlabPriorities];  // per priority and worker
+		std::size_t m_QueuedChunks[NumberOfSlabPriorities] = {};
+		std::size_t m_RunningChunks[NumberOfSlabPriorities] = {};
+		std::size_t m_QueuedLoops[NumberOfSlabPriorities] = {};
+		Accumulated m_Accumulated[NumberOfSlabPriorities];
+		unsigned int m_NextWorker = 0;  // first deque of the next loop, so concurrent loops start on different workers
+	};
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkStoppingPowerRatioFunctors_h
+#define mitkStoppingPowerRatioFunctors_h
+
+#include <cmath>
+
+namespace mitk
+{
+	/**
+	 * @brief      Parameters of the Bethe formula used to derive the proton stopping power ratio (SPR)
+	 * relative to water from the relative electron density (RED).
+	 *
+	 * SPR = RED * L(I) / L(I_water) with the stopping number L(I) = ln(2 m_e c^2 beta^2 gamma^2 / I) - beta^2.
+	 * When no effective atomic number is available the tissue is assumed to have the mean excitation energy
+	 * m_TissueExcitationEnergy. Otherwise ln(I) is taken from a piecewise linear fit over Z_eff. The bone line starts
+	 * where the soft tissue line ends, so I and the SPR are continuous and monotone across m_ZeffThreshold. The
+	 * defaults give roughly 75 eV for water (Z_eff 7.45) and 106 eV for cortical bone (Z_eff 13.6).
+	 */
+	struct SPRParameters
+	{
+		double m_KineticEnergy = 100.;            // proton kinetic energy in MeV
+		double m_WaterExcitationEnergy = 75.;     // mean excitation energy of water in eV
+		double m_TissueExcitationEnergy = 75.;    // mean excitation energy used without Z_eff in eV
+		double m_ZeffThreshold = 8.5;             // Z_eff border between the soft tissue and the bone fit
+		double m_SoftTissueSlope = 0.125;         // ln(I) = slope * Z_eff + offset for Z_eff < threshold
+		double m_SoftTissueOffset = 3.378;
+		double m_BoneSlope = 0.0437;              // ln(I) = slope * (Z_eff - threshold) + ln(I) at the threshold for Z_eff >= threshold
+
+		/**
+		 * @brief      Offset of the bone line, derived from the continuity with the soft tissue line at m_ZeffThreshold.
+		 */
+		double GetBoneOffset() const
+		{
+			return (m_SoftTissueSlope - m_BoneSlope) * m_ZeffThreshold + m_SoftTissueOffset;
+		}
+
+		/**
+		 * @brief      Squared velocity of the proton relative to the speed of light.
+		 */
+		double GetBetaSquared() const
+		{
+			const double protonRestEnergy = 938.272088; // MeV
+			const double gamma = 1. + m_KineticEnergy / protonRestEnergy;
+			return 1. - 1. / (gamma * gamma);
+		}
+
+		/**
+		 * @brief      Stopping number without the ln(I) term, i.e. ln(2 m_e c^2 beta^2 gamma^2) - beta^2 with energies in eV.
+		 */
+		double GetStoppingNumberOffset() const
+		{
+			const double twoElectronRestEnergy = 1.0219978e6; // eV
+			const double beta2 = GetBetaSquared();
+			return std::log(twoElectronRestEnergy * beta2 / (1. - beta2)) - beta2;
+		}
+
+		/**
+		 * @brief      Stopping number of water, the denominator of the SPR.
+		 */
+		double GetWaterStoppingNumber() const
+		{
+			return GetStoppingNumberOffset() - std::log(m_WaterExcitationEnergy);
+		}
+
+		/**
+		 * @brief      Constant factor SPR / RED for a tissue with mean excitation energy m_TissueExcitationEnergy.
+		 */
+		double GetConstantSPRFactor() const
+		{
+			return (GetStoppingNumberOffset() - std::log(m_TissueExcitationEnergy)) / GetWaterStoppingNumber();
+		}
+	};
+
+	namespace Functor
+	{
+		/**
+		 * @brief      Pixel functor converting HU into SPR in one step with a constant mean excitation energy:
+		 * SPR = (HU / 1000 + 1) * factor.
+		 */
+		template <typename TInput, typename TOutput>
+		class HUToSPR
+		{
+		public:
+			bool operator!=(const HUToSPR& other) const { return m_Factor != other.m_Factor; }
+			bool operator==(const HUToSPR& other) const { return !(*this != other); }
+
+			inline TOutput operator()(const TInput& hu) const
+			{
+				return static_cast<TOutput>((static_cast<double>(hu) * 0.001 + 1.) * m_Factor);
+			}
+
+			void SetParameters(const SPRParameters& parameters) { m_Factor = parameters.GetConstantSPRFactor(); }
+
+		private:
+			double m_Factor = 1.;
+		};
+
+		/**
+		 * @brief      Pixel functor fusing the alpha blending, the RED and the SPR conversion:
+		 * SPR = ((alpha * high + (1 - alpha) * low) / 1000 + 1) * factor.
+		 * The blend weights are prescaled so that each voxel costs two multiply-adds.
+		 */
+		template <typename TInput1, typename TInput2, typename TOutput>
+		class BlendToSPR
+		{
+		public:
+			bool operator!=(const BlendToSPR& other) const
+			{
+				return m_HighWeight != other.m_HighWeight || m_LowWeight != other.m_LowWeight || m_Factor != other.m_Factor;
+			}
+			bool operator==(const BlendToSPR& other) const { return !(*this != other); }
+
+			inline TOutput operator()(const TInput1& high, const TInput2& low) const
+			{
+				return static_cast<TOutput>(m_HighWeight * static_cast<double>(high) + m_LowWeight * static_cast<double>(low) + m_Factor);
+			}
+
+			void SetParameters(double alpha, const SPRParameters& parameters)
+			{
+				m_Factor = parameters.GetConstantSPRFactor();
+				m_HighWeight = alpha * 0.001 * m_Factor;
+				m_LowWeight = (1. - alpha) * 0.001 * m_Factor;
+			}
+
+		private:
+			double m_HighWeight = 0.;
+			double m_LowWeight = 0.;
+			double m_Factor = 1.;
+		};
+
+		/**
+		 * @brief      Pixel functor converting HU into SPR with a voxel wise mean excitation energy derived from Z_eff.
+		 * Since ln(I) is linear in Z_eff no logarithm has to be evaluated per voxel.
+		 */
+		template <typename TInput1, typename TInput2, typename TOutput>
+		class HUAndZeffToSPR
+		{
+		public:
+			bool operator!=(const HUAndZeffToSPR& other) const
+			{
+				return m_Offset != other.m_Offset || m_InverseWaterNumber != other.m_InverseWaterNumber
+					|| m_Threshold != other.m_Threshold || m_SoftSlope != other.m_SoftSlope || m_SoftOffset != other.m_SoftOffset
+					|| m_BoneSlope != other.m_BoneSlope || m_BoneOffset != other.m_BoneOffset;
+			}
+			bool operator==(const HUAndZeffToSPR& other) const { return !(*this != other); }
+
+			inline TOutput operator()(const TInput1& hu, const TInput2& zEff) const
+			{
+				const double z = static_cast<double>(zEff);
+				const double lnI = z < m_Threshold ? m_SoftSlope * z + m_SoftOffset : m_BoneSlope * z + m_BoneOffset;
+				const double red = static_cast<double>(hu) * 0.001 + 1.;
+				return static_cast<TOutput>(red * (m_Offset - lnI) * m_InverseWaterNumber);
+			}
+
+			void SetParameters(const SPRParameters& parameters)
+			{
+				m_Offset = parameters.GetStoppingNumberOffset();
+				m_InverseWaterNumber = 1. / parameters.GetWaterStoppingNumber();
+				m_Threshold = parameters.m_ZeffThreshold;
+				m_SoftSlope = parameters.m_SoftTissueSlope;
+				m_SoftOffset = parameters.m_SoftTissueOffset;
+				m_BoneSlope = parameters.m_BoneSlope;
+				m_BoneOffset = parameters.GetBoneOffset();
+			}
+
+		private:
+			double m_Offset = 0.;
+			double m_InverseWaterNumber = 1.;
+			double m_Threshold = 0.;
+			double m_SoftSlope = 0.;
+			double m_SoftOffset = 0.;
+			double m_BoneSlope = 0.;
+			double m_BoneOffset = 0.;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,267 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkVoxelKernels_h
+#define mitkVoxelKernels_h
+
+#include <mitkImage.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+
+#include <MitkAlphaBlendingExports.h>
+#include <mitkBodyMask.h>
+#include <mitkDECTKernels.h>
+#include <mitkPixelTypeDispatch.h>
+#include <mitkSlabParallelFor.h>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace mitk
+{
+	/**
+	 * @brief      Slab streamed voxel wise kernels working directly on the image buffers.
+	 *
+	 * The output is allocated once and written slab by slab, no intermediate images are created.
+	 * A slab consists of slabSize consecutive slices, time steps of 4D images continue the slice index.
+	 */
+	namespace VoxelKernels
+	{
+		/**
+		 * @brief      Allocates an image with the size and geometry of reference and the given pixel type.
+		 * The image owns its buffer. On NUMA machines the buffer is first touched by the workers which process its
+		 * slabs of slabSize slices.
+		 */
+		MITKALPHABLENDING_EXPORT mitk::Image::Pointer AllocateLike(const mitk::Image* reference, const mitk::PixelType& pixelType,
+			unsigned int slabSize = 1);
+
+		/**
+		 * @brief      Number of voxels of all time steps.
+		 */
+		MITKALPHABLENDING_EXPORT std::size_t GetNumberOfVoxels(const mitk::Image* image);
+
+		/**
+		 * @brief      Number of voxels of one slice, i.e. the size of the first two dimensions.
+		 */
+		MITKALPHABLENDING_EXPORT std::size_t GetSliceSize(const mitk::Image* image);
+
+		/**
+		 * @brief      Number of slabs of slabSize slices covering the image.
+		 */
+		MITKALPHABLENDING_EXPORT unsigned int GetNumberOfSlabs(const mitk::Image* image, unsigned int slabSize);
+
+		/**
+		 * @brief      Describes the contiguous buffer of an image for the raw buffer kernels in mitk::DECTKernels.
+		 * Throws an mitk::Exception for pixel types without a raw buffer equivalent.
+		 *
+		 * @param[in]  image  image of up to four dimensions
+		 * @param[in]  data   buffer of image, e.g. from an image accessor
+		 */
+		MITKALPHABLENDING_EXPORT DECTKernels::BufferView GetBufferView(const mitk::Image* image, const void* data);
+
+		/**
+		 * @brief      Computes output = functor(input) with double arithmetic for every voxel.
+		 *
+		 * @param[in]  input     image of any scalar pixel type
+		 * @param[in]  slabSize  number of slices per slab
+		 * @param[in]  functor   double(double)
+		 *
+		 * @return     double image with the geometry of input
+		 */
+		template <typename TFunctor>
+		mitk::Image::Pointer UnaryToDouble(const mitk::Image* input, unsigned int slabSize, const TFunctor& functor)
+		{
+			const std::size_t n = GetNumberOfVoxels(input);
+			const std::size_t slabVoxels = GetSliceSize(input) * std::max(1u, slabSize);
+
+			auto output = AllocateLike(input, mitk::MakeScalarPixelType<double>(), slabSize);
+			mitk::ImageReadAccessor inputAccessor(input);
+			mitk::ImageWriteAccessor outputAccessor(output);
+			double* out = static_cast<double*>(outputAccessor.GetData());
+
+			DispatchScalarPixelType(input->GetPixelType(), [&](auto tag)
+			{
+				using TPixel = PixelTypeOfTag<decltype(tag)>;
+				const TPixel* in = static_cast<const TPixel*>(inputAccessor.GetData());
+
+				SlabParallelFor(GetNumberOfSlabs(input, slabSize), [&](unsigned int slab)
+				{
+					const std::size_t last = std::min(n, (slab + 1) * slabVoxels);
+					for (std::size_t i = slab * slabVoxels; i < last; ++i)
+						out[i] = functor(static_cast<double>(in[i]));
+				});
+			});
+
+			return output;
+		}
+
+		/**
+		 * @brief      Computes output = functor(input1, input2) with double arithmetic for every voxel.
+		 * Both inputs have to have the same number of voxels, the pixel types may differ.
+		 *
+		 * @param[in]  input1    image of any scalar pixel type
+		 * @param[in]  input2    image of any scalar pixel type
+		 * @param[in]  slabSize  number of slices per slab
+		 * @param[in]  functor   double(double, double)
+		 *
+		 * @return     double image with the geometry of input1
+		 */
+		template <typename TFunctor>
+		mitk::Image::Pointer BinaryToDouble(const mitk::Image* input1, const mitk::Image* input2, unsigned int slabSize, const TFunctor& functor)
+		{
+			const std::size_t n = GetNumberOfVoxels(input1);
+			if (n != GetNumberOfVoxels(input2))
+			{
+				mitkThrow() << "Voxel wise operations between images of different size are not supported.";
+			}
+			const std::size_t slabVoxels = GetSliceSize(input1) * std::max(1u, slabSize);
+
+			auto output = AllocateLike(input1, mitk::MakeScalarPixelType<double>(), slabSize);
+			mitk::ImageReadAccessor inputAccessor1(input1);
+			mitk::ImageReadAccessor inputAccessor2(input2);
+			mitk::ImageWriteAccessor outputAccessor(output);
+			double* out = static_cast<double*>(outputAccessor.GetData());
+
+			DispatchScalarPixelType(input1->GetPixelType(), [&](auto tag1)
+			{
+				using TPixel1 = PixelTypeOfTag<decltype(tag1)>;
+				DispatchScalarPixelType(input2->GetPixelType(), [&](auto tag2)
+				{
+					using TPixel2 = PixelTypeOfTag<decltype(tag2)>;
+					const TPixel1* in1 = static_cast<const TPixel1*>(inputAccessor1.GetData());
+					const TPixel2* in2 = static_cast<const TPixel2*>(inputAccessor2.GetData());
+
+					SlabParallelFor(GetNumberOfSlabs(input1, slabSize), [&](unsigned int slab)
+					{
+						const std::size_t last = std::min(n, (slab + 1) * slabVoxels);
+						for (std::size_t i = slab * slabVoxels; i < last; ++i)
+							out[i] = functor(static_cast<double>(in1[i]), static_cast<double>(in2[i]));
+					});
+				});
+			});
+
+			return output;
+		}
+
+		/**
+		 * @brief      Computes output = functor(input) with double arithmetic inside the runs of mask for one time step,
+		 * all other voxels are set to outsideValue without reading the input. A raw kernel for the callers of
+		 * mitk::DECTKernels, slabs do not cross time steps and are reported to slabDone like there.
+		 *
+		 * @param[in]  input         image of any scalar pixel type
+		 * @param[in]  inputData     buffer of input, locked by the caller
+		 * @param[in]  mask          mask of the size of input
+		 * @param[in]  timeStep      time step to compute
+		 * @param[out] output        contiguous double voxels of the time step
+		 * @param[in]  slabSize      number of slices per slab
+		 * @param[in]  outsideValue  value of the voxels outside of the mask
+		 * @param[in]  functor       double(double)
+		 * @param[in]  slabDone      optional, called with the voxel range of every slab relative to output
+		 */
+		template <typename TFunctor>
+		void MaskedUnaryToDouble(const mitk::Image* input, const void* inputData, const BodyMask& mask, unsigned int timeStep, double* output,
+			unsigned int slabSize, double outsideValue, const TFunctor& functor, const DECTKernels::SlabCallback& slabDone = DECTKernels::SlabCallback())
+		{
+			mask.CheckCompatibility(input);
+			slabSize = std::max(1u, slabSize);
+			const std::size_t sliceSize = GetSliceSize(input);
+			const unsigned int numberOfSlices = input->GetDimension(2);
+			const unsigned int firstSlice = timeStep * numberOfSlices;
+			const std::size_t offset = firstSlice * sliceSize;
+
+			DispatchScalarPixelType(input->GetPixelType(), [&](auto tag)
+			{
+				using TPixel = PixelTypeOfTag<decltype(tag)>;
+				const TPixel* in = static_cast<const TPixel*>(inputData);
+
+				SlabParallelFor((numberOfSlices + slabSize - 1) / slabSize, [&](unsigned int slab)
+				{
+					const unsigned int first = firstSlice + slab * slabSize;
+					const unsigned int last = std::min(firstSlice + numberOfSlices, first + slabSize);
+					mask.ForEachRun(first, last,
+						[&](std::size_t begin, std::size_t end)
+						{
+							for (std::size_t i = begin; i < end; ++i)
+								output[i - offset] = functor(static_cast<double>(in[i]));
+						},
+						[&](std::size_t begin, std::size_t end)
+						{
+							std::fill(output + (begin - offset), output + (end - offset), outsideValue);
+						});
+					if (slabDone)
+						slabDone(slab, first * sliceSize - offset, last * sliceSize - offset);
+				});
+			});
+		}
+
+		/**
+		 * @brief      Computes output = functor(input1, input2) with double arithmetic inside the runs of mask for one
+		 * time step, all other voxels are set to outsideValue without reading the inputs. See MaskedUnaryToDouble.
+		 *
+		 * @param[in]  input1        image of any scalar pixel type
+		 * @param[in]  inputData1    buffer of input1, locked by the caller
+		 * @param[in]  input2        image of any scalar pixel type
+		 * @param[in]  inputData2    buffer of input2, locked by the caller
+		 * @param[in]  mask          mask of the size of the inputs
+		 * @param[in]  timeStep      time step to compute
+		 * @param[out] output        contiguous double voxels of the time step
+		 * @param[in]  slabSize      number of slices per slab
+		 * @param[in]  outsideValue  value of the voxels outside of the mask
+		 * @param[in]  functor       double(double, double)
+		 * @param[in]  slabDone      optional, called with the voxel range of every slab relative to output
+		 */
+		template <typename TFunctor>
+		void MaskedBinaryToDouble(const mitk::Image* input1, const void* inputData1, const mitk::Image* input2, const void* inputData2,
+			const BodyMask& mask, unsigned int timeStep, double* output, unsigned int slabSize, double outsideValue, const TFunctor& functor,
+			const DECTKernels::SlabCallback& slabDone = DECTKernels::SlabCallback())
+		{
+			mask.CheckCompatibility(input1);
+			mask.CheckCompatibility(input2);
+			slabSize = std::max(1u, slabSize);
+			const std::size_t sliceSize = GetSliceSize(input1);
+			const unsigned int numberOfSlices = input1->GetDimension(2);
+			const unsigned int firstSlice = timeStep * numberOfSlices;
+			const std::size_t offset = firstSlice * sliceSize;
+
+			DispatchScalarPixelType(input1->GetPixelType(), [&](auto tag1)
+			{
+				using TPixel1 = PixelTypeOfTag<decltype(tag1)>;
+				DispatchScalarPixelType(input2->GetPixelType(), [&](auto tag2)
+				{
+					using TPixel2 = PixelTypeOfTag<decltype(tag2)>;
+					const TPixel1* in1 = static_cast<const TPixel1*>(inputData1);
+					const TPixel2* in2 = static_cast<const TPixel2*>(inputData2);
+
+					SlabParallelFor((numberOfSlices + slabSize - 1) / slabSize, [&](unsigned int slab)
+					{
+						const unsigned int first = firstSlice + slab * slabSize;
+						const unsigned int last = std::min(firstSlice + numberOfSlices, first + slabSize);
+						mask.ForEachRun(first, last,
+							[&](std::size_t begin, std::size_t end)
+							{
+								for (std::size_t i = begin; i < end; ++i)
+									output[i - offset] = functor(static_cast<double>(in1[i]), static_cast<double>(in2[i]));
+							},
+							[&](std::size_t begin, std::size_t end)
+							{
+								std::fill(output + (begin - offset), output + (end - offset), outsideValue);
+							});
+						if (slabDone)
+							slabDone(slab, first * sliceSize - offset, last * sliceSize - offset);
+					});
+				});
+			});
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkVoxelStatistics_h
+#define mitkVoxelStatistics_h
+
+#include <mitkImage.h>
+
+#include <MitkAlphaBlendingExports.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Minimum, maximum, mean, standard deviation and histogram of the voxels written by a kernel.
+	 *
+	 * Kernels accumulate every slab into its own partial while they write the output, Merge combines the partials
+	 * in slab order afterwards. So the results do not depend on the number of threads and no second pass over the
+	 * image is needed. Values outside of the histogram range are counted in the first or last bin.
+	 * The results can be attached to the output image as properties, e.g. to set the level window of its node.
+	 */
+	class MITKALPHABLENDING_EXPORT VoxelStatistics
+	{
+	public:
+
+		double m_HistogramMinimum = -1024.;  // lower bound of the first bin
+		double m_HistogramMaximum = 3072.;   // upper bound of the last bin
+		unsigned int m_NumberOfBins = 1024;
+
+		// results, valid after Merge
+		std::size_t m_Count = 0;
+		double m_Minimum = 0.;
+		double m_Maximum = 0.;
+		double m_Mean = 0.;
+		double m_StandardDeviation = 0.;
+		std::vector<std::uint64_t> m_Histogram;
+
+		/**
+		 * @brief      Histogram range for HU images.
+		 */
+		static VoxelStatistics ForHU();
+
+		/**
+		 * @brief      Histogram range for RED and SPR images.
+		 */
+		static VoxelStatistics ForRED();
+
+		/**
+		 * @brief      Prepares one empty partial per slab.
+		 */
+		void Reset(unsigned int numberOfPartials);
+
+		/**
+		 * @brief      Adds values to a partial. Different partials may be accumulated concurrently.
+		 */
+		void Accumulate(unsigned int partial, const double* values, std::size_t count);
+
+		/**
+		 * @brief      Combines all partials in order into the results.
+		 */
+		void Merge();
+
+		/**
+		 * @brief      Value below which the given fraction of all voxels lies, interpolated within the histogram bin.
+		 */
+		double GetPercentile(double fraction) const;
+
+		/**
+		 * @brief      Stores the results as properties of the image.
+		 */
+		void AttachTo(mitk::Image* image) const;
+
+		/**
+		 * @brief      Reads results stored by AttachTo.
+		 *
+		 * @return     false if the image has no statistics attached
+		 */
+		static bool ReadFrom(const mitk::Image* image, VoxelStatistics& statistics);
+
+	private:
+
+		struct Partial
+		{
+			std::size_t m_Count = 0;
+			double m_Shift = 0.;          // first value, sums are taken relative to it to avoid cancellation
+			double m_Sum = 0.;
+			double m_SumOfSquares = 0.;
+			double m_Minimum = 0.;
+			double m_Maximum = 0.;
+			std::vector<std::uint64_t> m_Histogram;
+		};
+
+		std::vector<Partial> m_Partials;
+	};
+}
+
+#endif
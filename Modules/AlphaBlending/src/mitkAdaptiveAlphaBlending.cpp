@@ -0,0 +1,183 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkAdaptiveAlphaBlending.h"
+#include "mitkBufferPool.h"
+#include "mitkSlabParallelFor.h"
+
+#include <mitkGrabItkImageMemory.h>
+#include <mitkImageCast.h>
+#include <mitkExceptionMacro.h>
+
+#include <itkImage.h>
+
+#include <algorithm>
+
+mitk::Image::Pointer mitk::AdaptiveAlphaBlending::Blend(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow)
+{
+    if (imageHigh->GetDimension() != imageLow->GetDimension())
+    {
+        mitkThrow() << "Blending between images of different dimension is not supported by mitk::AdaptiveAlphaBlending.";
+    }
+
+    switch (imageHigh->GetDimension())
+    {
+    case 2:
+        return BlendFixedDimension<2>(imageHigh, imageLow);
+    case 3:
+        return BlendFixedDimension<3>(imageHigh, imageLow);
+    default:
+        mitkThrow() << "Image Dimension of " << imageHigh->GetDimension() << " is not supported by the adaptive blending";
+    }
+}
+
+template <unsigned int VDimension>
+mitk::Image::Pointer mitk::AdaptiveAlphaBlending::BlendFixedDimension(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow)
+{
+    typedef itk::Image<double, VDimension> DoubleImageType;
+
+    typename DoubleImageType::Pointer itkHigh;
+    typename DoubleImageType::Pointer itkLow;
+    mitk::CastToItkImage(imageHigh, itkHigh);
+    mitk::CastToItkImage(imageLow, itkLow);
+
+    auto region = itkHigh->GetLargestPossibleRegion();
+    if (region.GetSize() != itkLow->GetLargestPossibleRegion().GetSize())
+    {
+        mitkThrow() << "Blending between images of different size is not supported by mitk::AdaptiveAlphaBlending.";
+    }
+
+    std::size_t size[3] = { 1, 1, 1 };
+    for (unsigned int d = 0; d < VDimension; ++d)
+        size[d] = region.GetSize()[d];
+
+    const std::size_t sliceSize = size[0] * size[1];
+    const std::size_t n = sliceSize * size[2];
+    const double* high = itkHigh->GetBufferPointer();
+    const double* low = itkLow->GetBufferPointer();
+
+    // first and second moments of both inputs, turned into windowed means in place. The pooled buffers are
+    // uninitialized, so the pages of fresh ones are first touched by the threads filling the slices
+    BufferPool::Lease meanHighBuffer(n * sizeof(double)), squareHighBuffer(n * sizeof(double));
+    BufferPool::Lease meanLowBuffer(n * sizeof(double)), squareLowBuffer(n * sizeof(double));
+    double* meanHigh = meanHighBuffer.Get<double>();
+    double* squareHigh = squareHighBuffer.Get<double>();
+    double* meanLow = meanLowBuffer.Get<double>();
+    double* squareLow = squareLowBuffer.Get<double>();
+    SlabParallelFor(size[2], [&](unsigned int z)
+    {
+        for (std::size_t i = z * sliceSize; i < (z + 1) * sliceSize; ++i)
+        {
+            meanHigh[i] = high[i];
+            squareHigh[i] = high[i] * high[i];
+            meanLow[i] = low[i];
+            squareLow[i] = low[i] * low[i];
+        }
+    });
+
+    BoxMean(meanHigh, size, m_Radius);
+    BoxMean(squareHigh, size, m_Radius);
+    BoxMean(meanLow, size, m_Radius);
+    BoxMean(squareLow, size, m_Radius);
+
+    auto output = DoubleImageType::New();
+    output->CopyInformation(itkHigh);
+    output->SetRegions(region);
+    output->Allocate();
+    double* out = output->GetBufferPointer();
+
+    const double alpha = m_AlphaValue;
+    const double strength = m_Strength;
+
+    SlabParallelFor(size[2], [&](unsigned int z)
+    {
+        for (std::size_t i = z * sliceSize; i < (z + 1) * sliceSize; ++i)
+        {
+            // running sums leave rounding residues in flat regions, treat those as noise free
+            double varHigh = squareHigh[i] - meanHigh[i] * meanHigh[i];
+            double varLow = squareLow[i] - meanLow[i] * meanLow[i];
+            if (varHigh < 1e-12 * (squareHigh[i] + 1.))
+                varHigh = 0.;
+            if (varLow < 1e-12 * (squareLow[i] + 1.))
+                varLow = 0.;
+
+            const double total = varHigh + varLow;
+            const double optimal = total > 0. ? varLow / total : alpha;
+            const double localAlpha = alpha + strength * (optimal - alpha);
+
+            out[i] = localAlpha * high[i] + (1. - localAlpha) * low[i];
+        }
+    });
+
+    return mitk::GrabItkImageMemory(output.GetPointer());
+}
+
+void mitk::AdaptiveAlphaBlending::BoxMean(double * data, const std::size_t size[3], unsigned int radius)
+{
+    const std::size_t sliceSize = size[0] * size[1];
+
+    // x and y axis, every z slice is independent
+    SlabParallelFor(size[2], [&](unsigned int z)
+    {
+        std::vector<double> copy, sum;
+        double* slice = data + z * sliceSize;
+        for (std::size_t y = 0; y < size[1]; ++y)
+            BoxMeanRows(slice + y * size[0], size[0], 1, 1, radius, copy, sum);
+        BoxMeanRows(slice, size[1], size[0], size[0], radius, copy, sum);
+    });
+
+    if (size[2] < 2)
+        return;
+
+    // z axis, every y row is independent and the rows are contiguous in x
+    SlabParallelFor(size[1], [&](unsigned int y)
+    {
+        std::vector<double> copy, sum;
+        BoxMeanRows(data + y * size[0], size[2], sliceSize, size[0], radius, copy, sum);
+    });
+}
+
+void mitk::AdaptiveAlphaBlending::BoxMeanRows(double * data, std::size_t rowCount, std::size_t rowStride, std::size_t rowLength, unsigned int radius,
+    std::vector<double>& copy, std::vector<double>& sum)
+{
+    copy.resize(rowCount * rowLength);
+    for (std::size_t i = 0; i < rowCount; ++i)
+        std::copy(data + i * rowStride, data + i * rowStride + rowLength, copy.begin() + i * rowLength);
+
+    sum.assign(rowLength, 0.);
+
+    // window [first, last] slides along the rows, every row enters and leaves the sum exactly once
+    std::size_t entered = 0;
+    std::size_t left = 0;
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        const std::size_t first = i > radius ? i - radius : 0;
+        const std::size_t last = std::min<std::size_t>(i + radius, rowCount - 1);
+
+        for (; entered <= last; ++entered)
+        {
+            const double* row = copy.data() + entered * rowLength;
+            for (std::size_t k = 0; k < rowLength; ++k)
+                sum[k] += row[k];
+        }
+        for (; left < first; ++left)
+        {
+            const double* row = copy.data() + left * rowLength;
+            for (std::size_t k = 0; k < rowLength; ++k)
+                sum[k] -= row[k];
+        }
+
+        const double norm = 1. / static_cast<double>(last - first + 1);
+        double* out = data + i * rowStride;
+        for (std::size_t k = 0; k < rowLength; ++k)
+            out[k] = sum[k] * norm;
+    }
+}
@@ -0,0 +1,36 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkAlphaBlendingFilter.h"
+
+mitk::AlphaBlendingFilter::AlphaBlendingFilter()
+    : DECTImageFilter(2)
+{
+}
+
+mitk::AlphaBlendingFilter::~AlphaBlendingFilter()
+{
+}
+
+void mitk::AlphaBlendingFilter::SetHighEnergyImage(const mitk::Image * image)
+{
+    this->SetInput(0, image);
+}
+
+void mitk::AlphaBlendingFilter::SetLowEnergyImage(const mitk::Image * image)
+{
+    this->SetInput(1, image);
+}
+
+void mitk::AlphaBlendingFilter::GenerateSlices(const std::vector<DECTKernels::BufferView>& inputs, const DECTKernels::BufferView & output)
+{
+    DECTKernels::AlphaBlending(inputs[0], inputs[1], m_Alpha, output);
+}
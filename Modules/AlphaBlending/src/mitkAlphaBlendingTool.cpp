@@ -10,10 +10,17 @@ found in the LICENSE file.
 
 ============================================================================*/
 #include "mitkAlphaBlendingTool.h"
+#include "mitkAdaptiveAlphaBlending.h"
+#include "mitkAutoTuner.h"
+#include "mitkCompressedVolumeWriter.h"
+#include "mitkDECTKernels.h"
+#include "mitkImageExpression.h"
+#include "mitkSlabParallelFor.h"
+#include "mitkSlabThreadPool.h"
+#include "mitkVoxelKernels.h"
 
 #include <mitkImage.h>
-#include <mitkImageAccessByItk.h>
-#include <mitkImageCast.h>
+#include <mitkProperties.h>
 
 #include <usModuleContext.h>
 #include <usGetModuleContext.h>
@@ -22,16 +29,121 @@ found in the LICENSE file.
 #include <usModule.h>
 
 #include <tinyxml2.h>
-#include <itkArithmeticOpsFunctors.h>
-#include <itkImage.h>
-#include "itkUnaryFunctorImageFilter.h"
-#include "itkAddImageFilter.h"
-#include "itkMultiplyImageFilter.h"
-#include "itkDivideImageFilter.h"
 
+#include <algorithm>
+#include <memory>
+#include <sstream>
 #include <string>
 
+namespace
+{
+    /**
+     * Energy of a bin image from mitk::AlphaBlendingTool::BinEnergyPropertyName or the DICOM KVP, false if neither
+     * is set.
+     */
+    bool GetBinEnergy(const mitk::Image* image, double& energy)
+    {
+        auto property = dynamic_cast<mitk::DoubleProperty*>(image->GetProperty(mitk::AlphaBlendingTool::BinEnergyPropertyName).GetPointer());
+        if (nullptr != property)
+        {
+            energy = property->GetValue();
+            return true;
+        }
+        auto kvp = image->GetProperty("DICOM.0018.0060");
+        if (kvp.IsNull())
+            return false;
+        std::istringstream stream(kvp->GetValueAsString());
+        return static_cast<bool>(stream >> energy) && energy > 0.;
+    }
 
+    /**
+     * Runs a raw buffer kernel into numberOfOutputs double images like reference, the given results are reused and
+     * the missing ones allocated. The kernel is called once per time step with views of that time step, which is write
+     * locked in the outputs on its own, so finished time steps can be read while the others are processed.
+     * The statistics and pyramid levels of every slab are computed right after the kernel has written it and attached
+     * to the results.
+     */
+    template <typename TKernel>
+    std::vector<mitk::Image::Pointer> RunToDouble(const mitk::AlphaBlendingTool& tool, const mitk::Image* reference, std::size_t numberOfOutputs,
+        unsigned int slabSize, const mitk::VoxelStatistics& statisticsPrototype, const TKernel& kernel,
+        std::vector<mitk::Image::Pointer> results = std::vector<mitk::Image::Pointer>())
+    {
+        const unsigned int pyramidLevels = tool.GetPyramidLevels();
+        const unsigned int numberOfTimeSteps = reference->GetTimeSteps();
+        const std::size_t numberOfReused = std::min(results.size(), numberOfOutputs);
+        results.resize(numberOfOutputs);
+        std::vector<mitk::ImagePyramid> pyramids(numberOfOutputs);
+        std::vector<mitk::VoxelStatistics> statistics(numberOfOutputs, statisticsPrototype);
+        slabSize = std::max(1u, slabSize);
+        for (auto& pyramid : pyramids)
+        {
+            pyramid.m_NumberOfLevels = pyramidLevels;
+            if (pyramidLevels > 0)
+            {
+                pyramid.Initialize(reference);
+                slabSize = pyramid.GetAlignedSlabSize(slabSize);
+            }
+        }
+
+        for (std::size_t i = 0; i < numberOfOutputs; ++i)
+        {
+            if (i >= numberOfReused)
+                results[i] = mitk::VoxelKernels::AllocateLike(reference, mitk::MakeScalarPixelType<double>(), slabSize);
+        }
+        const std::size_t voxelsPerTimeStep = mitk::VoxelKernels::GetNumberOfVoxels(reference) / numberOfTimeSteps;
+        unsigned int slabsPerTimeStep = 0;
+
+        const auto& timeStepDone = tool.GetTimeStepCallback();
+        mitk::TimeStepParallelFor(numberOfTimeSteps, tool.GetMaxConcurrentTimeSteps(), [&](unsigned int timeStep)
+        {
+            std::vector<std::unique_ptr<mitk::ImageWriteAccessor>> accessors;
+            std::vector<double*> out;
+            std::vector<mitk::DECTKernels::BufferView> outputs;
+            for (std::size_t i = 0; i < numberOfOutputs; ++i)
+            {
+                accessors.emplace_back(new mitk::ImageWriteAccessor(results[i], numberOfTimeSteps > 1 ? results[i]->GetVolumeData(timeStep) : nullptr));
+                out.push_back(static_cast<double*>(accessors.back()->GetData()));
+                outputs.push_back(mitk::VoxelKernels::GetBufferView(results[i], out.back()));
+                outputs.back().m_Size[3] = 1;
+            }
+            if (0 == timeStep)
+            {
+                // the first time step is done alone, before the others are started
+                slabsPerTimeStep = mitk::DECTKernels::GetNumberOfSlabs(outputs.front(), slabSize);
+                for (auto& statistic : statistics)
+                    statistic.Reset(slabsPerTimeStep * numberOfTimeSteps);
+            }
+
+            kernel(timeStep, outputs, slabSize, [&](unsigned int slab, std::size_t begin, std::size_t end)
+            {
+                slab += timeStep * slabsPerTimeStep;
+                for (std::size_t i = 0; i < numberOfOutputs; ++i)
+                {
+                    statistics[i].Accumulate(slab, out[i] + begin, end - begin);
+                    if (pyramidLevels > 0)
+                        pyramids[i].Downsample(slab, slabSize, out[i] - timeStep * voxelsPerTimeStep);
+                }
+            });
+        },
+        [&](unsigned int timeStep)
+        {
+            if (!timeStepDone)
+                return;
+            for (const auto& result : results)
+                timeStepDone(timeStep, result);
+        });
+
+        for (std::size_t i = 0; i < numberOfOutputs; ++i)
+        {
+            statistics[i].Merge();
+            statistics[i].AttachTo(results[i]);
+            pyramids[i].AttachTo(results[i]);
+            if (i < numberOfReused)
+                results[i]->Modified();
+        }
+        return results;
+    }
+}
 
 void mitk::AlphaBlendingTool::Initialize()
 {
@@ -41,6 +153,7 @@ void mitk::AlphaBlendingTool::Initialize()
 void mitk::AlphaBlendingTool::Reset()
 {
     m_AlphaValueMap.clear();
+    m_WeightVectorMap.clear();
     ReadConfigResource("alphaParameter.xml");
 }
 
@@ -89,10 +202,7 @@ void mitk::AlphaBlendingTool::AddConfig(std::string& xmlData)
         {       
             for (tinyxml2::XMLElement* dataElement = rootElement->FirstChildElement(); dataElement != NULL; dataElement = dataElement->NextSiblingElement())
             {
-                const char* label = dataElement->Attribute("description");
-                const char* alphaValue = dataElement->Attribute("alphaValue");
-
-                m_AlphaValueMap[label] = std::stod(std::string(alphaValue));
+                AddMode(dataElement->Attribute("description"), dataElement->Attribute("alphaValue"), dataElement->Attribute("weights"));
             }
         }
         else
@@ -103,6 +213,38 @@ void mitk::AlphaBlendingTool::AddConfig(std::string& xmlData)
     }
 }
 
+void mitk::AlphaBlendingTool::AddMode(const char * description, const char * alphaValue, const char * weights)
+{
+    if (nullptr == description)
+    {
+        MITK_WARN << "Skipping a mode without description.";
+        return;
+    }
+
+    if (nullptr != weights)
+    {
+        // photon counting modes give one weight per energy bin, lowest energy first
+        std::vector<double> weightVector;
+        std::istringstream stream(weights);
+        for (std::string weight; stream >> weight;)
+            weightVector.push_back(std::stod(weight));
+        if (weightVector.empty())
+        {
+            MITK_WARN << "Skipping mode " << description << " without weights.";
+            return;
+        }
+        m_WeightVectorMap[description] = weightVector;
+    }
+    else if (nullptr != alphaValue)
+    {
+        m_AlphaValueMap[description] = std::stod(std::string(alphaValue));
+    }
+    else
+    {
+        MITK_WARN << "Skipping mode " << description << " without alpha value or weights.";
+    }
+}
+
 /**
  * @brief Read external resource defined in filepath and either append or overwrite the existing data.
  * The data from the xml file get's written into m_AlphaValueMap 
@@ -128,14 +270,14 @@ int mitk::AlphaBlendingTool::ReadExternalResource(const std::string& filepath, b
                 if (append)                    
                     Reset();
                 else
-            		m_AlphaValueMap.clear();
+                {
+                    m_AlphaValueMap.clear();
+                    m_WeightVectorMap.clear();
+                }
 
                 for (tinyxml2::XMLElement* dataElement = rootElement->FirstChildElement(); dataElement != NULL; dataElement = dataElement->NextSiblingElement())
                 {
-                    const char* label = dataElement->Attribute("description");
-                    const char* alphaValue = dataElement->Attribute("alphaValue");
-
-                    m_AlphaValueMap[label] = std::stod(std::string(alphaValue));
+                    AddMode(dataElement->Attribute("description"), dataElement->Attribute("alphaValue"), dataElement->Attribute("weights"));
                 }
                 return 0;
             }
@@ -158,153 +300,507 @@ int mitk::AlphaBlendingTool::ReadExternalResource(const std::string& filepath, b
 }
 
 
-/** This could be optimized by not converting to an MITK image after every function and do the whole alpha blending in only itk images and only convert once in the end,
- * but this would need a new macro in the form of AccessTwoImagesFixedDimensionsByItk_n in which it would be possible to give the additional alpha param,
- * or a manual cast to itk images what would require to know the pixel type.
- *
- */
-
 mitk::Image::Pointer mitk::AlphaBlendingTool::AlphaBlending(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow, double alpha)
 {
 	if (imageHigh->GetDimension() != imageLow->GetDimension())
 	{
         mitkThrow() << "Blending between images of different dimension is not supported by mitk::AlphaBlendingTool.";
 	}
-    //return mitk::ArithmeticOperation::Add(mitk::ArithmeticOperation::Multiply(imageHigh, alpha), mitk::ArithmeticOperation::Multiply(imageLow, (1. - alpha)));
-    mitk::AlphaBlendingHelper helper;
-    helper.m_AlphaValue = alpha;
-    return helper.Add(helper.Mlp(imageHigh, alpha), helper.Mlp(imageLow, (1 - alpha)));
+    return BlendWithDifferenceCache(nullptr, imageHigh, imageLow, alpha);
 }
 
-mitk::Image::Pointer mitk::AlphaBlendingTool::ConvertToRED(mitk::Image::Pointer & huCube)
+void mitk::AlphaBlendingTool::AlphaBlendingInto(mitk::Image::Pointer & output, mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow,
+    double alpha)
 {
-    mitk::AlphaBlendingHelper helper;
-    // Don't know why but it gave out wrong results when chaining the calls like this: return helper.Add(helper.Div(huCube, 1000.), 1.);
-	// So we need to use an extra pointer just for that
-    mitk::Image::Pointer tmpImage = helper.Div(huCube, 1000.);
-    return helper.Add(tmpImage, 1);
+    if (imageHigh->GetDimension() != imageLow->GetDimension())
+    {
+        mitkThrow() << "Blending between images of different dimension is not supported by mitk::AlphaBlendingTool.";
+    }
+    if (output.IsNull() || output->GetPixelType().GetComponentType() != itk::ImageIOBase::DOUBLE
+        || VoxelKernels::GetNumberOfVoxels(output) != VoxelKernels::GetNumberOfVoxels(imageHigh))
+    {
+        mitkThrow() << "Blending into an image requires a double image of the size of the inputs.";
+    }
+    BlendWithDifferenceCache(output, imageHigh, imageLow, alpha);
 }
 
-//Type function in order to access by itk
-template<typename TPixel, unsigned int VImageDimension>
-static void AddValue(const itk::Image<TPixel, VImageDimension>* image, double v, mitk::Image::Pointer& resultImage)
+mitk::Image::Pointer mitk::AlphaBlendingTool::BlendWithDifferenceCache(mitk::Image::Pointer output, mitk::Image::Pointer & imageHigh,
+    mitk::Image::Pointer & imageLow, double alpha)
 {
-    typedef itk::Image<TPixel, VImageDimension> ImageType;
-    typedef itk::Image<double, VImageDimension> DoubleOutputType;
-	
-    typedef itk::AddImageFilter<ImageType, ImageType, DoubleOutputType> FilterType;
+    std::vector<mitk::Image::Pointer> reused;
+    if (output.IsNotNull())
+    {
+        reused.push_back(output);
+    }
+    const bool cached = m_DifferenceCaching && IsDifferenceCached(imageHigh, imageLow);
+    const std::size_t numberOfOutputs = (output.IsNull() ? 1 : 0) + (m_DifferenceCaching && !cached ? 1 : 0);
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::AlphaBlending, { imageHigh, imageLow }, numberOfOutputs);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+
+    mitk::ImageReadAccessor lowAccessor(imageLow);
+    const auto low = VoxelKernels::GetBufferView(imageLow, lowAccessor.GetData());
+    if (cached)
+    {
+        const DECTKernels::BufferView& difference = m_DifferenceCache.m_Difference;
+        return RunToDouble(*this, imageHigh, 1, plan.m_SlabSize, VoxelStatistics::ForHU(),
+            [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+            {
+                DECTKernels::AlphaBlendingFromDifference(low.GetTimeStep(timeStep), difference.GetTimeStep(timeStep), alpha, outputs.front(),
+                    slabSize, slabDone);
+            }, reused).front();
+    }
+
+    mitk::ImageReadAccessor highAccessor(imageHigh);
+    const auto high = VoxelKernels::GetBufferView(imageHigh, highAccessor.GetData());
+    if (!m_DifferenceCaching)
+    {
+        return RunToDouble(*this, imageHigh, 1, plan.m_SlabSize, VoxelStatistics::ForHU(),
+            [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+            {
+                DECTKernels::AlphaBlending(high.GetTimeStep(timeStep), low.GetTimeStep(timeStep), alpha, outputs.front(), slabSize, slabDone);
+            }, reused).front();
+    }
+
+    // a single pair is cached, the difference of the previous pair goes back to the pool before the new one is
+    // leased, so re-blending pairs of the same size reuses the mapped pages of the previous difference
+    m_DifferenceCache = DifferenceCache();
+    const std::size_t pixelSize = m_ReducedPrecisionDifference ? sizeof(float) : sizeof(double);
+    auto buffer = std::make_shared<BufferPool::Lease>(VoxelKernels::GetNumberOfVoxels(imageHigh) * pixelSize);
+    const DECTKernels::BufferView difference(buffer->Get<void>(), m_ReducedPrecisionDifference ? mitkDECTFloat : mitkDECTDouble,
+        high.m_Size[0], high.m_Size[1], high.m_Size[2], high.m_Size[3]);
+    mitk::Image::Pointer result = RunToDouble(*this, imageHigh, 1, plan.m_SlabSize, VoxelStatistics::ForHU(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            DECTKernels::AlphaBlendingWithDifference(high.GetTimeStep(timeStep), low.GetTimeStep(timeStep), alpha, outputs.front(),
+                difference.GetTimeStep(timeStep), slabSize, slabDone);
+        }, reused).front();
+    m_DifferenceCache.m_High = imageHigh.GetPointer();
+    m_DifferenceCache.m_Low = imageLow.GetPointer();
+    m_DifferenceCache.m_HighTime = imageHigh->GetMTime();
+    m_DifferenceCache.m_LowTime = imageLow->GetMTime();
+    m_DifferenceCache.m_Buffer = buffer;
+    m_DifferenceCache.m_Difference = difference;
+    return result;
+}
+
+void mitk::AlphaBlendingTool::SetDifferenceCaching(bool enable, bool reducedPrecision)
+{
+    if (enable != m_DifferenceCaching || reducedPrecision != m_ReducedPrecisionDifference)
+    {
+        m_DifferenceCache = DifferenceCache();
+    }
+    m_DifferenceCaching = enable;
+    m_ReducedPrecisionDifference = reducedPrecision;
+}
+
+bool mitk::AlphaBlendingTool::IsDifferenceCached(const mitk::Image* imageHigh, const mitk::Image* imageLow) const
+{
+    // an expired pointer locks to null, so the address of a deleted input can never match a new image
+    return nullptr != m_DifferenceCache.m_Buffer && imageHigh == m_DifferenceCache.m_High.Lock().GetPointer()
+        && imageLow == m_DifferenceCache.m_Low.Lock().GetPointer() && imageHigh->GetMTime() == m_DifferenceCache.m_HighTime
+        && imageLow->GetMTime() == m_DifferenceCache.m_LowTime;
+}
+
+mitk::Image::Pointer mitk::AlphaBlendingTool::AlphaBlending(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow, double alpha,
+    const BodyMask & mask, double outsideValue)
+{
+    if (imageHigh->GetDimension() != imageLow->GetDimension())
+    {
+        mitkThrow() << "Blending between images of different dimension is not supported by mitk::AlphaBlendingTool.";
+    }
+    // the masked path never creates intermediates, so it runs slab wise in any case
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::AlphaBlending, imageHigh, imageLow);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+    mitk::ImageReadAccessor highAccessor(imageHigh);
+    mitk::ImageReadAccessor lowAccessor(imageLow);
+    return RunToDouble(*this, imageHigh, 1, plan.m_SlabSize, VoxelStatistics::ForHU(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            VoxelKernels::MaskedBinaryToDouble(imageHigh, highAccessor.GetData(), imageLow, lowAccessor.GetData(), mask, timeStep,
+                static_cast<double*>(outputs.front().m_Data), slabSize, outsideValue, [alpha](double high, double low)
+                {
+                    return alpha * high + (1. - alpha) * low;
+                }, slabDone);
+        }).front();
+}
+
+mitk::Image::Pointer mitk::AlphaBlendingTool::AlphaBlending(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow, double alpha,
+    const RigidAlignment & alignment, const BodyMask * mask, double outsideValue)
+{
+    if (imageHigh->GetDimension() != imageLow->GetDimension() || imageHigh->GetTimeSteps() != imageLow->GetTimeSteps())
+    {
+        mitkThrow() << "Blending between images of different dimension or number of time steps is not supported by mitk::AlphaBlendingTool.";
+    }
+    // the result is in the geometry of the low image, the high image may have another size
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::AlphaBlending, imageLow, imageHigh);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+
+    double highIndexTransform[12];
+    alignment.GetIndexTransform(imageLow, imageHigh, highIndexTransform);
+    mitk::ImageReadAccessor highAccessor(imageHigh);
+    mitk::ImageReadAccessor lowAccessor(imageLow);
+    const auto high = VoxelKernels::GetBufferView(imageHigh, highAccessor.GetData());
+    const auto low = VoxelKernels::GetBufferView(imageLow, lowAccessor.GetData());
+    if (nullptr != mask)
+    {
+        mask->CheckCompatibility(imageLow);
+    }
+    const std::size_t sliceSize = VoxelKernels::GetSliceSize(imageLow);
+    const unsigned int numberOfSlices = imageLow->GetDimension(2);
+    return RunToDouble(*this, imageLow, 1, plan.m_SlabSize, VoxelStatistics::ForHU(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            if (nullptr == mask)
+            {
+                DECTKernels::AlphaBlendingResampled(high.GetTimeStep(timeStep), highIndexTransform, low.GetTimeStep(timeStep), alpha, outputs.front(),
+                    slabSize, slabDone);
+                return;
+            }
+            // every slab is masked right after it is blended, before its statistics are taken
+            double* out = static_cast<double*>(outputs.front().m_Data);
+            const std::size_t offset = timeStep * numberOfSlices * sliceSize;
+            DECTKernels::AlphaBlendingResampled(high.GetTimeStep(timeStep), highIndexTransform, low.GetTimeStep(timeStep), alpha, outputs.front(),
+                slabSize, [&](unsigned int slab, std::size_t begin, std::size_t end)
+                {
+                    const unsigned int firstSlice = static_cast<unsigned int>((offset + begin) / sliceSize);
+                    const unsigned int lastSlice = static_cast<unsigned int>((offset + end) / sliceSize);
+                    mask->ForEachRun(firstSlice, lastSlice, [](std::size_t, std::size_t) {}, [&](std::size_t first, std::size_t last)
+                    {
+                        std::fill(out + (first - offset), out + (last - offset), outsideValue);
+                    });
+                    if (slabDone)
+                        slabDone(slab, begin, end);
+                });
+        }).front();
+}
 
-    auto filter = FilterType::New();
-    filter->SetInput(image);
-    //filter->GetFunctor().value = v;
-    filter->SetConstant(v);
-    filter->Update();
+mitk::Image::Pointer mitk::AlphaBlendingTool::AlphaBlending(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow,
+    mitk::Image::Pointer & alphaMap)
+{
+    if (imageHigh->GetDimension() != imageLow->GetDimension() || imageHigh->GetTimeSteps() != imageLow->GetTimeSteps())
+    {
+        mitkThrow() << "Blending between images of different dimension or number of time steps is not supported by mitk::AlphaBlendingTool.";
+    }
+    if (alphaMap.IsNull() || alphaMap->GetPixelType().GetNumberOfComponents() != 1
+        || (alphaMap->GetTimeSteps() != 1 && alphaMap->GetTimeSteps() != imageLow->GetTimeSteps()))
+    {
+        mitkThrow() << "The alpha map has to be a scalar image with one time step or as many as the blended images.";
+    }
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::AlphaBlending, imageHigh, imageLow);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+
+    // the identity alignment maps the indices of the images onto those of the map through both geometries
+    double alphaIndexTransform[12];
+    RigidAlignment().GetIndexTransform(imageLow, alphaMap, alphaIndexTransform);
+    const bool mapPerTimeStep = alphaMap->GetTimeSteps() == imageLow->GetTimeSteps();
+    mitk::ImageReadAccessor highAccessor(imageHigh);
+    mitk::ImageReadAccessor lowAccessor(imageLow);
+    mitk::ImageReadAccessor mapAccessor(alphaMap);
+    const auto high = VoxelKernels::GetBufferView(imageHigh, highAccessor.GetData());
+    const auto low = VoxelKernels::GetBufferView(imageLow, lowAccessor.GetData());
+    const auto map = VoxelKernels::GetBufferView(alphaMap, mapAccessor.GetData());
+    return RunToDouble(*this, imageLow, 1, plan.m_SlabSize, VoxelStatistics::ForHU(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            DECTKernels::AlphaMapBlending(high.GetTimeStep(timeStep), low.GetTimeStep(timeStep), map.GetTimeStep(mapPerTimeStep ? timeStep : 0),
+                alphaIndexTransform, outputs.front(), slabSize, slabDone);
+        }).front();
+}
 
+mitk::Image::Pointer mitk::AlphaBlendingTool::FixedPointAlphaBlending(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow, double alpha)
+{
+    if (imageHigh->GetDimension() != imageLow->GetDimension())
+    {
+        mitkThrow() << "Blending between images of different dimension is not supported by mitk::AlphaBlendingTool.";
+    }
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::FixedPointAlphaBlending, imageHigh, imageLow);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
 
-    mitk::CastToMitkImage(filter->GetOutput(), resultImage);
+    mitk::FixedPointAlphaBlending blending;
+    blending.m_AlphaValue = alpha;
+    return blending.Blend(imageHigh, imageLow, plan.m_SlabSize);
+}
 
+mitk::Image::Pointer mitk::AlphaBlendingTool::AdaptiveAlphaBlending(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow, double alpha,
+    unsigned int radius, double strength)
+{
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::AdaptiveAlphaBlending, imageHigh, imageLow);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+
+    mitk::AdaptiveAlphaBlending blending;
+    blending.m_AlphaValue = alpha;
+    blending.m_Radius = radius;
+    blending.m_Strength = strength;
+    return blending.Blend(imageHigh, imageLow);
 }
 
-template<typename TPixel, unsigned int VImageDimension>
-static void MlpValue(const itk::Image<TPixel, VImageDimension>* image, double v, mitk::Image::Pointer& resultImage)
+mitk::Image::Pointer mitk::AlphaBlendingTool::ConvertToRED(mitk::Image::Pointer & huCube)
 {
-    typedef itk::Image<TPixel, VImageDimension> ImageType;
-    typedef itk::Image<double, VImageDimension> DoubleOutputType;
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::ConvertToRED, huCube);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
 
-    typedef itk::MultiplyImageFilter<ImageType, ImageType, DoubleOutputType> FilterType;
+    mitk::ImageReadAccessor huAccessor(huCube);
+    const auto hu = VoxelKernels::GetBufferView(huCube, huAccessor.GetData());
+    return RunToDouble(*this, huCube, 1, plan.m_SlabSize, VoxelStatistics::ForRED(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            DECTKernels::ConvertToRED(hu.GetTimeStep(timeStep), outputs.front(), slabSize, slabDone);
+        }).front();
+}
 
-    auto filter = FilterType::New();
-    filter->SetInput(image);
-    //filter->GetFunctor().value = v;
-    filter->SetConstant(v);
-    filter->Update();
+mitk::Image::Pointer mitk::AlphaBlendingTool::ConvertToRED(mitk::Image::Pointer & huCube, const BodyMask & mask, double outsideValue)
+{
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::ConvertToRED, huCube);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+    mitk::ImageReadAccessor huAccessor(huCube);
+    return RunToDouble(*this, huCube, 1, plan.m_SlabSize, VoxelStatistics::ForRED(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            VoxelKernels::MaskedUnaryToDouble(huCube, huAccessor.GetData(), mask, timeStep, static_cast<double*>(outputs.front().m_Data), slabSize,
+                outsideValue, [](double hu)
+                {
+                    return hu / 1000. + 1.;
+                }, slabDone);
+        }).front();
+}
 
+const char* const mitk::AlphaBlendingTool::BinEnergyPropertyName = "dect.bin energy";
 
-    mitk::CastToMitkImage(filter->GetOutput(), resultImage);
+std::vector<std::size_t> mitk::AlphaBlendingTool::SortEnergyBins(const std::vector<const mitk::Image*>& binImages)
+{
+    std::vector<double> energies(binImages.size());
+    for (std::size_t i = 0; i < binImages.size(); ++i)
+    {
+        if (!GetBinEnergy(binImages[i], energies[i]))
+        {
+            mitkThrow() << "Energy bin " << i + 1 << " has neither the property \"" << BinEnergyPropertyName << "\" nor a KVP.";
+        }
+    }
+    std::vector<std::size_t> order(binImages.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&energies](std::size_t a, std::size_t b) { return energies[a] < energies[b]; });
+    for (std::size_t i = 1; i < order.size(); ++i)
+    {
+        if (energies[order[i - 1]] == energies[order[i]])
+        {
+            mitkThrow() << "Energy bins " << order[i - 1] + 1 << " and " << order[i] + 1 << " have the same energy of "
+                        << energies[order[i]] << " keV.";
+        }
+    }
+    return order;
+}
 
+mitk::Image::Pointer mitk::AlphaBlendingTool::WeightedCombination(const std::vector<mitk::Image::Pointer>& binImages, const std::vector<double>& weights)
+{
+    return WeightedCombination(binImages, std::vector<std::vector<double>>{ weights }).front();
 }
 
-template<typename TPixel, unsigned int VImageDimension>
-static void DivValue(const itk::Image<TPixel, VImageDimension>* image, double v, mitk::Image::Pointer& resultImage)
+std::vector<mitk::Image::Pointer> mitk::AlphaBlendingTool::WeightedCombination(const std::vector<mitk::Image::Pointer>& binImages,
+    const std::vector<std::vector<double>>& weightSets)
 {
-    typedef itk::Image<TPixel, VImageDimension> ImageType;
-    typedef itk::Image<double, VImageDimension> DoubleOutputType;
+    if (binImages.empty() || weightSets.empty())
+    {
+        mitkThrow() << "Weighted combination needs at least one energy bin and one weight set.";
+    }
+    std::vector<const mitk::Image*> inputs;
+    for (const auto& binImage : binImages)
+    {
+        if (binImage->GetDimension() != binImages.front()->GetDimension())
+        {
+            mitkThrow() << "Combining energy bins of different dimension is not supported by mitk::AlphaBlendingTool.";
+        }
+        inputs.push_back(binImage);
+    }
+    // the weights follow the bins from the lowest energy, bins of unknown energy are taken in the given order
+    for (std::size_t i = 1; i < inputs.size(); ++i)
+    {
+        double previous = 0.;
+        double energy = 0.;
+        if (GetBinEnergy(inputs[i - 1], previous) && GetBinEnergy(inputs[i], energy) && !(previous < energy))
+        {
+            mitkThrow() << "Energy bins have to be given lowest energy first, bin " << i + 1 << " has " << energy
+                        << " keV after " << previous << " keV.";
+        }
+    }
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::WeightedCombination, inputs, weightSets.size());
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
 
-    typedef itk::DivideImageFilter<ImageType, ImageType, DoubleOutputType> FilterType;
+    std::vector<std::unique_ptr<mitk::ImageReadAccessor>> accessors;
+    std::vector<DECTKernels::BufferView> bins;
+    for (const auto* input : inputs)
+    {
+        accessors.emplace_back(new mitk::ImageReadAccessor(input));
+        bins.push_back(VoxelKernels::GetBufferView(input, accessors.back()->GetData()));
+    }
+    return RunToDouble(*this, inputs.front(), weightSets.size(), plan.m_SlabSize, VoxelStatistics::ForHU(),
+        [&](unsigned int timeStep, const std::vector<DECTKernels::BufferView>& outputs, unsigned int slabSize, const DECTKernels::SlabCallback& slabDone)
+        {
+            std::vector<DECTKernels::BufferView> timeStepBins;
+            for (const auto& bin : bins)
+                timeStepBins.push_back(bin.GetTimeStep(timeStep));
+            DECTKernels::WeightedCombination(timeStepBins, weightSets, outputs, slabSize, slabDone);
+        });
+}
 
-    auto filter = FilterType::New();
-    filter->SetInput(image);
-    //filter->GetFunctor().value = v;
-    filter->SetConstant(v);
-    filter->Update();
+mitk::Image::Pointer mitk::AlphaBlendingTool::ConvertToSPR(mitk::Image::Pointer & huCube)
+{
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::ConvertToSPR, huCube);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+    mitk::Functor::HUToSPR<double, double> functor;
+    functor.SetParameters(m_SPRParameters);
+    return VoxelKernels::UnaryToDouble(huCube, plan.m_SlabSize, functor);
+}
 
+mitk::Image::Pointer mitk::AlphaBlendingTool::ConvertToSPR(mitk::Image::Pointer & huCube, mitk::Image::Pointer & zEffImage)
+{
+    if (huCube->GetDimension() != zEffImage->GetDimension())
+    {
+        mitkThrow() << "HU and Z_eff images of different dimension are not supported by mitk::AlphaBlendingTool.";
+    }
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::ConvertToSPR, huCube, zEffImage);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+    mitk::Functor::HUAndZeffToSPR<double, double, double> functor;
+    functor.SetParameters(m_SPRParameters);
+    return VoxelKernels::BinaryToDouble(huCube, zEffImage, plan.m_SlabSize, functor);
+}
 
-    mitk::CastToMitkImage(filter->GetOutput(), resultImage);
+mitk::Image::Pointer mitk::AlphaBlendingTool::AlphaBlendingToSPR(mitk::Image::Pointer & imageHigh, mitk::Image::Pointer & imageLow, double alpha)
+{
+    if (imageHigh->GetDimension() != imageLow->GetDimension())
+    {
+        mitkThrow() << "Blending between images of different dimension is not supported by mitk::AlphaBlendingTool.";
+    }
+    ExecutionPlan plan = PlanOrThrow(ExecutionPlanner::Operation::AlphaBlendingToSPR, imageHigh, imageLow);
+    SlabThreadLimit threads(plan.m_NumberOfThreads);
+    mitk::Functor::BlendToSPR<double, double, double> functor;
+    functor.SetParameters(alpha, m_SPRParameters);
+    return VoxelKernels::BinaryToDouble(imageHigh, imageLow, plan.m_SlabSize, functor);
+}
+
+bool mitk::AlphaBlendingTool::Autotune(const std::vector<ExecutionPlanner::Operation>& operations, const std::vector<mitk::PixelType>& pixelTypes,
+    const AutotuneCallback& progress)
+{
+    std::vector<ExecutionPlanner::Operation> tunedOperations = operations;
+    if (tunedOperations.empty())
+    {
+        tunedOperations = { ExecutionPlanner::Operation::AlphaBlending, ExecutionPlanner::Operation::ConvertToRED,
+            ExecutionPlanner::Operation::ConvertToSPR, ExecutionPlanner::Operation::AlphaBlendingToSPR };
+    }
+    std::vector<mitk::PixelType> tunedPixelTypes = pixelTypes;
+    if (tunedPixelTypes.empty())
+    {
+        tunedPixelTypes = { mitk::MakeScalarPixelType<short>(), mitk::MakeScalarPixelType<double>() };
+    }
 
+    // the calibration runs on a tool of its own, so the difference cache and the time step callback are not touched
+    AlphaBlendingTool calibration;
+    calibration.SetMemoryBudget(GetMemoryBudget());
+    calibration.SetPyramidLevels(GetPyramidLevels());
+    calibration.SetSPRParameters(GetSPRParameters());
+    AutoTuner tuner;
+    const std::map<std::string, TunedParameters> previousTuning = GetTuning();
+    const std::size_t total = tunedOperations.size() * tunedPixelTypes.size();
+    std::size_t tuned = 0;
+    for (const auto operation : tunedOperations)
+    {
+        for (const auto& pixelType : tunedPixelTypes)
+        {
+            if (progress && !progress(tuned++, total))
+            {
+                m_Planner.m_Tuning = previousTuning;
+                return false;
+            }
+            TunedParameters parameters;
+            if (tuner.Tune(calibration, operation, pixelType, parameters))
+            {
+                SetTunedParameters(operation, pixelType, parameters);
+                MITK_INFO << "Tuned " << ExecutionPlanner::GetTuningKey(operation, pixelType) << ": " << parameters.m_NumberOfThreads
+                          << " threads (0 for all), " << parameters.m_SlabSize << " slices per slab, " << parameters.m_Throughput << " megavoxels/s";
+            }
+        }
+    }
+    if (progress)
+        progress(total, total);
+    return true;
 }
 
+void mitk::AlphaBlendingTool::SetTunedParameters(ExecutionPlanner::Operation operation, const mitk::PixelType & pixelType,
+    const TunedParameters & parameters)
+{
+    m_Planner.m_Tuning[ExecutionPlanner::GetTuningKey(operation, pixelType)] = parameters;
+}
 
-mitk::Image::Pointer mitk::AlphaBlendingHelper::Add(mitk::Image::Pointer& image, double v)
+void mitk::AlphaBlendingTool::RemoveTunedParameters(ExecutionPlanner::Operation operation, const mitk::PixelType & pixelType)
 {
-    mitk::Image::Pointer resultImage;
-    AccessByItk_n(image, AddValue, (v, resultImage));
-    return resultImage;
+    m_Planner.m_Tuning.erase(ExecutionPlanner::GetTuningKey(operation, pixelType));
 }
 
-mitk::Image::Pointer mitk::AlphaBlendingHelper::Mlp(mitk::Image::Pointer& image, double v)
+mitk::ExecutionPlan mitk::AlphaBlendingTool::Plan(ExecutionPlanner::Operation operation, const mitk::Image * imageA, const mitk::Image * imageB) const
 {
-    mitk::Image::Pointer resultImage;
-    AccessByItk_n(image, MlpValue, (v, resultImage));
-    return resultImage;
+    std::vector<const mitk::Image*> inputs = { imageA };
+    if (nullptr != imageB)
+        inputs.push_back(imageB);
+    return Plan(operation, inputs);
 }
 
-mitk::Image::Pointer mitk::AlphaBlendingHelper::Div(mitk::Image::Pointer& image, double v)
+mitk::ExecutionPlan mitk::AlphaBlendingTool::Plan(ExecutionPlanner::Operation operation, const std::vector<const mitk::Image*>& inputs,
+    std::size_t numberOfOutputs) const
 {
-    mitk::Image::Pointer resultImage;
-    AccessByItk_n(image, DivValue,(v, resultImage));
-    return resultImage;	
+    const std::size_t pixelSize = operation == ExecutionPlanner::Operation::FixedPointAlphaBlending ? sizeof(short) : sizeof(double);
+    return m_Planner.Plan(operation, inputs, pixelSize * numberOfOutputs);
 }
 
-mitk::Image::Pointer mitk::AlphaBlendingHelper::Add(mitk::Image::Pointer & imageA, mitk::Image::Pointer & imageB)
+mitk::ExecutionPlan mitk::AlphaBlendingTool::PlanOrThrow(ExecutionPlanner::Operation operation, const mitk::Image * imageA, const mitk::Image * imageB) const
 {
-	switch (imageA->GetDimension())
-	{
-    case 1:
-        AccessTwoImagesFixedDimensionByItk(imageA, imageB, mitk::AlphaBlendingHelper::Add2Functor, 1);
-        break;
-    case 2:
-        AccessTwoImagesFixedDimensionByItk(imageA, imageB, mitk::AlphaBlendingHelper::Add2Functor, 2);
-        break;
-    case 3:
-        AccessTwoImagesFixedDimensionByItk(imageA, imageB, mitk::AlphaBlendingHelper::Add2Functor, 3);
-        break;
-    case 4:
-        AccessTwoImagesFixedDimensionByItk(imageA, imageB, mitk::AlphaBlendingHelper::Add2Functor, 4);
-        break;
-    default:
-        mitkThrow() << "Image Dimension of " << imageA->GetDimension() << " is not supported";
-        break;
-	}
-	
-    return m_ResultImage;    
+    std::vector<const mitk::Image*> inputs = { imageA };
+    if (nullptr != imageB)
+        inputs.push_back(imageB);
+    return PlanOrThrow(operation, inputs);
 }
-// functions for add arithmetic operation on two images
-// in this case the pixel type should always be a double because of the image operation before
-template<typename TPixel1, unsigned int VImageDimension1, typename TPixel2, unsigned int VImageDimension2 >
-void mitk::AlphaBlendingHelper::Add2Functor(const itk::Image<TPixel1, VImageDimension1>* imageA, const itk::Image<TPixel2, VImageDimension2>* imageB)
+
+mitk::ExecutionPlan mitk::AlphaBlendingTool::PlanOrThrow(ExecutionPlanner::Operation operation, const std::vector<const mitk::Image*>& inputs,
+    std::size_t numberOfOutputs) const
 {
-    typedef itk::Image<TPixel1, VImageDimension1> ImageType1;
-    typedef itk::Image<TPixel2, VImageDimension2> ImageType2;
-    typedef itk::AddImageFilter<ImageType1, ImageType2, itk::Image<double,VImageDimension1>> FilterType;
+    ExecutionPlan plan = Plan(operation, inputs, numberOfOutputs);
+    if (plan.m_Strategy == ExecutionPlan::Strategy::Refused)
+    {
+        mitkThrow() << plan.m_Message;
+    }
+    if (plan.m_Strategy == ExecutionPlan::Strategy::SlabStreamed)
+    {
+        MITK_INFO << plan.m_Message;
+    }
+    return plan;
+}
 
-    auto filter = FilterType::New();
-    filter->SetInput1(imageA);
-    filter->SetInput2(imageB);
-    filter->Update();
+void mitk::AlphaBlendingTool::ExportHU(mitk::Image::Pointer & huCube, const std::string & filename)
+{
+    mitk::CompressedVolumeWriter::ForHU().Write(huCube, filename);
+}
 
-    mitk::CastToMitkImage(filter->GetOutput(), m_ResultImage) ;
+void mitk::AlphaBlendingTool::ExportRED(mitk::Image::Pointer & redCube, const std::string & filename)
+{
+    mitk::CompressedVolumeWriter::ForRED().Write(redCube, filename);
+}
 
+// the arithmetic helpers evaluate single expressions, chain them with mitk::ImageExpression to avoid intermediates
+mitk::Image::Pointer mitk::AlphaBlendingHelper::Add(mitk::Image::Pointer& image, double v)
+{
+    return ImageExpression::Evaluate(ImageExpression::Input(image) + v);
 }
 
+mitk::Image::Pointer mitk::AlphaBlendingHelper::Mlp(mitk::Image::Pointer& image, double v)
+{
+    return ImageExpression::Evaluate(ImageExpression::Input(image) * v);
+}
 
+mitk::Image::Pointer mitk::AlphaBlendingHelper::Div(mitk::Image::Pointer& image, double v)
+{
+    return ImageExpression::Evaluate(ImageExpression::Input(image) / v);
+}
 
+mitk::Image::Pointer mitk::AlphaBlendingHelper::Add(mitk::Image::Pointer & imageA, mitk::Image::Pointer & imageB)
+{
+    return ImageExpression::Evaluate(ImageExpression::Input(imageA) + ImageExpression::Input(imageB));
+}
@@ -0,0 +1,211 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkAutoTuner.h"
+#include "mitkAlphaBlendingTool.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkImageWriteAccessor.h>
+
+#include <itkMultiThreaderBase.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const double CalibrationAlpha = 0.6;
+
+    template <typename TPixel>
+    void Fill(void* data, const std::vector<double>& values)
+    {
+        TPixel* pixels = static_cast<TPixel*>(data);
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            const double value = std::max<double>(std::numeric_limits<TPixel>::lowest(), std::min<double>(std::numeric_limits<TPixel>::max(), values[i]));
+            pixels[i] = static_cast<TPixel>(value);
+        }
+    }
+
+    mitk::Image::Pointer Run(mitk::AlphaBlendingTool& tool, mitk::ExecutionPlanner::Operation operation, mitk::Image::Pointer& high,
+        mitk::Image::Pointer& low)
+    {
+        switch (operation)
+        {
+        case mitk::ExecutionPlanner::Operation::AlphaBlending:
+            return tool.AlphaBlending(high, low, CalibrationAlpha);
+        case mitk::ExecutionPlanner::Operation::AdaptiveAlphaBlending:
+            return tool.AdaptiveAlphaBlending(high, low, CalibrationAlpha);
+        case mitk::ExecutionPlanner::Operation::ConvertToRED:
+            return tool.ConvertToRED(low);
+        case mitk::ExecutionPlanner::Operation::ConvertToSPR:
+            return tool.ConvertToSPR(low);
+        case mitk::ExecutionPlanner::Operation::AlphaBlendingToSPR:
+            return tool.AlphaBlendingToSPR(high, low, CalibrationAlpha);
+        case mitk::ExecutionPlanner::Operation::FixedPointAlphaBlending:
+            return tool.FixedPointAlphaBlending(high, low, CalibrationAlpha);
+        case mitk::ExecutionPlanner::Operation::WeightedCombination:
+            return tool.WeightedCombination({ low, high, low, high }, { 0.4, 0.3, 0.2, 0.1 });
+        }
+        return nullptr;
+    }
+
+    bool IsSupported(mitk::ExecutionPlanner::Operation operation, const mitk::PixelType& pixelType)
+    {
+        if (pixelType.GetNumberOfComponents() != 1)
+            return false;
+        if (operation != mitk::ExecutionPlanner::Operation::FixedPointAlphaBlending)
+            return true;
+        const auto componentType = pixelType.GetComponentType();
+        return componentType == itk::ImageIOBase::CHAR || componentType == itk::ImageIOBase::UCHAR
+            || componentType == itk::ImageIOBase::SHORT || componentType == itk::ImageIOBase::USHORT;
+    }
+}
+
+mitk::Image::Pointer mitk::AutoTuner::CreateVolume(const mitk::PixelType & pixelType, double tissue, double bone) const
+{
+    std::vector<double> values(static_cast<std::size_t>(m_Size[0]) * m_Size[1] * m_Size[2]);
+    const double radius = 0.45 * std::min(m_Size[0], m_Size[1]);
+    for (unsigned int z = 0; z < m_Size[2]; ++z)
+        for (unsigned int y = 0; y < m_Size[1]; ++y)
+            for (unsigned int x = 0; x < m_Size[0]; ++x)
+            {
+                const double r = std::hypot(x - m_Size[0] / 2., y - m_Size[1] / 2.);
+                double value = -1000.;
+                if (r < 0.2 * radius)
+                    value = bone;
+                else if (r < radius)
+                    value = tissue + (x + 3 * y + 7 * z) % 21 - 10;
+                values[(static_cast<std::size_t>(z) * m_Size[1] + y) * m_Size[0] + x] = value;
+            }
+
+    unsigned int dimensions[3] = { m_Size[0], m_Size[1], m_Size[2] };
+    mitk::Image::Pointer image = mitk::Image::New();
+    image->Initialize(pixelType, 3, dimensions);
+    mitk::ImageWriteAccessor accessor(image);
+    switch (pixelType.GetComponentType())
+    {
+    case itk::ImageIOBase::CHAR:
+        Fill<char>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::UCHAR:
+        Fill<unsigned char>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::SHORT:
+        Fill<short>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::USHORT:
+        Fill<unsigned short>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::INT:
+        Fill<int>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::UINT:
+        Fill<unsigned int>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::FLOAT:
+        Fill<float>(accessor.GetData(), values);
+        break;
+    case itk::ImageIOBase::DOUBLE:
+        Fill<double>(accessor.GetData(), values);
+        break;
+    default:
+        mitkThrow() << "The calibration volume can not be created as " << pixelType.GetComponentTypeAsString() << ".";
+    }
+    return image;
+}
+
+bool mitk::AutoTuner::Tune(AlphaBlendingTool & tool, ExecutionPlanner::Operation operation, const mitk::PixelType & pixelType,
+    TunedParameters & parameters) const
+{
+    if (!IsSupported(operation, pixelType))
+        return false;
+
+    mitk::Image::Pointer high = CreateVolume(pixelType, 40., 900.);
+    mitk::Image::Pointer low = CreateVolume(pixelType, 60., 1400.);
+    const double voxels = static_cast<double>(m_Size[0]) * m_Size[1] * m_Size[2];
+
+    const std::string key = ExecutionPlanner::GetTuningKey(operation, pixelType);
+    const auto& tuning = tool.GetTuning();
+    const auto previous = tuning.find(key);
+    const bool hadPrevious = previous != tuning.end();
+    const TunedParameters previousParameters = hadPrevious ? previous->second : TunedParameters();
+
+    // megavoxels per second of the fastest run, 0 if the candidate is refused
+    auto measure = [&](const TunedParameters& candidate)
+    {
+        tool.SetTunedParameters(operation, pixelType, candidate);
+        double best = 0.;
+        try
+        {
+            for (unsigned int repetition = 0; repetition <= m_Repetitions; ++repetition)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                mitk::Image::Pointer result = Run(tool, operation, high, low);
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (repetition > 0)
+                    best = std::max(best, voxels / 1e6 / std::max(seconds, 1e-9));
+            }
+        }
+        catch (const mitk::Exception&)
+        {
+            return 0.;
+        }
+        return best;
+    };
+
+    TunedParameters best;
+    best.m_SlabSize = 1;
+    best.m_Throughput = measure(best);
+    auto consider = [&](TunedParameters candidate)
+    {
+        candidate.m_Throughput = measure(candidate);
+        if (candidate.m_Throughput > best.m_Throughput)
+            best = candidate;
+    };
+
+    const unsigned int allThreads = std::max(1u, static_cast<unsigned int>(itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads()));
+    std::vector<unsigned int> threadCounts = m_ThreadCounts;
+    if (threadCounts.empty())
+    {
+        for (unsigned int threads = 1; threads < allThreads; threads *= 2)
+            threadCounts.push_back(threads);
+    }
+    for (unsigned int threads : threadCounts)
+    {
+        TunedParameters candidate = best;
+        candidate.m_NumberOfThreads = threads < allThreads ? threads : 0;
+        if (candidate.m_NumberOfThreads != best.m_NumberOfThreads)
+            consider(candidate);
+    }
+    if (ExecutionPlanner::IsStreamable(operation))
+    {
+        for (unsigned int slabSize : m_SlabSizes)
+        {
+            TunedParameters candidate = best;
+            candidate.m_SlabSize = std::min(slabSize, m_Size[2]);
+            if (candidate.m_SlabSize != best.m_SlabSize)
+                consider(candidate);
+        }
+    }
+
+    if (hadPrevious)
+        tool.SetTunedParameters(operation, pixelType, previousParameters);
+    else
+        tool.RemoveTunedParameters(operation, pixelType);
+
+    if (best.m_Throughput <= 0.)
+        return false;
+    parameters = best;
+    return true;
+}
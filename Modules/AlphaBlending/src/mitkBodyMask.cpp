@@ -0,0 +1,130 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkBodyMask.h"
+#include "mitkPixelTypeDispatch.h"
+#include "mitkSlabParallelFor.h"
+#include "mitkVoxelKernels.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkImageReadAccessor.h>
+
+mitk::BodyMask mitk::BodyMask::FromSegmentation(const mitk::Image * segmentation)
+{
+    if (nullptr == segmentation)
+    {
+        mitkThrow() << "No segmentation given for the body mask.";
+    }
+
+    const std::size_t sliceSize = VoxelKernels::GetSliceSize(segmentation);
+    const std::size_t numberOfVoxels = VoxelKernels::GetNumberOfVoxels(segmentation);
+    const unsigned int numberOfSlices = VoxelKernels::GetNumberOfSlabs(segmentation, 1);
+    std::vector<std::vector<Span>> sliceRuns(numberOfSlices);
+
+    mitk::ImageReadAccessor accessor(segmentation);
+    DispatchScalarPixelType(segmentation->GetPixelType(), [&](auto tag)
+    {
+        using TPixel = PixelTypeOfTag<decltype(tag)>;
+        const TPixel* mask = static_cast<const TPixel*>(accessor.GetData());
+
+        SlabParallelFor(numberOfSlices, [&](unsigned int slice)
+        {
+            auto& runs = sliceRuns[slice];
+            const std::size_t last = std::min(numberOfVoxels, (slice + 1) * sliceSize);
+            std::size_t i = slice * sliceSize;
+            while (i < last)
+            {
+                while (i < last && mask[i] == TPixel(0))
+                    ++i;
+                const std::size_t begin = i;
+                while (i < last && mask[i] != TPixel(0))
+                    ++i;
+                if (begin < i)
+                    runs.push_back({ begin, i });
+            }
+        });
+    });
+
+    return FromSliceRuns(sliceRuns, sliceSize, numberOfVoxels);
+}
+
+mitk::BodyMask mitk::BodyMask::FromThreshold(const mitk::Image * image, double threshold)
+{
+    if (nullptr == image)
+    {
+        mitkThrow() << "No image given for the body mask.";
+    }
+
+    const std::size_t rowSize = image->GetDimension(0);
+    const std::size_t sliceSize = VoxelKernels::GetSliceSize(image);
+    const std::size_t numberOfVoxels = VoxelKernels::GetNumberOfVoxels(image);
+    const unsigned int numberOfSlices = VoxelKernels::GetNumberOfSlabs(image, 1);
+    std::vector<std::vector<Span>> sliceRuns(numberOfSlices);
+
+    mitk::ImageReadAccessor accessor(image);
+    DispatchScalarPixelType(image->GetPixelType(), [&](auto tag)
+    {
+        using TPixel = PixelTypeOfTag<decltype(tag)>;
+        const TPixel* values = static_cast<const TPixel*>(accessor.GetData());
+
+        SlabParallelFor(numberOfSlices, [&](unsigned int slice)
+        {
+            auto& runs = sliceRuns[slice];
+            const std::size_t last = std::min(numberOfVoxels, (slice + 1) * sliceSize);
+            for (std::size_t row = slice * sliceSize; row < last; row += rowSize)
+            {
+                // one run from the first to the last tissue voxel of the row
+                std::size_t begin = row;
+                std::size_t end = row + rowSize;
+                while (begin < end && static_cast<double>(values[begin]) <= threshold)
+                    ++begin;
+                while (end > begin && static_cast<double>(values[end - 1]) <= threshold)
+                    --end;
+                if (begin < end)
+                    runs.push_back({ begin, end });
+            }
+        });
+    });
+
+    return FromSliceRuns(sliceRuns, sliceSize, numberOfVoxels);
+}
+
+mitk::BodyMask mitk::BodyMask::FromSliceRuns(std::vector<std::vector<Span>>& sliceRuns, std::size_t sliceSize, std::size_t numberOfVoxels)
+{
+    BodyMask mask;
+    mask.m_SliceSize = sliceSize;
+    mask.m_NumberOfVoxels = numberOfVoxels;
+    mask.m_SliceOffsets.reserve(sliceRuns.size() + 1);
+    mask.m_SliceOffsets.push_back(0);
+
+    for (auto& runs : sliceRuns)
+    {
+        mask.m_Spans.insert(mask.m_Spans.end(), runs.begin(), runs.end());
+        mask.m_SliceOffsets.push_back(mask.m_Spans.size());
+    }
+    return mask;
+}
+
+std::size_t mitk::BodyMask::GetNumberOfMaskedVoxels() const
+{
+    std::size_t n = 0;
+    for (const auto& span : m_Spans)
+        n += span.m_End - span.m_Begin;
+    return n;
+}
+
+void mitk::BodyMask::CheckCompatibility(const mitk::Image * image) const
+{
+    if (VoxelKernels::GetNumberOfVoxels(image) != m_NumberOfVoxels || VoxelKernels::GetSliceSize(image) != m_SliceSize)
+    {
+        mitkThrow() << "The body mask does not have the size of the image.";
+    }
+}
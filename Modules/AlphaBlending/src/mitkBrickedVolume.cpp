@@ -0,0 +1,494 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkBrickedVolume.h"
+#include "mitkPixelTypeDispatch.h"
+#include "mitkSlabParallelFor.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+#include <mitkSmartPointerProperty.h>
+
+#include <itk_zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    /**
+     * Node properties hold itk objects, so the bricked image of a compressed node is wrapped.
+     */
+    class BrickedVolumeHolder : public itk::Object
+    {
+    public:
+        mitkClassMacroItkParent(BrickedVolumeHolder, itk::Object);
+        itkFactorylessNewMacro(Self);
+
+        std::shared_ptr<const mitk::BrickedVolume> m_Volume;
+    };
+
+    mitk::PixelType GetScalarPixelType(const mitk::Image* image)
+    {
+        if (nullptr == image || image->GetDimension() < 2 || image->GetDimension() > 4)
+        {
+            mitkThrow() << "Only 2D to 4D images can be stored as bricks.";
+        }
+        if (image->GetPixelType().GetNumberOfComponents() != 1)
+        {
+            mitkThrow() << "Only scalar images can be stored as bricks, got " << image->GetPixelType().GetPixelTypeAsString() << ".";
+        }
+        return image->GetPixelType();
+    }
+
+    // byte k of voxel i goes to plane k at position i
+    void Shuffle(const unsigned char* voxels, std::size_t count, std::size_t pixelSize, unsigned char* planes)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            for (std::size_t k = 0; k < pixelSize; ++k)
+                planes[k * count + i] = voxels[i * pixelSize + k];
+    }
+
+    void Unshuffle(const unsigned char* planes, std::size_t count, std::size_t pixelSize, unsigned char* voxels)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            for (std::size_t k = 0; k < pixelSize; ++k)
+                voxels[i * pixelSize + k] = planes[k * count + i];
+    }
+
+    std::vector<unsigned char> Deflate(const std::vector<unsigned char>& planes, int level, std::size_t brick)
+    {
+        uLongf size = compressBound(static_cast<uLong>(planes.size()));
+        std::vector<unsigned char> compressed(size);
+        if (compress2(compressed.data(), &size, planes.data(), static_cast<uLong>(planes.size()), level) != Z_OK)
+        {
+            mitkThrow() << "Brick " << brick << " could not be compressed.";
+        }
+        compressed.resize(size);
+        compressed.shrink_to_fit();
+        return compressed;
+    }
+
+    void Inflate(const std::vector<unsigned char>& compressed, std::vector<unsigned char>& planes, std::size_t brick)
+    {
+        uLongf size = static_cast<uLongf>(planes.size());
+        if (uncompress(planes.data(), &size, compressed.data(), static_cast<uLong>(compressed.size())) != Z_OK || size != planes.size())
+        {
+            mitkThrow() << "Brick " << brick << " is corrupt.";
+        }
+    }
+
+    /**
+     * Multiples of step relative to their minimum as planes of width little endian bytes. Returns false if a value
+     * is not finite or the range does not fit into 4 bytes, width is 0 for a constant brick.
+     */
+    template <typename TPixel>
+    bool Quantize(const unsigned char* voxels, std::size_t count, double step, std::vector<unsigned char>& planes,
+        unsigned char& width, long long& minimum)
+    {
+        // integers up to 2^53 are exact in double
+        const double limit = 9e15;
+        std::vector<long long> quantized(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            TPixel pixel;
+            std::memcpy(&pixel, voxels + i * sizeof(TPixel), sizeof(TPixel));
+            const double value = std::round(static_cast<double>(pixel) / step);
+            if (!(std::abs(value) < limit))
+                return false;
+            quantized[i] = static_cast<long long>(value);
+        }
+        const auto range = std::minmax_element(quantized.begin(), quantized.end());
+        minimum = *range.first;
+        const unsigned long long span = static_cast<unsigned long long>(*range.second - minimum);
+        width = span == 0 ? 0 : span < (1ull << 8) ? 1 : span < (1ull << 16) ? 2 : span < (1ull << 32) ? 4 : 8;
+        if (width > 4)
+            return false;
+
+        planes.resize(count * width);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const unsigned long long offset = static_cast<unsigned long long>(quantized[i] - minimum);
+            for (unsigned int k = 0; k < width; ++k)
+                planes[k * count + i] = static_cast<unsigned char>(offset >> (8 * k));
+        }
+        return true;
+    }
+
+    template <typename TPixel>
+    void Dequantize(const std::vector<unsigned char>& planes, std::size_t count, double step, unsigned char width,
+        long long minimum, unsigned char* voxels)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            unsigned long long offset = 0;
+            for (unsigned int k = 0; k < width; ++k)
+                offset |= static_cast<unsigned long long>(planes[k * count + i]) << (8 * k);
+            const TPixel pixel = static_cast<TPixel>(static_cast<double>(minimum + static_cast<long long>(offset)) * step);
+            std::memcpy(voxels + i * sizeof(TPixel), &pixel, sizeof(TPixel));
+        }
+    }
+
+    bool IsFloatingPoint(const mitk::PixelType& pixelType)
+    {
+        return pixelType.GetComponentType() == itk::ImageIOBase::FLOAT || pixelType.GetComponentType() == itk::ImageIOBase::DOUBLE;
+    }
+}
+
+double mitk::BrickedVolume::Statistics::GetCompressionRatio() const
+{
+    const std::size_t resident = m_StoredBytes + m_CachedBytes;
+    return resident > 0 ? static_cast<double>(m_UncompressedBytes) / resident : 0.;
+}
+
+mitk::BrickedVolume::BrickedVolume(const mitk::Image * image, double quantizationStep, unsigned int brickSize, int compressionLevel)
+    : m_PixelType(GetScalarPixelType(image))
+{
+    if (brickSize == 0)
+    {
+        mitkThrow() << "The brick size has to be at least one voxel.";
+    }
+    if (!(quantizationStep >= 0.))
+    {
+        mitkThrow() << "The quantization step must not be negative.";
+    }
+    m_BrickSize = brickSize;
+    m_QuantizationStep = IsFloatingPoint(m_PixelType) ? quantizationStep : 0.;
+    m_Dimension = image->GetDimension();
+    for (unsigned int d = 0; d < m_Dimension; ++d)
+        m_Dimensions[d] = image->GetDimension(d);
+    m_TimeGeometry = image->GetTimeGeometry()->Clone();
+    m_Properties = image->GetPropertyList()->Clone();
+    for (unsigned int d = 0; d < 3; ++d)
+        m_BricksPerAxis[d] = (m_Dimensions[d] + brickSize - 1) / brickSize;
+    m_Bricks.resize(static_cast<std::size_t>(m_BricksPerAxis[0]) * m_BricksPerAxis[1] * m_BricksPerAxis[2] * m_Dimensions[3]);
+
+    const std::size_t pixelSize = m_PixelType.GetSize();
+    const std::size_t rowStride = m_Dimensions[0];
+    const std::size_t sliceStride = rowStride * m_Dimensions[1];
+    const std::size_t volumeStride = sliceStride * m_Dimensions[2];
+    mitk::ImageReadAccessor accessor(image);
+    const unsigned char* data = static_cast<const unsigned char*>(accessor.GetData());
+
+    SlabParallelFor(static_cast<unsigned int>(m_Bricks.size()), [&](unsigned int brick)
+    {
+        unsigned int origin[3];
+        unsigned int extent[3];
+        unsigned int timeStep;
+        GetBrickRegion(brick, origin, extent, timeStep);
+
+        // gather the brick into consecutive rows
+        const std::size_t count = static_cast<std::size_t>(extent[0]) * extent[1] * extent[2];
+        const std::size_t rowBytes = extent[0] * pixelSize;
+        std::vector<unsigned char> voxels(count * pixelSize);
+        for (unsigned int z = 0; z < extent[2]; ++z)
+            for (unsigned int y = 0; y < extent[1]; ++y)
+            {
+                const std::size_t offset = timeStep * volumeStride + (origin[2] + z) * sliceStride + (origin[1] + y) * rowStride + origin[0];
+                std::memcpy(&voxels[(static_cast<std::size_t>(z) * extent[1] + y) * rowBytes], data + offset * pixelSize, rowBytes);
+            }
+
+        Brick& stored = m_Bricks[brick];
+        std::vector<unsigned char> planes;
+        if (m_QuantizationStep > 0.)
+        {
+            bool quantized = false;
+            DispatchScalarPixelType(m_PixelType, [&](auto tag)
+            {
+                using TPixel = PixelTypeOfTag<decltype(tag)>;
+                quantized = Quantize<TPixel>(voxels.data(), count, m_QuantizationStep, planes, stored.m_Width, stored.m_Minimum);
+                if (quantized && stored.m_Width == 0)
+                {
+                    // constant after quantization, stored as the restored value
+                    stored.m_Constant = true;
+                    const TPixel pixel = static_cast<TPixel>(static_cast<double>(stored.m_Minimum) * m_QuantizationStep);
+                    stored.m_Data.resize(sizeof(TPixel));
+                    std::memcpy(stored.m_Data.data(), &pixel, sizeof(TPixel));
+                }
+            });
+            if (quantized)
+            {
+                if (!stored.m_Constant)
+                    stored.m_Data = Deflate(planes, compressionLevel, brick);
+                return;
+            }
+            stored.m_Width = 0;
+        }
+
+        bool constant = true;
+        for (std::size_t i = 1; i < count && constant; ++i)
+            constant = 0 == std::memcmp(&voxels[i * pixelSize], &voxels[0], pixelSize);
+        if (constant)
+        {
+            stored.m_Constant = true;
+            stored.m_Data.assign(voxels.begin(), voxels.begin() + pixelSize);
+            return;
+        }
+
+        planes.resize(voxels.size());
+        Shuffle(voxels.data(), count, pixelSize, planes.data());
+        stored.m_Data = Deflate(planes, compressionLevel, brick);
+    });
+}
+
+std::size_t mitk::BrickedVolume::GetBrickIndex(unsigned int x, unsigned int y, unsigned int z, unsigned int timeStep) const
+{
+    return ((static_cast<std::size_t>(timeStep) * m_BricksPerAxis[2] + z / m_BrickSize) * m_BricksPerAxis[1] + y / m_BrickSize) * m_BricksPerAxis[0]
+        + x / m_BrickSize;
+}
+
+void mitk::BrickedVolume::GetBrickRegion(std::size_t brick, unsigned int origin[3], unsigned int extent[3], unsigned int & timeStep) const
+{
+    std::size_t rest = brick;
+    for (unsigned int d = 0; d < 3; ++d)
+    {
+        const unsigned int index = static_cast<unsigned int>(rest % m_BricksPerAxis[d]);
+        rest /= m_BricksPerAxis[d];
+        origin[d] = index * m_BrickSize;
+        extent[d] = std::min(m_BrickSize, m_Dimensions[d] - origin[d]);
+    }
+    timeStep = static_cast<unsigned int>(rest);
+}
+
+void mitk::BrickedVolume::DecodeBrick(std::size_t brick, unsigned char * voxels) const
+{
+    unsigned int origin[3];
+    unsigned int extent[3];
+    unsigned int timeStep;
+    GetBrickRegion(brick, origin, extent, timeStep);
+    const std::size_t count = static_cast<std::size_t>(extent[0]) * extent[1] * extent[2];
+    const std::size_t pixelSize = m_PixelType.GetSize();
+
+    const Brick& stored = m_Bricks[brick];
+    if (stored.m_Constant)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            std::memcpy(voxels + i * pixelSize, stored.m_Data.data(), pixelSize);
+        return;
+    }
+
+    if (stored.m_Width > 0)
+    {
+        std::vector<unsigned char> planes(count * stored.m_Width);
+        Inflate(stored.m_Data, planes, brick);
+        DispatchScalarPixelType(m_PixelType, [&](auto tag)
+        {
+            using TPixel = PixelTypeOfTag<decltype(tag)>;
+            Dequantize<TPixel>(planes, count, m_QuantizationStep, stored.m_Width, stored.m_Minimum, voxels);
+        });
+        return;
+    }
+
+    std::vector<unsigned char> planes(count * pixelSize);
+    Inflate(stored.m_Data, planes, brick);
+    Unshuffle(planes.data(), count, pixelSize, voxels);
+}
+
+mitk::BrickedVolume::DecodedBrick mitk::BrickedVolume::GetDecodedBrick(std::size_t brick) const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+        auto cached = m_CacheIndex.find(brick);
+        if (cached != m_CacheIndex.end())
+        {
+            ++m_CacheHits;
+            m_Cache.splice(m_Cache.begin(), m_Cache, cached->second);
+            return cached->second->second;
+        }
+        ++m_CacheMisses;
+    }
+
+    // decompress outside of the lock, concurrent misses of the same brick decompress it twice
+    unsigned int origin[3];
+    unsigned int extent[3];
+    unsigned int timeStep;
+    GetBrickRegion(brick, origin, extent, timeStep);
+    auto voxels = std::make_shared<std::vector<unsigned char>>(static_cast<std::size_t>(extent[0]) * extent[1] * extent[2] * m_PixelType.GetSize());
+    DecodeBrick(brick, voxels->data());
+
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    if (m_CacheCapacity > 0 && m_CacheIndex.find(brick) == m_CacheIndex.end())
+    {
+        m_Cache.emplace_front(brick, voxels);
+        m_CacheIndex[brick] = m_Cache.begin();
+        TrimCacheLocked(m_CacheCapacity);
+    }
+    return voxels;
+}
+
+void mitk::BrickedVolume::TrimCacheLocked(std::size_t maximumBricks) const
+{
+    while (m_Cache.size() > maximumBricks)
+    {
+        m_CacheIndex.erase(m_Cache.back().first);
+        m_Cache.pop_back();
+    }
+}
+
+mitk::Image::Pointer mitk::BrickedVolume::ToImage() const
+{
+    auto image = mitk::Image::New();
+    image->Initialize(m_PixelType, m_Dimension, m_Dimensions);
+    image->SetTimeGeometry(m_TimeGeometry->Clone());
+    image->SetPropertyList(m_Properties->Clone());
+
+    const std::size_t pixelSize = m_PixelType.GetSize();
+    const std::size_t rowStride = m_Dimensions[0];
+    const std::size_t sliceStride = rowStride * m_Dimensions[1];
+    const std::size_t volumeStride = sliceStride * m_Dimensions[2];
+    mitk::ImageWriteAccessor accessor(image);
+    unsigned char* data = static_cast<unsigned char*>(accessor.GetData());
+
+    // every brick is decompressed once, so the cache is bypassed
+    SlabParallelFor(static_cast<unsigned int>(GetNumberOfBricks()), [&](unsigned int brick)
+    {
+        unsigned int origin[3];
+        unsigned int extent[3];
+        unsigned int timeStep;
+        GetBrickRegion(brick, origin, extent, timeStep);
+        const std::size_t rowBytes = extent[0] * pixelSize;
+        std::vector<unsigned char> voxels(static_cast<std::size_t>(extent[0]) * extent[1] * extent[2] * pixelSize);
+        DecodeBrick(brick, voxels.data());
+        for (unsigned int z = 0; z < extent[2]; ++z)
+            for (unsigned int y = 0; y < extent[1]; ++y)
+            {
+                const std::size_t offset = timeStep * volumeStride + (origin[2] + z) * sliceStride + (origin[1] + y) * rowStride + origin[0];
+                std::memcpy(data + offset * pixelSize, &voxels[(static_cast<std::size_t>(z) * extent[1] + y) * rowBytes], rowBytes);
+            }
+    });
+    return image;
+}
+
+double mitk::BrickedVolume::GetValue(unsigned int x, unsigned int y, unsigned int z, unsigned int timeStep) const
+{
+    if (x >= m_Dimensions[0] || y >= m_Dimensions[1] || z >= m_Dimensions[2] || timeStep >= m_Dimensions[3])
+    {
+        mitkThrow() << "Voxel (" << x << ", " << y << ", " << z << ") of time step " << timeStep << " is outside of the volume.";
+    }
+    const std::size_t brick = GetBrickIndex(x, y, z, timeStep);
+    unsigned int origin[3];
+    unsigned int extent[3];
+    unsigned int brickTimeStep;
+    GetBrickRegion(brick, origin, extent, brickTimeStep);
+    const std::size_t i = (static_cast<std::size_t>(z - origin[2]) * extent[1] + (y - origin[1])) * extent[0] + (x - origin[0]);
+
+    const DecodedBrick voxels = GetDecodedBrick(brick);
+    double value = 0.;
+    DispatchScalarPixelType(m_PixelType, [&](auto tag)
+    {
+        using TPixel = PixelTypeOfTag<decltype(tag)>;
+        TPixel pixel;
+        std::memcpy(&pixel, voxels->data() + i * sizeof(TPixel), sizeof(TPixel));
+        value = static_cast<double>(pixel);
+    });
+    return value;
+}
+
+void mitk::BrickedVolume::ReadSlice(unsigned int z, unsigned int timeStep, void * slice) const
+{
+    if (z >= m_Dimensions[2] || timeStep >= m_Dimensions[3])
+    {
+        mitkThrow() << "Slice " << z << " of time step " << timeStep << " is outside of the volume.";
+    }
+    const std::size_t pixelSize = m_PixelType.GetSize();
+    unsigned char* out = static_cast<unsigned char*>(slice);
+    for (unsigned int by = 0; by < m_BricksPerAxis[1]; ++by)
+        for (unsigned int bx = 0; bx < m_BricksPerAxis[0]; ++bx)
+        {
+            const std::size_t brick = GetBrickIndex(bx * m_BrickSize, by * m_BrickSize, z, timeStep);
+            unsigned int origin[3];
+            unsigned int extent[3];
+            unsigned int brickTimeStep;
+            GetBrickRegion(brick, origin, extent, brickTimeStep);
+            const std::size_t rowBytes = extent[0] * pixelSize;
+            const DecodedBrick voxels = GetDecodedBrick(brick);
+            for (unsigned int y = 0; y < extent[1]; ++y)
+            {
+                const std::size_t source = (static_cast<std::size_t>(z - origin[2]) * extent[1] + y) * rowBytes;
+                const std::size_t target = (static_cast<std::size_t>(origin[1] + y) * m_Dimensions[0] + origin[0]) * pixelSize;
+                std::memcpy(out + target, voxels->data() + source, rowBytes);
+            }
+        }
+}
+
+void mitk::BrickedVolume::SetCacheCapacity(std::size_t bricks)
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    m_CacheCapacity = bricks;
+    TrimCacheLocked(bricks);
+}
+
+std::size_t mitk::BrickedVolume::GetCacheCapacity() const
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    return m_CacheCapacity;
+}
+
+mitk::BrickedVolume::Statistics mitk::BrickedVolume::GetStatistics() const
+{
+    Statistics statistics;
+    statistics.m_Bricks = m_Bricks.size();
+    statistics.m_UncompressedBytes = static_cast<std::size_t>(m_Dimensions[0]) * m_Dimensions[1] * m_Dimensions[2] * m_Dimensions[3] * m_PixelType.GetSize();
+    statistics.m_StoredBytes = m_Bricks.size() * sizeof(Brick);
+    for (const auto& brick : m_Bricks)
+    {
+        statistics.m_StoredBytes += brick.m_Data.capacity();
+        if (brick.m_Constant)
+            ++statistics.m_ConstantBricks;
+    }
+
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    for (const auto& cached : m_Cache)
+        statistics.m_CachedBytes += cached.second->size();
+    statistics.m_CacheHits = m_CacheHits;
+    statistics.m_CacheMisses = m_CacheMisses;
+    return statistics;
+}
+
+const char* const mitk::BrickedVolume::NodePropertyName = "dect.bricked volume";
+
+void mitk::BrickedVolume::CompressNode(mitk::DataNode * node, double quantizationStep, unsigned int brickSize)
+{
+    const mitk::Image* image = nullptr != node ? dynamic_cast<const mitk::Image*>(node->GetData()) : nullptr;
+    if (nullptr == image)
+    {
+        mitkThrow() << "Only nodes holding an image can be compressed.";
+    }
+    auto holder = BrickedVolumeHolder::New();
+    holder->m_Volume = std::make_shared<BrickedVolume>(image, quantizationStep, brickSize);
+    // nothing is rendered until the image is restored, so the node is hidden first and showing it restores it
+    node->SetVisibility(false);
+    node->SetProperty(NodePropertyName, mitk::SmartPointerProperty::New(holder.GetPointer()));
+    node->SetData(nullptr);
+}
+
+mitk::Image* mitk::BrickedVolume::DecompressNode(mitk::DataNode * node)
+{
+    if (nullptr == node)
+        return nullptr;
+    const std::shared_ptr<const BrickedVolume> volume = GetFromNode(node);
+    if (nullptr != volume)
+    {
+        // the property goes first, so observers of the new data see a plain image node
+        node->GetPropertyList()->DeleteProperty(NodePropertyName);
+        node->SetData(volume->ToImage());
+    }
+    return dynamic_cast<mitk::Image*>(node->GetData());
+}
+
+std::shared_ptr<const mitk::BrickedVolume> mitk::BrickedVolume::GetFromNode(const mitk::DataNode * node)
+{
+    auto property = nullptr != node ? dynamic_cast<mitk::SmartPointerProperty*>(node->GetProperty(NodePropertyName, nullptr, false)) : nullptr;
+    auto holder = nullptr != property ? dynamic_cast<BrickedVolumeHolder*>(property->GetSmartPointer().GetPointer()) : nullptr;
+    return nullptr != holder ? holder->m_Volume : nullptr;
+}
@@ -0,0 +1,197 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkBufferPool.h"
+
+#include <mitkExceptionMacro.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    const std::size_t PageSize = 4096;
+    const std::size_t HugePageSize = std::size_t(2) << 20;
+}
+
+mitk::BufferPool::Lease::Lease(std::size_t bytes)
+    : m_Buffer(BufferPool::GetInstance().Acquire(bytes))
+{
+}
+
+mitk::BufferPool::Lease::~Lease()
+{
+    BufferPool::GetInstance().Release(m_Buffer);
+}
+
+mitk::BufferPool & mitk::BufferPool::GetInstance()
+{
+    // never destroyed, images holding pooled buffers may outlive static destruction
+    static BufferPool* instance = new BufferPool();
+    return *instance;
+}
+
+std::size_t mitk::BufferPool::GetSizeClass(std::size_t bytes)
+{
+    if (bytes <= PageSize)
+        return PageSize;
+
+    // eight classes per power of two
+    unsigned int highestBit = 0;
+    for (std::size_t value = bytes - 1; value > 1; value >>= 1)
+        ++highestBit;
+    const std::size_t step = std::max(PageSize, std::size_t(1) << (highestBit >= 3 ? highestBit - 3 : 0));
+    return (bytes + step - 1) / step * step;
+}
+
+mitk::BufferPool::Buffer mitk::BufferPool::Acquire(std::size_t bytes)
+{
+    Buffer buffer;
+    buffer.m_Size = GetSizeClass(bytes);
+    bool hugePages = false;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ++m_Statistics.m_Requests;
+        m_Statistics.m_BytesInUse += buffer.m_Size;
+
+        auto idle = m_Idle.find(buffer.m_Size);
+        if (idle != m_Idle.end() && !idle->second.empty())
+        {
+            buffer.m_Data = idle->second.back();
+            buffer.m_Reused = true;
+            idle->second.pop_back();
+            m_Statistics.m_BytesPooled -= buffer.m_Size;
+            ++m_Statistics.m_Hits;
+            m_Statistics.m_PageFaultsAvoided += buffer.m_Size / PageSize;
+            return buffer;
+        }
+        hugePages = m_UseHugePages;
+    }
+
+    // allocate outside of the lock, other threads may still take idle buffers
+    buffer.m_Data = AllocateAligned(buffer.m_Size, hugePages);
+    if (nullptr == buffer.m_Data)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Statistics.m_BytesInUse -= buffer.m_Size;
+        // idle buffers of other classes may be in the way, free them and try once more
+        TrimLocked(0);
+        buffer.m_Data = AllocateAligned(buffer.m_Size, hugePages);
+        if (nullptr == buffer.m_Data)
+        {
+            mitkThrow() << "Could not allocate a buffer of " << buffer.m_Size << " bytes.";
+        }
+        m_Statistics.m_BytesInUse += buffer.m_Size;
+    }
+    return buffer;
+}
+
+void mitk::BufferPool::Release(const Buffer & buffer)
+{
+    if (nullptr == buffer.m_Data)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Statistics.m_BytesInUse -= buffer.m_Size;
+    m_Idle[buffer.m_Size].push_back(buffer.m_Data);
+    m_Statistics.m_BytesPooled += buffer.m_Size;
+    if (m_Statistics.m_BytesPooled > m_Capacity)
+        TrimLocked(m_Capacity);
+}
+
+void mitk::BufferPool::Trim(std::size_t maximumBytes)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    TrimLocked(maximumBytes);
+}
+
+void mitk::BufferPool::TrimLocked(std::size_t maximumBytes)
+{
+    for (auto idle = m_Idle.rbegin(); idle != m_Idle.rend() && m_Statistics.m_BytesPooled > maximumBytes; ++idle)
+    {
+        while (!idle->second.empty() && m_Statistics.m_BytesPooled > maximumBytes)
+        {
+            FreeAligned(idle->second.back());
+            idle->second.pop_back();
+            m_Statistics.m_BytesPooled -= idle->first;
+            m_Statistics.m_BytesTrimmed += idle->first;
+        }
+    }
+}
+
+void mitk::BufferPool::SetCapacity(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Capacity = bytes;
+    TrimLocked(m_Capacity);
+}
+
+std::size_t mitk::BufferPool::GetCapacity() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Capacity;
+}
+
+void mitk::BufferPool::SetCapacityForMemoryBudget(std::size_t memoryBudget)
+{
+    SetCapacity(memoryBudget > 0 ? memoryBudget / 8 : DefaultCapacity);
+}
+
+void mitk::BufferPool::SetUseHugePages(bool useHugePages)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_UseHugePages = useHugePages;
+}
+
+bool mitk::BufferPool::GetUseHugePages() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_UseHugePages;
+}
+
+mitk::BufferPool::Statistics mitk::BufferPool::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Statistics;
+}
+
+void * mitk::BufferPool::AllocateAligned(std::size_t bytes, bool hugePages)
+{
+    const bool huge = hugePages && bytes >= HugePageSize;
+    const std::size_t alignment = huge ? HugePageSize : Alignment;
+#ifdef _WIN32
+    return _aligned_malloc(bytes, alignment);
+#else
+    void* data = nullptr;
+    if (posix_memalign(&data, alignment, bytes) != 0)
+        return nullptr;
+#ifdef MADV_HUGEPAGE
+    if (huge)
+        madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+    return data;
+#endif
+}
+
+void mitk::BufferPool::FreeAligned(void * data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
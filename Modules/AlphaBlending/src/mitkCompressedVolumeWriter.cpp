@@ -0,0 +1,258 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkCompressedVolumeWriter.h"
+#include "mitkSlabParallelFor.h"
+
+#include <mitkImageReadAccessor.h>
+#include <mitkPixelTypeMultiplex.h>
+#include <mitkExceptionMacro.h>
+#include <mitkStringProperty.h>
+
+#include <itk_zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+    struct ChunkJob
+    {
+        const void* m_Source;
+        std::size_t m_First;
+        std::size_t m_Count;
+        mitk::CompressedVolumeWriter::StorageType m_StorageType;
+        double m_RescaleSlope;
+        double m_RescaleIntercept;
+        std::vector<unsigned char>* m_Raw;
+    };
+
+    template <typename TStorage, typename TPixel>
+    void Quantize(const TPixel* in, TStorage* out, std::size_t count, double slope, double intercept)
+    {
+        const double inverseSlope = 1. / slope;
+        const double lower = static_cast<double>(std::numeric_limits<TStorage>::min());
+        const double upper = static_cast<double>(std::numeric_limits<TStorage>::max());
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const double value = std::floor((static_cast<double>(in[i]) - intercept) * inverseSlope + 0.5);
+            // casting NaN or out of range values is undefined, NaN is stored as the lowest value
+            if (!(value > lower))
+                out[i] = std::numeric_limits<TStorage>::min();
+            else if (value < upper)
+                out[i] = static_cast<TStorage>(value);
+            else
+                out[i] = std::numeric_limits<TStorage>::max();
+        }
+    }
+
+    template <typename TPixel>
+    void QuantizeChunk(const mitk::PixelType, ChunkJob& job)
+    {
+        const TPixel* in = static_cast<const TPixel*>(job.m_Source) + job.m_First;
+        if (job.m_StorageType == mitk::CompressedVolumeWriter::StorageType::Int16)
+        {
+            job.m_Raw->resize(job.m_Count * sizeof(short));
+            Quantize(in, reinterpret_cast<short*>(job.m_Raw->data()), job.m_Count, job.m_RescaleSlope, job.m_RescaleIntercept);
+        }
+        else
+        {
+            job.m_Raw->resize(job.m_Count * sizeof(unsigned short));
+            Quantize(in, reinterpret_cast<unsigned short*>(job.m_Raw->data()), job.m_Count, job.m_RescaleSlope, job.m_RescaleIntercept);
+        }
+    }
+
+    bool IsLittleEndian()
+    {
+        const unsigned short probe = 1;
+        return *reinterpret_cast<const unsigned char*>(&probe) == 1;
+    }
+}
+
+mitk::CompressedVolumeWriter mitk::CompressedVolumeWriter::ForHU()
+{
+    CompressedVolumeWriter writer;
+    writer.m_StorageType = StorageType::Int16;
+    writer.m_RescaleSlope = 1.;
+    writer.m_RescaleIntercept = 0.;
+    return writer;
+}
+
+mitk::CompressedVolumeWriter mitk::CompressedVolumeWriter::ForRED()
+{
+    CompressedVolumeWriter writer;
+    writer.m_StorageType = StorageType::UInt16;
+    writer.m_RescaleSlope = 1e-4;
+    writer.m_RescaleIntercept = 0.;
+    return writer;
+}
+
+const char* const mitk::CompressedVolumeWriter::QuantityPropertyName = "dect.quantity";
+
+mitk::CompressedVolumeWriter mitk::CompressedVolumeWriter::ForImage(const mitk::Image * image)
+{
+    auto property = nullptr != image ? dynamic_cast<mitk::StringProperty*>(image->GetProperty(QuantityPropertyName).GetPointer()) : nullptr;
+    const std::string quantity = nullptr != property ? property->GetValueAsString() : "HU";
+    return quantity == "RED" || quantity == "SPR" ? ForRED() : ForHU();
+}
+
+std::vector<unsigned char> mitk::CompressedVolumeWriter::CompressChunk(const unsigned char * data, std::size_t size, int level)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+
+    // window bits of 15 + 16 select the gzip wrapper
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        mitkThrow() << "Could not initialize the zlib compression.";
+    }
+
+    std::vector<unsigned char> compressed(deflateBound(&stream, static_cast<uLong>(size)));
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = compressed.data();
+    stream.avail_out = static_cast<uInt>(compressed.size());
+
+    const int result = deflate(&stream, Z_FINISH);
+    const std::size_t compressedSize = stream.total_out;
+    deflateEnd(&stream);
+
+    if (result != Z_STREAM_END)
+    {
+        mitkThrow() << "Compression of a chunk failed with zlib error " << result;
+    }
+
+    compressed.resize(compressedSize);
+    return compressed;
+}
+
+std::string mitk::CompressedVolumeWriter::CreateHeader(const mitk::Image * image) const
+{
+    const unsigned int dimension = image->GetDimension();
+    const unsigned int spatialDimension = std::min(dimension, 3u);
+    const mitk::BaseGeometry* geometry = image->GetGeometry();
+    const auto matrix = geometry->GetIndexToWorldTransform()->GetMatrix();
+    const mitk::Point3D origin = geometry->GetOrigin();
+
+    std::ostringstream header;
+    header.precision(17);
+    header << "NRRD0004\n";
+    header << "# Complete NRRD file format specification at:\n";
+    header << "# http://teem.sourceforge.net/nrrd/format.html\n";
+    header << "type: " << (m_StorageType == StorageType::Int16 ? "short" : "unsigned short") << "\n";
+    header << "dimension: " << dimension << "\n";
+    header << "space: left-posterior-superior\n";
+
+    header << "sizes:";
+    for (unsigned int d = 0; d < dimension; ++d)
+        header << " " << image->GetDimension(d);
+    header << "\n";
+
+    header << "space directions:";
+    for (unsigned int d = 0; d < spatialDimension; ++d)
+        header << " (" << matrix[0][d] << "," << matrix[1][d] << "," << matrix[2][d] << ")";
+    if (dimension > 3)
+        header << " none";
+    header << "\n";
+
+    header << "kinds:";
+    for (unsigned int d = 0; d < spatialDimension; ++d)
+        header << " domain";
+    if (dimension > 3)
+        header << " time";
+    header << "\n";
+
+    header << "endian: " << (IsLittleEndian() ? "little" : "big") << "\n";
+    header << "encoding: gzip\n";
+    header << "space origin: (" << origin[0] << "," << origin[1] << "," << origin[2] << ")\n";
+    header << "RescaleSlope:=" << m_RescaleSlope << "\n";
+    header << "RescaleIntercept:=" << m_RescaleIntercept << "\n";
+    header << "\n";
+    return header.str();
+}
+
+void mitk::CompressedVolumeWriter::Write(const mitk::Image * image, const std::string & filename) const
+{
+    if (nullptr == image || image->GetDimension() < 2 || image->GetDimension() > 4)
+    {
+        mitkThrow() << "Only 2D to 4D images can be written by mitk::CompressedVolumeWriter.";
+    }
+    if (image->GetPixelType().GetNumberOfComponents() != 1)
+    {
+        mitkThrow() << "Only scalar images can be written by mitk::CompressedVolumeWriter.";
+    }
+    if (m_RescaleSlope == 0.)
+    {
+        mitkThrow() << "Rescale slope must not be zero.";
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        mitkThrow() << "Could not open " << filename << " for writing.";
+    }
+    file << CreateHeader(image);
+
+    mitk::ImageReadAccessor accessor(image);
+    const void* source = accessor.GetData();
+    const mitk::PixelType pixelType = image->GetPixelType();
+
+    std::size_t numberOfVoxels = 1;
+    for (unsigned int d = 0; d < image->GetDimension(); ++d)
+        numberOfVoxels *= image->GetDimension(d);
+
+    const std::size_t voxelsPerChunk = std::max<std::size_t>(1, m_ChunkSize / sizeof(short));
+    const std::size_t numberOfChunks = (numberOfVoxels + voxelsPerChunk - 1) / voxelsPerChunk;
+
+    // chunks are compressed in batches to bound the memory held by compressed data waiting to be written in order
+    const std::size_t batchSize = 64;
+    for (std::size_t batchStart = 0; batchStart < numberOfChunks; batchStart += batchSize)
+    {
+        const std::size_t count = std::min(batchSize, numberOfChunks - batchStart);
+        std::vector<std::vector<unsigned char>> compressed(count);
+        std::vector<std::string> errors(count);
+
+        SlabParallelFor(static_cast<unsigned int>(count), [&](unsigned int c)
+        {
+            const std::size_t first = (batchStart + c) * voxelsPerChunk;
+            std::vector<unsigned char> raw;
+            ChunkJob job = { source, first, std::min(voxelsPerChunk, numberOfVoxels - first), m_StorageType, m_RescaleSlope, m_RescaleIntercept, &raw };
+            try
+            {
+                mitkPixelTypeMultiplex1(QuantizeChunk, pixelType, job);
+                compressed[c] = CompressChunk(raw.data(), raw.size(), m_CompressionLevel);
+            }
+            catch (const std::exception& e)
+            {
+                errors[c] = e.what();
+            }
+        });
+
+        for (std::size_t c = 0; c < count; ++c)
+        {
+            if (!errors[c].empty())
+            {
+                mitkThrow() << "Could not write " << filename << ": " << errors[c];
+            }
+            file.write(reinterpret_cast<const char*>(compressed[c].data()), compressed[c].size());
+        }
+    }
+
+    if (!file)
+    {
+        mitkThrow() << "Writing " << filename << " failed.";
+    }
+}
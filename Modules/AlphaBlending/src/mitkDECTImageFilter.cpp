@@ -0,0 +1,140 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkDECTImageFilter.h"
+#include "mitkBufferPool.h"
+#include "mitkSlabParallelFor.h"
+#include "mitkVoxelKernels.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+
+#include <memory>
+
+namespace
+{
+    // view of numberOfSlices slices of an input starting at the data of an image data item
+    mitk::DECTKernels::BufferView GetSlicesView(const mitk::Image* input, const void* data, unsigned int numberOfSlices)
+    {
+        mitk::DECTKernels::BufferView view = mitk::VoxelKernels::GetBufferView(input, data);
+        view.m_Size[2] = numberOfSlices;
+        view.m_Size[3] = 1;
+        return view;
+    }
+}
+
+mitk::DECTImageFilter::DECTImageFilter(unsigned int numberOfInputs)
+    : m_NumberOfInputs(numberOfInputs)
+{
+    this->SetNumberOfRequiredInputs(numberOfInputs);
+}
+
+mitk::DECTImageFilter::~DECTImageFilter()
+{
+}
+
+void mitk::DECTImageFilter::GenerateInputRequestedRegion()
+{
+    // voxel wise kernels need exactly the slices and time steps requested from the output
+    for (unsigned int i = 0; i < this->GetNumberOfInputs(); ++i)
+    {
+        mitk::Image* input = const_cast<mitk::Image*>(this->GetInput(i));
+        if (nullptr != input)
+        {
+            input->SetRequestedRegion(this->GetOutput());
+        }
+    }
+}
+
+void mitk::DECTImageFilter::GenerateOutputInformation()
+{
+    const mitk::Image* reference = this->GetInput(0);
+    for (unsigned int i = 0; i < m_NumberOfInputs; ++i)
+    {
+        const mitk::Image* input = this->GetInput(i);
+        if (nullptr == input)
+        {
+            mitkThrow() << this->GetNameOfClass() << " needs " << m_NumberOfInputs << " input images, input " << i << " is not set.";
+        }
+        if (input->GetPixelType().GetNumberOfComponents() != 1)
+        {
+            mitkThrow() << this->GetNameOfClass() << " needs scalar images, got " << input->GetPixelType().GetPixelTypeAsString();
+        }
+        bool sameSize = input->GetDimension() == reference->GetDimension();
+        for (unsigned int d = 0; d < 4 && sameSize; ++d)
+            sameSize = input->GetDimension(d) == reference->GetDimension(d);
+        if (!sameSize)
+        {
+            mitkThrow() << "Images of different size are not supported by " << this->GetNameOfClass() << ".";
+        }
+    }
+
+    mitk::Image* output = this->GetOutput();
+    output->Initialize(mitk::MakeScalarPixelType<double>(), reference->GetDimension(), reference->GetDimensions());
+    output->SetTimeGeometry(reference->GetTimeGeometry()->Clone());
+}
+
+void mitk::DECTImageFilter::GenerateData()
+{
+    mitk::Image* output = this->GetOutput();
+    const mitk::SlicedData::RegionType region = output->GetRequestedRegion();
+    const unsigned int firstSlice = static_cast<unsigned int>(region.GetIndex(2));
+    const unsigned int numberOfSlices = static_cast<unsigned int>(region.GetSize(2));
+    const unsigned int firstTimeStep = static_cast<unsigned int>(region.GetIndex(3));
+    const unsigned int numberOfTimeSteps = static_cast<unsigned int>(region.GetSize(3));
+    const std::size_t sizeX = output->GetDimension(0);
+    const std::size_t sizeY = output->GetDimension(1);
+    const bool wholeVolumes = 0 == firstSlice && numberOfSlices == output->GetDimension(2);
+
+    for (unsigned int t = firstTimeStep; t < firstTimeStep + numberOfTimeSteps; ++t)
+    {
+        if (wholeVolumes)
+        {
+            // the kernel parallelizes over the slabs of the volume and writes the output in place
+            std::vector<std::unique_ptr<mitk::ImageReadAccessor>> accessors;
+            std::vector<DECTKernels::BufferView> inputs;
+            for (unsigned int i = 0; i < m_NumberOfInputs; ++i)
+            {
+                const mitk::Image* input = this->GetInput(i);
+                accessors.emplace_back(new mitk::ImageReadAccessor(input, input->GetVolumeData(t).GetPointer()));
+                inputs.push_back(GetSlicesView(input, accessors.back()->GetData(), numberOfSlices));
+            }
+            mitk::ImageWriteAccessor outputAccessor(output, output->GetVolumeData(t).GetPointer());
+            this->GenerateSlices(inputs, DECTKernels::BufferView(outputAccessor.GetData(), mitkDECTDouble, sizeX, sizeY, numberOfSlices));
+            continue;
+        }
+
+        // only the requested slices are read and set, the image data items are fetched before the parallel part
+        std::vector<std::unique_ptr<mitk::ImageReadAccessor>> accessors;
+        std::vector<std::vector<DECTKernels::BufferView>> inputs(numberOfSlices);
+        for (unsigned int s = 0; s < numberOfSlices; ++s)
+        {
+            for (unsigned int i = 0; i < m_NumberOfInputs; ++i)
+            {
+                const mitk::Image* input = this->GetInput(i);
+                accessors.emplace_back(new mitk::ImageReadAccessor(input, input->GetSliceData(firstSlice + s, t).GetPointer()));
+                inputs[s].push_back(GetSlicesView(input, accessors.back()->GetData(), 1));
+            }
+        }
+        const std::size_t sliceSize = sizeX * sizeY;
+        mitk::BufferPool::Lease slicesBuffer(sliceSize * numberOfSlices * sizeof(double));
+        double* slices = slicesBuffer.Get<double>();
+        SlabParallelFor(numberOfSlices, [&](unsigned int s)
+        {
+            this->GenerateSlices(inputs[s], DECTKernels::BufferView(slices + s * sliceSize, mitkDECTDouble, sizeX, sizeY));
+        });
+        for (unsigned int s = 0; s < numberOfSlices; ++s)
+        {
+            output->SetSlice(slices + s * sliceSize, firstSlice + s, t);
+        }
+    }
+}
@@ -0,0 +1,769 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkDECTKernels.h"
+#include "mitkBufferPool.h"
+#include "mitkFixedPointAlphaBlending.h"
+#include "mitkSlabParallelFor.h"
+
+#include <mitkExceptionMacro.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    thread_local std::string LastError;
+
+    template <typename TPixel>
+    void LoadRowOf(const char* source, std::ptrdiff_t stride, std::size_t n, double* row)
+    {
+        TPixel value;
+        if (stride == static_cast<std::ptrdiff_t>(sizeof(TPixel)))
+        {
+            // constant stride, the loop vectorizes
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                std::memcpy(&value, source + i * sizeof(TPixel), sizeof(TPixel));
+                row[i] = static_cast<double>(value);
+            }
+            return;
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(&value, source + static_cast<std::ptrdiff_t>(i) * stride, sizeof(TPixel));
+            row[i] = static_cast<double>(value);
+        }
+    }
+
+    template <typename TPixel>
+    TPixel ConvertValue(double value, std::true_type /*isInteger*/)
+    {
+        if (std::isnan(value))
+            return TPixel(0);
+        value = std::round(value);
+        value = std::max(value, static_cast<double>(std::numeric_limits<TPixel>::lowest()));
+        value = std::min(value, static_cast<double>(std::numeric_limits<TPixel>::max()));
+        return static_cast<TPixel>(value);
+    }
+
+    template <typename TPixel>
+    TPixel ConvertValue(double value, std::false_type /*isInteger*/)
+    {
+        return static_cast<TPixel>(value);
+    }
+
+    template <typename TPixel>
+    void StoreRowOf(const double* row, std::size_t n, char* target, std::ptrdiff_t stride)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const TPixel value = ConvertValue<TPixel>(row[i], std::is_integral<TPixel>());
+            std::memcpy(target + static_cast<std::ptrdiff_t>(i) * stride, &value, sizeof(TPixel));
+        }
+    }
+
+    template <typename TFunction>
+    void DispatchPixelType(mitkDECTPixelType pixelType, const TFunction& function)
+    {
+        switch (pixelType)
+        {
+        case mitkDECTInt8:
+            function(std::int8_t());
+            break;
+        case mitkDECTUInt8:
+            function(std::uint8_t());
+            break;
+        case mitkDECTInt16:
+            function(std::int16_t());
+            break;
+        case mitkDECTUInt16:
+            function(std::uint16_t());
+            break;
+        case mitkDECTInt32:
+            function(std::int32_t());
+            break;
+        case mitkDECTUInt32:
+            function(std::uint32_t());
+            break;
+        case mitkDECTInt64:
+            function(std::int64_t());
+            break;
+        case mitkDECTUInt64:
+            function(std::uint64_t());
+            break;
+        case mitkDECTFloat:
+            function(float());
+            break;
+        case mitkDECTDouble:
+            function(double());
+            break;
+        default:
+            mitkThrow() << "Unknown raw buffer pixel type " << static_cast<int>(pixelType) << ".";
+        }
+    }
+
+    /**
+     * A buffer with resolved strides, rows are addressed by y, z and t.
+     */
+    struct Row
+    {
+        const mitk::DECTKernels::BufferView* m_View;
+        std::ptrdiff_t m_Strides[4];
+
+        explicit Row(const mitk::DECTKernels::BufferView& view) : m_View(&view) { view.GetStrides(m_Strides); }
+
+        char* GetAddress(std::size_t y, std::size_t z, std::size_t t) const
+        {
+            return static_cast<char*>(m_View->m_Data) + static_cast<std::ptrdiff_t>(y) * m_Strides[1]
+                + static_cast<std::ptrdiff_t>(z) * m_Strides[2] + static_cast<std::ptrdiff_t>(t) * m_Strides[3];
+        }
+
+        void Load(std::size_t y, std::size_t z, std::size_t t, double* row) const
+        {
+            const char* source = GetAddress(y, z, t);
+            const std::size_t n = m_View->m_Size[0];
+            DispatchPixelType(m_View->m_PixelType, [&](auto tag) { LoadRowOf<decltype(tag)>(source, m_Strides[0], n, row); });
+        }
+
+        void Store(const double* row, std::size_t y, std::size_t z, std::size_t t) const
+        {
+            char* target = GetAddress(y, z, t);
+            const std::size_t n = m_View->m_Size[0];
+            DispatchPixelType(m_View->m_PixelType, [&](auto tag) { StoreRowOf<decltype(tag)>(row, n, target, m_Strides[0]); });
+        }
+    };
+
+    void CheckBuffer(const mitk::DECTKernels::BufferView& buffer, const char* name)
+    {
+        if (nullptr == buffer.m_Data)
+        {
+            mitkThrow() << "The " << name << " buffer is null.";
+        }
+        if (buffer.m_PixelType < mitkDECTInt8 || buffer.m_PixelType > mitkDECTDouble)
+        {
+            mitkThrow() << "The " << name << " buffer has the unknown pixel type " << static_cast<int>(buffer.m_PixelType) << ".";
+        }
+        if (0 == buffer.GetNumberOfVoxels())
+        {
+            mitkThrow() << "The " << name << " buffer is empty.";
+        }
+    }
+
+    void CheckSameSize(const mitk::DECTKernels::BufferView& a, const mitk::DECTKernels::BufferView& b, const char* name)
+    {
+        if (!std::equal(a.m_Size, a.m_Size + 4, b.m_Size))
+        {
+            mitkThrow() << "The " << name << " buffer has the size " << b.m_Size[0] << "|" << b.m_Size[1] << "|" << b.m_Size[2] << "|"
+                        << b.m_Size[3] << ", expected " << a.m_Size[0] << "|" << a.m_Size[1] << "|" << a.m_Size[2] << "|" << a.m_Size[3] << ".";
+        }
+    }
+
+    /**
+     * Trilinear interpolation in the first time step, positions outside of the buffer are clamped to its border.
+     */
+    template <typename TPixel>
+    void SampleOf(const mitk::DECTKernels::BufferView& buffer, const std::ptrdiff_t strides[4], const double* positions, std::size_t count,
+        double* values)
+    {
+        const char* base = static_cast<const char*>(buffer.m_Data);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::ptrdiff_t offsets[3][2];
+            double weights[3];
+            for (int d = 0; d < 3; ++d)
+            {
+                const double maximum = static_cast<double>(buffer.m_Size[d] - 1);
+                const double position = positions[3 * i + d];
+                // NaN is clamped to 0 as well
+                const double clamped = position > 0. ? std::min(position, maximum) : 0.;
+                const double lower = std::floor(clamped);
+                const std::ptrdiff_t index = static_cast<std::ptrdiff_t>(lower);
+                weights[d] = clamped - lower;
+                offsets[d][0] = index * strides[d];
+                offsets[d][1] = std::min<std::ptrdiff_t>(index + 1, static_cast<std::ptrdiff_t>(buffer.m_Size[d]) - 1) * strides[d];
+            }
+
+            double value = 0.;
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                const int cx = corner & 1;
+                const int cy = (corner >> 1) & 1;
+                const int cz = corner >> 2;
+                const double weight = (cx ? weights[0] : 1. - weights[0]) * (cy ? weights[1] : 1. - weights[1]) * (cz ? weights[2] : 1. - weights[2]);
+                if (0. == weight)
+                    continue;
+                TPixel voxel;
+                std::memcpy(&voxel, base + offsets[0][cx] + offsets[1][cy] + offsets[2][cz], sizeof(TPixel));
+                value += weight * static_cast<double>(voxel);
+            }
+            values[i] = value;
+        }
+    }
+
+    /**
+     * Fills an input row which is not read from a buffer of the output size, e.g. a resampled one. scratch belongs to
+     * the slab and holds the scratch size given to ForEachRow, e.g. for the sample positions of a row.
+     */
+    typedef std::function<void(std::size_t y, std::size_t z, std::size_t t, std::size_t n, double* row, double* scratch)> RowSource;
+
+    /**
+     * Runs rowFunction(inputRows, outputRows, n) for every row, the input rows are converted to double before and
+     * the output rows are converted to the output pixel types after it. The row of an optional row source follows
+     * the input rows. The rows and the scratch of a slab are leased from mitk::BufferPool.
+     */
+    template <typename TRowFunction>
+    void ForEachRow(const std::vector<const mitk::DECTKernels::BufferView*>& inputs, const std::vector<const mitk::DECTKernels::BufferView*>& outputs,
+        unsigned int slabSize, const mitk::DECTKernels::SlabCallback& slabDone, const TRowFunction& rowFunction,
+        const RowSource& rowSource = RowSource(), std::size_t scratchSize = 0)
+    {
+        if (inputs.empty() || outputs.empty())
+        {
+            mitkThrow() << "Raw buffer kernels need at least one input and one output buffer.";
+        }
+        const mitk::DECTKernels::BufferView& reference = *outputs.front();
+        for (std::size_t i = 0; i < outputs.size(); ++i)
+        {
+            const std::string name = "output " + std::to_string(i + 1);
+            CheckBuffer(*outputs[i], name.c_str());
+            CheckSameSize(reference, *outputs[i], name.c_str());
+        }
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            const std::string name = "input " + std::to_string(i + 1);
+            CheckBuffer(*inputs[i], name.c_str());
+            CheckSameSize(reference, *inputs[i], name.c_str());
+        }
+
+        slabSize = std::max(1u, slabSize);
+        const std::size_t* size = reference.m_Size;
+        const std::size_t slabsPerTimeStep = (size[2] + slabSize - 1) / slabSize;
+        const std::size_t sliceSize = size[0] * size[1];
+
+        std::vector<Row> inputRows;
+        for (const auto* input : inputs)
+            inputRows.emplace_back(*input);
+        std::vector<Row> outputRows;
+        for (const auto* output : outputs)
+            outputRows.emplace_back(*output);
+
+        mitk::SlabParallelFor(mitk::DECTKernels::GetNumberOfSlabs(reference, slabSize), [&](unsigned int slab)
+        {
+            const std::size_t t = slab / slabsPerTimeStep;
+            const std::size_t firstSlice = (slab % slabsPerTimeStep) * slabSize;
+            const std::size_t lastSlice = std::min<std::size_t>(firstSlice + slabSize, size[2]);
+
+            const std::size_t rowsSize = (inputRows.size() + (rowSource ? 1 : 0) + outputRows.size()) * size[0];
+            mitk::BufferPool::Lease buffer((rowsSize + scratchSize) * sizeof(double));
+            double* rows = buffer.Get<double>();
+            double* scratch = rows + rowsSize;
+            std::vector<const double*> in(inputRows.size() + (rowSource ? 1 : 0));
+            std::vector<double*> out(outputRows.size());
+            for (std::size_t i = 0; i < in.size(); ++i)
+                in[i] = rows + i * size[0];
+            for (std::size_t i = 0; i < out.size(); ++i)
+                out[i] = rows + (in.size() + i) * size[0];
+
+            for (std::size_t z = firstSlice; z < lastSlice; ++z)
+            {
+                for (std::size_t y = 0; y < size[1]; ++y)
+                {
+                    for (std::size_t i = 0; i < inputRows.size(); ++i)
+                        inputRows[i].Load(y, z, t, rows + i * size[0]);
+                    if (rowSource)
+                        rowSource(y, z, t, size[0], rows + inputRows.size() * size[0], scratch);
+                    rowFunction(in.data(), out.data(), size[0]);
+                    for (std::size_t i = 0; i < out.size(); ++i)
+                        outputRows[i].Store(out[i], y, z, t);
+                }
+            }
+
+            if (slabDone)
+                slabDone(slab, (t * size[2] + firstSlice) * sliceSize, (t * size[2] + lastSlice) * sliceSize);
+        });
+    }
+
+    std::int32_t GetMaxMagnitude(const mitk::DECTKernels::BufferView& buffer)
+    {
+        switch (buffer.m_PixelType)
+        {
+        case mitkDECTInt8:
+            return 128;
+        case mitkDECTUInt8:
+            return 255;
+        case mitkDECTInt16:
+            return 32768;
+        case mitkDECTUInt16:
+            return 65535;
+        default:
+            mitkThrow() << "Fixed point blending needs 8 or 16 bit integer buffers, got pixel type " << static_cast<int>(buffer.m_PixelType) << ".";
+        }
+    }
+
+    template <typename TFunction>
+    void DispatchFixedPointType(mitkDECTPixelType pixelType, const TFunction& function)
+    {
+        switch (pixelType)
+        {
+        case mitkDECTInt8:
+            function(std::int8_t());
+            break;
+        case mitkDECTUInt8:
+            function(std::uint8_t());
+            break;
+        case mitkDECTInt16:
+            function(std::int16_t());
+            break;
+        case mitkDECTUInt16:
+            function(std::uint16_t());
+            break;
+        default:
+            mitkThrow() << "Fixed point blending needs 8 or 16 bit integer buffers, got pixel type " << static_cast<int>(pixelType) << ".";
+        }
+    }
+
+    /**
+     * Blends one row of integer inputs into int16 without converting to double.
+     */
+    template <typename THigh, typename TLow>
+    void FixedPointRow(const mitk::FixedPointAlphaBlending::Weights& weights, const char* high, std::ptrdiff_t highStride, const char* low,
+        std::ptrdiff_t lowStride, char* output, std::ptrdiff_t outputStride, std::size_t n)
+    {
+        THigh h;
+        TLow l;
+        std::int16_t value;
+        if (highStride == static_cast<std::ptrdiff_t>(sizeof(THigh)) && lowStride == static_cast<std::ptrdiff_t>(sizeof(TLow))
+            && outputStride == static_cast<std::ptrdiff_t>(sizeof(std::int16_t)))
+        {
+            // constant strides, the loop vectorizes
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                std::memcpy(&h, high + i * sizeof(THigh), sizeof(THigh));
+                std::memcpy(&l, low + i * sizeof(TLow), sizeof(TLow));
+                value = mitk::FixedPointAlphaBlending::BlendVoxel(weights, h, l);
+                std::memcpy(output + i * sizeof(std::int16_t), &value, sizeof(std::int16_t));
+            }
+            return;
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(&h, high + static_cast<std::ptrdiff_t>(i) * highStride, sizeof(THigh));
+            std::memcpy(&l, low + static_cast<std::ptrdiff_t>(i) * lowStride, sizeof(TLow));
+            value = mitk::FixedPointAlphaBlending::BlendVoxel(weights, h, l);
+            std::memcpy(output + static_cast<std::ptrdiff_t>(i) * outputStride, &value, sizeof(std::int16_t));
+        }
+    }
+
+    template <typename TFunction>
+    mitkDECTStatus CallFromC(const TFunction& function)
+    {
+        try
+        {
+            function();
+            LastError.clear();
+            return mitkDECTSuccess;
+        }
+        catch (const mitk::Exception& e)
+        {
+            LastError = e.GetDescription();
+            return mitkDECTInvalidArgument;
+        }
+        catch (const std::exception& e)
+        {
+            LastError = e.what();
+            return mitkDECTFailure;
+        }
+        catch (...)
+        {
+            LastError = "Unknown error.";
+            return mitkDECTFailure;
+        }
+    }
+
+    mitkDECTStatus NullDescriptor()
+    {
+        LastError = "A buffer descriptor is null.";
+        return mitkDECTInvalidArgument;
+    }
+}
+
+mitk::DECTKernels::BufferView::BufferView(const mitkDECTBuffer & buffer)
+    : m_Data(buffer.data), m_PixelType(buffer.pixelType)
+{
+    std::copy(buffer.size, buffer.size + 4, m_Size);
+    std::copy(buffer.stride, buffer.stride + 4, m_Stride);
+}
+
+mitk::DECTKernels::BufferView::BufferView(void * data, PixelType pixelType, std::size_t x, std::size_t y, std::size_t z, std::size_t t)
+    : m_Data(data), m_PixelType(pixelType)
+{
+    m_Size[0] = x;
+    m_Size[1] = y;
+    m_Size[2] = z;
+    m_Size[3] = t;
+}
+
+void mitk::DECTKernels::BufferView::GetStrides(std::ptrdiff_t strides[4]) const
+{
+    std::ptrdiff_t contiguous = static_cast<std::ptrdiff_t>(GetPixelSize(m_PixelType));
+    for (int d = 0; d < 4; ++d)
+    {
+        strides[d] = 0 != m_Stride[d] ? m_Stride[d] : contiguous;
+        contiguous *= static_cast<std::ptrdiff_t>(m_Size[d]);
+    }
+}
+
+mitk::DECTKernels::BufferView mitk::DECTKernels::BufferView::GetTimeStep(std::size_t timeStep) const
+{
+    if (timeStep >= m_Size[3])
+    {
+        mitkThrow() << "Time step " << timeStep << " is out of range, the buffer has " << m_Size[3] << " time steps.";
+    }
+    std::ptrdiff_t strides[4];
+    GetStrides(strides);
+
+    BufferView view = *this;
+    view.m_Data = static_cast<char*>(m_Data) + static_cast<std::ptrdiff_t>(timeStep) * strides[3];
+    view.m_Size[3] = 1;
+    return view;
+}
+
+std::size_t mitk::DECTKernels::GetPixelSize(PixelType pixelType)
+{
+    std::size_t size = 0;
+    DispatchPixelType(pixelType, [&](auto tag) { size = sizeof(tag); });
+    return size;
+}
+
+unsigned int mitk::DECTKernels::GetNumberOfSlabs(const BufferView & buffer, unsigned int slabSize)
+{
+    slabSize = std::max(1u, slabSize);
+    return static_cast<unsigned int>(buffer.m_Size[3] * ((buffer.m_Size[2] + slabSize - 1) / slabSize));
+}
+
+void mitk::DECTKernels::AlphaBlending(const BufferView & high, const BufferView & low, double alpha, const BufferView & output,
+    unsigned int slabSize, const SlabCallback & slabDone)
+{
+    ForEachRow({ &high, &low }, { &output }, slabSize, slabDone, [alpha](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[0][i] = alpha * in[0][i] + (1. - alpha) * in[1][i];
+    });
+}
+
+void mitk::DECTKernels::AlphaBlendingResampled(const BufferView & high, const double highIndexTransform[12], const BufferView & low,
+    double alpha, const BufferView & output, unsigned int slabSize, const SlabCallback & slabDone)
+{
+    CheckBuffer(high, "high");
+    if (high.m_Size[3] != low.m_Size[3])
+    {
+        mitkThrow() << "The high buffer has " << high.m_Size[3] << " time steps, expected " << low.m_Size[3] << ".";
+    }
+    double transform[12];
+    std::copy(highIndexTransform, highIndexTransform + 12, transform);
+
+    ForEachRow({ &low }, { &output }, slabSize, slabDone, [alpha](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[0][i] = alpha * in[1][i] + (1. - alpha) * in[0][i];
+    },
+    [&](std::size_t y, std::size_t z, std::size_t t, std::size_t n, double* row, double* positions)
+    {
+        // the positions of a row are a line in the high buffer
+        for (std::size_t x = 0; x < n; ++x)
+        {
+            for (int d = 0; d < 3; ++d)
+            {
+                const double* m = transform + 4 * d;
+                positions[3 * x + d] = m[0] * static_cast<double>(x) + m[1] * static_cast<double>(y) + m[2] * static_cast<double>(z) + m[3];
+            }
+        }
+        Sample(high.GetTimeStep(t), positions, n, row);
+    }, 3 * output.m_Size[0]);
+}
+
+void mitk::DECTKernels::AlphaMapBlending(const BufferView & high, const BufferView & low, const BufferView & alphaMap,
+    const double alphaIndexTransform[12], const BufferView & output, unsigned int slabSize, const SlabCallback & slabDone)
+{
+    CheckBuffer(alphaMap, "alpha map");
+    double transform[12];
+    std::copy(alphaIndexTransform, alphaIndexTransform + 12, transform);
+    const bool perTimeStep = alphaMap.m_Size[3] == output.m_Size[3];
+
+    auto blend = [](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[0][i] = in[2][i] * in[0][i] + (1. - in[2][i]) * in[1][i];
+    };
+
+    // a map on the output grid is read like any other input
+    bool sameGrid = true;
+    for (int d = 0; d < 3; ++d)
+    {
+        sameGrid = sameGrid && alphaMap.m_Size[d] == output.m_Size[d];
+        for (int c = 0; c < 4; ++c)
+            sameGrid = sameGrid && std::abs(transform[4 * d + c] - (c == d ? 1. : 0.)) < 1e-9;
+    }
+    if (sameGrid && perTimeStep)
+    {
+        ForEachRow({ &high, &low, &alphaMap }, { &output }, slabSize, slabDone, blend);
+        return;
+    }
+
+    // the y and z positions of a row do not depend on x for grids of the same orientation, then the map is
+    // interpolated in y and z once per row and only linearly in x per voxel
+    const bool separable = 0. == transform[4] && 0. == transform[8];
+    const std::size_t mapWidth = alphaMap.m_Size[0];
+    ForEachRow({ &high, &low }, { &output }, slabSize, slabDone, blend,
+    [&](std::size_t y, std::size_t z, std::size_t t, std::size_t n, double* row, double* scratch)
+    {
+        const BufferView map = alphaMap.GetTimeStep(perTimeStep ? t : 0);
+        double start[3];
+        for (int d = 0; d < 3; ++d)
+        {
+            const double* m = transform + 4 * d;
+            start[d] = m[1] * static_cast<double>(y) + m[2] * static_cast<double>(z) + m[3];
+        }
+
+        if (separable)
+        {
+            double* positions = scratch;
+            double* line = positions + 3 * mapWidth;
+            for (std::size_t x = 0; x < mapWidth; ++x)
+            {
+                positions[3 * x] = static_cast<double>(x);
+                positions[3 * x + 1] = start[1];
+                positions[3 * x + 2] = start[2];
+            }
+            Sample(map, positions, mapWidth, line);
+
+            const double maximum = static_cast<double>(mapWidth - 1);
+            for (std::size_t x = 0; x < n; ++x)
+            {
+                const double position = transform[0] * static_cast<double>(x) + start[0];
+                const double clamped = position > 0. ? std::min(position, maximum) : 0.;
+                const std::size_t lower = static_cast<std::size_t>(clamped);
+                const std::size_t upper = std::min(lower + 1, mapWidth - 1);
+                const double weight = clamped - static_cast<double>(lower);
+                row[x] = (1. - weight) * line[lower] + weight * line[upper];
+            }
+            return;
+        }
+
+        double* positions = scratch;
+        for (std::size_t x = 0; x < n; ++x)
+        {
+            for (int d = 0; d < 3; ++d)
+                positions[3 * x + d] = transform[4 * d] * static_cast<double>(x) + start[d];
+        }
+        Sample(map, positions, n, row);
+    }, separable ? 4 * mapWidth : 3 * output.m_Size[0]);
+}
+
+void mitk::DECTKernels::Sample(const BufferView & buffer, const double * positions, std::size_t count, double * values)
+{
+    CheckBuffer(buffer, "sampled");
+    if (nullptr == positions || nullptr == values)
+    {
+        mitkThrow() << "Sampling needs positions and values.";
+    }
+    std::ptrdiff_t strides[4];
+    buffer.GetStrides(strides);
+    DispatchPixelType(buffer.m_PixelType, [&](auto tag) { SampleOf<decltype(tag)>(buffer, strides, positions, count, values); });
+}
+
+void mitk::DECTKernels::AlphaBlendingWithDifference(const BufferView & high, const BufferView & low, double alpha, const BufferView & output,
+    const BufferView & difference, unsigned int slabSize, const SlabCallback & slabDone)
+{
+    ForEachRow({ &high, &low }, { &output, &difference }, slabSize, slabDone, [alpha](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            out[0][i] = alpha * in[0][i] + (1. - alpha) * in[1][i];
+            out[1][i] = in[0][i] - in[1][i];
+        }
+    });
+}
+
+void mitk::DECTKernels::AlphaBlendingFromDifference(const BufferView & low, const BufferView & difference, double alpha, const BufferView & output,
+    unsigned int slabSize, const SlabCallback & slabDone)
+{
+    ForEachRow({ &low, &difference }, { &output }, slabSize, slabDone, [alpha](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[0][i] = in[0][i] + alpha * in[1][i];
+    });
+}
+
+void mitk::DECTKernels::ConvertToRED(const BufferView & hu, const BufferView & output, unsigned int slabSize, const SlabCallback & slabDone)
+{
+    ForEachRow({ &hu }, { &output }, slabSize, slabDone, [](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[0][i] = in[0][i] / 1000. + 1.;
+    });
+}
+
+void mitk::DECTKernels::AlphaBlendingToRED(const BufferView & high, const BufferView & low, double alpha, const BufferView & output,
+    unsigned int slabSize, const SlabCallback & slabDone)
+{
+    ForEachRow({ &high, &low }, { &output }, slabSize, slabDone, [alpha](const double* const* in, double* const* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[0][i] = (alpha * in[0][i] + (1. - alpha) * in[1][i]) / 1000. + 1.;
+    });
+}
+
+void mitk::DECTKernels::FixedPointAlphaBlending(const BufferView & high, const BufferView & low, double alpha, const BufferView & output,
+    unsigned int slabSize, const SlabCallback & slabDone)
+{
+    if (output.m_PixelType != mitkDECTInt16)
+    {
+        mitkThrow() << "Fixed point blending writes int16 buffers, got pixel type " << static_cast<int>(output.m_PixelType) << ".";
+    }
+    CheckBuffer(output, "output");
+    CheckBuffer(high, "high");
+    CheckBuffer(low, "low");
+    CheckSameSize(output, high, "high");
+    CheckSameSize(output, low, "low");
+    const auto weights = mitk::FixedPointAlphaBlending::ComputeWeights(alpha, std::max(GetMaxMagnitude(high), GetMaxMagnitude(low)));
+
+    slabSize = std::max(1u, slabSize);
+    const std::size_t* size = output.m_Size;
+    const std::size_t slabsPerTimeStep = (size[2] + slabSize - 1) / slabSize;
+    const std::size_t sliceSize = size[0] * size[1];
+    const Row highRows(high);
+    const Row lowRows(low);
+    const Row outputRows(output);
+
+    // integer rows straight from buffer to buffer, no double staging as in ForEachRow
+    DispatchFixedPointType(high.m_PixelType, [&](auto highTag)
+    {
+        DispatchFixedPointType(low.m_PixelType, [&](auto lowTag)
+        {
+            mitk::SlabParallelFor(GetNumberOfSlabs(output, slabSize), [&](unsigned int slab)
+            {
+                const std::size_t t = slab / slabsPerTimeStep;
+                const std::size_t firstSlice = (slab % slabsPerTimeStep) * slabSize;
+                const std::size_t lastSlice = std::min<std::size_t>(firstSlice + slabSize, size[2]);
+                for (std::size_t z = firstSlice; z < lastSlice; ++z)
+                {
+                    for (std::size_t y = 0; y < size[1]; ++y)
+                    {
+                        FixedPointRow<decltype(highTag), decltype(lowTag)>(weights, highRows.GetAddress(y, z, t), highRows.m_Strides[0],
+                            lowRows.GetAddress(y, z, t), lowRows.m_Strides[0], outputRows.GetAddress(y, z, t), outputRows.m_Strides[0], size[0]);
+                    }
+                }
+
+                if (slabDone)
+                    slabDone(slab, (t * size[2] + firstSlice) * sliceSize, (t * size[2] + lastSlice) * sliceSize);
+            });
+        });
+    });
+}
+
+void mitk::DECTKernels::WeightedCombination(const std::vector<BufferView>& bins, const std::vector<std::vector<double>>& weightSets,
+    const std::vector<BufferView>& outputs, unsigned int slabSize, const SlabCallback & slabDone)
+{
+    if (weightSets.size() != outputs.size())
+    {
+        mitkThrow() << "Got " << weightSets.size() << " weight sets for " << outputs.size() << " outputs.";
+    }
+    for (const auto& weights : weightSets)
+    {
+        if (weights.size() != bins.size())
+        {
+            mitkThrow() << "Got a weight set with " << weights.size() << " weights for " << bins.size() << " energy bins.";
+        }
+    }
+
+    std::vector<const BufferView*> inputs;
+    for (const auto& bin : bins)
+        inputs.push_back(&bin);
+    std::vector<const BufferView*> outputPointers;
+    for (const auto& output : outputs)
+        outputPointers.push_back(&output);
+
+    ForEachRow(inputs, outputPointers, slabSize, slabDone, [&weightSets](const double* const* in, double* const* out, std::size_t n)
+    {
+        // the voxel loops are innermost, so they vectorize for any number of bins
+        for (std::size_t s = 0; s < weightSets.size(); ++s)
+        {
+            const double* weights = weightSets[s].data();
+            double* target = out[s];
+            for (std::size_t i = 0; i < n; ++i)
+                target[i] = weights[0] * in[0][i];
+            for (std::size_t b = 1; b < weightSets[s].size(); ++b)
+            {
+                const double weight = weights[b];
+                const double* bin = in[b];
+                for (std::size_t i = 0; i < n; ++i)
+                    target[i] += weight * bin[i];
+            }
+        }
+    });
+}
+
+mitkDECTStatus mitkDECTAlphaBlending(const mitkDECTBuffer * high, const mitkDECTBuffer * low, double alpha, const mitkDECTBuffer * output)
+{
+    if (nullptr == high || nullptr == low || nullptr == output)
+        return NullDescriptor();
+    return CallFromC([&]() { mitk::DECTKernels::AlphaBlending(*high, *low, alpha, *output); });
+}
+
+mitkDECTStatus mitkDECTConvertToRED(const mitkDECTBuffer * hu, const mitkDECTBuffer * output)
+{
+    if (nullptr == hu || nullptr == output)
+        return NullDescriptor();
+    return CallFromC([&]() { mitk::DECTKernels::ConvertToRED(*hu, *output); });
+}
+
+mitkDECTStatus mitkDECTAlphaBlendingToRED(const mitkDECTBuffer * high, const mitkDECTBuffer * low, double alpha, const mitkDECTBuffer * output)
+{
+    if (nullptr == high || nullptr == low || nullptr == output)
+        return NullDescriptor();
+    return CallFromC([&]() { mitk::DECTKernels::AlphaBlendingToRED(*high, *low, alpha, *output); });
+}
+
+mitkDECTStatus mitkDECTFixedPointAlphaBlending(const mitkDECTBuffer * high, const mitkDECTBuffer * low, double alpha, const mitkDECTBuffer * output)
+{
+    if (nullptr == high || nullptr == low || nullptr == output)
+        return NullDescriptor();
+    return CallFromC([&]() { mitk::DECTKernels::FixedPointAlphaBlending(*high, *low, alpha, *output); });
+}
+
+mitkDECTStatus mitkDECTWeightedCombination(const mitkDECTBuffer * bins, size_t numberOfBins, const double * weights, size_t numberOfWeightSets,
+    const mitkDECTBuffer * outputs)
+{
+    if (nullptr == bins || nullptr == weights || nullptr == outputs)
+        return NullDescriptor();
+    return CallFromC([&]()
+    {
+        std::vector<mitk::DECTKernels::BufferView> binViews(bins, bins + numberOfBins);
+        std::vector<mitk::DECTKernels::BufferView> outputViews(outputs, outputs + numberOfWeightSets);
+        std::vector<std::vector<double>> weightSets;
+        for (std::size_t s = 0; s < numberOfWeightSets; ++s)
+            weightSets.emplace_back(weights + s * numberOfBins, weights + (s + 1) * numberOfBins);
+        mitk::DECTKernels::WeightedCombination(binViews, weightSets, outputViews);
+    });
+}
+
+const char* mitkDECTGetLastError(void)
+{
+    return LastError.c_str();
+}
@@ -0,0 +1,421 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkDECTSeriesLoader.h"
+#include "mitkSlabParallelFor.h"
+
+#include <mitkGrabItkImageMemory.h>
+#include <mitkImageCast.h>
+#include <mitkExceptionMacro.h>
+
+#include <itkGDCMImageIO.h>
+#include <itkImageFileReader.h>
+#include <itkImage.h>
+#include <itksys/Directory.hxx>
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cmath>
+#include <regex>
+#include <sstream>
+
+namespace
+{
+    typedef itk::Image<double, 3> DoubleVolumeType;
+
+    struct FileHeader
+    {
+        bool m_Valid = false;
+        std::string m_File;
+        std::string m_SeriesInstanceUID;
+        std::string m_StudyInstanceUID;
+        std::string m_FrameOfReferenceUID;
+        std::string m_Description;
+        double m_KVP = 0.;
+        unsigned int m_Columns = 0;
+        unsigned int m_Rows = 0;
+        double m_PixelSpacing[2] = { 1., 1. };
+        double m_Orientation[6] = { 1., 0., 0., 0., 1., 0. };
+        double m_Position[3] = { 0., 0., 0. };
+        double m_SlicePosition = 0.;    // position along the slice normal
+        bool m_ShortPixels = true;
+    };
+
+    std::string Trim(const std::string& value)
+    {
+        const auto first = value.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            return std::string();
+        const auto last = value.find_last_not_of(" \t\r\n");
+        return value.substr(first, last - first + 1);
+    }
+
+    // parse a DICOM multi value string of the form "a\b\c"
+    bool ParseValues(const std::string& value, double* values, unsigned int count)
+    {
+        std::stringstream stream(value);
+        std::string item;
+        unsigned int i = 0;
+        while (i < count && std::getline(stream, item, '\\'))
+        {
+            try
+            {
+                values[i++] = std::stod(item);
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+        return i == count;
+    }
+
+    std::string GetTag(itk::GDCMImageIO* io, const std::string& tag)
+    {
+        std::string value;
+        io->GetValueFromTag(tag, value);
+        return Trim(value);
+    }
+
+    void ReadHeader(FileHeader& header)
+    {
+        auto io = itk::GDCMImageIO::New();
+        if (!io->CanReadFile(header.m_File.c_str()))
+            return;
+
+        try
+        {
+            io->SetFileName(header.m_File);
+            io->ReadImageInformation();
+        }
+        catch (const itk::ExceptionObject&)
+        {
+            return;
+        }
+
+        header.m_SeriesInstanceUID = GetTag(io, "0020|000e");
+        header.m_StudyInstanceUID = GetTag(io, "0020|000d");
+        header.m_FrameOfReferenceUID = GetTag(io, "0020|0052");
+        header.m_Description = GetTag(io, "0008|103e");
+        ParseValues(GetTag(io, "0018|0060"), &header.m_KVP, 1);
+        header.m_Columns = io->GetDimensions(0);
+        header.m_Rows = io->GetDimensions(1);
+        header.m_PixelSpacing[0] = io->GetSpacing(0);
+        header.m_PixelSpacing[1] = io->GetSpacing(1);
+        ParseValues(GetTag(io, "0020|0037"), header.m_Orientation, 6);
+        ParseValues(GetTag(io, "0020|0032"), header.m_Position, 3);
+        // the component type after rescale slope and intercept, e.g. int for unsigned 16 bit data with a negative intercept
+        const auto componentType = io->GetComponentType();
+        header.m_ShortPixels = componentType == itk::ImageIOBase::SHORT || componentType == itk::ImageIOBase::UCHAR
+            || componentType == itk::ImageIOBase::CHAR;
+
+        const double* o = header.m_Orientation;
+        const double normal[3] = { o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3] };
+        header.m_SlicePosition = normal[0] * header.m_Position[0] + normal[1] * header.m_Position[1] + normal[2] * header.m_Position[2];
+
+        header.m_Valid = !header.m_SeriesInstanceUID.empty();
+    }
+
+    // voxel wise blending needs the same voxel grid, up to the rounding of the DICOM headers
+    bool HaveSameGrid(const mitk::DECTSeriesLoader::SeriesInfo& a, const mitk::DECTSeriesLoader::SeriesInfo& b)
+    {
+        if (a.m_Files.size() != b.m_Files.size() || a.m_Columns != b.m_Columns || a.m_Rows != b.m_Rows)
+            return false;
+
+        auto sameSpacing = [](double x, double y) { return std::abs(x - y) <= 1e-3 * std::max(std::abs(x), std::abs(y)); };
+        if (!sameSpacing(a.m_PixelSpacing[0], b.m_PixelSpacing[0]) || !sameSpacing(a.m_PixelSpacing[1], b.m_PixelSpacing[1])
+            || !sameSpacing(a.m_SliceSpacing, b.m_SliceSpacing))
+            return false;
+
+        for (unsigned int i = 0; i < 6; ++i)
+        {
+            if (std::abs(a.m_Orientation[i] - b.m_Orientation[i]) > 1e-4)
+                return false;
+        }
+
+        // a tenth of a voxel
+        const double originTolerance = 0.1 * std::min({ a.m_PixelSpacing[0], a.m_PixelSpacing[1], std::abs(a.m_SliceSpacing) });
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            if (std::abs(a.m_Origin[i] - b.m_Origin[i]) > originTolerance)
+                return false;
+        }
+        return true;
+    }
+
+    template <typename TPixel>
+    typename itk::Image<TPixel, 3>::Pointer AllocateVolume(const mitk::DECTSeriesLoader::SeriesInfo& series)
+    {
+        typedef itk::Image<TPixel, 3> VolumeType;
+
+        typename VolumeType::SizeType size;
+        size[0] = series.m_Columns;
+        size[1] = series.m_Rows;
+        size[2] = series.m_Files.size();
+
+        typename VolumeType::SpacingType spacing;
+        spacing[0] = series.m_PixelSpacing[0];
+        spacing[1] = series.m_PixelSpacing[1];
+        spacing[2] = series.m_SliceSpacing;
+
+        typename VolumeType::PointType origin;
+        typename VolumeType::DirectionType direction;
+        const double* o = series.m_Orientation;
+        const double normal[3] = { o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3] };
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            origin[i] = series.m_Origin[i];
+            direction[i][0] = o[i];
+            direction[i][1] = o[3 + i];
+            direction[i][2] = normal[i];
+        }
+
+        auto volume = VolumeType::New();
+        volume->SetRegions(size);
+        volume->SetSpacing(spacing);
+        volume->SetOrigin(origin);
+        volume->SetDirection(direction);
+        volume->Allocate();
+        return volume;
+    }
+
+    template <typename TPixel>
+    void ReadSlice(const std::string& file, TPixel* target, std::size_t sliceSize)
+    {
+        typedef itk::Image<TPixel, 2> SliceType;
+
+        auto reader = itk::ImageFileReader<SliceType>::New();
+        reader->SetImageIO(itk::GDCMImageIO::New());
+        reader->SetFileName(file);
+        reader->Update();
+
+        const SliceType* slice = reader->GetOutput();
+        if (slice->GetLargestPossibleRegion().GetNumberOfPixels() != sliceSize)
+        {
+            mitkThrow() << "DICOM slice " << file << " does not match the size of its series.";
+        }
+        std::copy(slice->GetBufferPointer(), slice->GetBufferPointer() + sliceSize, target);
+    }
+
+    template <typename TPixel>
+    mitk::DECTSeriesLoader::LoadResult LoadVolumes(const mitk::DECTSeriesLoader::SeriesPair& pair, bool blend, double alpha)
+    {
+        const mitk::DECTSeriesLoader::SeriesInfo& low = pair.m_Low;
+        const mitk::DECTSeriesLoader::SeriesInfo& high = pair.m_High;
+        auto lowVolume = AllocateVolume<TPixel>(low);
+        auto highVolume = AllocateVolume<TPixel>(high);
+
+        DoubleVolumeType::Pointer blendedVolume;
+        if (blend)
+        {
+            blendedVolume = DoubleVolumeType::New();
+            blendedVolume->CopyInformation(lowVolume);
+            blendedVolume->SetRegions(lowVolume->GetLargestPossibleRegion());
+            blendedVolume->Allocate();
+        }
+
+        const std::size_t sliceSize = static_cast<std::size_t>(low.m_Columns) * low.m_Rows;
+        const unsigned int numberOfSlices = static_cast<unsigned int>(low.m_Files.size());
+        std::vector<std::string> errors(numberOfSlices);
+
+        // a slice is blended right after it is decoded in both series, while other threads still decode
+        mitk::SlabParallelFor(numberOfSlices, [&](unsigned int z)
+        {
+            const std::size_t offset = z * sliceSize;
+            try
+            {
+                ReadSlice(low.m_Files[z], lowVolume->GetBufferPointer() + offset, sliceSize);
+                ReadSlice(high.m_Files[z], highVolume->GetBufferPointer() + offset, sliceSize);
+            }
+            catch (const std::exception& e)
+            {
+                errors[z] = e.what();
+                return;
+            }
+
+            if (blend)
+            {
+                const TPixel* l = lowVolume->GetBufferPointer() + offset;
+                const TPixel* h = highVolume->GetBufferPointer() + offset;
+                double* out = blendedVolume->GetBufferPointer() + offset;
+                for (std::size_t i = 0; i < sliceSize; ++i)
+                    out[i] = alpha * h[i] + (1. - alpha) * l[i];
+            }
+        });
+
+        for (const auto& error : errors)
+        {
+            if (!error.empty())
+            {
+                mitkThrow() << "Could not decode DICOM series: " << error;
+            }
+        }
+
+        // take over the buffers instead of copying them, so the slices stay on the nodes of the threads that decoded them
+        mitk::DECTSeriesLoader::LoadResult result;
+        result.m_LowImage = mitk::GrabItkImageMemory(lowVolume.GetPointer());
+        result.m_HighImage = mitk::GrabItkImageMemory(highVolume.GetPointer());
+        if (blend)
+        {
+            result.m_BlendedImage = mitk::GrabItkImageMemory(blendedVolume.GetPointer());
+        }
+        return result;
+    }
+}
+
+std::vector<mitk::DECTSeriesLoader::SeriesInfo> mitk::DECTSeriesLoader::ScanDirectory(const std::string & directory)
+{
+    itksys::Directory dir;
+    if (!dir.Load(directory))
+    {
+        mitkThrow() << "Could not open DICOM directory " << directory;
+    }
+
+    std::vector<FileHeader> headers;
+    for (unsigned long i = 0; i < dir.GetNumberOfFiles(); ++i)
+    {
+        std::string path = directory + "/" + dir.GetFile(i);
+        if (!itksys::SystemTools::FileIsDirectory(path))
+        {
+            FileHeader header;
+            header.m_File = path;
+            headers.push_back(header);
+        }
+    }
+
+    // header parsing dominates for large directories, every file is independent
+    SlabParallelFor(static_cast<unsigned int>(headers.size()), [&headers](unsigned int i)
+    {
+        ReadHeader(headers[i]);
+    });
+
+    std::map<std::string, std::vector<const FileHeader*>> seriesMap;
+    for (const auto& header : headers)
+    {
+        if (header.m_Valid)
+            seriesMap[header.m_SeriesInstanceUID].push_back(&header);
+    }
+
+    std::vector<SeriesInfo> result;
+    for (auto& entry : seriesMap)
+    {
+        auto& files = entry.second;
+        std::sort(files.begin(), files.end(), [](const FileHeader* a, const FileHeader* b)
+        {
+            return a->m_SlicePosition < b->m_SlicePosition;
+        });
+
+        const FileHeader* first = files.front();
+        SeriesInfo info;
+        info.m_SeriesInstanceUID = first->m_SeriesInstanceUID;
+        info.m_StudyInstanceUID = first->m_StudyInstanceUID;
+        info.m_FrameOfReferenceUID = first->m_FrameOfReferenceUID;
+        info.m_Description = first->m_Description;
+        info.m_KVP = first->m_KVP;
+        info.m_Columns = first->m_Columns;
+        info.m_Rows = first->m_Rows;
+        info.m_ShortPixels = std::all_of(files.begin(), files.end(), [](const FileHeader* file) { return file->m_ShortPixels; });
+        std::copy(first->m_PixelSpacing, first->m_PixelSpacing + 2, info.m_PixelSpacing);
+        std::copy(first->m_Orientation, first->m_Orientation + 6, info.m_Orientation);
+        std::copy(first->m_Position, first->m_Position + 3, info.m_Origin);
+        if (files.size() > 1)
+        {
+            info.m_SliceSpacing = (files.back()->m_SlicePosition - first->m_SlicePosition) / (files.size() - 1);
+        }
+        for (const auto* file : files)
+        {
+            info.m_Files.push_back(file->m_File);
+        }
+        result.push_back(info);
+    }
+
+    return result;
+}
+
+std::vector<mitk::DECTSeriesLoader::SeriesPair> mitk::DECTSeriesLoader::PairSeries(const std::vector<SeriesInfo>& series, const std::map<std::string, double>& alphaValueMap)
+{
+    std::map<std::pair<std::string, std::string>, std::vector<const SeriesInfo*>> groups;
+    for (const auto& info : series)
+    {
+        if (info.m_KVP > 0.)
+            groups[std::make_pair(info.m_StudyInstanceUID, info.m_FrameOfReferenceUID)].push_back(&info);
+    }
+
+    std::vector<SeriesPair> result;
+    for (const auto& group : groups)
+    {
+        const auto& members = group.second;
+        auto minmax = std::minmax_element(members.begin(), members.end(), [](const SeriesInfo* a, const SeriesInfo* b)
+        {
+            return a->m_KVP < b->m_KVP;
+        });
+        const double lowKVP = (*minmax.first)->m_KVP;
+        const double highKVP = (*minmax.second)->m_KVP;
+        if (highKVP - lowKVP < 1.)
+            continue;
+
+        // every high kVp series is used at most once, the grids have to match for voxel wise blending
+        std::vector<bool> used(members.size(), false);
+        for (const auto* low : members)
+        {
+            if (low->m_KVP != lowKVP)
+                continue;
+
+            for (std::size_t i = 0; i < members.size(); ++i)
+            {
+                const SeriesInfo* high = members[i];
+                if (used[i] || high->m_KVP != highKVP || !HaveSameGrid(*low, *high))
+                    continue;
+
+                SeriesPair pair;
+                pair.m_Low = *low;
+                pair.m_High = *high;
+                pair.m_Modes = FindModes(lowKVP, highKVP, alphaValueMap);
+                result.push_back(pair);
+                used[i] = true;
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+std::vector<std::string> mitk::DECTSeriesLoader::FindModes(double lowKVP, double highKVP, const std::map<std::string, double>& alphaValueMap)
+{
+    static const std::regex pattern("(\\d+(?:\\.\\d+)?)\\s*kv\\s*/\\s*(\\d+(?:\\.\\d+)?)\\s*kv", std::regex::icase);
+
+    std::vector<std::string> modes;
+    for (const auto& entry : alphaValueMap)
+    {
+        std::smatch match;
+        if (std::regex_search(entry.first, match, pattern)
+            && std::abs(std::stod(match[1].str()) - lowKVP) < 0.5
+            && std::abs(std::stod(match[2].str()) - highKVP) < 0.5)
+        {
+            modes.push_back(entry.first);
+        }
+    }
+    return modes;
+}
+
+mitk::DECTSeriesLoader::LoadResult mitk::DECTSeriesLoader::LoadPair(const SeriesPair & pair, bool blend, double alpha)
+{
+    if (pair.m_Low.m_Files.empty() || !HaveSameGrid(pair.m_Low, pair.m_High))
+    {
+        mitkThrow() << "Low and high energy series have to share the voxel grid to be blended by mitk::DECTSeriesLoader.";
+    }
+
+    // unsigned or rescaled values beyond the range of short would be truncated
+    if (pair.m_Low.m_ShortPixels && pair.m_High.m_ShortPixels)
+        return LoadVolumes<short>(pair, blend, alpha);
+    return LoadVolumes<float>(pair, blend, alpha);
+}
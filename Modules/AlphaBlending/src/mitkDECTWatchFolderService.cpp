@@ -0,0 +1,372 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkDECTWatchFolderService.h"
+#include "mitkCompressedVolumeWriter.h"
+#include "mitkSlabThreadPool.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkLogMacros.h>
+
+#include <itksys/Directory.hxx>
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double SecondsSince(const Clock::time_point& start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    std::vector<std::string> GetFiles(const std::string& directory)
+    {
+        std::vector<std::string> files;
+        itksys::Directory dir;
+        if (!dir.Load(directory))
+            return files;
+        for (unsigned long i = 0; i < dir.GetNumberOfFiles(); ++i)
+        {
+            const std::string name = dir.GetFile(i);
+            if (name != "." && name != "..")
+                files.push_back(name);
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+}
+
+mitk::DECTWatchFolderService::DECTWatchFolderService()
+    : m_Running(false)
+{
+}
+
+mitk::DECTWatchFolderService::~DECTWatchFolderService()
+{
+    Stop();
+}
+
+void mitk::DECTWatchFolderService::Start()
+{
+    if (m_Running)
+        return;
+
+    if (!itksys::SystemTools::FileIsDirectory(m_InputDirectory))
+    {
+        mitkThrow() << "The watched directory " << m_InputDirectory << " does not exist.";
+    }
+    if (!itksys::SystemTools::MakeDirectory(m_OutputDirectory))
+    {
+        mitkThrow() << "Could not create the output directory " << m_OutputDirectory;
+    }
+    if (m_Tool.m_AlphaValueMap.empty())
+    {
+        m_Tool.Initialize();
+    }
+
+    m_ReadQueue.reset(new BoundedQueue<CasePointer>(m_QueueCapacity));
+    m_ComputeQueue.reset(new BoundedQueue<CasePointer>(m_QueueCapacity));
+    m_WriteQueue.reset(new BoundedQueue<CasePointer>(m_QueueCapacity));
+    {
+        std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+        m_Statistics = Statistics();
+    }
+
+    m_Running = true;
+    m_WriteThread = std::thread(&DECTWatchFolderService::Write, this);
+    m_ComputeThread = std::thread(&DECTWatchFolderService::Compute, this);
+    m_ReadThread = std::thread(&DECTWatchFolderService::Read, this);
+    m_WatchThread = std::thread(&DECTWatchFolderService::Watch, this);
+}
+
+void mitk::DECTWatchFolderService::Stop()
+{
+    if (!m_Running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_WatchMutex);
+        m_Running = false;
+    }
+    m_WatchCondition.notify_all();
+    m_WatchThread.join();
+
+    // every stage drains its queue and closes the next one
+    m_ReadQueue->Close();
+    m_ReadThread.join();
+    m_ComputeThread.join();
+    m_WriteThread.join();
+}
+
+void mitk::DECTWatchFolderService::Watch()
+{
+    while (m_Running)
+    {
+        try
+        {
+            Poll();
+        }
+        catch (const std::exception& e)
+        {
+            MITK_WARN << "Scanning " << m_InputDirectory << " failed: " << e.what();
+        }
+
+        std::unique_lock<std::mutex> lock(m_WatchMutex);
+        m_WatchCondition.wait_for(lock, std::chrono::milliseconds(m_PollInterval), [this]() { return !m_Running; });
+    }
+}
+
+std::size_t mitk::DECTWatchFolderService::Poll()
+{
+    std::lock_guard<std::mutex> lock(m_PollMutex);
+    if (!m_Running)
+        return 0;
+
+    {
+        std::lock_guard<std::mutex> failedLock(m_FailedMutex);
+        for (const auto& failed : m_FailedCases)
+            m_KnownCases.erase(failed);
+        m_FailedCases.clear();
+    }
+
+    std::vector<std::string> directories = { m_InputDirectory };
+    for (const auto& name : GetFiles(m_InputDirectory))
+    {
+        const std::string path = m_InputDirectory + "/" + name;
+        if (itksys::SystemTools::FileIsDirectory(path))
+            directories.push_back(path);
+    }
+
+    std::size_t discovered = 0;
+    for (const auto& directory : directories)
+    {
+        // a directory is complete when its files did not change for some polls
+        std::ostringstream signature;
+        for (const auto& name : GetFiles(directory))
+        {
+            const std::string path = directory + "/" + name;
+            if (!itksys::SystemTools::FileIsDirectory(path))
+                signature << name << ':' << itksys::SystemTools::FileLength(path) << ':' << itksys::SystemTools::ModifiedTime(path) << ';';
+        }
+
+        DirectoryState& state = m_Directories[directory];
+        if (state.m_Signature != signature.str())
+        {
+            state.m_Signature = signature.str();
+            state.m_UnchangedScans = 0;
+            state.m_Scanned = false;
+            continue;
+        }
+        if (state.m_Scanned || state.m_Signature.empty() || ++state.m_UnchangedScans < m_StableScans)
+            continue;
+
+        state.m_Scanned = true;
+        discovered += ScanCompleteDirectory(directory);
+    }
+    return discovered;
+}
+
+std::size_t mitk::DECTWatchFolderService::ScanCompleteDirectory(const std::string & directory)
+{
+    std::size_t discovered = 0;
+    const auto series = m_Loader.ScanDirectory(directory);
+    for (const auto& pair : m_Loader.PairSeries(series, m_Tool.m_AlphaValueMap))
+    {
+        auto currentCase = std::make_shared<Case>();
+        currentCase->m_Pair = pair;
+        currentCase->m_OutputDirectory = m_OutputDirectory + "/" + pair.m_Low.m_StudyInstanceUID + "_" + pair.m_Low.m_SeriesInstanceUID;
+        if (!m_KnownCases.insert(currentCase->m_OutputDirectory).second)
+            continue;
+
+        if (itksys::SystemTools::FileExists(currentCase->m_OutputDirectory + "/hu.nrrd"))
+        {
+            MITK_INFO << "Skipping " << currentCase->m_OutputDirectory << ", it has been converted before.";
+            continue;
+        }
+
+        std::string mode = m_Mode;
+        if (mode.empty() && !pair.m_Modes.empty())
+            mode = pair.m_Modes.front();
+        auto alpha = m_Tool.m_AlphaValueMap.find(mode);
+        if (alpha == m_Tool.m_AlphaValueMap.end())
+        {
+            MITK_WARN << "Skipping " << currentCase->m_OutputDirectory << ", no alpha value for " << pair.m_Low.m_KVP << " kV / "
+                      << pair.m_High.m_KVP << " kV.";
+            continue;
+        }
+        currentCase->m_Alpha = alpha->second;
+
+        if (!m_Running || !m_ReadQueue->Push(currentCase))
+            break;
+        ++discovered;
+        std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+        ++m_Statistics.m_Discovered;
+    }
+    return discovered;
+}
+
+void mitk::DECTWatchFolderService::Read()
+{
+    CasePointer currentCase;
+    while (m_ReadQueue->Pop(currentCase))
+    {
+        const auto start = Clock::now();
+        bool failed = false;
+        try
+        {
+            auto loaded = m_Loader.LoadPair(currentCase->m_Pair, false, 0.);
+            currentCase->m_LowImage = loaded.m_LowImage;
+            currentCase->m_HighImage = loaded.m_HighImage;
+        }
+        catch (const std::exception& e)
+        {
+            MITK_ERROR << "Reading " << currentCase->m_OutputDirectory << " failed: " << e.what();
+            failed = true;
+        }
+        RecordStage(m_Statistics.m_Read, SecondsSince(start), failed);
+
+        if (failed)
+            ForgetCase(*currentCase);
+        else
+            m_ComputeQueue->Push(currentCase);
+    }
+    m_ComputeQueue->Close();
+}
+
+void mitk::DECTWatchFolderService::Compute()
+{
+    // background work, slab loops of the view preempt the cases
+    SlabPriorityScope priority(SlabPriority::Batch);
+    CasePointer currentCase;
+    while (m_ComputeQueue->Pop(currentCase))
+    {
+        const auto start = Clock::now();
+        bool failed = false;
+        try
+        {
+            mitk::Image::Pointer huImage = m_Tool.AlphaBlending(currentCase->m_HighImage, currentCase->m_LowImage, currentCase->m_Alpha);
+            // the inputs are not needed anymore, release them before the case waits for the writer
+            currentCase->m_LowImage = nullptr;
+            currentCase->m_HighImage = nullptr;
+
+            // the files store multiples of the rescale slope, quantizing the bricks to it keeps them unchanged
+            if (m_WriteRED)
+            {
+                mitk::Image::Pointer redImage = m_Tool.ConvertToRED(huImage);
+                currentCase->m_REDVolume.reset(new BrickedVolume(redImage, CompressedVolumeWriter::ForRED().m_RescaleSlope));
+            }
+            currentCase->m_HUVolume.reset(new BrickedVolume(huImage, CompressedVolumeWriter::ForHU().m_RescaleSlope));
+        }
+        catch (const std::exception& e)
+        {
+            MITK_ERROR << "Blending " << currentCase->m_OutputDirectory << " failed: " << e.what();
+            failed = true;
+        }
+        RecordStage(m_Statistics.m_Compute, SecondsSince(start), failed);
+
+        if (failed)
+            ForgetCase(*currentCase);
+        else
+            m_WriteQueue->Push(currentCase);
+    }
+    m_WriteQueue->Close();
+}
+
+void mitk::DECTWatchFolderService::Write()
+{
+    CasePointer currentCase;
+    while (m_WriteQueue->Pop(currentCase))
+    {
+        const auto start = Clock::now();
+        bool failed = false;
+        try
+        {
+            const std::string& directory = currentCase->m_OutputDirectory;
+            if (!itksys::SystemTools::MakeDirectory(directory))
+            {
+                mitkThrow() << "Could not create " << directory;
+            }
+            if (currentCase->m_REDVolume)
+            {
+                mitk::Image::Pointer redImage = currentCase->m_REDVolume->ToImage();
+                currentCase->m_REDVolume.reset();
+                m_Tool.ExportRED(redImage, directory + "/red.nrrd");
+            }
+
+            // hu.nrrd marks a converted case, so it appears only when it is complete
+            mitk::Image::Pointer huImage = currentCase->m_HUVolume->ToImage();
+            currentCase->m_HUVolume.reset();
+            m_Tool.ExportHU(huImage, directory + "/hu.part.nrrd");
+            if (!itksys::SystemTools::RenameFile(directory + "/hu.part.nrrd", directory + "/hu.nrrd"))
+            {
+                mitkThrow() << "Could not rename " << directory << "/hu.part.nrrd";
+            }
+            MITK_INFO << "Converted " << directory;
+        }
+        catch (const std::exception& e)
+        {
+            MITK_ERROR << "Writing " << currentCase->m_OutputDirectory << " failed: " << e.what();
+            failed = true;
+        }
+        RecordStage(m_Statistics.m_Write, SecondsSince(start), failed);
+        if (failed)
+            ForgetCase(*currentCase);
+        currentCase.reset();
+    }
+}
+
+void mitk::DECTWatchFolderService::ForgetCase(const Case & failedCase)
+{
+    std::lock_guard<std::mutex> lock(m_FailedMutex);
+    m_FailedCases.push_back(failedCase.m_OutputDirectory);
+}
+
+void mitk::DECTWatchFolderService::RecordStage(StageStatistics & stage, double seconds, bool failed)
+{
+    std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+    if (failed)
+        ++stage.m_Failed;
+    else
+        ++stage.m_Processed;
+    stage.m_LastSeconds = seconds;
+    stage.m_TotalSeconds += seconds;
+    stage.m_MaximumSeconds = std::max(stage.m_MaximumSeconds, seconds);
+}
+
+mitk::DECTWatchFolderService::Statistics mitk::DECTWatchFolderService::GetStatistics() const
+{
+    Statistics statistics;
+    {
+        std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+        statistics = m_Statistics;
+    }
+
+    const std::pair<QueueStatistics*, const BoundedQueue<CasePointer>*> queues[] = {
+        { &statistics.m_ReadQueue, m_ReadQueue.get() },
+        { &statistics.m_ComputeQueue, m_ComputeQueue.get() },
+        { &statistics.m_WriteQueue, m_WriteQueue.get() }
+    };
+    for (const auto& queue : queues)
+    {
+        if (nullptr == queue.second)
+            continue;
+        queue.first->m_Depth = queue.second->GetSize();
+        queue.first->m_PeakDepth = queue.second->GetPeakSize();
+        queue.first->m_Capacity = queue.second->GetCapacity();
+    }
+    return statistics;
+}
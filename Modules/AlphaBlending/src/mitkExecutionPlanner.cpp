@@ -0,0 +1,209 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkExecutionPlanner.h"
+#include "mitkVoxelKernels.h"
+
+#include <mitkExceptionMacro.h>
+
+#include <itksys/SystemInformation.hxx>
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    std::string ToMegaBytes(std::size_t bytes)
+    {
+        std::ostringstream stream;
+        stream.precision(1);
+        stream << std::fixed << bytes / (1024. * 1024.) << " MB";
+        return stream.str();
+    }
+}
+
+unsigned int mitk::ExecutionPlanner::GetInMemoryVolumeCount(Operation operation)
+{
+    switch (operation)
+    {
+    case Operation::AlphaBlending:
+    case Operation::ConvertToRED:
+    case Operation::ConvertToSPR:
+    case Operation::AlphaBlendingToSPR:
+        // the slab kernels write the output directly
+        return 1;
+    case Operation::AdaptiveAlphaBlending:
+        // two double casts, four windowed moments and the output, which the mitk image takes over
+        return 7;
+    case Operation::FixedPointAlphaBlending:
+        // writes the int16 output directly
+        return 0;
+    case Operation::WeightedCombination:
+        // writes all outputs directly, they are counted in the output pixel size
+        return 0;
+    }
+    return 0;
+}
+
+bool mitk::ExecutionPlanner::IsStreamable(Operation operation)
+{
+    return operation != Operation::AdaptiveAlphaBlending;
+}
+
+std::size_t mitk::ExecutionPlanner::GetImageMemory(const mitk::Image * image)
+{
+    return VoxelKernels::GetNumberOfVoxels(image) * image->GetPixelType().GetSize();
+}
+
+mitk::ExecutionPlan mitk::ExecutionPlanner::Plan(Operation operation, const std::vector<const mitk::Image*>& inputs, std::size_t outputPixelSize) const
+{
+    if (inputs.empty() || nullptr == inputs.front())
+    {
+        mitkThrow() << "Execution planning needs at least one input image.";
+    }
+
+    ExecutionPlan plan;
+    std::size_t inputPixelSize = 0;
+    for (const auto* input : inputs)
+    {
+        plan.m_InputMemory += GetImageMemory(input);
+        inputPixelSize += input->GetPixelType().GetSize();
+    }
+
+    const std::size_t numberOfVoxels = VoxelKernels::GetNumberOfVoxels(inputs.front());
+    const std::size_t streamedPeak = plan.m_InputMemory + numberOfVoxels * outputPixelSize;
+    const std::size_t inMemoryPeak = std::max(streamedPeak, plan.m_InputMemory + GetInMemoryVolumeCount(operation) * numberOfVoxels * sizeof(double));
+
+    if (m_MemoryBudget == 0 || inMemoryPeak <= m_MemoryBudget)
+    {
+        plan.m_Strategy = ExecutionPlan::Strategy::InMemory;
+        plan.m_PeakMemory = inMemoryPeak;
+        plan.m_Message = "Full in memory execution, predicted peak memory " + ToMegaBytes(inMemoryPeak) + ".";
+    }
+    else if (IsStreamable(operation) && streamedPeak <= m_MemoryBudget)
+    {
+        // slabs are sized so that the inputs and the output of one slab stay within the working set target
+        const std::size_t sliceBytes = VoxelKernels::GetSliceSize(inputs.front()) * (inputPixelSize + outputPixelSize);
+        plan.m_Strategy = ExecutionPlan::Strategy::SlabStreamed;
+        plan.m_PeakMemory = streamedPeak;
+        plan.m_SlabSize = static_cast<unsigned int>(std::max<std::size_t>(1, m_SlabMemoryTarget / std::max<std::size_t>(1, sliceBytes)));
+
+        std::ostringstream message;
+        message << "Slab streamed execution with " << plan.m_SlabSize << " slices per slab, predicted peak memory "
+                << ToMegaBytes(streamedPeak) << " instead of " << ToMegaBytes(inMemoryPeak) << ".";
+        plan.m_Message = message.str();
+    }
+    else
+    {
+        plan.m_Strategy = ExecutionPlan::Strategy::Refused;
+        plan.m_PeakMemory = IsStreamable(operation) ? streamedPeak : inMemoryPeak;
+        plan.m_Message = "The operation needs at least " + ToMegaBytes(plan.m_PeakMemory) + " but the memory budget is "
+                         + ToMegaBytes(m_MemoryBudget) + ".";
+    }
+
+    const auto tuned = m_Tuning.find(GetTuningKey(operation, inputs.front()->GetPixelType()));
+    if (tuned != m_Tuning.end() && plan.m_Strategy != ExecutionPlan::Strategy::Refused)
+    {
+        const TunedParameters& parameters = tuned->second;
+        // streamed slabs are bounded by the working set target
+        if (parameters.m_SlabSize > 0)
+            plan.m_SlabSize = plan.m_SlabSize > 0 ? std::min(plan.m_SlabSize, parameters.m_SlabSize) : parameters.m_SlabSize;
+        plan.m_NumberOfThreads = parameters.m_NumberOfThreads;
+    }
+
+    return plan;
+}
+
+std::string mitk::ExecutionPlanner::GetName(Operation operation)
+{
+    switch (operation)
+    {
+    case Operation::AlphaBlending:
+        return "AlphaBlending";
+    case Operation::AdaptiveAlphaBlending:
+        return "AdaptiveAlphaBlending";
+    case Operation::ConvertToRED:
+        return "ConvertToRED";
+    case Operation::ConvertToSPR:
+        return "ConvertToSPR";
+    case Operation::AlphaBlendingToSPR:
+        return "AlphaBlendingToSPR";
+    case Operation::FixedPointAlphaBlending:
+        return "FixedPointAlphaBlending";
+    case Operation::WeightedCombination:
+        return "WeightedCombination";
+    }
+    return "";
+}
+
+std::string mitk::ExecutionPlanner::GetTuningKey(Operation operation, const mitk::PixelType & pixelType)
+{
+    return GetName(operation) + " " + pixelType.GetComponentTypeAsString();
+}
+
+std::string mitk::ExecutionPlanner::GetMachineFingerprint()
+{
+    // the processor is queried once, the separators of the tuning string are replaced in its name
+    static const std::string processor = []()
+    {
+        itksys::SystemInformation information;
+        information.RunCPUCheck();
+        std::string name = information.GetExtendedProcessorName();
+        if (name.empty())
+            name = std::string(information.GetVendorString()) + " " + information.GetModelName();
+        std::replace_if(name.begin(), name.end(), [](char c) { return ';' == c || '=' == c; }, ' ');
+        return name;
+    }();
+    std::ostringstream machine;
+    machine << "cpu=" << processor << ";threads=" << std::thread::hardware_concurrency();
+    return machine.str();
+}
+
+std::string mitk::ExecutionPlanner::GetTuningString() const
+{
+    // cpu=<processor>;threads=<machine threads>;<key>=<threads>,<slab size>,<throughput>;...
+    std::ostringstream stream;
+    stream << GetMachineFingerprint();
+    for (const auto& entry : m_Tuning)
+    {
+        const TunedParameters& parameters = entry.second;
+        stream << ";" << entry.first << "=" << parameters.m_NumberOfThreads << "," << parameters.m_SlabSize << "," << parameters.m_Throughput;
+    }
+    return stream.str();
+}
+
+bool mitk::ExecutionPlanner::SetTuningString(const std::string & tuning)
+{
+    m_Tuning.clear();
+    const std::string machine = GetMachineFingerprint();
+    if (0 != tuning.compare(0, machine.size(), machine) || (tuning.size() > machine.size() && ';' != tuning[machine.size()]))
+        return false;
+    std::istringstream stream(tuning.substr(machine.size()));
+    std::string entry;
+    std::getline(stream, entry, ';');
+
+    std::map<std::string, TunedParameters> table;
+    while (std::getline(stream, entry, ';'))
+    {
+        const std::size_t separator = entry.find('=');
+        if (separator == std::string::npos)
+            return false;
+        std::istringstream values(entry.substr(separator + 1));
+        TunedParameters parameters;
+        char comma[2];
+        if (!(values >> parameters.m_NumberOfThreads >> comma[0] >> parameters.m_SlabSize >> comma[1] >> parameters.m_Throughput))
+            return false;
+        table[entry.substr(0, separator)] = parameters;
+    }
+    m_Tuning = table;
+    return true;
+}
@@ -0,0 +1,66 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkFixedPointAlphaBlending.h"
+#include "mitkVoxelKernels.h"
+
+#include <mitkExceptionMacro.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+mitk::FixedPointAlphaBlending::Weights mitk::FixedPointAlphaBlending::ComputeWeights(double alpha, std::int32_t maxMagnitude)
+{
+    for (int fractionBits = 30; fractionBits >= 0; --fractionBits)
+    {
+        const std::int64_t one = std::int64_t(1) << fractionBits;
+        const std::int64_t high = std::llround(alpha * one);
+        const std::int64_t low = one - high;
+        const std::int64_t peak = (std::abs(high) + std::abs(low)) * maxMagnitude + one / 2;
+
+        if (peak <= INT32_MAX)
+        {
+            Weights weights;
+            weights.m_High = static_cast<std::int32_t>(high);
+            weights.m_Low = static_cast<std::int32_t>(low);
+            weights.m_FractionBits = static_cast<unsigned int>(fractionBits);
+            return weights;
+        }
+    }
+    mitkThrow() << "Alpha value " << alpha << " is too large for fixed point blending.";
+}
+
+double mitk::FixedPointAlphaBlending::GetErrorBound(double alpha, std::int32_t maxMagnitude)
+{
+    // the blend with the quantized alpha differs by (alpha - w_high / 2^f) * (high - low)
+    const Weights weights = ComputeWeights(alpha, maxMagnitude);
+    const double quantizedAlpha = std::ldexp(static_cast<double>(weights.m_High), -static_cast<int>(weights.m_FractionBits));
+    return std::abs(alpha - quantizedAlpha) * 2. * maxMagnitude;
+}
+
+mitk::Image::Pointer mitk::FixedPointAlphaBlending::Blend(const mitk::Image * imageHigh, const mitk::Image * imageLow, unsigned int slabSize) const
+{
+    if (VoxelKernels::GetNumberOfVoxels(imageHigh) != VoxelKernels::GetNumberOfVoxels(imageLow))
+    {
+        mitkThrow() << "Voxel wise operations between images of different size are not supported.";
+    }
+    auto output = VoxelKernels::AllocateLike(imageHigh, mitk::MakeScalarPixelType<short>(), slabSize);
+    mitk::ImageReadAccessor highAccessor(imageHigh);
+    mitk::ImageReadAccessor lowAccessor(imageLow);
+    mitk::ImageWriteAccessor outputAccessor(output);
+
+    DECTKernels::FixedPointAlphaBlending(VoxelKernels::GetBufferView(imageHigh, highAccessor.GetData()),
+        VoxelKernels::GetBufferView(imageLow, lowAccessor.GetData()), m_AlphaValue, VoxelKernels::GetBufferView(output, outputAccessor.GetData()),
+        slabSize);
+
+    return output;
+}
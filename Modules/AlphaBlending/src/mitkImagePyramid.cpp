@@ -0,0 +1,180 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkImagePyramid.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkSmartPointerProperty.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+    std::string GetLevelPropertyName(unsigned int level)
+    {
+        return "dect.pyramid.level " + std::to_string(level);
+    }
+}
+
+void mitk::ImagePyramid::Initialize(const mitk::Image * reference)
+{
+    if (reference->GetDimension() < 2 || reference->GetDimension() > 4)
+    {
+        mitkThrow() << "Image pyramids are only supported for 2D, 3D and 4D images.";
+    }
+
+    m_TimeSteps = reference->GetDimension() > 3 ? reference->GetDimension(3) : 1;
+    m_Sizes.assign(1, LevelSize{ { reference->GetDimension(0), reference->GetDimension(1), reference->GetDimension() > 2 ? reference->GetDimension(2) : 1u } });
+    m_Levels.clear();
+    m_Accessors.clear();
+    m_Buffers.clear();
+
+    const bool scaleZ = m_Sizes[0].m_Size[2] > 1;
+    const mitk::BaseGeometry* referenceGeometry = reference->GetGeometry();
+
+    for (unsigned int level = 1; level <= m_NumberOfLevels; ++level)
+    {
+        const LevelSize& previous = m_Sizes.back();
+        LevelSize size = { { (previous.m_Size[0] + 1) / 2, (previous.m_Size[1] + 1) / 2, scaleZ ? (previous.m_Size[2] + 1) / 2 : 1 } };
+        m_Sizes.push_back(size);
+
+        // voxels are 2^level times larger, the first voxel is centered on the first 2^level voxels of the full resolution
+        const double factor = static_cast<double>(1u << level);
+        auto geometry = referenceGeometry->Clone();
+        mitk::Vector3D spacing = referenceGeometry->GetSpacing();
+        mitk::Point3D firstCenter;
+        for (unsigned int d = 0; d < 3; ++d)
+        {
+            const double axisFactor = (d < 2 || scaleZ) ? factor : 1.;
+            spacing[d] *= axisFactor;
+            firstCenter[d] = (axisFactor - 1.) / 2.;
+        }
+        mitk::Point3D origin;
+        referenceGeometry->IndexToWorld(firstCenter, origin);
+
+        mitk::BaseGeometry::BoundsArrayType bounds;
+        bounds.Fill(0);
+        bounds[1] = static_cast<double>(size.m_Size[0]);
+        bounds[3] = static_cast<double>(size.m_Size[1]);
+        bounds[5] = static_cast<double>(size.m_Size[2]);
+        geometry->SetBounds(bounds);
+        geometry->SetSpacing(spacing);
+        geometry->SetOrigin(origin);
+
+        auto image = mitk::Image::New();
+        image->Initialize(mitk::MakeScalarPixelType<float>(), *geometry, 1, static_cast<int>(m_TimeSteps));
+        m_Levels.push_back(image);
+
+        m_Accessors.push_back(std::make_shared<mitk::ImageWriteAccessor>(image));
+        m_Buffers.push_back(static_cast<float*>(m_Accessors.back()->GetData()));
+    }
+}
+
+unsigned int mitk::ImagePyramid::GetAlignedSlabSize(unsigned int slabSize) const
+{
+    const unsigned int alignment = 1u << m_NumberOfLevels;
+    return (std::max(1u, slabSize) + alignment - 1) / alignment * alignment;
+}
+
+unsigned int mitk::ImagePyramid::GetNumberOfSlabs(unsigned int slabSize) const
+{
+    const std::size_t slices = m_Sizes[0].m_Size[2];
+    return static_cast<unsigned int>(m_TimeSteps * ((slices + slabSize - 1) / slabSize));
+}
+
+void mitk::ImagePyramid::GetSlabRange(unsigned int slab, unsigned int slabSize, std::size_t & begin, std::size_t & end) const
+{
+    const LevelSize& size = m_Sizes[0];
+    const std::size_t slabsPerTimeStep = (size.m_Size[2] + slabSize - 1) / slabSize;
+    const std::size_t timeStep = slab / slabsPerTimeStep;
+    const std::size_t firstSlice = (slab % slabsPerTimeStep) * slabSize;
+    const std::size_t lastSlice = std::min<std::size_t>(firstSlice + slabSize, size.m_Size[2]);
+    const std::size_t sliceSize = size.m_Size[0] * size.m_Size[1];
+
+    begin = (timeStep * size.m_Size[2] + firstSlice) * sliceSize;
+    end = (timeStep * size.m_Size[2] + lastSlice) * sliceSize;
+}
+
+void mitk::ImagePyramid::Downsample(unsigned int slab, unsigned int slabSize, const double * output)
+{
+    const std::size_t slabsPerTimeStep = (m_Sizes[0].m_Size[2] + slabSize - 1) / slabSize;
+    const unsigned int timeStep = static_cast<unsigned int>(slab / slabsPerTimeStep);
+    std::size_t firstSlice = (slab % slabsPerTimeStep) * slabSize;
+    std::size_t lastSlice = std::min<std::size_t>(firstSlice + slabSize, m_Sizes[0].m_Size[2]);
+
+    for (unsigned int level = 1; level <= m_NumberOfLevels; ++level)
+    {
+        // the slab is aligned, so every target slice depends on source slices of this slab only
+        const bool scaleZ = m_Sizes[0].m_Size[2] > 1;
+        const std::size_t targetFirst = scaleZ ? firstSlice / 2 : firstSlice;
+        const std::size_t targetLast = scaleZ ? (lastSlice + 1) / 2 : lastSlice;
+
+        if (level == 1)
+            DownsampleLevel(output, m_Sizes[0], m_Buffers[0], m_Sizes[1], timeStep, targetFirst, targetLast);
+        else
+            DownsampleLevel(m_Buffers[level - 2], m_Sizes[level - 1], m_Buffers[level - 1], m_Sizes[level], timeStep, targetFirst, targetLast);
+
+        firstSlice = targetFirst;
+        lastSlice = targetLast;
+    }
+}
+
+template <typename TSource>
+void mitk::ImagePyramid::DownsampleLevel(const TSource * source, const LevelSize & sourceSize, float * target, const LevelSize & targetSize,
+    unsigned int timeStep, std::size_t firstSlice, std::size_t lastSlice)
+{
+    const std::size_t zFactor = targetSize.m_Size[2] < sourceSize.m_Size[2] ? 2 : 1;
+    const std::size_t sourceSlice = sourceSize.m_Size[0] * sourceSize.m_Size[1];
+    source += timeStep * sourceSize.GetVolume();
+    target += timeStep * targetSize.GetVolume();
+
+    for (std::size_t z = firstSlice; z < lastSlice; ++z)
+    {
+        const std::size_t z0 = z * zFactor;
+        const std::size_t z1 = std::min(z0 + zFactor, sourceSize.m_Size[2]);
+        for (std::size_t y = 0; y < targetSize.m_Size[1]; ++y)
+        {
+            const std::size_t y0 = 2 * y;
+            const std::size_t y1 = std::min(y0 + 2, sourceSize.m_Size[1]);
+            float* targetRow = target + (z * targetSize.m_Size[1] + y) * targetSize.m_Size[0];
+            for (std::size_t x = 0; x < targetSize.m_Size[0]; ++x)
+            {
+                const std::size_t x0 = 2 * x;
+                const std::size_t x1 = std::min(x0 + 2, sourceSize.m_Size[0]);
+                double sum = 0.;
+                for (std::size_t zs = z0; zs < z1; ++zs)
+                    for (std::size_t ys = y0; ys < y1; ++ys)
+                        for (std::size_t xs = x0; xs < x1; ++xs)
+                            sum += source[zs * sourceSlice + ys * sourceSize.m_Size[0] + xs];
+                targetRow[x] = static_cast<float>(sum / ((z1 - z0) * (y1 - y0) * (x1 - x0)));
+            }
+        }
+    }
+}
+
+void mitk::ImagePyramid::AttachTo(mitk::Image * image)
+{
+    m_Buffers.clear();
+    m_Accessors.clear();
+    for (unsigned int level = 1; level <= m_Levels.size(); ++level)
+    {
+        image->SetProperty(GetLevelPropertyName(level), mitk::SmartPointerProperty::New(m_Levels[level - 1].GetPointer()));
+    }
+}
+
+mitk::Image::Pointer mitk::ImagePyramid::GetLevel(const mitk::Image * image, unsigned int level)
+{
+    auto property = dynamic_cast<mitk::SmartPointerProperty*>(image->GetProperty(GetLevelPropertyName(level).c_str()).GetPointer());
+    if (nullptr == property)
+        return nullptr;
+    return dynamic_cast<mitk::Image*>(property->GetSmartPointer().GetPointer());
+}
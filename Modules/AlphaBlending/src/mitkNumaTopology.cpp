@@ -0,0 +1,210 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkNumaTopology.h"
+#include "mitkSlabParallelFor.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    const std::size_t PageSize = 4096;
+
+    std::mutex CurrentMutex;
+    std::unique_ptr<mitk::NumaTopology> Current;
+    thread_local int CurrentNode = -1;
+#ifdef __linux__
+    // affinity of the thread before it was bound to its first node, restored when it is unbound
+    thread_local cpu_set_t UnboundCpus;
+    thread_local bool HasUnboundCpus = false;
+#endif
+
+    unsigned int GetNumberOfCpus()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    mitk::NumaTopology SingleNode()
+    {
+        mitk::NumaTopology topology;
+        topology.m_NodeCpus.resize(1);
+        for (unsigned int cpu = 0; cpu < GetNumberOfCpus(); ++cpu)
+            topology.m_NodeCpus[0].push_back(cpu);
+        return topology;
+    }
+}
+
+std::vector<unsigned int> mitk::NumaTopology::ParseList(const std::string & list)
+{
+    std::vector<unsigned int> numbers;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        if (range.find_first_of("0123456789") == std::string::npos)
+            continue;
+        const auto dash = range.find('-');
+        const unsigned long first = std::stoul(range.substr(0, dash));
+        const unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (unsigned long number = first; number <= last; ++number)
+            numbers.push_back(static_cast<unsigned int>(number));
+    }
+    return numbers;
+}
+
+mitk::NumaTopology mitk::NumaTopology::Detect()
+{
+    NumaTopology topology;
+#ifdef __linux__
+    // node numbers can have gaps, e.g. "0-1,3" after a node was taken offline
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    if (online && std::getline(online, nodes))
+    {
+        for (unsigned int node : ParseList(nodes))
+        {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!file || !std::getline(file, list))
+                continue;
+            // memory only nodes have no cpus
+            auto cpus = ParseList(list);
+            if (!cpus.empty())
+                topology.m_NodeCpus.push_back(cpus);
+        }
+    }
+#endif
+    if (topology.m_NodeCpus.empty())
+        return SingleNode();
+    return topology;
+}
+
+mitk::NumaTopology mitk::NumaTopology::Simulate(unsigned int numberOfNodes)
+{
+    numberOfNodes = std::max(1u, numberOfNodes);
+    const unsigned int numberOfCpus = GetNumberOfCpus();
+
+    NumaTopology topology;
+    topology.m_Simulated = true;
+    topology.m_NodeCpus.resize(numberOfNodes);
+    // with fewer cpus than nodes, nodes share cpus
+    const unsigned int cpusPerNode = std::max(1u, numberOfCpus / numberOfNodes);
+    for (unsigned int node = 0; node < numberOfNodes; ++node)
+        for (unsigned int k = 0; k < cpusPerNode; ++k)
+            topology.m_NodeCpus[node].push_back((node * cpusPerNode + k) % numberOfCpus);
+    return topology;
+}
+
+mitk::NumaTopology mitk::NumaTopology::GetCurrent()
+{
+    std::lock_guard<std::mutex> lock(CurrentMutex);
+    if (!Current)
+    {
+        const char* simulatedNodes = std::getenv("MITK_DECT_NUMA_NODES");
+        const int numberOfNodes = nullptr != simulatedNodes ? std::atoi(simulatedNodes) : 0;
+        Current.reset(new NumaTopology(numberOfNodes > 1 ? Simulate(numberOfNodes) : Detect()));
+    }
+    return *Current;
+}
+
+void mitk::NumaTopology::SetCurrent(const NumaTopology & topology)
+{
+    std::lock_guard<std::mutex> lock(CurrentMutex);
+    Current.reset(new NumaTopology(topology.m_NodeCpus.empty() ? SingleNode() : topology));
+}
+
+int mitk::NumaTopology::GetCurrentNode()
+{
+    return CurrentNode;
+}
+
+unsigned int mitk::NumaTopology::GetNumberOfWorkers(unsigned int numberOfSlabs)
+{
+    return std::max(1u, std::min(numberOfSlabs, GetNumberOfSlabThreads()));
+}
+
+unsigned int mitk::NumaTopology::GetWorkerOfSlab(unsigned int slab, unsigned int numberOfSlabs, unsigned int numberOfWorkers)
+{
+    // worker w processes the slabs [w * numberOfSlabs / numberOfWorkers, (w + 1) * numberOfSlabs / numberOfWorkers)
+    return static_cast<unsigned int>(((slab + 1ull) * numberOfWorkers - 1) / numberOfSlabs);
+}
+
+unsigned int mitk::NumaTopology::GetNodeOfWorker(unsigned int worker, unsigned int numberOfWorkers) const
+{
+    return static_cast<unsigned int>(static_cast<unsigned long long>(worker) * GetNumberOfNodes() / std::max(1u, numberOfWorkers));
+}
+
+unsigned int mitk::NumaTopology::GetNodeOfSlab(unsigned int slab, unsigned int numberOfSlabs) const
+{
+    const unsigned int workers = GetNumberOfWorkers(numberOfSlabs);
+    return GetNodeOfWorker(GetWorkerOfSlab(slab, numberOfSlabs, workers), workers);
+}
+
+bool mitk::NumaTopology::BindCurrentThread(unsigned int node) const
+{
+#ifdef __linux__
+    // a thread moving from one node to the next keeps the affinity it had before its first node
+    if (!HasUnboundCpus)
+        HasUnboundCpus = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &UnboundCpus) == 0;
+#endif
+    CurrentNode = static_cast<int>(node);
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (unsigned int cpu : m_NodeCpus[node])
+        CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) == 0;
+#else
+    return false;
+#endif
+}
+
+bool mitk::NumaTopology::UnbindCurrentThread()
+{
+    CurrentNode = -1;
+#ifdef __linux__
+    // without a saved affinity the thread has never been bound
+    if (!HasUnboundCpus)
+        return true;
+    HasUnboundCpus = false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &UnboundCpus) == 0;
+#else
+    return false;
+#endif
+}
+
+void mitk::NumaTopology::FirstTouch(void * buffer, std::size_t bytes, std::size_t slabBytes)
+{
+    if (GetCurrent().GetNumberOfNodes() < 2 || bytes == 0 || slabBytes == 0)
+        return;
+
+    char* data = static_cast<char*>(buffer);
+    const unsigned int numberOfSlabs = static_cast<unsigned int>((bytes + slabBytes - 1) / slabBytes);
+    SlabParallelFor(numberOfSlabs, [&](unsigned int slab)
+    {
+        const std::size_t first = slab * slabBytes;
+        const std::size_t last = std::min(bytes, first + slabBytes);
+        for (std::size_t offset = first; offset < last; offset += PageSize)
+            data[offset] = 0;
+    });
+}
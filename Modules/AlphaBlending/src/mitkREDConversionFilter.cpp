@@ -0,0 +1,26 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkREDConversionFilter.h"
+
+mitk::REDConversionFilter::REDConversionFilter()
+    : DECTImageFilter(1)
+{
+}
+
+mitk::REDConversionFilter::~REDConversionFilter()
+{
+}
+
+void mitk::REDConversionFilter::GenerateSlices(const std::vector<DECTKernels::BufferView>& inputs, const DECTKernels::BufferView & output)
+{
+    DECTKernels::ConvertToRED(inputs[0], output);
+}
@@ -0,0 +1,466 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkRigidAlignment.h"
+#include "mitkBufferPool.h"
+#include "mitkSlabParallelFor.h"
+#include "mitkVoxelKernels.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkImageReadAccessor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // 3x4 affine matrices, the rows of the 3x3 matrix with the offset in the last column
+
+    void Compose(const double a[12], const double b[12], double out[12])
+    {
+        double result[12];
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                double value = 3 == j ? a[4 * i + 3] : 0.;
+                for (int k = 0; k < 3; ++k)
+                    value += a[4 * i + k] * b[4 * k + j];
+                result[4 * i + j] = value;
+            }
+        }
+        std::copy(result, result + 12, out);
+    }
+
+    void Invert(const double a[12], double out[12])
+    {
+        const double c00 = a[5] * a[10] - a[6] * a[9];
+        const double c01 = a[6] * a[8] - a[4] * a[10];
+        const double c02 = a[4] * a[9] - a[5] * a[8];
+        const double determinant = a[0] * c00 + a[1] * c01 + a[2] * c02;
+        if (std::abs(determinant) < 1e-12)
+        {
+            mitkThrow() << "The image geometry is singular.";
+        }
+        double result[12] = {
+            c00, a[2] * a[9] - a[1] * a[10], a[1] * a[6] - a[2] * a[5], 0.,
+            c01, a[0] * a[10] - a[2] * a[8], a[2] * a[4] - a[0] * a[6], 0.,
+            c02, a[1] * a[8] - a[0] * a[9], a[0] * a[5] - a[1] * a[4], 0. };
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                result[4 * i + j] /= determinant;
+            result[4 * i + 3] = -(result[4 * i] * a[3] + result[4 * i + 1] * a[7] + result[4 * i + 2] * a[11]);
+        }
+        std::copy(result, result + 12, out);
+    }
+
+    void Apply(const double a[12], const double point[3], double out[3])
+    {
+        for (int i = 0; i < 3; ++i)
+            out[i] = a[4 * i] * point[0] + a[4 * i + 1] * point[1] + a[4 * i + 2] * point[2] + a[4 * i + 3];
+    }
+
+    // rotation around center followed by the translation, in world coordinates
+    void RigidMatrix(const mitk::RigidAlignment::Transform& transform, const double center[3], double out[12])
+    {
+        const double cx = std::cos(transform.m_Angles[0]), sx = std::sin(transform.m_Angles[0]);
+        const double cy = std::cos(transform.m_Angles[1]), sy = std::sin(transform.m_Angles[1]);
+        const double cz = std::cos(transform.m_Angles[2]), sz = std::sin(transform.m_Angles[2]);
+        // Rz * Ry * Rx
+        const double rotation[9] = {
+            cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx,
+            sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx,
+            -sy, cy * sx, cy * cx };
+        for (int i = 0; i < 3; ++i)
+        {
+            double offset = center[i] + transform.m_Translation[i];
+            for (int j = 0; j < 3; ++j)
+            {
+                out[4 * i + j] = rotation[3 * i + j];
+                offset -= rotation[3 * i + j] * center[j];
+            }
+            out[4 * i + 3] = offset;
+        }
+    }
+
+    /**
+     * A pyramid level, every voxel is the mean of factor voxels of the finest level.
+     */
+    struct Level
+    {
+        std::vector<float> m_Voxels;         // empty for the finest level, which is read from the input
+        mitk::DECTKernels::BufferView m_View;
+        std::size_t m_Factor[3] = { 1, 1, 1 };
+
+        // maps level indices to the indices of the finest level
+        void GetLevelToFinest(double matrix[12]) const
+        {
+            std::fill(matrix, matrix + 12, 0.);
+            for (int d = 0; d < 3; ++d)
+            {
+                matrix[5 * d] = static_cast<double>(m_Factor[d]);
+                matrix[4 * d + 3] = (static_cast<double>(m_Factor[d]) - 1.) / 2.;
+            }
+        }
+    };
+
+    /**
+     * Levels from the finest to the coarsest, dimensions of a single voxel are not downsampled. The trilinear sample at
+     * the center of 2|2|2 voxels is their mean, so every level is sampled from the level before.
+     */
+    std::vector<Level> BuildPyramid(const mitk::DECTKernels::BufferView& finest, unsigned int numberOfLevels)
+    {
+        std::vector<Level> levels(std::max(1u, numberOfLevels));
+        levels[0].m_View = finest;
+        levels[0].m_View.m_Size[3] = 1;
+        for (std::size_t l = 1; l < levels.size(); ++l)
+        {
+            const Level& source = levels[l - 1];
+            Level& target = levels[l];
+            std::size_t size[3];
+            bool downsampled[3];
+            for (int d = 0; d < 3; ++d)
+            {
+                downsampled[d] = source.m_View.m_Size[d] >= 2;
+                size[d] = downsampled[d] ? source.m_View.m_Size[d] / 2 : source.m_View.m_Size[d];
+                target.m_Factor[d] = downsampled[d] ? 2 * source.m_Factor[d] : source.m_Factor[d];
+            }
+            target.m_Voxels.resize(size[0] * size[1] * size[2]);
+            target.m_View = mitk::DECTKernels::BufferView(target.m_Voxels.data(), mitkDECTFloat, size[0], size[1], size[2]);
+
+            mitk::SlabParallelFor(static_cast<unsigned int>(size[2]), [&](unsigned int z)
+            {
+                mitk::BufferPool::Lease buffer(4 * size[0] * sizeof(double));
+                double* positions = buffer.Get<double>();
+                double* values = positions + 3 * size[0];
+                for (std::size_t y = 0; y < size[1]; ++y)
+                {
+                    const std::size_t index[3] = { 0, y, z };
+                    for (std::size_t x = 0; x < size[0]; ++x)
+                    {
+                        for (int d = 0; d < 3; ++d)
+                        {
+                            const double i = static_cast<double>(0 == d ? x : index[d]);
+                            positions[3 * x + d] = downsampled[d] ? 2. * i + 0.5 : i;
+                        }
+                    }
+                    mitk::DECTKernels::Sample(source.m_View, positions, size[0], values);
+                    float* row = target.m_Voxels.data() + (z * size[1] + y) * size[0];
+                    for (std::size_t x = 0; x < size[0]; ++x)
+                        row[x] = static_cast<float>(values[x]);
+                }
+            });
+        }
+        return levels;
+    }
+
+    /**
+     * Normalized cross correlation of the fixed samples and the moving level at the mapped positions.
+     */
+    class Metric
+    {
+    public:
+        Metric(const Level& fixed, const Level& moving, unsigned int numberOfSamples, unsigned int seed)
+            : m_Moving(moving)
+        {
+            const std::size_t* size = fixed.m_View.m_Size;
+            const std::size_t numberOfVoxels = size[0] * size[1] * size[2];
+            std::mt19937 random(seed);
+            std::uniform_int_distribution<std::size_t> voxel(0, numberOfVoxels - 1);
+            const std::size_t count = std::min<std::size_t>(numberOfSamples, numberOfVoxels);
+            m_Positions.resize(3 * count);
+            m_Values.resize(count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const std::size_t index = numberOfVoxels == count ? i : voxel(random);
+                m_Positions[3 * i] = static_cast<double>(index % size[0]);
+                m_Positions[3 * i + 1] = static_cast<double>((index / size[0]) % size[1]);
+                m_Positions[3 * i + 2] = static_cast<double>(index / (size[0] * size[1]));
+            }
+            mitk::DECTKernels::Sample(fixed.m_View, m_Positions.data(), count, m_Values.data());
+        }
+
+        double Evaluate(const double indexTransform[12]) const
+        {
+            const std::size_t count = m_Values.size();
+            const unsigned int numberOfBlocks = static_cast<unsigned int>(std::min<std::size_t>(32, count));
+            std::vector<Sums> partials(numberOfBlocks);
+
+            mitk::SlabParallelFor(numberOfBlocks, [&](unsigned int block)
+            {
+                const std::size_t begin = block * count / numberOfBlocks;
+                const std::size_t end = (block + 1) * count / numberOfBlocks;
+                std::vector<double> positions;
+                std::vector<double> fixedValues;
+                positions.reserve(3 * (end - begin));
+                fixedValues.reserve(end - begin);
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    double position[3];
+                    Apply(indexTransform, &m_Positions[3 * i], position);
+                    bool inside = true;
+                    for (int d = 0; d < 3; ++d)
+                        inside = inside && position[d] >= -0.5 && position[d] <= static_cast<double>(m_Moving.m_View.m_Size[d]) - 0.5;
+                    if (!inside)
+                        continue;
+                    positions.insert(positions.end(), position, position + 3);
+                    fixedValues.push_back(m_Values[i]);
+                }
+                std::vector<double> movingValues(fixedValues.size());
+                if (!movingValues.empty())
+                    mitk::DECTKernels::Sample(m_Moving.m_View, positions.data(), movingValues.size(), movingValues.data());
+
+                Sums& sums = partials[block];
+                for (std::size_t i = 0; i < movingValues.size(); ++i)
+                    sums.Add(fixedValues[i], movingValues[i]);
+            });
+
+            // merged in block order, so the result does not depend on the number of threads
+            Sums total;
+            for (const auto& partial : partials)
+                total.Merge(partial);
+            return total.GetCorrelation(count);
+        }
+
+    private:
+
+        struct Sums
+        {
+            double m_Count = 0., m_Fixed = 0., m_Moving = 0., m_FixedSquares = 0., m_MovingSquares = 0., m_Products = 0.;
+
+            void Add(double f, double m)
+            {
+                m_Count += 1.;
+                m_Fixed += f;
+                m_Moving += m;
+                m_FixedSquares += f * f;
+                m_MovingSquares += m * m;
+                m_Products += f * m;
+            }
+
+            void Merge(const Sums& other)
+            {
+                m_Count += other.m_Count;
+                m_Fixed += other.m_Fixed;
+                m_Moving += other.m_Moving;
+                m_FixedSquares += other.m_FixedSquares;
+                m_MovingSquares += other.m_MovingSquares;
+                m_Products += other.m_Products;
+            }
+
+            double GetCorrelation(std::size_t numberOfSamples) const
+            {
+                // most samples mapped outside of the moving image are as bad as no correlation
+                if (m_Count < 0.1 * static_cast<double>(numberOfSamples) || m_Count < 2.)
+                    return 0.;
+                const double covariance = m_Products - m_Fixed * m_Moving / m_Count;
+                const double fixedVariance = m_FixedSquares - m_Fixed * m_Fixed / m_Count;
+                const double movingVariance = m_MovingSquares - m_Moving * m_Moving / m_Count;
+                if (fixedVariance <= 0. || movingVariance <= 0.)
+                    return 0.;
+                return covariance / std::sqrt(fixedVariance * movingVariance);
+            }
+        };
+
+        const Level& m_Moving;
+        std::vector<double> m_Positions;  // fixed level indices, x, y, z triples
+        std::vector<double> m_Values;
+    };
+
+    double GetMinimumSpacing(const double indexToWorld[12])
+    {
+        double spacing = 0.;
+        for (int d = 0; d < 3; ++d)
+        {
+            const double length = std::sqrt(indexToWorld[d] * indexToWorld[d] + indexToWorld[4 + d] * indexToWorld[4 + d]
+                + indexToWorld[8 + d] * indexToWorld[8 + d]);
+            spacing = 0 == d ? length : std::min(spacing, length);
+        }
+        return spacing;
+    }
+}
+
+void mitk::RigidAlignment::GetIndexToWorld(const mitk::Image * image, double matrix[12])
+{
+    const auto* transform = image->GetGeometry()->GetIndexToWorldTransform();
+    const auto& rotation = transform->GetMatrix();
+    const auto& offset = transform->GetOffset();
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+            matrix[4 * i + j] = rotation[i][j];
+        matrix[4 * i + 3] = offset[i];
+    }
+}
+
+void mitk::RigidAlignment::Align(const mitk::Image * fixed, const mitk::Image * moving)
+{
+    double fixedIndexToWorld[12];
+    double movingIndexToWorld[12];
+    GetIndexToWorld(fixed, fixedIndexToWorld);
+    GetIndexToWorld(moving, movingIndexToWorld);
+
+    mitk::ImageReadAccessor fixedAccessor(fixed);
+    mitk::ImageReadAccessor movingAccessor(moving);
+    Align(VoxelKernels::GetBufferView(fixed, fixedAccessor.GetData()), fixedIndexToWorld,
+        VoxelKernels::GetBufferView(moving, movingAccessor.GetData()), movingIndexToWorld);
+}
+
+void mitk::RigidAlignment::Align(const DECTKernels::BufferView & fixed, const double fixedIndexToWorld[12], const DECTKernels::BufferView & moving,
+    const double movingIndexToWorld[12])
+{
+    const std::vector<Level> fixedLevels = BuildPyramid(fixed, m_NumberOfLevels);
+    const std::vector<Level> movingLevels = BuildPyramid(moving, m_NumberOfLevels);
+
+    double worldToMoving[12];
+    Invert(movingIndexToWorld, worldToMoving);
+    double center[3];
+    const double centerIndex[3] = { (fixed.m_Size[0] - 1) / 2., (fixed.m_Size[1] - 1) / 2., (fixed.m_Size[2] - 1) / 2. };
+    Apply(fixedIndexToWorld, centerIndex, center);
+
+    // rotations are scaled by the radius of the fixed image, so a unit step moves its border by about 1 mm
+    double corner[3];
+    const double cornerIndex[3] = { 0., 0., 0. };
+    Apply(fixedIndexToWorld, cornerIndex, corner);
+    const double radius = std::max(1., std::sqrt((center[0] - corner[0]) * (center[0] - corner[0]) + (center[1] - corner[1]) * (center[1] - corner[1])
+        + (center[2] - corner[2]) * (center[2] - corner[2])));
+
+    double parameters[6];
+    for (int i = 0; i < 3; ++i)
+    {
+        parameters[i] = m_Transform.m_Angles[i] * radius;
+        parameters[3 + i] = m_Transform.m_Translation[i];
+    }
+    auto toTransform = [radius](const double* p)
+    {
+        Transform transform;
+        for (int i = 0; i < 3; ++i)
+        {
+            transform.m_Angles[i] = p[i] / radius;
+            transform.m_Translation[i] = p[3 + i];
+        }
+        return transform;
+    };
+
+    double firstStep = m_MaximumStep;
+    for (std::size_t l = fixedLevels.size(); l-- > 0;)
+    {
+        const Level& fixedLevel = fixedLevels[l];
+        const Level& movingLevel = movingLevels[std::min(l, movingLevels.size() - 1)];
+        const Metric metric(fixedLevel, movingLevel, m_NumberOfSamples, static_cast<unsigned int>(l));
+
+        double fixedToFinest[12];
+        double movingToFinest[12];
+        double finestToMoving[12];
+        fixedLevel.GetLevelToFinest(fixedToFinest);
+        movingLevel.GetLevelToFinest(movingToFinest);
+        Invert(movingToFinest, finestToMoving);
+        double levelIndexToWorld[12];
+        Compose(fixedIndexToWorld, fixedToFinest, levelIndexToWorld);
+        double worldToMovingLevel[12];
+        Compose(finestToMoving, worldToMoving, worldToMovingLevel);
+
+        // negative correlation, minimized
+        auto cost = [&](const double* p)
+        {
+            double rigid[12];
+            double indexTransform[12];
+            RigidMatrix(toTransform(p), center, rigid);
+            Compose(rigid, levelIndexToWorld, indexTransform);
+            Compose(worldToMovingLevel, indexTransform, indexTransform);
+            return -metric.Evaluate(indexTransform);
+        };
+        const double delta = 0.5 * GetMinimumSpacing(levelIndexToWorld);
+        auto gradient = [&](const double* p, double* g)
+        {
+            for (int i = 0; i < 6; ++i)
+            {
+                double q[6];
+                std::copy(p, p + 6, q);
+                q[i] = p[i] + delta;
+                const double forward = cost(q);
+                q[i] = p[i] - delta;
+                const double backward = cost(q);
+                g[i] = (forward - backward) / (2. * delta);
+            }
+        };
+
+        // resilient propagation: every parameter has its own step, which grows while the sign of its derivative is kept
+        // and is halved when it flips, so the different sensitivity to rotations and translations does not matter
+        const std::size_t factor = std::max(fixedLevel.m_Factor[0], std::max(fixedLevel.m_Factor[1], fixedLevel.m_Factor[2]));
+        const double minimumStep = m_MinimumStep * static_cast<double>(factor);
+        const double maximumStep = std::max(firstStep, minimumStep);
+        double steps[6];
+        double previous[6];
+        std::fill(steps, steps + 6, maximumStep);
+        std::fill(previous, previous + 6, 0.);
+        for (unsigned int iteration = 0; iteration < m_MaximumIterations; ++iteration)
+        {
+            double g[6];
+            gradient(parameters, g);
+            bool converged = true;
+            for (int i = 0; i < 6; ++i)
+            {
+                if (g[i] * previous[i] > 0.)
+                {
+                    steps[i] = std::min(1.2 * steps[i], maximumStep);
+                }
+                else if (g[i] * previous[i] < 0.)
+                {
+                    steps[i] /= 2.;
+                    g[i] = 0.;
+                }
+                if (g[i] > 0.)
+                    parameters[i] -= steps[i];
+                else if (g[i] < 0.)
+                    parameters[i] += steps[i];
+                previous[i] = g[i];
+                converged = converged && steps[i] < minimumStep;
+            }
+            if (converged)
+                break;
+        }
+        m_Correlation = -cost(parameters);
+        firstStep /= 2.;
+    }
+    m_Transform = toTransform(parameters);
+}
+
+void mitk::RigidAlignment::GetIndexTransform(const mitk::Image * fixed, const mitk::Image * moving, double matrix[12]) const
+{
+    double fixedIndexToWorld[12];
+    double movingIndexToWorld[12];
+    GetIndexToWorld(fixed, fixedIndexToWorld);
+    GetIndexToWorld(moving, movingIndexToWorld);
+
+    DECTKernels::BufferView fixedSize;
+    for (unsigned int d = 0; d < 3; ++d)
+        fixedSize.m_Size[d] = d < fixed->GetDimension() ? fixed->GetDimension(d) : 1;
+    GetIndexTransform(fixedSize, fixedIndexToWorld, movingIndexToWorld, matrix);
+}
+
+void mitk::RigidAlignment::GetIndexTransform(const DECTKernels::BufferView & fixed, const double fixedIndexToWorld[12],
+    const double movingIndexToWorld[12], double matrix[12]) const
+{
+    double center[3];
+    const double centerIndex[3] = { (fixed.m_Size[0] - 1) / 2., (fixed.m_Size[1] - 1) / 2., (fixed.m_Size[2] - 1) / 2. };
+    Apply(fixedIndexToWorld, centerIndex, center);
+
+    double rigid[12];
+    double worldToMoving[12];
+    RigidMatrix(m_Transform, center, rigid);
+    Invert(movingIndexToWorld, worldToMoving);
+    Compose(rigid, fixedIndexToWorld, matrix);
+    Compose(worldToMoving, matrix, matrix);
+}
@@ -0,0 +1,113 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkSlabParallelFor.h"
+#include "mitkNumaTopology.h"
+#include "mitkSlabThreadPool.h"
+
+#include <itkMultiThreaderBase.h>
+
+#include <algorithm>
+
+namespace
+{
+    // set on workers of SlabParallelFor, nested calls run serially on the worker
+    thread_local bool InsideWorker = false;
+
+    // thread limit of the calling thread, 0 for none
+    thread_local unsigned int ThreadLimit = 0;
+
+    class WorkerScope
+    {
+    public:
+        WorkerScope() : m_Previous(InsideWorker) { InsideWorker = true; }
+        ~WorkerScope() { InsideWorker = m_Previous; }
+
+    private:
+        bool m_Previous;
+    };
+}
+
+void mitk::SlabParallelFor(unsigned int numberOfSlabs, const std::function<void(unsigned int)>& slabFunction)
+{
+    if (numberOfSlabs == 0)
+        return;
+
+    if (numberOfSlabs == 1 || InsideWorker)
+    {
+        for (unsigned int slab = 0; slab < numberOfSlabs; ++slab)
+            slabFunction(slab);
+        return;
+    }
+
+    // on NUMA machines the slabs keep the placement of mitk::NumaTopology::FirstTouch
+    const NumaTopology topology = NumaTopology::GetCurrent();
+    SlabThreadPool::GetInstance().ParallelFor(numberOfSlabs, ThreadLimit, GetCurrentSlabPriority(), [&slabFunction](unsigned int slab)
+    {
+        WorkerScope scope;
+        slabFunction(slab);
+    }, topology.GetNumberOfNodes() > 1 ? &topology : nullptr);
+}
+
+mitk::SlabThreadLimit::SlabThreadLimit(unsigned int numberOfThreads)
+    : m_Previous(ThreadLimit)
+{
+    if (numberOfThreads > 0)
+        ThreadLimit = numberOfThreads;
+}
+
+mitk::SlabThreadLimit::~SlabThreadLimit()
+{
+    ThreadLimit = m_Previous;
+}
+
+unsigned int mitk::GetNumberOfSlabThreads()
+{
+    const unsigned int threads = std::max(1u, static_cast<unsigned int>(itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads()));
+    return ThreadLimit > 0 ? std::min(ThreadLimit, threads) : threads;
+}
+
+void mitk::TimeStepParallelFor(unsigned int numberOfTimeSteps, unsigned int maxConcurrentTimeSteps,
+    const std::function<void(unsigned int)>& timeStepFunction, const std::function<void(unsigned int)>& timeStepDone)
+{
+    const unsigned int numberOfThreads = GetNumberOfSlabThreads();
+    const unsigned int waveSize = maxConcurrentTimeSteps > 0 ? maxConcurrentTimeSteps : numberOfThreads;
+
+    // the first time step alone, for an early preview
+    unsigned int first = 0;
+    unsigned int count = std::min(1u, numberOfTimeSteps);
+    while (count > 0)
+    {
+        if (count < numberOfThreads || InsideWorker)
+        {
+            for (unsigned int timeStep = first; timeStep < first + count; ++timeStep)
+            {
+                timeStepFunction(timeStep);
+                if (timeStepDone)
+                    timeStepDone(timeStep);
+            }
+        }
+        else
+        {
+            SlabParallelFor(count, [&](unsigned int i)
+            {
+                timeStepFunction(first + i);
+            });
+            for (unsigned int timeStep = first; timeStep < first + count; ++timeStep)
+            {
+                if (timeStepDone)
+                    timeStepDone(timeStep);
+            }
+        }
+        first += count;
+        count = std::min(waveSize, numberOfTimeSteps - first);
+    }
+}
@@ -0,0 +1,312 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkSlabThreadPool.h"
+
+#include <itkMultiThreaderBase.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    thread_local mitk::SlabPriority CurrentPriority = mitk::SlabPriority::Normal;
+
+    // set on the workers of the pool
+    thread_local bool PoolWorker = false;
+
+    unsigned int ToIndex(mitk::SlabPriority priority)
+    {
+        return static_cast<unsigned int>(priority);
+    }
+
+    double Seconds(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+}
+
+struct mitk::SlabThreadPool::Loop
+{
+    const std::function<void(unsigned int)>* m_Function = nullptr;
+    SlabPriority m_Priority = SlabPriority::Normal;
+    unsigned int m_MaxThreads = 0;     // 0 for all workers
+    unsigned int m_Running = 0;        // chunks currently running
+    bool m_Started = false;
+    std::size_t m_Unstarted = 0;       // chunks still queued
+    std::size_t m_Unfinished = 0;      // chunks queued or running
+    Clock::time_point m_Submitted;
+    std::unique_ptr<NumaTopology> m_Topology;  // nullptr without node placement
+    std::atomic<bool> m_Failed{ false };
+    std::exception_ptr m_Error;
+};
+
+mitk::SlabPriorityScope::SlabPriorityScope(SlabPriority priority)
+    : m_Previous(CurrentPriority)
+{
+    CurrentPriority = priority;
+}
+
+mitk::SlabPriorityScope::~SlabPriorityScope()
+{
+    CurrentPriority = m_Previous;
+}
+
+mitk::SlabPriority mitk::GetCurrentSlabPriority()
+{
+    return CurrentPriority;
+}
+
+mitk::SlabThreadPool & mitk::SlabThreadPool::GetInstance()
+{
+    // never destroyed, joining the workers during static destruction can deadlock on some platforms
+    static SlabThreadPool* instance = new SlabThreadPool(
+        std::max(1u, static_cast<unsigned int>(itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads())));
+    return *instance;
+}
+
+mitk::SlabThreadPool::SlabThreadPool(unsigned int numberOfWorkers)
+    : m_NumberOfWorkers(numberOfWorkers)
+{
+    for (auto& deques : m_Deques)
+        deques.resize(numberOfWorkers);
+    m_Workers.reserve(numberOfWorkers);
+    for (unsigned int worker = 0; worker < numberOfWorkers; ++worker)
+        m_Workers.emplace_back(&SlabThreadPool::Work, this, worker);
+}
+
+void mitk::SlabThreadPool::ParallelFor(unsigned int numberOfSlabs, unsigned int maxThreads, SlabPriority priority,
+    const std::function<void(unsigned int)>& slabFunction, const NumaTopology* topology)
+{
+    if (numberOfSlabs == 0)
+        return;
+
+    // a worker waiting for other workers could exhaust the pool
+    if (PoolWorker)
+    {
+        for (unsigned int slab = 0; slab < numberOfSlabs; ++slab)
+            slabFunction(slab);
+        return;
+    }
+
+    const unsigned int numberOfWorkers = GetNumberOfWorkers();
+    const unsigned int participants = maxThreads > 0 ? std::min(maxThreads, numberOfWorkers) : numberOfWorkers;
+
+    auto loop = std::make_shared<Loop>();
+    loop->m_Function = &slabFunction;
+    loop->m_Priority = priority;
+    loop->m_MaxThreads = maxThreads;
+    loop->m_Submitted = Clock::now();
+
+    // chunks with the deque they are queued on
+    std::vector<std::pair<Chunk, unsigned int>> chunks;
+    if (nullptr != topology && topology->GetNumberOfNodes() > 1)
+    {
+        // the slab ranges of NumaTopology, each split into chunks on the same node
+        loop->m_Topology.reset(new NumaTopology(*topology));
+        const unsigned int numberOfRanges = NumaTopology::GetNumberOfWorkers(numberOfSlabs);
+        for (unsigned int range = 0; range < numberOfRanges; ++range)
+        {
+            const unsigned int first = static_cast<unsigned int>(static_cast<unsigned long long>(range) * numberOfSlabs / numberOfRanges);
+            const unsigned int last = static_cast<unsigned int>((range + 1ull) * numberOfSlabs / numberOfRanges);
+            const unsigned int chunkSize = std::max(1u, (last - first) / 4);
+            for (unsigned int chunkFirst = first; chunkFirst < last; chunkFirst += chunkSize)
+            {
+                Chunk chunk;
+                chunk.m_Loop = loop;
+                chunk.m_First = chunkFirst;
+                chunk.m_Last = std::min(last, chunkFirst + chunkSize);
+                chunk.m_Node = static_cast<int>(topology->GetNodeOfWorker(range, numberOfRanges));
+                chunks.emplace_back(chunk, range % numberOfWorkers);
+            }
+        }
+    }
+    else
+    {
+        const unsigned int chunkSize = std::max(1u, numberOfSlabs / (4 * participants));
+        const unsigned int numberOfChunks = (numberOfSlabs + chunkSize - 1) / chunkSize;
+        for (unsigned int c = 0; c < numberOfChunks; ++c)
+        {
+            Chunk chunk;
+            chunk.m_Loop = loop;
+            chunk.m_First = c * chunkSize;
+            chunk.m_Last = std::min(numberOfSlabs, chunk.m_First + chunkSize);
+            // consecutive chunks on one worker, the others are stolen
+            chunks.emplace_back(chunk, static_cast<unsigned int>(static_cast<unsigned long long>(c) * numberOfWorkers / numberOfChunks));
+        }
+    }
+    const std::size_t numberOfChunks = chunks.size();
+    loop->m_Unstarted = numberOfChunks;
+    loop->m_Unfinished = numberOfChunks;
+
+    const unsigned int p = ToIndex(priority);
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    // placed loops keep their ranges on the workers of the same index
+    const unsigned int firstWorker = loop->m_Topology ? 0 : m_NextWorker++ % numberOfWorkers;
+    for (const auto& chunk : chunks)
+        m_Deques[p][(firstWorker + chunk.second) % numberOfWorkers].push_back(chunk.first);
+    m_QueuedChunks[p] += numberOfChunks;
+    ++m_QueuedLoops[p];
+    m_WorkAvailable.notify_all();
+
+    m_LoopDone.wait(lock, [&loop]() { return loop->m_Unfinished == 0; });
+    lock.unlock();
+
+    if (loop->m_Error)
+        std::rethrow_exception(loop->m_Error);
+}
+
+bool mitk::SlabThreadPool::TakeChunkLocked(unsigned int worker, Chunk & chunk)
+{
+    auto runnable = [](const Chunk& candidate)
+    {
+        return candidate.m_Loop->m_MaxThreads == 0 || candidate.m_Loop->m_Running < candidate.m_Loop->m_MaxThreads;
+    };
+
+    const unsigned int numberOfWorkers = GetNumberOfWorkers();
+    for (unsigned int p = 0; p < NumberOfSlabPriorities; ++p)
+    {
+        if (m_QueuedChunks[p] == 0)
+            continue;
+        bool found = false;
+        // own deque from the front, then steal from the back of the others
+        auto& own = m_Deques[p][worker];
+        auto ownChunk = std::find_if(own.begin(), own.end(), runnable);
+        if (ownChunk != own.end())
+        {
+            chunk = *ownChunk;
+            own.erase(ownChunk);
+            found = true;
+        }
+        for (unsigned int i = 1; i < numberOfWorkers && !found; ++i)
+        {
+            auto& victim = m_Deques[p][(worker + i) % numberOfWorkers];
+            auto stolen = std::find_if(victim.rbegin(), victim.rend(), runnable);
+            if (stolen != victim.rend())
+            {
+                chunk = *stolen;
+                victim.erase(std::next(stolen).base());
+                found = true;
+            }
+        }
+        if (!found)
+            continue;
+
+        Loop& loop = *chunk.m_Loop;
+        --m_QueuedChunks[p];
+        ++m_RunningChunks[p];
+        ++loop.m_Running;
+        if (!loop.m_Started)
+        {
+            loop.m_Started = true;
+            const double wait = Seconds(Clock::now() - loop.m_Submitted);
+            ++m_Accumulated[p].m_StartedLoops;
+            m_Accumulated[p].m_WaitSum += wait;
+            m_Accumulated[p].m_MaxWait = std::max(m_Accumulated[p].m_MaxWait, wait);
+        }
+        if (--loop.m_Unstarted == 0)
+            --m_QueuedLoops[p];
+        return true;
+    }
+    return false;
+}
+
+void mitk::SlabThreadPool::FinishChunkLocked(const Chunk & chunk)
+{
+    Loop& loop = *chunk.m_Loop;
+    const unsigned int p = ToIndex(loop.m_Priority);
+    --m_RunningChunks[p];
+    ++m_Accumulated[p].m_Chunks;
+    --loop.m_Running;
+    if (--loop.m_Unfinished == 0)
+    {
+        const double latency = Seconds(Clock::now() - loop.m_Submitted);
+        ++m_Accumulated[p].m_Loops;
+        m_Accumulated[p].m_LatencySum += latency;
+        m_Accumulated[p].m_MaxLatency = std::max(m_Accumulated[p].m_MaxLatency, latency);
+        m_LoopDone.notify_all();
+    }
+    else if (loop.m_MaxThreads > 0 && loop.m_Unstarted > 0)
+    {
+        // a worker may have skipped the loop because of its thread limit
+        m_WorkAvailable.notify_all();
+    }
+}
+
+void mitk::SlabThreadPool::Work(unsigned int worker)
+{
+    PoolWorker = true;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true)
+    {
+        Chunk chunk;
+        while (!TakeChunkLocked(worker, chunk))
+            m_WorkAvailable.wait(lock);
+        lock.unlock();
+
+        Loop& loop = *chunk.m_Loop;
+        std::exception_ptr error;
+        if (!loop.m_Failed)
+        {
+            // slab loops started by the slab function take its priority
+            SlabPriorityScope priority(loop.m_Priority);
+            try
+            {
+                if (chunk.m_Node >= 0)
+                    loop.m_Topology->BindCurrentThread(static_cast<unsigned int>(chunk.m_Node));
+                else if (NumaTopology::GetCurrentNode() >= 0)
+                    NumaTopology::UnbindCurrentThread();
+                for (unsigned int slab = chunk.m_First; slab < chunk.m_Last; ++slab)
+                    (*loop.m_Function)(slab);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+                loop.m_Failed = true;
+            }
+        }
+
+        lock.lock();
+        if (error && !loop.m_Error)
+            loop.m_Error = error;
+        FinishChunkLocked(chunk);
+    }
+}
+
+mitk::SlabThreadPool::Metrics mitk::SlabThreadPool::GetMetrics(SlabPriority priority) const
+{
+    const unsigned int p = ToIndex(priority);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const Accumulated& accumulated = m_Accumulated[p];
+    Metrics metrics;
+    metrics.m_QueuedLoops = m_QueuedLoops[p];
+    metrics.m_QueuedChunks = m_QueuedChunks[p];
+    metrics.m_RunningChunks = m_RunningChunks[p];
+    metrics.m_StartedLoops = accumulated.m_StartedLoops;
+    metrics.m_CompletedLoops = accumulated.m_Loops;
+    metrics.m_CompletedChunks = accumulated.m_Chunks;
+    metrics.m_MeanWait = accumulated.m_StartedLoops > 0 ? accumulated.m_WaitSum / accumulated.m_StartedLoops : 0.;
+    metrics.m_MaxWait = accumulated.m_MaxWait;
+    metrics.m_MeanLatency = accumulated.m_Loops > 0 ? accumulated.m_LatencySum / accumulated.m_Loops : 0.;
+    metrics.m_MaxLatency = accumulated.m_MaxLatency;
+    return metrics;
+}
+
+void mitk::SlabThreadPool::ResetMetrics()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto& accumulated : m_Accumulated)
+        accumulated = Accumulated();
+}
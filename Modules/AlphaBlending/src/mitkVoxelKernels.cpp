@@ -0,0 +1,108 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkVoxelKernels.h"
+#include "mitkNumaTopology.h"
+
+#include <mitkExceptionMacro.h>
+
+#include <new>
+
+mitk::Image::Pointer mitk::VoxelKernels::AllocateLike(const mitk::Image * reference, const mitk::PixelType & pixelType, unsigned int slabSize)
+{
+    auto output = mitk::Image::New();
+    output->Initialize(pixelType, reference->GetDimension(), reference->GetDimensions());
+    output->SetTimeGeometry(reference->GetTimeGeometry()->Clone());
+
+    // the image owns its buffer, aliases of the data may outlive the mitk::Image
+    const std::size_t pixelSize = pixelType.GetSize();
+    const std::size_t bytes = GetNumberOfVoxels(reference) * pixelSize;
+    auto* data = new (std::nothrow) unsigned char[bytes];
+    if (nullptr == data)
+    {
+        mitkThrow() << "Could not allocate an image of " << bytes << " bytes.";
+    }
+    // place the pages before anything else writes to them
+    NumaTopology::FirstTouch(data, bytes, GetSliceSize(reference) * std::max(1u, slabSize) * pixelSize);
+    output->SetImportChannel(data, 0, mitk::Image::ManageMemory);
+    return output;
+}
+
+std::size_t mitk::VoxelKernels::GetNumberOfVoxels(const mitk::Image * image)
+{
+    std::size_t n = 1;
+    for (unsigned int d = 0; d < image->GetDimension(); ++d)
+        n *= image->GetDimension(d);
+    return n;
+}
+
+std::size_t mitk::VoxelKernels::GetSliceSize(const mitk::Image * image)
+{
+    std::size_t n = image->GetDimension(0);
+    if (image->GetDimension() > 1)
+        n *= image->GetDimension(1);
+    return n;
+}
+
+unsigned int mitk::VoxelKernels::GetNumberOfSlabs(const mitk::Image * image, unsigned int slabSize)
+{
+    const std::size_t slabVoxels = GetSliceSize(image) * std::max(1u, slabSize);
+    return static_cast<unsigned int>((GetNumberOfVoxels(image) + slabVoxels - 1) / slabVoxels);
+}
+
+mitk::DECTKernels::BufferView mitk::VoxelKernels::GetBufferView(const mitk::Image * image, const void * data)
+{
+    if (image->GetPixelType().GetNumberOfComponents() != 1)
+    {
+        mitkThrow() << "Raw buffer kernels need scalar images, got " << image->GetPixelType().GetPixelTypeAsString();
+    }
+
+    DECTKernels::PixelType pixelType;
+    switch (image->GetPixelType().GetComponentType())
+    {
+    case itk::ImageIOBase::CHAR:
+        pixelType = mitkDECTInt8;
+        break;
+    case itk::ImageIOBase::UCHAR:
+        pixelType = mitkDECTUInt8;
+        break;
+    case itk::ImageIOBase::SHORT:
+        pixelType = mitkDECTInt16;
+        break;
+    case itk::ImageIOBase::USHORT:
+        pixelType = mitkDECTUInt16;
+        break;
+    case itk::ImageIOBase::INT:
+        pixelType = mitkDECTInt32;
+        break;
+    case itk::ImageIOBase::UINT:
+        pixelType = mitkDECTUInt32;
+        break;
+    case itk::ImageIOBase::LONG:
+        pixelType = image->GetPixelType().GetSize() == 8 ? mitkDECTInt64 : mitkDECTInt32;
+        break;
+    case itk::ImageIOBase::ULONG:
+        pixelType = image->GetPixelType().GetSize() == 8 ? mitkDECTUInt64 : mitkDECTUInt32;
+        break;
+    case itk::ImageIOBase::FLOAT:
+        pixelType = mitkDECTFloat;
+        break;
+    case itk::ImageIOBase::DOUBLE:
+        pixelType = mitkDECTDouble;
+        break;
+    default:
+        mitkThrow() << "Raw buffer kernels do not support the pixel type " << image->GetPixelType().GetComponentTypeAsString();
+    }
+
+    // the buffer is only written through views of images created by the kernels
+    return DECTKernels::BufferView(const_cast<void*>(data), pixelType, image->GetDimension(0), image->GetDimension(1), image->GetDimension(2),
+        image->GetDimension(3));
+}
@@ -0,0 +1,202 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkVoxelStatistics.h"
+
+#include <mitkProperties.h>
+#include <mitkVectorProperty.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const char* const MinimumProperty = "dect.statistics.minimum";
+    const char* const MaximumProperty = "dect.statistics.maximum";
+    const char* const MeanProperty = "dect.statistics.mean";
+    const char* const StandardDeviationProperty = "dect.statistics.standard deviation";
+    const char* const HistogramRangeProperty = "dect.statistics.histogram range";
+    const char* const HistogramProperty = "dect.statistics.histogram";
+
+    bool GetDouble(const mitk::Image* image, const char* name, double& value)
+    {
+        auto property = dynamic_cast<mitk::DoubleProperty*>(image->GetProperty(name).GetPointer());
+        if (nullptr == property)
+            return false;
+        value = property->GetValue();
+        return true;
+    }
+}
+
+mitk::VoxelStatistics mitk::VoxelStatistics::ForHU()
+{
+    // 4 HU per bin
+    return VoxelStatistics();
+}
+
+mitk::VoxelStatistics mitk::VoxelStatistics::ForRED()
+{
+    VoxelStatistics statistics;
+    statistics.m_HistogramMinimum = 0.;
+    statistics.m_HistogramMaximum = 4.;
+    statistics.m_NumberOfBins = 1000;
+    return statistics;
+}
+
+void mitk::VoxelStatistics::Reset(unsigned int numberOfPartials)
+{
+    m_Partials.assign(numberOfPartials, Partial());
+    for (auto& partial : m_Partials)
+        partial.m_Histogram.assign(m_NumberOfBins, 0);
+}
+
+void mitk::VoxelStatistics::Accumulate(unsigned int partialIndex, const double * values, std::size_t count)
+{
+    if (count == 0)
+        return;
+
+    Partial& partial = m_Partials[partialIndex];
+    if (partial.m_Count == 0)
+    {
+        partial.m_Shift = values[0];
+        partial.m_Minimum = values[0];
+        partial.m_Maximum = values[0];
+    }
+
+    const double binScale = m_NumberOfBins / (m_HistogramMaximum - m_HistogramMinimum);
+    const double lastBin = m_NumberOfBins - 1.;
+    double sum = 0.;
+    double sumOfSquares = 0.;
+    double minimum = partial.m_Minimum;
+    double maximum = partial.m_Maximum;
+    std::uint64_t* histogram = partial.m_Histogram.data();
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const double value = values[i];
+        const double shifted = value - partial.m_Shift;
+        sum += shifted;
+        sumOfSquares += shifted * shifted;
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+        ++histogram[static_cast<std::size_t>(std::min(lastBin, std::max(0., (value - m_HistogramMinimum) * binScale)))];
+    }
+
+    partial.m_Count += count;
+    partial.m_Sum += sum;
+    partial.m_SumOfSquares += sumOfSquares;
+    partial.m_Minimum = minimum;
+    partial.m_Maximum = maximum;
+}
+
+void mitk::VoxelStatistics::Merge()
+{
+    m_Count = 0;
+    m_Mean = 0.;
+    m_Histogram.assign(m_NumberOfBins, 0);
+    double m2 = 0.;
+
+    for (const auto& partial : m_Partials)
+    {
+        if (partial.m_Count == 0)
+            continue;
+
+        // combine mean and sum of squared deviations pairwise, see Chan et al.
+        const double n = static_cast<double>(partial.m_Count);
+        const double mean = partial.m_Shift + partial.m_Sum / n;
+        const double partialM2 = std::max(0., partial.m_SumOfSquares - partial.m_Sum * partial.m_Sum / n);
+
+        if (m_Count == 0)
+        {
+            m_Minimum = partial.m_Minimum;
+            m_Maximum = partial.m_Maximum;
+        }
+        m_Minimum = std::min(m_Minimum, partial.m_Minimum);
+        m_Maximum = std::max(m_Maximum, partial.m_Maximum);
+
+        const double count = static_cast<double>(m_Count);
+        const double total = count + n;
+        const double delta = mean - m_Mean;
+        m_Mean += delta * n / total;
+        m2 += partialM2 + delta * delta * count * n / total;
+        m_Count += partial.m_Count;
+
+        for (unsigned int bin = 0; bin < m_NumberOfBins; ++bin)
+            m_Histogram[bin] += partial.m_Histogram[bin];
+    }
+
+    m_StandardDeviation = m_Count > 0 ? std::sqrt(m2 / m_Count) : 0.;
+    m_Partials.clear();
+}
+
+double mitk::VoxelStatistics::GetPercentile(double fraction) const
+{
+    std::uint64_t total = 0;
+    for (auto count : m_Histogram)
+        total += count;
+    if (total == 0)
+        return m_Minimum;
+
+    const double binWidth = (m_HistogramMaximum - m_HistogramMinimum) / m_NumberOfBins;
+    const double target = std::min(1., std::max(0., fraction)) * total;
+    double cumulative = 0.;
+    for (std::size_t bin = 0; bin < m_Histogram.size(); ++bin)
+    {
+        if (m_Histogram[bin] > 0 && cumulative + m_Histogram[bin] >= target)
+        {
+            const double value = m_HistogramMinimum + (bin + (target - cumulative) / m_Histogram[bin]) * binWidth;
+            return std::min(m_Maximum, std::max(m_Minimum, value));
+        }
+        cumulative += m_Histogram[bin];
+    }
+    return m_Maximum;
+}
+
+void mitk::VoxelStatistics::AttachTo(mitk::Image * image) const
+{
+    image->SetProperty(MinimumProperty, mitk::DoubleProperty::New(m_Minimum));
+    image->SetProperty(MaximumProperty, mitk::DoubleProperty::New(m_Maximum));
+    image->SetProperty(MeanProperty, mitk::DoubleProperty::New(m_Mean));
+    image->SetProperty(StandardDeviationProperty, mitk::DoubleProperty::New(m_StandardDeviation));
+
+    auto range = mitk::DoubleVectorProperty::New();
+    range->SetValue({ m_HistogramMinimum, m_HistogramMaximum });
+    image->SetProperty(HistogramRangeProperty, range);
+
+    auto histogram = mitk::DoubleVectorProperty::New();
+    histogram->SetValue(std::vector<double>(m_Histogram.begin(), m_Histogram.end()));
+    image->SetProperty(HistogramProperty, histogram);
+}
+
+bool mitk::VoxelStatistics::ReadFrom(const mitk::Image * image, VoxelStatistics & statistics)
+{
+    auto range = dynamic_cast<mitk::DoubleVectorProperty*>(image->GetProperty(HistogramRangeProperty).GetPointer());
+    auto histogram = dynamic_cast<mitk::DoubleVectorProperty*>(image->GetProperty(HistogramProperty).GetPointer());
+    if (nullptr == range || nullptr == histogram || range->GetValue().size() != 2 || histogram->GetValue().empty())
+        return false;
+
+    VoxelStatistics result;
+    if (!GetDouble(image, MinimumProperty, result.m_Minimum) || !GetDouble(image, MaximumProperty, result.m_Maximum)
+        || !GetDouble(image, MeanProperty, result.m_Mean) || !GetDouble(image, StandardDeviationProperty, result.m_StandardDeviation))
+        return false;
+
+    result.m_HistogramMinimum = range->GetValue()[0];
+    result.m_HistogramMaximum = range->GetValue()[1];
+    result.m_NumberOfBins = static_cast<unsigned int>(histogram->GetValue().size());
+    for (double count : histogram->GetValue())
+    {
+        result.m_Histogram.push_back(static_cast<std::uint64_t>(count));
+        result.m_Count += static_cast<std::size_t>(count);
+    }
+
+    statistics = result;
+    return true;
+}
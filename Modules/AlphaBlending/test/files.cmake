@@ -4,4 +4,14 @@ set(MODULE_TESTS
 #  mitkImportExternalAlphaValues.cpp
 #)
 #SET(MODULE_CUSTOM_TESTS
-)
\ No newline at end of file
+)
+
+# performance tests need the baseline as argument, they are registered in CMakeLists.txt
+set(MODULE_CUSTOM_TESTS
+   mitkAlphaBlendingPerformanceTest.cpp
+)
+
+# helpers compiled into the test driver
+set(TEST_CPP_FILES
+   mitkDECTPhantom.cpp
+)
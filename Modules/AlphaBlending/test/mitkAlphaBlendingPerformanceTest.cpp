@@ -0,0 +1,327 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include <mitkAlphaBlendingTool.h>
+#include <mitkBodyMask.h>
+#include <mitkDECTKernels.h>
+#include "mitkDECTPhantom.h"
+#include <mitkTestingMacros.h>
+#include <mitkImage.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkImageWriteAccessor.h>
+#include <mitkSlabParallelFor.h>
+#include <mitkVoxelKernels.h>
+
+#include <itkMemoryUsageObserver.h>
+#include <itksys/SystemInformation.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Performance regression test of the AlphaBlendingTool, registered with the label "Performance".
+ *
+ * Every operation runs on the same synthetic 256|256|64 int16 volume pair of mitk::DECTPhantom. The best throughput
+ * in megavoxels per second of a few repetitions is measured, and in one more run the peak of the resident memory
+ * above the memory before the call. The peak is sampled in a background thread while the call runs, so temporaries
+ * released before it returns are included. Absolute throughput depends on the machine, so it is divided by the
+ * throughput of a parallel copy of the low volume in the same run. The baseline JSON file has flat entries
+ * "<operation>.relativeThroughput" and "<operation>.memory" (MB), the test fails if the relative throughput drops or
+ * the memory grows by more than the threshold fraction. The relative throughput depends on the number of threads
+ * sharing the memory bandwidth, so it is only checked if "build.optimized" and "machine.threads" of the baseline match
+ * this build and machine. The measured values are written in the same format together with the machine and build
+ * they were measured on, so a reference machine can update the baseline by copying them.
+ *
+ * usage: mitkAlphaBlendingPerformanceTest <baseline.json> [threshold] [measured.json]
+ */
+namespace
+{
+	const unsigned int SizeX = 256;
+	const unsigned int SizeY = 256;
+	const unsigned int SizeZ = 64;
+	const unsigned int Repetitions = 3;
+	const double MemorySlackMB = 4.;   // absolute tolerance for allocator and thread stack noise
+	const std::chrono::microseconds SamplingInterval(500);
+
+	struct Measurement
+	{
+		double m_Throughput = 0.;  // megavoxels per second
+		double m_Memory = 0.;      // MB
+	};
+
+	double GetResidentMB()
+	{
+		itk::MemoryUsageObserver observer;
+		return observer.GetMemoryUsage() / 1024.;
+	}
+
+	/**
+	 * Samples the resident memory in a background thread from construction until Stop.
+	 */
+	class PeakResidentSampler
+	{
+	public:
+		PeakResidentSampler() : m_Running(true), m_Peak(GetResidentMB()), m_Thread([this]() { this->Sample(); }) {}
+		~PeakResidentSampler() { Stop(); }
+
+		/**
+		 * Stops the sampling and returns the peak in MB.
+		 */
+		double Stop()
+		{
+			if (m_Thread.joinable())
+			{
+				m_Running = false;
+				m_Thread.join();
+				m_Peak = std::max(m_Peak, GetResidentMB());
+			}
+			return m_Peak;
+		}
+
+	private:
+		void Sample()
+		{
+			while (m_Running)
+			{
+				m_Peak = std::max(m_Peak, GetResidentMB());
+				std::this_thread::sleep_for(SamplingInterval);
+			}
+		}
+
+		std::atomic<bool> m_Running;
+		double m_Peak;  // written by the sampling thread until it is joined
+		std::thread m_Thread;
+	};
+
+	Measurement Measure(const std::function<mitk::Image::Pointer()>& operation)
+	{
+		Measurement measurement;
+		const double voxels = static_cast<double>(SizeX) * SizeY * SizeZ;
+		double bestSeconds = 0.;
+		for (unsigned int repetition = 0; repetition <= Repetitions; ++repetition)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			mitk::Image::Pointer result = operation();
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			// the first run warms up caches and the thread pool, it is not timed
+			if (repetition > 0)
+				bestSeconds = repetition == 1 ? seconds : std::min(bestSeconds, seconds);
+		}
+		measurement.m_Throughput = voxels / 1e6 / std::max(bestSeconds, 1e-9);
+
+		// the sampling thread would take time from the timed runs, so the memory is measured in a run of its own
+		const double residentBefore = GetResidentMB();
+		PeakResidentSampler sampler;
+		mitk::Image::Pointer result = operation();
+		measurement.m_Memory = std::max(0., sampler.Stop() - residentBefore);
+		return measurement;
+	}
+
+	std::map<std::string, double> ReadBaseline(const std::string& filename)
+	{
+		std::map<std::string, double> baseline;
+		std::ifstream file(filename);
+		std::stringstream content;
+		content << file.rdbuf();
+
+		const std::string text = content.str();
+		const std::regex entry("\"([^\"]+)\"\\s*:\\s*(-?[0-9.]+(?:[eE][-+]?[0-9]+)?)");
+		for (std::sregex_iterator it(text.begin(), text.end(), entry), end; it != end; ++it)
+			baseline[(*it)[1].str()] = std::stod((*it)[2].str());
+		return baseline;
+	}
+
+	bool IsOptimizedBuild()
+	{
+#ifdef NDEBUG
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	std::string GetCompiler()
+	{
+#if defined(_MSC_VER)
+		return "MSVC " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+		return "Clang " __clang_version__;
+#elif defined(__GNUC__)
+		return "GCC " __VERSION__;
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string GetProcessor()
+	{
+		itksys::SystemInformation information;
+		information.RunCPUCheck();
+		std::string name = information.GetExtendedProcessorName();
+		name.erase(std::remove_if(name.begin(), name.end(), [](char c) { return c == '"' || c == '\\'; }), name.end());
+		return name;
+	}
+
+	void WriteMeasurements(const std::string& filename, const std::map<std::string, Measurement>& measurements, double copyThroughput)
+	{
+		std::ofstream file(filename);
+		file << "{\n";
+		file << "  \"machine.processor\": \"" << GetProcessor() << "\",\n";
+		file << "  \"machine.threads\": " << std::thread::hardware_concurrency() << ",\n";
+		file << "  \"build.compiler\": \"" << GetCompiler() << "\",\n";
+		file << "  \"build.optimized\": " << (IsOptimizedBuild() ? 1 : 0) << ",\n";
+		file << "  \"Copy.throughput\": " << copyThroughput << (measurements.empty() ? "\n" : ",\n");
+		std::size_t written = 0;
+		for (const auto& measurement : measurements)
+		{
+			file << "  \"" << measurement.first << ".throughput\": " << measurement.second.m_Throughput << ",\n";
+			file << "  \"" << measurement.first << ".relativeThroughput\": " << measurement.second.m_Throughput / copyThroughput << ",\n";
+			file << "  \"" << measurement.first << ".memory\": " << measurement.second.m_Memory << (++written < measurements.size() ? ",\n" : "\n");
+		}
+		file << "}\n";
+	}
+}
+
+int mitkAlphaBlendingPerformanceTest(int argc, char* argv[])
+{
+	MITK_TEST_BEGIN("AlphaBlendingPerformance");
+	MITK_TEST_CONDITION_REQUIRED(argc >= 2, "Test needs the baseline file as first argument.");
+
+	const std::map<std::string, double> baseline = ReadBaseline(argv[1]);
+	MITK_TEST_CONDITION_REQUIRED(!baseline.empty(), "Baseline " << argv[1] << " should contain measurements.");
+	const double threshold = argc >= 3 ? std::atof(argv[2]) : 0.2;
+
+	mitk::AlphaBlendingTool tool;
+	mitk::DECTPhantom phantom;
+	phantom.m_Size[0] = SizeX;
+	phantom.m_Size[1] = SizeY;
+	phantom.m_Size[2] = SizeZ;
+	phantom.m_LowNoise = 15.;
+	phantom.m_HighNoise = 10.;
+	mitk::DECTPhantom::Images images = phantom.Generate();
+	mitk::Image::Pointer high = images.m_High;
+	mitk::Image::Pointer low = images.m_Low;
+	const double alpha = 0.6;
+	mitk::Image::Pointer hu = tool.AlphaBlending(high, low, alpha);
+	const mitk::BodyMask mask = mitk::BodyMask::FromThreshold(low);
+
+	// the reference for the throughput of this machine, copying the low volume slice by slice on all cores
+	double copyThroughput = 0.;
+	{
+		mitk::Image::Pointer copy = mitk::Image::New();
+		copy->Initialize(low);
+		mitk::ImageReadAccessor lowAccessor(low);
+		mitk::ImageWriteAccessor copyAccessor(copy);
+		const char* source = static_cast<const char*>(lowAccessor.GetData());
+		char* target = static_cast<char*>(copyAccessor.GetData());
+		const std::size_t sliceBytes = static_cast<std::size_t>(SizeX) * SizeY * sizeof(short);
+		copyThroughput = Measure([&]()
+		{
+			mitk::SlabParallelFor(SizeZ, [&](unsigned int z) { std::memcpy(target + z * sliceBytes, source + z * sliceBytes, sliceBytes); });
+			return copy;
+		}).m_Throughput;
+	}
+	MITK_TEST_OUTPUT(<< "Copy: " << copyThroughput << " megavoxels/s");
+
+	std::map<std::string, Measurement> measurements;
+	measurements["AlphaBlending"] = Measure([&]() { return tool.AlphaBlending(high, low, alpha); });
+	measurements["MaskedAlphaBlending"] = Measure([&]() { return tool.AlphaBlending(high, low, alpha, mask); });
+	measurements["FixedPointAlphaBlending"] = Measure([&]() { return tool.FixedPointAlphaBlending(high, low, alpha); });
+	{
+		// the integer row kernel alone, into a preallocated int16 buffer
+		mitk::Image::Pointer fixedPoint = tool.FixedPointAlphaBlending(high, low, alpha);
+		mitk::ImageReadAccessor highAccessor(high);
+		mitk::ImageReadAccessor lowAccessor(low);
+		mitk::ImageWriteAccessor outputAccessor(fixedPoint);
+		const mitk::DECTKernels::BufferView highView = mitk::VoxelKernels::GetBufferView(high, highAccessor.GetData());
+		const mitk::DECTKernels::BufferView lowView = mitk::VoxelKernels::GetBufferView(low, lowAccessor.GetData());
+		const mitk::DECTKernels::BufferView outputView = mitk::VoxelKernels::GetBufferView(fixedPoint, outputAccessor.GetData());
+		measurements["FixedPointAlphaBlendingKernel"] = Measure([&]()
+		{
+			mitk::DECTKernels::FixedPointAlphaBlending(highView, lowView, alpha, outputView);
+			return fixedPoint;
+		});
+	}
+	{
+		// the double row kernels alone, into preallocated double buffers
+		mitk::Image::Pointer blended = tool.AlphaBlending(high, low, alpha);
+		mitk::Image::Pointer red = tool.ConvertToRED(hu);
+		mitk::ImageReadAccessor highAccessor(high);
+		mitk::ImageReadAccessor lowAccessor(low);
+		mitk::ImageReadAccessor huAccessor(hu);
+		mitk::ImageWriteAccessor blendedAccessor(blended);
+		mitk::ImageWriteAccessor redAccessor(red);
+		const mitk::DECTKernels::BufferView highView = mitk::VoxelKernels::GetBufferView(high, highAccessor.GetData());
+		const mitk::DECTKernels::BufferView lowView = mitk::VoxelKernels::GetBufferView(low, lowAccessor.GetData());
+		const mitk::DECTKernels::BufferView huView = mitk::VoxelKernels::GetBufferView(hu, huAccessor.GetData());
+		const mitk::DECTKernels::BufferView blendedView = mitk::VoxelKernels::GetBufferView(blended, blendedAccessor.GetData());
+		const mitk::DECTKernels::BufferView redView = mitk::VoxelKernels::GetBufferView(red, redAccessor.GetData());
+		measurements["AlphaBlendingKernel"] = Measure([&]()
+		{
+			mitk::DECTKernels::AlphaBlending(highView, lowView, alpha, blendedView);
+			return blended;
+		});
+		measurements["ConvertToREDKernel"] = Measure([&]()
+		{
+			mitk::DECTKernels::ConvertToRED(huView, redView);
+			return red;
+		});
+	}
+	measurements["ConvertToRED"] = Measure([&]() { return tool.ConvertToRED(hu); });
+	measurements["AlphaBlendingToSPR"] = Measure([&]() { return tool.AlphaBlendingToSPR(high, low, alpha); });
+
+	if (argc >= 4)
+		WriteMeasurements(argv[3], measurements, copyThroughput);
+
+	auto optimized = baseline.find("build.optimized");
+	auto threads = baseline.find("machine.threads");
+	const bool checkThroughput = (optimized == baseline.end() || (optimized->second != 0.) == IsOptimizedBuild())
+		&& (threads == baseline.end() || threads->second == std::thread::hardware_concurrency());
+	if (!checkThroughput)
+		MITK_TEST_OUTPUT(<< "The baseline was measured with another build type or number of threads, the throughput is not checked.");
+
+	for (const auto& measurement : measurements)
+	{
+		const std::string& name = measurement.first;
+		const double relativeThroughput = measurement.second.m_Throughput / copyThroughput;
+		MITK_TEST_OUTPUT(<< name << ": " << measurement.second.m_Throughput << " megavoxels/s (" << relativeThroughput << " of the copy), "
+			<< measurement.second.m_Memory << " MB");
+
+		auto throughput = baseline.find(name + ".relativeThroughput");
+		auto memory = baseline.find(name + ".memory");
+		if (throughput == baseline.end() || memory == baseline.end())
+		{
+			MITK_TEST_OUTPUT(<< name << " has no baseline yet, it is not checked.");
+			continue;
+		}
+
+		if (checkThroughput)
+			MITK_TEST_CONDITION(relativeThroughput >= throughput->second * (1. - threshold),
+				name << " relative throughput " << relativeThroughput << " should not drop below the baseline " << throughput->second);
+		MITK_TEST_CONDITION(measurement.second.m_Memory <= memory->second * (1. + threshold) + MemorySlackMB,
+			name << " memory " << measurement.second.m_Memory << " MB should not exceed the baseline " << memory->second << " MB");
+	}
+
+	MITK_TEST_END();
+}
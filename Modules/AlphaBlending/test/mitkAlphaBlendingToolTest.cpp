@@ -1,14 +1,108 @@
 
 #include <mitkAlphaBlendingTool.h>
+#include <mitkAlphaBlendingFilter.h>
+#include <mitkAdaptiveAlphaBlending.h>
+#include <mitkAutoTuner.h>
+#include <mitkBodyMask.h>
+#include <mitkBoundedQueue.h>
+#include <mitkBrickedVolume.h>
+#include <mitkBufferPool.h>
+#include <mitkDECTKernels.h>
+#include "mitkDECTPhantom.h"
+#include <mitkDECTSeriesLoader.h>
+#include <mitkDECTWatchFolderService.h>
+#include <mitkCompressedVolumeWriter.h>
+#include <mitkImageReadAccessor.h>
+#include <mitkExecutionPlanner.h>
+#include <mitkFixedPointAlphaBlending.h>
+#include <mitkImageExpression.h>
+#include <mitkImagePyramid.h>
+#include <mitkNumaTopology.h>
+#include <mitkREDConversionFilter.h>
+#include <mitkRigidAlignment.h>
+#include <mitkSlabParallelFor.h>
+#include <mitkSlabThreadPool.h>
+#include <mitkVoxelStatistics.h>
 #include <mitkTestFixture.h>
 #include <mitkTestingMacros.h>
 #include <mitkImage.h>
 #include <mitkIOUtil.h>
+#include <mitkProperties.h>
+#include <mitkStandaloneDataStorage.h>
+#include <mitkStringProperty.h>
 
 #include <mitkEqual.h>
 #include <mitkImageGenerator.h>
+#include <itkGDCMImageIO.h>
+#include <itkImageFileWriter.h>
+#include <itkMetaDataObject.h>
 #include <itkImageRegionIterator.h>
 #include <itkImage.h>
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	/**
+	 * @brief      Replaces the current NUMA topology and restores the previous one when it goes out of scope,
+	 * also if an assertion fails.
+	 */
+	class NumaTopologyGuard
+	{
+	public:
+		explicit NumaTopologyGuard(const mitk::NumaTopology& topology)
+			: m_Previous(mitk::NumaTopology::GetCurrent())
+		{
+			mitk::NumaTopology::SetCurrent(topology);
+		}
+
+		~NumaTopologyGuard()
+		{
+			mitk::NumaTopology::SetCurrent(m_Previous);
+		}
+
+	private:
+		mitk::NumaTopology m_Previous;
+	};
+
+	/**
+	 * @brief      Blending filter counting the slices its kernel computes, to check that a pipeline request computes
+	 * the requested slices only.
+	 */
+	class SliceCountingAlphaBlendingFilter : public mitk::AlphaBlendingFilter
+	{
+	public:
+		mitkClassMacro(SliceCountingAlphaBlendingFilter, mitk::AlphaBlendingFilter);
+		itkFactorylessNewMacro(Self);
+
+		std::atomic<std::size_t> m_ComputedSlices{ 0 };
+
+	protected:
+		void GenerateSlices(const std::vector<mitk::DECTKernels::BufferView>& inputs, const mitk::DECTKernels::BufferView& output) override
+		{
+			m_ComputedSlices += output.m_Size[2];
+			Superclass::GenerateSlices(inputs, output);
+		}
+	};
+}
 
 class mitkAlphaBlendingToolTestSuite : public mitk::TestFixture
 {
@@ -17,6 +111,40 @@ class mitkAlphaBlendingToolTestSuite : public mitk::TestFixture
 	MITK_TEST(TestNumericAlphaBlending);
 	MITK_TEST(TestNumericREDConversion);
 	MITK_TEST(TestFailingReadExResource);
+	MITK_TEST(TestNumericSPRConversion);
+	MITK_TEST(TestFusedBlendingToSPR);
+	MITK_TEST(TestZeffSPRConversion);
+	MITK_TEST(TestAdaptiveBlendingWithoutStrength);
+	MITK_TEST(TestAdaptiveBlendingNoiseFreeInput);
+	MITK_TEST(TestBoxMean);
+	MITK_TEST(TestSeriesModeMatching);
+	MITK_TEST(TestSeriesPairing);
+	MITK_TEST(TestSeriesLoading);
+	MITK_TEST(TestCompressedExport);
+	MITK_TEST(TestExecutionPlanning);
+	MITK_TEST(TestSlabStreamedExecution);
+	MITK_TEST(TestThresholdBodyMask);
+	MITK_TEST(TestMaskedComputation);
+	MITK_TEST(TestFixedPointBlending);
+	MITK_TEST(TestImageExpression);
+	MITK_TEST(TestSamePassStatistics);
+	MITK_TEST(TestPyramidGeneration);
+	MITK_TEST(TestNumaPlacement);
+	MITK_TEST(TestBufferPool);
+	MITK_TEST(TestWatchFolderPipeline);
+	MITK_TEST(TestWatchFolderConversion);
+	MITK_TEST(TestRawBufferKernels);
+	MITK_TEST(TestEnergyBinCombination);
+	MITK_TEST(TestIncrementalBlending);
+	MITK_TEST(TestTimeStepProcessing);
+	MITK_TEST(TestRigidAlignment);
+	MITK_TEST(TestSyntheticPhantom);
+	MITK_TEST(TestAutotuning);
+	MITK_TEST(TestPriorityThreadPool);
+	MITK_TEST(TestBrickedVolume);
+	MITK_TEST(TestBrickedDataNode);
+	MITK_TEST(TestAlphaMapBlending);
+	MITK_TEST(TestPipelineFilters);
 	CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -142,6 +270,1371 @@ public:
 
 	}
 
+	void TestNumericSPRConversion()
+	{
+		// with the default parameters tissue and water share the same mean excitation energy, so SPR equals RED
+		mitk::Image::Pointer sprImage = m_BlendingTool->ConvertToSPR(m_LowImage);
+		CPPUNIT_ASSERT_MESSAGE("Failed to create SPR image.", sprImage.IsNotNull());
+		MITK_ASSERT_EQUAL(m_ExpectedREDImage, sprImage, "SPR image should equal the RED image for water like tissue.");
+
+		// a higher mean excitation energy lowers the stopping power
+		mitk::AlphaBlendingTool tool;
+		mitk::SPRParameters parameters;
+		parameters.m_TissueExcitationEnergy = 112.;
+		tool.SetSPRParameters(parameters);
+		CPPUNIT_ASSERT_MESSAGE("SPR factor for bone like tissue should be below one.", parameters.GetConstantSPRFactor() < 1.);
+
+		double factor = parameters.GetConstantSPRFactor();
+		double vals[8] = { 1. * factor, 1.001 * factor, 1.002 * factor, 1.003 * factor, 1.004 * factor, 1.005 * factor, 1.006 * factor, 1.007 * factor };
+		mitk::Image::Pointer expected = createImage(vals);
+		mitk::Image::Pointer boneImage = tool.ConvertToSPR(m_LowImage);
+		MITK_ASSERT_EQUAL(expected, boneImage, "SPR image should be the RED image scaled by the Bethe factor.");
+	}
+
+	void TestFusedBlendingToSPR()
+	{
+		// the fused single pass has to match the chained blending and conversion
+		mitk::Image::Pointer huImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		mitk::Image::Pointer expected = m_BlendingTool->ConvertToSPR(huImage);
+		mitk::Image::Pointer sprImage = m_BlendingTool->AlphaBlendingToSPR(m_LowImage, m_HighImage, m_Alpha);
+
+		CPPUNIT_ASSERT_MESSAGE("Failed to create fused SPR image.", sprImage.IsNotNull());
+		MITK_ASSERT_EQUAL(expected, sprImage, "Fused SPR image should be the same as the chained result.");
+
+		CPPUNIT_ASSERT_THROW_MESSAGE(
+			"Calling fused SPR blending with two images of different dimensions should throw an exception.",
+			m_BlendingTool->AlphaBlendingToSPR(m_TwoDimensionImage, m_HighImage, m_Alpha),
+			mitk::Exception);
+	}
+
+	void TestZeffSPRConversion()
+	{
+		// Z_eff for which the soft tissue fit yields the mean excitation energy of water
+		mitk::SPRParameters parameters;
+		double zWater = (std::log(parameters.m_WaterExcitationEnergy) - parameters.m_SoftTissueOffset) / parameters.m_SoftTissueSlope;
+		double zVals[8] = { zWater, zWater, zWater, zWater, zWater, zWater, zWater, zWater };
+		mitk::Image::Pointer zEffImage = createImage(zVals);
+
+		mitk::Image::Pointer sprImage = m_BlendingTool->ConvertToSPR(m_LowImage, zEffImage);
+		CPPUNIT_ASSERT_MESSAGE("Failed to create SPR image from Z_eff.", sprImage.IsNotNull());
+		MITK_ASSERT_EQUAL(m_ExpectedREDImage, sprImage, "SPR image of water like Z_eff should equal the RED image.");
+
+		// a higher Z_eff means a higher mean excitation energy and a lower SPR, also across the bone threshold
+		mitk::Functor::HUAndZeffToSPR<double, double, double> functor;
+		functor.SetParameters(parameters);
+		const double threshold = parameters.m_ZeffThreshold;
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The SPR should be continuous at the bone threshold.",
+			functor(0., std::nextafter(threshold, 0.)), functor(0., threshold), 1e-12);
+		double previous = functor(0., 6.);
+		for (double z = 6.05; z < 16.; z += 0.05)
+		{
+			const double spr = functor(0., z);
+			CPPUNIT_ASSERT_MESSAGE("The SPR should decrease with Z_eff.", spr < previous);
+			previous = spr;
+		}
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Cortical bone should have a mean excitation energy of about 106 eV.",
+			106., std::exp(parameters.m_BoneSlope * 13.6 + parameters.GetBoneOffset()), 1.);
+	}
+
+	void TestAdaptiveBlendingWithoutStrength()
+	{
+		// without strength the adaptive blending falls back to the global alpha
+		mitk::Image::Pointer expected = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		mitk::Image::Pointer adaptive = m_BlendingTool->AdaptiveAlphaBlending(m_LowImage, m_HighImage, m_Alpha, 1, 0.);
+
+		CPPUNIT_ASSERT_MESSAGE("Failed to create image with adaptive alpha blending.", adaptive.IsNotNull());
+		MITK_ASSERT_EQUAL(expected, adaptive, "Adaptive blending with strength 0 should equal the global blend.");
+	}
+
+	void TestAdaptiveBlendingNoiseFreeInput()
+	{
+		// a constant high image has no local variance, so the noise optimal blend takes only the high image
+		double vals[8] = { 5., 5., 5., 5., 5., 5., 5., 5. };
+		mitk::Image::Pointer constantImage = createImage(vals);
+		mitk::Image::Pointer adaptive = m_BlendingTool->AdaptiveAlphaBlending(constantImage, m_LowImage, m_Alpha, 1, 1.);
+
+		MITK_ASSERT_EQUAL(constantImage, adaptive, "Noise optimal blend of a noise free image should return that image.");
+
+		CPPUNIT_ASSERT_THROW_MESSAGE(
+			"Calling adaptive blending with two images of different dimensions should throw an exception.",
+			m_BlendingTool->AdaptiveAlphaBlending(m_TwoDimensionImage, m_HighImage, m_Alpha),
+			mitk::Exception);
+	}
+
+	void TestBoxMean()
+	{
+		// 4|3|2 volume, the running sums have to match a brute force box mean for every radius
+		const std::size_t size[3] = { 4, 3, 2 };
+		std::vector<double> values(24);
+		for (std::size_t i = 0; i < values.size(); ++i)
+			values[i] = static_cast<double>((i * 7) % 5);
+
+		for (unsigned int radius = 0; radius < 4; ++radius)
+		{
+			std::vector<double> result = values;
+			mitk::AdaptiveAlphaBlending::BoxMean(result.data(), size, radius);
+
+			for (int z = 0; z < 2; ++z) for (int y = 0; y < 3; ++y) for (int x = 0; x < 4; ++x)
+			{
+				double sum = 0.;
+				int count = 0;
+				for (int k = z - (int)radius; k <= z + (int)radius; ++k) for (int j = y - (int)radius; j <= y + (int)radius; ++j) for (int i = x - (int)radius; i <= x + (int)radius; ++i)
+				{
+					if (i < 0 || j < 0 || k < 0 || i >= 4 || j >= 3 || k >= 2)
+						continue;
+					sum += values[(k * 3 + j) * 4 + i];
+					++count;
+				}
+				CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Box mean differs from brute force mean.", sum / count, result[(z * 3 + y) * 4 + x], 1e-12);
+			}
+		}
+	}
+
+	void TestSeriesModeMatching()
+	{
+		std::map<std::string, double> alphaValueMap = { { "DECT80kv/140kv", 1.455 }, { "DECT100kv/140kv", 1.7 }, { "custom", 1. } };
+
+		auto modes = mitk::DECTSeriesLoader::FindModes(100., 140., alphaValueMap);
+		CPPUNIT_ASSERT_MESSAGE("Exactly one mode should match 100/140 kVp.", modes.size() == 1 && modes.front() == "DECT100kv/140kv");
+
+		modes = mitk::DECTSeriesLoader::FindModes(90., 150., alphaValueMap);
+		CPPUNIT_ASSERT_MESSAGE("No mode should match 90/150 kVp.", modes.empty());
+	}
+
+	void TestSeriesPairing()
+	{
+		std::map<std::string, double> alphaValueMap = { { "DECT80kv/140kv", 1.455 } };
+
+		mitk::DECTSeriesLoader::SeriesInfo low, high, otherStudy;
+		low.m_StudyInstanceUID = high.m_StudyInstanceUID = "1.2.3";
+		low.m_FrameOfReferenceUID = high.m_FrameOfReferenceUID = "1.2.3.4";
+		low.m_SeriesInstanceUID = "1";
+		high.m_SeriesInstanceUID = "2";
+		low.m_KVP = 80.;
+		high.m_KVP = 140.;
+		low.m_Files = high.m_Files = { "a", "b" };
+
+		// a series of another study must never be paired with the low energy series
+		otherStudy = high;
+		otherStudy.m_SeriesInstanceUID = "3";
+		otherStudy.m_StudyInstanceUID = "9.9.9";
+
+		mitk::DECTSeriesLoader loader;
+		auto pairs = loader.PairSeries({ high, otherStudy, low }, alphaValueMap);
+
+		CPPUNIT_ASSERT_MESSAGE("Exactly one pair should be found.", pairs.size() == 1);
+		CPPUNIT_ASSERT_MESSAGE("Low energy series should be paired correctly.", pairs.front().m_Low.m_SeriesInstanceUID == "1");
+		CPPUNIT_ASSERT_MESSAGE("High energy series should be paired correctly.", pairs.front().m_High.m_SeriesInstanceUID == "2");
+		CPPUNIT_ASSERT_MESSAGE("Matching mode should be selected.", pairs.front().m_Modes.size() == 1 && pairs.front().m_Modes.front() == "DECT80kv/140kv");
+	}
+
+	void TestSeriesLoading()
+	{
+		// a 4x3x2 pair, the high energy series is unsigned 16 bit with values beyond the range of short
+		const unsigned int size[3] = { 4, 3, 2 };
+		std::vector<short> lowVoxels(24);
+		std::vector<unsigned short> highVoxels(24);
+		for (unsigned int i = 0; i < 24; ++i)
+		{
+			lowVoxels[i] = static_cast<short>(100 * i - 1000);
+			highVoxels[i] = static_cast<unsigned short>(40000 + i);
+		}
+		const std::string directory = mitk::IOUtil::CreateTemporaryDirectory("mitkDECTSeries_XXXXXX");
+		writeDicomSeries(directory, "1.2.826.0.1.3680043.9.7001.1", 80., size, lowVoxels.data());
+		writeDicomSeries(directory, "1.2.826.0.1.3680043.9.7001.2", 140., size, highVoxels.data());
+
+		std::map<std::string, double> alphaValueMap = { { "DECT80kv/140kv", 0.5 } };
+		mitk::DECTSeriesLoader loader;
+		const auto series = loader.ScanDirectory(directory);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Both series should be found.", std::size_t(2), series.size());
+		const auto pairs = loader.PairSeries(series, alphaValueMap);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The series should be paired.", std::size_t(1), pairs.size());
+		const mitk::DECTSeriesLoader::SeriesPair& pair = pairs.front();
+		CPPUNIT_ASSERT_MESSAGE("Signed 16 bit data should fit into short.", pair.m_Low.m_ShortPixels);
+		CPPUNIT_ASSERT_MESSAGE("Unsigned 16 bit data should not fit into short.", !pair.m_High.m_ShortPixels);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Slice spacing should be read.", 2., pair.m_Low.m_SliceSpacing, 1e-6);
+
+		const mitk::DECTSeriesLoader::LoadResult result = loader.LoadPair(pair, true, 0.5);
+		CPPUNIT_ASSERT_MESSAGE("Series beyond the range of short should be loaded as float.",
+			result.m_HighImage->GetPixelType().GetComponentType() == itk::ImageIOBase::FLOAT);
+		mitk::ImageReadAccessor highAccessor(result.m_HighImage);
+		mitk::ImageReadAccessor blendedAccessor(result.m_BlendedImage);
+		const float* high = static_cast<const float*>(highAccessor.GetData());
+		const double* blended = static_cast<const double*>(blendedAccessor.GetData());
+		for (unsigned int i = 0; i < 24; ++i)
+		{
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Unsigned values should not be truncated.", static_cast<float>(highVoxels[i]), high[i]);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Slices should be blended while loading.", 0.5 * highVoxels[i] + 0.5 * lowVoxels[i], blended[i], 1e-9);
+		}
+
+		// series with a shifted origin, spacing or orientation must neither be paired nor blended
+		mitk::DECTSeriesLoader::SeriesPair shifted = pair;
+		shifted.m_High.m_Origin[0] += 0.5;
+		CPPUNIT_ASSERT_MESSAGE("Series with different origins should not be paired.", loader.PairSeries({ shifted.m_Low, shifted.m_High }, alphaValueMap).empty());
+		CPPUNIT_ASSERT_THROW_MESSAGE("Series with different origins should not be loaded.", loader.LoadPair(shifted, true, 0.5), mitk::Exception);
+		mitk::DECTSeriesLoader::SeriesPair scaled = pair;
+		scaled.m_High.m_SliceSpacing = 3.;
+		CPPUNIT_ASSERT_MESSAGE("Series with different spacings should not be paired.", loader.PairSeries({ scaled.m_Low, scaled.m_High }, alphaValueMap).empty());
+		mitk::DECTSeriesLoader::SeriesPair rotated = pair;
+		std::swap(rotated.m_High.m_Orientation[0], rotated.m_High.m_Orientation[1]);
+		CPPUNIT_ASSERT_MESSAGE("Series with different orientations should not be paired.", loader.PairSeries({ rotated.m_Low, rotated.m_High }, alphaValueMap).empty());
+
+		itksys::SystemTools::RemoveADirectory(directory);
+	}
+
+	void TestCompressedExport()
+	{
+		// the expected HU image is stored as rounded int16, the RED image with a slope of 1e-4
+		m_HUImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		std::string huFile = mitk::IOUtil::CreateTemporaryFile("mitkAlphaBlendingHU_XXXXXX.nrrd");
+		std::string redFile = mitk::IOUtil::CreateTemporaryFile("mitkAlphaBlendingRED_XXXXXX.nrrd");
+
+		// small chunks so that the volume is split into several gzip members
+		mitk::CompressedVolumeWriter writer = mitk::CompressedVolumeWriter::ForHU();
+		writer.m_ChunkSize = 4;
+		writer.Write(m_HUImage, huFile);
+		m_BlendingTool->ExportRED(m_REDImage, redFile);
+
+		// the writer is chosen by the quantity property, not by the name of an image
+		mitk::Image::Pointer sprImage = m_REDImage->Clone();
+		sprImage->SetProperty(mitk::CompressedVolumeWriter::QuantityPropertyName, mitk::StringProperty::New("SPR"));
+		CPPUNIT_ASSERT_MESSAGE("SPR images should be written with the RED precision.",
+			mitk::CompressedVolumeWriter::ForImage(sprImage).m_StorageType == mitk::CompressedVolumeWriter::StorageType::UInt16);
+		CPPUNIT_ASSERT_MESSAGE("Images without quantity should be written as HU images.",
+			mitk::CompressedVolumeWriter::ForImage(m_HUImage).m_StorageType == mitk::CompressedVolumeWriter::StorageType::Int16);
+
+		mitk::Image::Pointer huImage = mitk::IOUtil::Load<mitk::Image>(huFile);
+		mitk::Image::Pointer redImage = mitk::IOUtil::Load<mitk::Image>(redFile);
+		std::remove(huFile.c_str());
+		std::remove(redFile.c_str());
+
+		CPPUNIT_ASSERT_MESSAGE("Exported HU image should be stored as short.", huImage->GetPixelType().GetComponentType() == itk::ImageIOBase::SHORT);
+		CPPUNIT_ASSERT_MESSAGE("Exported RED image should be stored as unsigned short.", redImage->GetPixelType().GetComponentType() == itk::ImageIOBase::USHORT);
+
+		short expectedHU[8] = { -3, -1, 1, 3, 4, 6, 8, 10 };
+		mitk::ImageReadAccessor huAccessor(huImage);
+		mitk::ImageReadAccessor redAccessor(redImage);
+		const short* hu = static_cast<const short*>(huAccessor.GetData());
+		const unsigned short* red = static_cast<const unsigned short*>(redAccessor.GetData());
+		for (int i = 0; i < 8; ++i)
+		{
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Exported HU value differs.", expectedHU[i], hu[i]);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Exported RED value differs.", static_cast<unsigned short>(10000 + 10 * i), red[i]);
+		}
+
+		// NaN and values beyond the storage type must be mapped to defined values
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		const double infinity = std::numeric_limits<double>::infinity();
+		double invalidVals[8] = { nan, infinity, -infinity, 1e9, -1e9, 40000., -40000., 7. };
+		short expectedInvalid[8] = { -32768, 32767, -32768, 32767, -32768, 32767, -32768, 7 };
+		std::string invalidFile = mitk::IOUtil::CreateTemporaryFile("mitkAlphaBlendingInvalid_XXXXXX.nrrd");
+		mitk::Image::Pointer invalidValues = createImage(invalidVals);
+		m_BlendingTool->ExportHU(invalidValues, invalidFile);
+		mitk::Image::Pointer invalidImage = mitk::IOUtil::Load<mitk::Image>(invalidFile);
+		std::remove(invalidFile.c_str());
+		mitk::ImageReadAccessor invalidAccessor(invalidImage);
+		const short* invalid = static_cast<const short*>(invalidAccessor.GetData());
+		for (int i = 0; i < 8; ++i)
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Invalid values should be clamped.", expectedInvalid[i], invalid[i]);
+	}
+
+	void TestExecutionPlanning()
+	{
+		// two 2|2|2 double inputs take 128 bytes, the slab kernels of the blend to SPR add the double output volume
+		mitk::ExecutionPlanner planner;
+		std::vector<const mitk::Image*> inputs = { m_LowImage, m_HighImage };
+
+		mitk::ExecutionPlan plan = planner.Plan(mitk::ExecutionPlanner::Operation::AlphaBlendingToSPR, inputs);
+		CPPUNIT_ASSERT_MESSAGE("Without budget the operation should run in memory.", plan.m_Strategy == mitk::ExecutionPlan::Strategy::InMemory);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Input memory should be predicted.", std::size_t(128), plan.m_InputMemory);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("In memory peak should be predicted.", std::size_t(192), plan.m_PeakMemory);
+
+		planner.m_MemoryBudget = 200;
+		plan = planner.Plan(mitk::ExecutionPlanner::Operation::AlphaBlending, inputs);
+		CPPUNIT_ASSERT_MESSAGE("The fused blend should fit in memory.", plan.m_Strategy == mitk::ExecutionPlan::Strategy::InMemory);
+
+		plan = planner.Plan(mitk::ExecutionPlanner::Operation::AlphaBlendingToSPR, inputs);
+		CPPUNIT_ASSERT_MESSAGE("The blend to SPR should fit in memory without intermediates.", plan.m_Strategy == mitk::ExecutionPlan::Strategy::InMemory);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The peak should only hold the output.", std::size_t(192), plan.m_PeakMemory);
+
+		plan = planner.Plan(mitk::ExecutionPlanner::Operation::AdaptiveAlphaBlending, inputs);
+		CPPUNIT_ASSERT_MESSAGE("Adaptive blending cannot be streamed and should be refused.", plan.m_Strategy == mitk::ExecutionPlan::Strategy::Refused);
+
+		planner.m_MemoryBudget = 100;
+		plan = planner.Plan(mitk::ExecutionPlanner::Operation::AlphaBlending, inputs);
+		CPPUNIT_ASSERT_MESSAGE("A too small budget should refuse the operation.", plan.m_Strategy == mitk::ExecutionPlan::Strategy::Refused);
+		CPPUNIT_ASSERT_MESSAGE("A refused plan should explain why.", !plan.m_Message.empty());
+	}
+
+	void TestSlabStreamedExecution()
+	{
+		// slabs of several slices have to give the same results as the default single slice slabs
+		mitk::AlphaBlendingTool tool;
+		tool.SetMemoryBudget(200);
+		mitk::TunedParameters parameters;
+		parameters.m_SlabSize = 2;
+		for (auto operation : { mitk::ExecutionPlanner::Operation::AlphaBlending, mitk::ExecutionPlanner::Operation::ConvertToRED,
+			mitk::ExecutionPlanner::Operation::AlphaBlendingToSPR })
+			tool.SetTunedParameters(operation, m_LowImage->GetPixelType(), parameters);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Blending to SPR should run in slabs of two slices.", 2u,
+			tool.Plan(mitk::ExecutionPlanner::Operation::AlphaBlendingToSPR, m_LowImage, m_HighImage).m_SlabSize);
+
+		mitk::Image::Pointer huImage = tool.AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		MITK_ASSERT_EQUAL(m_ExpectedHUImage, huImage, "Streamed blended image should be the same as expected image.");
+
+		mitk::Image::Pointer redImage = tool.ConvertToRED(m_LowImage);
+		MITK_ASSERT_EQUAL(m_ExpectedREDImage, redImage, "Streamed RED image should be the same as expected image.");
+
+		mitk::Image::Pointer sprImage = tool.AlphaBlendingToSPR(m_LowImage, m_HighImage, m_Alpha);
+		mitk::Image::Pointer expectedSPR = m_BlendingTool->AlphaBlendingToSPR(m_LowImage, m_HighImage, m_Alpha);
+		MITK_ASSERT_EQUAL(expectedSPR, sprImage, "Streamed SPR image should be the same as the in memory result.");
+
+		tool.SetMemoryBudget(100);
+		CPPUNIT_ASSERT_THROW_MESSAGE(
+			"Blending beyond the memory budget should throw an exception.",
+			tool.AlphaBlending(m_LowImage, m_HighImage, m_Alpha),
+			mitk::Exception);
+	}
+
+	void TestThresholdBodyMask()
+	{
+		// rows of two voxels, every row is closed between its first and last voxel above the threshold
+		double vals[8] = { -1000., 50., -1000., -1000., 20., -1000., 30., 40. };
+		mitk::Image::Pointer image = createImage(vals);
+		mitk::BodyMask mask = mitk::BodyMask::FromThreshold(image);
+
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Mask should have two slices.", 2u, mask.GetNumberOfSlices());
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Mask should contain all tissue voxels.", std::size_t(4), mask.GetNumberOfMaskedVoxels());
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Empty rows should not create runs.", std::size_t(3), mask.m_Spans.size());
+		CPPUNIT_ASSERT_MESSAGE("Runs of the second slice should follow the first slice.", mask.m_SliceOffsets[1] == 1 && mask.m_SliceOffsets[2] == 3);
+		CPPUNIT_ASSERT_MESSAGE("Runs of a row should be joined.", mask.m_Spans[2].m_Begin == 6 && mask.m_Spans[2].m_End == 8);
+	}
+
+	void TestMaskedComputation()
+	{
+		// inside the mask the results are the same as without mask, outside the constant is used
+		double maskVals[8] = { 0., 1., 1., 0., 0., 0., 1., 1. };
+		mitk::Image::Pointer segmentation = createImage(maskVals);
+		mitk::BodyMask mask = mitk::BodyMask::FromSegmentation(segmentation);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Mask should contain all segmented voxels.", std::size_t(4), mask.GetNumberOfMaskedVoxels());
+
+		mitk::Image::Pointer huImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha, mask);
+		mitk::Image::Pointer redImage = m_BlendingTool->ConvertToRED(m_LowImage, mask);
+
+		mitk::ImageReadAccessor expectedHUAccessor(m_ExpectedHUImage);
+		mitk::ImageReadAccessor expectedREDAccessor(m_ExpectedREDImage);
+		mitk::ImageReadAccessor huAccessor(huImage);
+		mitk::ImageReadAccessor redAccessor(redImage);
+		const double* expectedHU = static_cast<const double*>(expectedHUAccessor.GetData());
+		const double* expectedRED = static_cast<const double*>(expectedREDAccessor.GetData());
+		const double* hu = static_cast<const double*>(huAccessor.GetData());
+		const double* red = static_cast<const double*>(redAccessor.GetData());
+		for (int i = 0; i < 8; ++i)
+		{
+			bool inside = maskVals[i] != 0.;
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Masked blended value differs.", inside ? expectedHU[i] : -1000., hu[i], 1e-9);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Masked RED value differs.", inside ? expectedRED[i] : 0., red[i], 1e-9);
+		}
+
+		// the masked paths attach the statistics of their output like the unmasked ones, outside voxels included
+		mitk::VoxelStatistics huStatistics;
+		mitk::VoxelStatistics redStatistics;
+		CPPUNIT_ASSERT_MESSAGE("Masked blending should attach statistics to the output.", mitk::VoxelStatistics::ReadFrom(huImage, huStatistics));
+		CPPUNIT_ASSERT_MESSAGE("Masked RED conversion should attach statistics to the output.", mitk::VoxelStatistics::ReadFrom(redImage, redStatistics));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("All voxels should be counted.", std::size_t(8), huStatistics.m_Count);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The outside value should be the minimum.", -1000., huStatistics.m_Minimum, 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Masked RED maximum differs.", *std::max_element(red, red + 8), redStatistics.m_Maximum, 1e-9);
+
+		CPPUNIT_ASSERT_THROW_MESSAGE(
+			"A mask of different size should throw an exception.",
+			m_BlendingTool->ConvertToRED(m_LowImage, mitk::BodyMask::FromSegmentation(m_TwoDimensionImage)),
+			mitk::Exception);
+	}
+
+	void TestFixedPointBlending()
+	{
+		// the integer blend has to stay within the quantization bound of the double blend
+		short highVals[8] = { -1000, -50, 0, 40, 1200, 3000, -1024, 3071 };
+		short lowVals[8] = { -990, -80, 10, 55, 1400, 3500, -1024, 2000 };
+		mitk::Image::Pointer highImage = createShortImage(highVals);
+		mitk::Image::Pointer lowImage = createShortImage(lowVals);
+
+		mitk::Image::Pointer fixedImage = m_BlendingTool->FixedPointAlphaBlending(highImage, lowImage, m_Alpha);
+		mitk::Image::Pointer doubleImage = m_BlendingTool->AlphaBlending(highImage, lowImage, m_Alpha);
+		CPPUNIT_ASSERT_MESSAGE("Fixed point blending should create a short image.", fixedImage->GetPixelType().GetComponentType() == itk::ImageIOBase::SHORT);
+
+		const double bound = mitk::FixedPointAlphaBlending::GetErrorBound(m_Alpha, 32768) + 0.5;
+		CPPUNIT_ASSERT_MESSAGE("Quantization error should be below one HU.", bound <= 1.5);
+
+		mitk::ImageReadAccessor fixedAccessor(fixedImage);
+		mitk::ImageReadAccessor doubleAccessor(doubleImage);
+		const short* fixed = static_cast<const short*>(fixedAccessor.GetData());
+		const double* reference = static_cast<const double*>(doubleAccessor.GetData());
+		for (int i = 0; i < 8; ++i)
+		{
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Fixed point blend differs from the double blend.", reference[i], fixed[i], bound);
+		}
+
+		// the result must not depend on the partitioning into slabs
+		mitk::FixedPointAlphaBlending blending;
+		blending.m_AlphaValue = m_Alpha;
+		mitk::Image::Pointer slabImage = blending.Blend(highImage, lowImage, 2);
+		mitk::ImageReadAccessor slabAccessor(slabImage);
+		const short* slab = static_cast<const short*>(slabAccessor.GetData());
+		for (int i = 0; i < 8; ++i)
+		{
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Fixed point blend should be bit identical for every slab size.", fixed[i], slab[i]);
+		}
+
+		// half values are rounded away from zero
+		mitk::FixedPointAlphaBlending::Weights weights = mitk::FixedPointAlphaBlending::ComputeWeights(0.5, 32768);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Positive half should be rounded up.", std::int16_t(2), mitk::FixedPointAlphaBlending::BlendVoxel(weights, 3, 0));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Negative half should be rounded down.", std::int16_t(-2), mitk::FixedPointAlphaBlending::BlendVoxel(weights, -3, 0));
+
+		CPPUNIT_ASSERT_THROW_MESSAGE(
+			"Fixed point blending of double images should throw an exception.",
+			m_BlendingTool->FixedPointAlphaBlending(m_LowImage, m_HighImage, m_Alpha),
+			mitk::Exception);
+	}
+
+	void TestImageExpression()
+	{
+		// chained helper calls used to give wrong results
+		mitk::AlphaBlendingHelper helper;
+		mitk::Image::Pointer divided = helper.Div(m_LowImage, 1000.);
+		MITK_ASSERT_EQUAL(m_ExpectedREDImage, helper.Add(divided, 1.), "Chained helper arithmetic should give the RED image.");
+
+		// custom formulas are fused into one pass, e.g. the blend and a clamp of negative values
+		using namespace mitk::ImageExpression;
+		auto clamp = [](double v) { return v < 0. ? 0. : v; };
+		mitk::Image::Pointer clamped = Evaluate(Apply(clamp, m_Alpha * Input(m_LowImage) + (1. - m_Alpha) * Input(m_HighImage)));
+
+		mitk::ImageReadAccessor expectedAccessor(m_ExpectedHUImage);
+		mitk::ImageReadAccessor clampedAccessor(clamped);
+		const double* expected = static_cast<const double*>(expectedAccessor.GetData());
+		const double* values = static_cast<const double*>(clampedAccessor.GetData());
+		for (int i = 0; i < 8; ++i)
+		{
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Custom expression value differs.", clamp(expected[i]), values[i], 1e-9);
+		}
+
+		CPPUNIT_ASSERT_THROW_MESSAGE(
+			"Expressions between images of different size should throw an exception.",
+			Evaluate(Input(m_LowImage) - Input(m_TwoDimensionImage)),
+			mitk::Exception);
+	}
+
+	void TestSamePassStatistics()
+	{
+		// statistics of the expected HU image {-3.15, -1.25, ..., 10.15}, computed while blending
+		m_HUImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		mitk::VoxelStatistics statistics;
+		CPPUNIT_ASSERT_MESSAGE("Blending should attach statistics to the output.", mitk::VoxelStatistics::ReadFrom(m_HUImage, statistics));
+
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("All voxels should be counted.", std::size_t(8), statistics.m_Count);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Minimum differs.", -3.15, statistics.m_Minimum, 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Maximum differs.", 10.15, statistics.m_Maximum, 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Mean differs.", 3.5, statistics.m_Mean, 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Standard deviation differs.", 1.9 * std::sqrt(5.25), statistics.m_StandardDeviation, 1e-9);
+
+		// merging per slab partials must give the same result for any partitioning
+		using namespace mitk::ImageExpression;
+		mitk::VoxelStatistics single = mitk::VoxelStatistics::ForHU();
+		mitk::VoxelStatistics sliced = mitk::VoxelStatistics::ForHU();
+		Evaluate(Input(m_HUImage), 2, &single);
+		Evaluate(Input(m_HUImage), 1, &sliced);
+		CPPUNIT_ASSERT_MESSAGE("Histograms should not depend on the slab size.", single.m_Histogram == sliced.m_Histogram);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Mean should not depend on the slab size.", single.m_Mean, sliced.m_Mean, 1e-12);
+
+		mitk::VoxelStatistics redStatistics;
+		CPPUNIT_ASSERT_MESSAGE("RED conversion should attach statistics to the output.", mitk::VoxelStatistics::ReadFrom(m_REDImage, redStatistics));
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("RED maximum differs.", 1.007, redStatistics.m_Maximum, 1e-9);
+		CPPUNIT_ASSERT_MESSAGE("Median should lie within the value range.",
+			redStatistics.GetPercentile(0.5) >= redStatistics.m_Minimum && redStatistics.GetPercentile(0.5) <= redStatistics.m_Maximum);
+	}
+
+	void TestPyramidGeneration()
+	{
+		// every level of the 2|2|2 expected HU image is a single voxel with the mean of all voxels
+		m_HUImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		for (unsigned int level = 1; level <= 3; ++level)
+		{
+			mitk::Image::Pointer pyramidLevel = mitk::ImagePyramid::GetLevel(m_HUImage, level);
+			CPPUNIT_ASSERT_MESSAGE("Blending should attach the pyramid levels to the output.", pyramidLevel.IsNotNull());
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Levels should not be smaller than one voxel.", 1u, pyramidLevel->GetDimension(0));
+
+			mitk::ImageReadAccessor accessor(pyramidLevel);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Level should hold the block mean.", 3.5, static_cast<const float*>(accessor.GetData())[0], 1e-5);
+		}
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Spacing of the first level should be doubled.",
+			2. * m_HUImage->GetGeometry()->GetSpacing()[0], mitk::ImagePyramid::GetLevel(m_HUImage, 1)->GetGeometry()->GetSpacing()[0], 1e-9);
+		CPPUNIT_ASSERT_MESSAGE("Only the requested levels should be attached.", mitk::ImagePyramid::GetLevel(m_HUImage, 4).IsNull());
+
+		// a 6|6|5 ramp, the first level averages 2|2|2 blocks and keeps the odd last slice on its own
+		std::vector<double> ramp(6 * 6 * 5);
+		for (std::size_t i = 0; i < ramp.size(); ++i)
+			ramp[i] = static_cast<double>(i);
+		mitk::Image::Pointer image = mitk::Image::New();
+		unsigned int dimensions[3] = { 6, 6, 5 };
+		image->Initialize(mitk::MakeScalarPixelType<double>(), 3, dimensions);
+		image->SetVolume(ramp.data());
+
+		using namespace mitk::ImageExpression;
+		mitk::ImagePyramid pyramid;
+		pyramid.m_NumberOfLevels = 1;
+		mitk::Image::Pointer result = Evaluate(Input(image), 1, nullptr, &pyramid);
+		pyramid.AttachTo(result);
+
+		mitk::Image::Pointer firstLevel = mitk::ImagePyramid::GetLevel(result, 1);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Odd sizes should be rounded up.", 3u, firstLevel->GetDimension(2));
+		mitk::ImageReadAccessor accessor(firstLevel);
+		const float* values = static_cast<const float*>(accessor.GetData());
+		// block (0, 0, 0) holds x, y in {0, 1} and z in {0, 1}, block (0, 0, 2) only the last slice z = 4
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("First block mean differs.", (0. + 1. + 6. + 7.) / 4. + 18., values[0], 1e-4);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Last slice block mean differs.", (0. + 1. + 6. + 7.) / 4. + 144., values[2 * 9], 1e-4);
+
+		// the levels of a blend and its RED conversion in slabs of a single slice, which are aligned to 8 slices, match
+		// a downsampling of the full resolution outputs
+		mitk::Image::Pointer low = createPhantomImage(nullptr, 1., 0.);
+		mitk::Image::Pointer high = createPhantomImage(nullptr, 0.7, 50.);
+		mitk::AlphaBlendingTool tool;
+		mitk::TunedParameters singleSlices;
+		singleSlices.m_SlabSize = 1;
+		tool.SetTunedParameters(mitk::ExecutionPlanner::Operation::AlphaBlending, mitk::MakeScalarPixelType<double>(), singleSlices);
+		tool.SetTunedParameters(mitk::ExecutionPlanner::Operation::ConvertToRED, mitk::MakeScalarPixelType<double>(), singleSlices);
+		mitk::Image::Pointer hu = tool.AlphaBlending(high, low, 0.6);
+		mitk::Image::Pointer red = tool.ConvertToRED(hu);
+		for (const mitk::Image::Pointer& output : { hu, red })
+		{
+			mitk::ImageReadAccessor outputAccessor(output);
+			const double* outputValues = static_cast<const double*>(outputAccessor.GetData());
+			std::vector<double> reference(outputValues, outputValues + 32 * 32 * 24);
+			unsigned int size[3] = { 32, 32, 24 };
+			for (unsigned int level = 1; level <= 3; ++level)
+			{
+				reference = downsampleReference(reference, size);
+				mitk::Image::Pointer pyramidLevel = mitk::ImagePyramid::GetLevel(output, level);
+				CPPUNIT_ASSERT_MESSAGE("The output should have its pyramid levels.", pyramidLevel.IsNotNull());
+				CPPUNIT_ASSERT_EQUAL_MESSAGE("The level should have the reference size.", size[2], pyramidLevel->GetDimension(2));
+				mitk::ImageReadAccessor levelAccessor(pyramidLevel);
+				const float* levelValues = static_cast<const float*>(levelAccessor.GetData());
+				for (std::size_t i = 0; i < reference.size(); ++i)
+					CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The level should match the reference downsampling.", reference[i], levelValues[i],
+						1e-5 * (1. + std::abs(reference[i])));
+			}
+		}
+
+		m_BlendingTool->SetPyramidLevels(0);
+		m_HUImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		CPPUNIT_ASSERT_MESSAGE("Disabled pyramids should not be attached.", mitk::ImagePyramid::GetLevel(m_HUImage, 1).IsNull());
+	}
+
+	void TestNumaPlacement()
+	{
+		short highVals[8] = { -1000, -50, 0, 40, 1200, 3000, -1024, 3071 };
+		short lowVals[8] = { -990, -80, 10, 55, 1400, 3500, -1024, 2000 };
+		mitk::Image::Pointer highImage = createShortImage(highVals);
+		mitk::Image::Pointer lowImage = createShortImage(lowVals);
+		mitk::Image::Pointer expectedFixedPoint = m_BlendingTool->FixedPointAlphaBlending(highImage, lowImage, m_Alpha);
+
+		// two simulated nodes, the slabs have to run on the node their memory was first touched from
+		NumaTopologyGuard guard(mitk::NumaTopology::Simulate(2));
+		const mitk::NumaTopology topology = mitk::NumaTopology::GetCurrent();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Simulated topology should have two nodes.", 2u, topology.GetNumberOfNodes());
+
+		// on the persistent workers of the slab thread pool
+		mitk::SlabThreadPool& pool = mitk::SlabThreadPool::GetInstance();
+		const std::size_t completedLoops = pool.GetMetrics(mitk::SlabPriority::Normal).m_CompletedLoops;
+		const unsigned int numberOfSlabs = 16;
+		std::vector<int> nodes(numberOfSlabs, -1);
+		mitk::SlabParallelFor(numberOfSlabs, [&nodes](unsigned int slab) { nodes[slab] = mitk::NumaTopology::GetCurrentNode(); });
+		CPPUNIT_ASSERT_MESSAGE("The placed loop should run on the pool.", pool.GetMetrics(mitk::SlabPriority::Normal).m_CompletedLoops > completedLoops);
+		for (unsigned int slab = 0; slab < numberOfSlabs; ++slab)
+		{
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Slab should run on its node.", static_cast<int>(topology.GetNodeOfSlab(slab, numberOfSlabs)), nodes[slab]);
+			if (slab > 0)
+				CPPUNIT_ASSERT_MESSAGE("Nodes should get consecutive slabs.", nodes[slab - 1] <= nodes[slab]);
+		}
+		if (mitk::NumaTopology::GetNumberOfWorkers(numberOfSlabs) > 1)
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("Both nodes should get slabs.", 1, nodes.back());
+
+		// sysfs lists can have gaps, e.g. the online nodes after a node was taken offline
+		const std::vector<unsigned int> onlineNodes = { 0, 1, 3 };
+		CPPUNIT_ASSERT_MESSAGE("Node lists with gaps should be parsed.", onlineNodes == mitk::NumaTopology::ParseList("0-1,3\n"));
+
+#ifdef __linux__
+		// unbinding restores the affinity from before the first binding, not all cpus
+		cpu_set_t before;
+		cpu_set_t after;
+		CPPUNIT_ASSERT(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &before) == 0);
+		topology.BindCurrentThread(0);
+		topology.BindCurrentThread(1);
+		CPPUNIT_ASSERT_MESSAGE("Unbinding should succeed.", mitk::NumaTopology::UnbindCurrentThread());
+		CPPUNIT_ASSERT(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &after) == 0);
+		CPPUNIT_ASSERT_MESSAGE("Unbinding should restore the previous affinity.", CPU_EQUAL(&before, &after));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Unbinding should clear the current node.", -1, mitk::NumaTopology::GetCurrentNode());
+#endif
+
+		// placement must not change any result
+		MITK_ASSERT_EQUAL(m_ExpectedHUImage, m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha),
+			"Blending with NUMA placement should give the expected image.");
+		MITK_ASSERT_EQUAL(expectedFixedPoint, m_BlendingTool->FixedPointAlphaBlending(highImage, lowImage, m_Alpha),
+			"Fixed point blending with NUMA placement should be bit identical.");
+	}
+
+	void TestBufferPool()
+	{
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Small requests should get one page.", std::size_t(4096), mitk::BufferPool::GetSizeClass(1));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Powers of two should be a size class.", std::size_t(1) << 20, mitk::BufferPool::GetSizeClass(std::size_t(1) << 20));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Size classes should be an eighth of a power of two apart.", (std::size_t(9) << 17),
+			mitk::BufferPool::GetSizeClass((std::size_t(1) << 20) + 1));
+
+		mitk::BufferPool& pool = mitk::BufferPool::GetInstance();
+		const std::size_t capacity = pool.GetCapacity();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The pool should keep idle buffers by default.", std::size_t(mitk::BufferPool::DefaultCapacity), capacity);
+		pool.SetCapacityForMemoryBudget(std::size_t(512) << 20);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The capacity should be an eighth of the budget.", std::size_t(64) << 20, pool.GetCapacity());
+
+		const std::size_t bytes = 300000;
+		{
+			mitk::BufferPool::Lease lease(bytes);
+			CPPUNIT_ASSERT_MESSAGE("Buffers should be 64 byte aligned.", reinterpret_cast<std::uintptr_t>(lease.Get<char>()) % mitk::BufferPool::Alignment == 0);
+		}
+		const mitk::BufferPool::Statistics before = pool.GetStatistics();
+		{
+			mitk::BufferPool::Lease lease(bytes - 100);
+			CPPUNIT_ASSERT_MESSAGE("A released buffer of the same size class should be reused.", lease.GetBuffer().m_Reused);
+		}
+		const mitk::BufferPool::Statistics after = pool.GetStatistics();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Reuse should be counted as hit.", before.m_Hits + 1, after.m_Hits);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Reuse should avoid the page faults of the buffer.",
+			before.m_PageFaultsAvoided + mitk::BufferPool::GetSizeClass(bytes) / 4096, after.m_PageFaultsAvoided);
+
+		// the kernel temporaries are leased, output images own their buffers, aliases of the data must never see them reused
+		const mitk::BufferPool::Statistics beforeBlending = pool.GetStatistics();
+		mitk::Image::Pointer huImage = m_BlendingTool->AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		const mitk::BufferPool::Statistics afterBlending = pool.GetStatistics();
+		CPPUNIT_ASSERT_MESSAGE("The rows of the blending should be leased.", afterBlending.m_Requests > beforeBlending.m_Requests);
+		CPPUNIT_ASSERT_MESSAGE("The rows of the blending should be reused.", afterBlending.m_Hits > beforeBlending.m_Hits);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Output images should not hold pooled buffers.", beforeBlending.m_BytesInUse, afterBlending.m_BytesInUse);
+		MITK_ASSERT_EQUAL(m_ExpectedHUImage, huImage, "Blending should give the expected image.");
+
+		// the cached difference is leased and goes back to the pool when another pair is blended
+		mitk::AlphaBlendingTool tool;
+		tool.SetDifferenceCaching(true);
+		tool.AlphaBlending(m_HighImage, m_LowImage, m_Alpha);
+		const std::size_t differenceBytes = mitk::BufferPool::GetSizeClass(8 * sizeof(double));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The cached difference should be leased.", afterBlending.m_BytesInUse + differenceBytes,
+			pool.GetStatistics().m_BytesInUse);
+		tool.AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The difference of the previous pair should be returned.", afterBlending.m_BytesInUse + differenceBytes,
+			pool.GetStatistics().m_BytesInUse);
+		tool.SetDifferenceCaching(false);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Disabling the cache should return the difference.", afterBlending.m_BytesInUse, pool.GetStatistics().m_BytesInUse);
+
+		pool.SetCapacity(0);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("A capacity of 0 should trim all idle buffers.", std::size_t(0), pool.GetStatistics().m_BytesPooled);
+		pool.SetCapacity(capacity);
+	}
+
+	void TestWatchFolderPipeline()
+	{
+		// a producer can run ahead of the consumer by the capacity only, closing drains the queue
+		mitk::BoundedQueue<int> queue(2);
+		std::thread producer([&queue]()
+		{
+			for (int i = 1; i <= 10; ++i)
+				queue.Push(i);
+			queue.Close();
+		});
+		int sum = 0;
+		int item = 0;
+		while (queue.Pop(item))
+			sum += item;
+		producer.join();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("All items should pass the queue.", 55, sum);
+		CPPUNIT_ASSERT_MESSAGE("The queue should never exceed its capacity.", queue.GetPeakSize() <= 2);
+		CPPUNIT_ASSERT_MESSAGE("A closed queue should refuse items.", !queue.Push(1));
+
+		// an empty watched directory gives no cases, the pipeline starts and stops cleanly
+		const std::string directory = mitk::IOUtil::CreateTemporaryDirectory();
+		mitk::DECTWatchFolderService service;
+		service.m_InputDirectory = directory;
+		service.m_OutputDirectory = directory + "/converted";
+		service.m_PollInterval = 10;
+		service.m_QueueCapacity = 3;
+		service.GetTool().m_AlphaValueMap["DECT80kv/140kv"] = 0.6;
+		service.Start();
+		CPPUNIT_ASSERT_MESSAGE("The service should run after Start.", service.IsRunning());
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("An empty directory should not contain cases.", std::size_t(0), service.Poll());
+		service.Stop();
+
+		const mitk::DECTWatchFolderService::Statistics statistics = service.GetStatistics();
+		CPPUNIT_ASSERT_MESSAGE("The service should not run after Stop.", !service.IsRunning());
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("No case should have been discovered.", std::size_t(0), statistics.m_Discovered);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Queue capacity should be reported.", std::size_t(3), statistics.m_ComputeQueue.m_Capacity);
+		itksys::SystemTools::RemoveADirectory(directory);
+	}
+
+	void TestWatchFolderConversion()
+	{
+		// the phantom pair arrives as two DICOM series, the case is converted from the series to hu.nrrd and red.nrrd
+		mitk::DECTPhantom phantom;
+		phantom.m_Size[0] = 32;
+		phantom.m_Size[1] = 32;
+		phantom.m_Size[2] = 4;
+		phantom.m_LowNoise = 15.;
+		phantom.m_HighNoise = 10.;
+		mitk::DECTPhantom::Images images = phantom.Generate();
+		const std::string directory = mitk::IOUtil::CreateTemporaryDirectory("mitkDECTWatchFolder_XXXXXX");
+		const std::string inputDirectory = directory + "/incoming";
+		itksys::SystemTools::MakeDirectory(inputDirectory);
+		{
+			mitk::ImageReadAccessor lowAccessor(images.m_Low);
+			mitk::ImageReadAccessor highAccessor(images.m_High);
+			writeDicomSeries(inputDirectory, "1.2.826.0.1.3680043.9.7001.1", 80., phantom.m_Size, static_cast<const short*>(lowAccessor.GetData()));
+			writeDicomSeries(inputDirectory, "1.2.826.0.1.3680043.9.7001.2", 140., phantom.m_Size, static_cast<const short*>(highAccessor.GetData()));
+		}
+
+		// a file in place of the output directory makes the first attempt fail in the write stage
+		const std::string caseDirectory = directory + "/converted/1.2.826.0.1.3680043.9.7001_1.2.826.0.1.3680043.9.7001.1";
+		itksys::SystemTools::MakeDirectory(directory + "/converted");
+		std::ofstream(caseDirectory) << "blocked";
+
+		mitk::DECTWatchFolderService service;
+		service.m_InputDirectory = inputDirectory;
+		service.m_OutputDirectory = directory + "/converted";
+		service.m_PollInterval = 10;
+		service.m_StableScans = 1;
+		service.GetTool().m_AlphaValueMap["DECT80kv/140kv"] = phantom.m_Alpha;
+		auto waitFor = [&service](std::function<bool(const mitk::DECTWatchFolderService::Statistics&)> condition)
+		{
+			for (unsigned int i = 0; i < 3000 && !condition(service.GetStatistics()); ++i)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			return condition(service.GetStatistics());
+		};
+		service.Start();
+		CPPUNIT_ASSERT_MESSAGE("Writing the blocked case should fail.",
+			waitFor([](const mitk::DECTWatchFolderService::Statistics& statistics) { return statistics.m_Write.m_Failed == 1; }));
+
+		// the failed case is converted again once its directory changes
+		std::remove(caseDirectory.c_str());
+		std::ofstream(inputDirectory + "/notes.txt") << "the blocking file is gone";
+		CPPUNIT_ASSERT_MESSAGE("The failed case should be converted once its directory changed.",
+			waitFor([](const mitk::DECTWatchFolderService::Statistics& statistics) { return statistics.m_Write.m_Processed == 1; }));
+		service.Stop();
+
+		const mitk::DECTWatchFolderService::Statistics statistics = service.GetStatistics();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The case should have been discovered twice.", std::size_t(2), statistics.m_Discovered);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Both attempts should have been read.", std::size_t(2), statistics.m_Read.m_Processed);
+		CPPUNIT_ASSERT_MESSAGE("hu.nrrd should be written.", itksys::SystemTools::FileExists(caseDirectory + "/hu.nrrd"));
+		CPPUNIT_ASSERT_MESSAGE("red.nrrd should be written.", itksys::SystemTools::FileExists(caseDirectory + "/red.nrrd"));
+		CPPUNIT_ASSERT_MESSAGE("No partial file should remain.", !itksys::SystemTools::FileExists(caseDirectory + "/hu.part.nrrd"));
+
+		// the stored HU values are the rounded blend of the phantom
+		mitk::Image::Pointer expected = m_BlendingTool->AlphaBlending(images.m_High, images.m_Low, phantom.m_Alpha);
+		mitk::Image::Pointer converted = mitk::IOUtil::Load<mitk::Image>(caseDirectory + "/hu.nrrd");
+		CPPUNIT_ASSERT_MESSAGE("The converted HU image should be stored as short.", converted->GetPixelType().GetComponentType() == itk::ImageIOBase::SHORT);
+		mitk::ImageReadAccessor expectedAccessor(expected);
+		mitk::ImageReadAccessor convertedAccessor(converted);
+		const double* expectedValues = static_cast<const double*>(expectedAccessor.GetData());
+		const short* convertedValues = static_cast<const short*>(convertedAccessor.GetData());
+		const std::size_t voxels = 32 * 32 * 4;
+		for (std::size_t i = 0; i < voxels; ++i)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The converted case should hold the blended phantom.", expectedValues[i], convertedValues[i], 0.5 + 1e-9);
+		itksys::SystemTools::RemoveADirectory(directory);
+	}
+
+	void TestRawBufferKernels()
+	{
+		// low and high energy interleaved in one buffer, as delivered by some reconstructions
+		mitk::ImageReadAccessor lowAccessor(m_LowImage);
+		mitk::ImageReadAccessor highAccessor(m_HighImage);
+		const double* low = static_cast<const double*>(lowAccessor.GetData());
+		const double* high = static_cast<const double*>(highAccessor.GetData());
+		std::vector<float> interleaved(16);
+		for (std::size_t i = 0; i < 8; ++i)
+		{
+			interleaved[2 * i] = static_cast<float>(high[i]);
+			interleaved[2 * i + 1] = static_cast<float>(low[i]);
+		}
+
+		mitkDECTBuffer highBuffer = { interleaved.data(), mitkDECTFloat, { 2, 2, 2, 1 }, { 8, 16, 32, 64 } };
+		mitkDECTBuffer lowBuffer = highBuffer;
+		lowBuffer.data = interleaved.data() + 1;
+		std::vector<double> hu(8);
+		mitkDECTBuffer huBuffer = { hu.data(), mitkDECTDouble, { 2, 2, 2, 1 }, { 0, 0, 0, 0 } };
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Blending strided buffers should succeed.", mitkDECTSuccess,
+			mitkDECTAlphaBlending(&highBuffer, &lowBuffer, m_Alpha, &huBuffer));
+
+		mitk::ImageReadAccessor expectedAccessor(m_ExpectedHUImage);
+		const double* expected = static_cast<const double*>(expectedAccessor.GetData());
+		for (std::size_t i = 0; i < 8; ++i)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Raw buffer blending should match the tool.", expected[i], hu[i], 1e-3);
+
+		// rED in place
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Converting in place should succeed.", mitkDECTSuccess, mitkDECTConvertToRED(&huBuffer, &huBuffer));
+		mitk::ImageReadAccessor expectedREDAccessor(m_ExpectedREDImage);
+		const double* expectedRED = static_cast<const double*>(expectedREDAccessor.GetData());
+		for (std::size_t i = 0; i < 8; ++i)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("In place rED conversion should match the tool.", expectedRED[i], hu[i], 1e-6);
+
+		huBuffer.size[2] = 1;
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Buffers of different size should be rejected.", mitkDECTInvalidArgument,
+			mitkDECTAlphaBlending(&highBuffer, &lowBuffer, m_Alpha, &huBuffer));
+		CPPUNIT_ASSERT_MESSAGE("A rejected call should describe the error.", std::string(mitkDECTGetLastError()).size() > 0);
+
+		// integer outputs are rounded and saturated
+		std::vector<double> values = { 1e6, -1e6, 2.5, -2.5 };
+		std::vector<std::int16_t> saturated(4);
+		mitk::DECTKernels::AlphaBlending(mitk::DECTKernels::BufferView(values.data(), mitkDECTDouble, 4, 1),
+			mitk::DECTKernels::BufferView(values.data(), mitkDECTDouble, 4, 1), 0.5,
+			mitk::DECTKernels::BufferView(saturated.data(), mitkDECTInt16, 4, 1));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Large values should saturate.", std::int16_t(32767), saturated[0]);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Small values should saturate.", std::int16_t(-32768), saturated[1]);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Halves should be rounded away from zero.", std::int16_t(3), saturated[2]);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Negative halves should be rounded away from zero.", std::int16_t(-3), saturated[3]);
+	}
+
+	void TestEnergyBinCombination()
+	{
+		// two bins weighted with 1 - alpha and alpha are the alpha blend
+		std::vector<mitk::Image::Pointer> bins = { m_LowImage, m_HighImage };
+		mitk::Image::Pointer huImage = m_BlendingTool->WeightedCombination(bins, std::vector<double>{ 1. - m_Alpha, m_Alpha });
+		MITK_ASSERT_EQUAL(m_ExpectedHUImage, huImage, "Weighted combination of two bins should equal the alpha blend.");
+
+		std::vector<mitk::Image::Pointer> images = m_BlendingTool->WeightedCombination(bins, { { 1. - m_Alpha, m_Alpha }, { 0., 1. } });
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Every weight set should give an image.", std::size_t(2), images.size());
+		MITK_ASSERT_EQUAL(m_ExpectedHUImage, images[0], "The first weight set should give the alpha blend.");
+		MITK_ASSERT_EQUAL(m_HighImage, images[1], "The second weight set should select the high energy bin.");
+
+		CPPUNIT_ASSERT_THROW_MESSAGE("A weight set needs one weight per bin.",
+			m_BlendingTool->WeightedCombination(bins, std::vector<double>{ 1. }), mitk::Exception);
+
+		// bins are ordered by their energy, not by the selection order
+		mitk::Image::Pointer lowBin = m_LowImage->Clone();
+		mitk::Image::Pointer highBin = m_HighImage->Clone();
+		lowBin->SetProperty(mitk::AlphaBlendingTool::BinEnergyPropertyName, mitk::DoubleProperty::New(25.));
+		highBin->SetProperty(mitk::AlphaBlendingTool::BinEnergyPropertyName, mitk::DoubleProperty::New(65.));
+		const std::vector<std::size_t> expectedOrder = { 1, 0 };
+		CPPUNIT_ASSERT_MESSAGE("Bins should be sorted by energy.", expectedOrder == mitk::AlphaBlendingTool::SortEnergyBins({ highBin, lowBin }));
+		CPPUNIT_ASSERT_THROW_MESSAGE("Bins without energy cannot be sorted.",
+			mitk::AlphaBlendingTool::SortEnergyBins({ highBin, m_LowImage }), mitk::Exception);
+		std::vector<mitk::Image::Pointer> swappedBins = { highBin, lowBin };
+		CPPUNIT_ASSERT_THROW_MESSAGE("Bins out of energy order should be rejected.",
+			m_BlendingTool->WeightedCombination(swappedBins, std::vector<double>{ 1. - m_Alpha, m_Alpha }), mitk::Exception);
+
+		// weight vectors are read from the modes of the alpha value file
+		std::ofstream stream;
+		const std::string filename = mitk::IOUtil::CreateTemporaryFile(stream, "binWeightsXXXXXX.xml");
+		stream << "<AlphaBlendingTool>\n  <Mode description=\"CounT3bin/Test\" weights=\"0.2 0.3 0.5\"/>\n</AlphaBlendingTool>\n";
+		stream.close();
+
+		mitk::AlphaBlendingTool tool;
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The weight file should be readable.", 0, tool.ReadExternalResource(filename, false));
+		std::remove(filename.c_str());
+		CPPUNIT_ASSERT_MESSAGE("Weight modes should not be alpha values.", tool.m_AlphaValueMap.empty());
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("All weights should be read.", std::size_t(3), tool.m_WeightVectorMap["CounT3bin/Test"].size());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Weights should be read in order.", 0.5, tool.m_WeightVectorMap["CounT3bin/Test"][2], 1e-12);
+	}
+
+	void TestIncrementalBlending()
+	{
+		mitk::AlphaBlendingTool tool;
+		tool.SetDifferenceCaching(true);
+		mitk::Image::Pointer huImage = tool.AlphaBlending(m_HighImage, m_LowImage, m_Alpha);
+		CPPUNIT_ASSERT_MESSAGE("The first blend should cache the difference.", tool.IsDifferenceCached(m_HighImage, m_LowImage));
+
+		// re-blending from the difference gives the direct blend up to rounding
+		mitk::Image::Pointer reblended = tool.AlphaBlending(m_HighImage, m_LowImage, m_Alpha);
+		mitk::ImageReadAccessor expectedAccessor(m_ExpectedHUImage);
+		mitk::ImageReadAccessor reblendedAccessor(reblended);
+		const double* expected = static_cast<const double*>(expectedAccessor.GetData());
+		const double* values = static_cast<const double*>(reblendedAccessor.GetData());
+		for (std::size_t i = 0; i < 8; ++i)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Blending from the cached difference should equal the blend.", expected[i], values[i], 1e-9);
+
+		// a new alpha is blended into the existing image
+		const void* buffer = mitk::ImageReadAccessor(huImage).GetData();
+		tool.AlphaBlendingInto(huImage, m_HighImage, m_LowImage, 1.);
+		mitk::ImageReadAccessor highAccessor(m_HighImage);
+		mitk::ImageReadAccessor huAccessor(huImage);
+		CPPUNIT_ASSERT_MESSAGE("Blending into an image should reuse its buffer.", buffer == huAccessor.GetData());
+		const double* high = static_cast<const double*>(highAccessor.GetData());
+		values = static_cast<const double*>(huAccessor.GetData());
+		for (std::size_t i = 0; i < 8; ++i)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Alpha 1 should give the high image.", high[i], values[i], 1e-9);
+
+		// another pair or a modified input invalidates the cache
+		tool.AlphaBlending(m_LowImage, m_HighImage, m_Alpha);
+		CPPUNIT_ASSERT_MESSAGE("Blending another pair should replace the cache.", !tool.IsDifferenceCached(m_HighImage, m_LowImage));
+		CPPUNIT_ASSERT_MESSAGE("The new pair should be cached.", tool.IsDifferenceCached(m_LowImage, m_HighImage));
+		m_HighImage->Modified();
+		CPPUNIT_ASSERT_MESSAGE("Modifying an input should invalidate the cache.", !tool.IsDifferenceCached(m_LowImage, m_HighImage));
+
+		CPPUNIT_ASSERT_THROW_MESSAGE("Blending into an image of another size should fail.",
+			tool.AlphaBlendingInto(m_TwoDimensionImage, m_HighImage, m_LowImage, m_Alpha), mitk::Exception);
+	}
+
+	void TestTimeStepProcessing()
+	{
+		// every time step in order and once, nested slab loops run within the time steps
+		std::vector<unsigned int> done;
+		std::vector<int> processed(5, 0);
+		mitk::TimeStepParallelFor(5, 2, [&](unsigned int timeStep)
+		{
+			mitk::SlabParallelFor(3, [&](unsigned int) {});
+			++processed[timeStep];
+		},
+		[&](unsigned int timeStep)
+		{
+			done.push_back(timeStep);
+		});
+		CPPUNIT_ASSERT_MESSAGE("Every time step should be processed once.", std::all_of(processed.begin(), processed.end(), [](int n) { return n == 1; }));
+		CPPUNIT_ASSERT_MESSAGE("Time steps should be reported in order.", done == std::vector<unsigned int>({ 0, 1, 2, 3, 4 }));
+
+		// 4D blending reports every time step and gives the voxel wise blend of all of them
+		mitk::Image::Pointer high = create4DImage(4, 0.);
+		mitk::Image::Pointer low = create4DImage(4, 50.);
+		mitk::AlphaBlendingTool tool;
+		tool.SetMaxConcurrentTimeSteps(2);
+		std::vector<unsigned int> previewed;
+		tool.SetTimeStepCallback([&](unsigned int timeStep, const mitk::Image::Pointer&)
+		{
+			previewed.push_back(timeStep);
+		});
+		mitk::Image::Pointer hu = tool.AlphaBlending(high, low, m_Alpha);
+		CPPUNIT_ASSERT_MESSAGE("Every time step should be reported once.", previewed == std::vector<unsigned int>({ 0, 1, 2, 3 }));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The output should keep the time steps.", 4u, hu->GetTimeSteps());
+
+		mitk::ImageReadAccessor highAccessor(high);
+		mitk::ImageReadAccessor lowAccessor(low);
+		mitk::ImageReadAccessor huAccessor(hu);
+		const double* highValues = static_cast<const double*>(highAccessor.GetData());
+		const double* lowValues = static_cast<const double*>(lowAccessor.GetData());
+		const double* values = static_cast<const double*>(huAccessor.GetData());
+		for (std::size_t i = 0; i < 32; ++i)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Every time step should be blended.",
+				m_Alpha * highValues[i] + (1. - m_Alpha) * lowValues[i], values[i], 1e-9);
+	}
+
+	void TestRigidAlignment()
+	{
+		// the moving image is the fixed one shifted by a known translation and with another contrast
+		const double shift[3] = { 1.5, -1., 0.5 };
+		mitk::Image::Pointer fixed = createPhantomImage(nullptr, 1., 0.);
+		mitk::Image::Pointer moving = createPhantomImage(shift, 0.7, 50.);
+		mitk::RigidAlignment alignment;
+		alignment.m_NumberOfLevels = 2;
+		alignment.Align(fixed, moving);
+		for (int d = 0; d < 3; ++d)
+		{
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The translation should be recovered.", shift[d], alignment.m_Transform.m_Translation[d], 0.2);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("No rotation should be found.", 0., alignment.m_Transform.m_Angles[d], 0.02);
+		}
+		CPPUNIT_ASSERT_MESSAGE("The aligned images should correlate.", alignment.m_Correlation > 0.99);
+
+		// blending only the moving image maps it back onto the fixed one
+		mitk::Image::Pointer hu = m_BlendingTool->AlphaBlending(moving, fixed, 1., alignment);
+		mitk::ImageReadAccessor fixedAccessor(fixed);
+		mitk::ImageReadAccessor huAccessor(hu);
+		const double* fixedValues = static_cast<const double*>(fixedAccessor.GetData());
+		const double* values = static_cast<const double*>(huAccessor.GetData());
+		double error = 0.;
+		unsigned int count = 0;
+		for (unsigned int z = 4; z < 20; ++z)
+			for (unsigned int y = 4; y < 28; ++y)
+				for (unsigned int x = 4; x < 28; ++x, ++count)
+					error += std::abs(values[(z * 32 + y) * 32 + x] - (0.7 * fixedValues[(z * 32 + y) * 32 + x] + 50.));
+		CPPUNIT_ASSERT_MESSAGE("The aligned blend should match the fixed image.", error / count < 10.);
+
+		// with a body mask the aligned blend is kept inside and air outside
+		const mitk::BodyMask mask = mitk::BodyMask::FromThreshold(fixed);
+		mitk::Image::Pointer masked = m_BlendingTool->AlphaBlending(moving, fixed, 1., alignment, &mask);
+		mitk::ImageReadAccessor maskedAccessor(masked);
+		const double* maskedValues = static_cast<const double*>(maskedAccessor.GetData());
+		std::size_t mismatches = 0;
+		mask.ForEachRun(0, mask.GetNumberOfSlices(),
+			[&](std::size_t begin, std::size_t end)
+			{
+				for (std::size_t i = begin; i < end; ++i)
+					mismatches += maskedValues[i] != values[i] ? 1 : 0;
+			},
+			[&](std::size_t begin, std::size_t end)
+			{
+				for (std::size_t i = begin; i < end; ++i)
+					mismatches += maskedValues[i] != -1000. ? 1 : 0;
+			});
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The masked aligned blend should differ from the aligned blend outside of the mask only.", std::size_t(0), mismatches);
+		mitk::VoxelStatistics statistics;
+		CPPUNIT_ASSERT_MESSAGE("The masked aligned blend should attach statistics.", mitk::VoxelStatistics::ReadFrom(masked, statistics));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The statistics should count all voxels.", mask.m_NumberOfVoxels, statistics.m_Count);
+	}
+
+	void TestSyntheticPhantom()
+	{
+		mitk::DECTPhantom phantom;
+		phantom.m_Size[0] = 48;
+		phantom.m_Size[1] = 40;
+		phantom.m_Size[2] = 6;
+		phantom.m_PixelType = mitk::MakeScalarPixelType<double>();
+		mitk::DECTPhantom::Images images = phantom.Generate();
+
+		// blending with the alpha of the phantom gives the RED of every material at the center of its insert
+		mitk::Image::Pointer hu = m_BlendingTool->AlphaBlending(images.m_High, images.m_Low, phantom.m_Alpha);
+		mitk::Image::Pointer red = m_BlendingTool->ConvertToRED(hu);
+		mitk::ImageReadAccessor labelAccessor(images.m_Labels);
+		mitk::ImageReadAccessor redAccessor(red);
+		const unsigned char* labels = static_cast<const unsigned char*>(labelAccessor.GetData());
+		const double* reds = static_cast<const double*>(redAccessor.GetData());
+		for (unsigned int label = 1; label < phantom.m_Materials.size(); ++label)
+		{
+			unsigned int index[3];
+			phantom.GetInsertCenter(label, index);
+			const std::size_t i = (static_cast<std::size_t>(index[2]) * 40 + index[1]) * 48 + index[0];
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("The insert center should have the label of its material.", label, static_cast<unsigned int>(labels[i]));
+			CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(phantom.m_Materials[label].m_Name + " should have its RED.", phantom.m_Materials[label].m_RED, reds[i], 1e-9);
+		}
+		CPPUNIT_ASSERT_MESSAGE("Bone should be brighter at low kV.", phantom.m_Materials.back().m_LowHU > phantom.m_Materials.back().m_HighHU);
+
+		// noise is reproducible, has the configured deviation and integer phantoms are rounded
+		phantom.m_PixelType = mitk::MakeScalarPixelType<short>();
+		phantom.m_LowNoise = 20.;
+		phantom.m_TimeSteps = 2;
+		mitk::DECTPhantom::Images noisy = phantom.Generate();
+		mitk::DECTPhantom::Images again = phantom.Generate();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The phantom should be 4D.", 2u, noisy.m_Low->GetTimeSteps());
+		mitk::ImageReadAccessor noisyAccessor(noisy.m_Low);
+		mitk::ImageReadAccessor againAccessor(again.m_Low);
+		mitk::ImageReadAccessor noisyLabelAccessor(noisy.m_Labels);
+		const short* noisyValues = static_cast<const short*>(noisyAccessor.GetData());
+		const short* againValues = static_cast<const short*>(againAccessor.GetData());
+		const unsigned char* noisyLabels = static_cast<const unsigned char*>(noisyLabelAccessor.GetData());
+		const std::size_t voxels = 48 * 40 * 6 * 2;
+		CPPUNIT_ASSERT_MESSAGE("The noise should be reproducible.", std::equal(noisyValues, noisyValues + voxels, againValues));
+		double sum = 0.;
+		double squares = 0.;
+		unsigned int count = 0;
+		for (std::size_t i = 0; i < voxels; ++i)
+		{
+			if (1 != noisyLabels[i])
+				continue;
+			sum += noisyValues[i];
+			squares += static_cast<double>(noisyValues[i]) * noisyValues[i];
+			++count;
+		}
+		const double mean = sum / count;
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("Water should stay at 0 HU on average.", 0., mean, 2.);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The noise should have the configured deviation.", 20., std::sqrt(squares / count - mean * mean), 2.);
+	}
+
+	void TestAutotuning()
+	{
+		const mitk::PixelType doubleType = mitk::MakeScalarPixelType<double>();
+		mitk::AlphaBlendingTool tool;
+		mitk::TunedParameters parameters;
+		parameters.m_NumberOfThreads = 1;
+		parameters.m_SlabSize = 1;
+		parameters.m_Throughput = 12.5;
+		tool.SetTunedParameters(mitk::ExecutionPlanner::Operation::ConvertToSPR, doubleType, parameters);
+
+		// the tuned slab size and thread count are planned without changing the strategy
+		mitk::ExecutionPlan plan = tool.Plan(mitk::ExecutionPlanner::Operation::ConvertToSPR, m_LowImage);
+		CPPUNIT_ASSERT_MESSAGE("The tuned SPR conversion should stay in memory.", plan.m_Strategy == mitk::ExecutionPlan::Strategy::InMemory);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The tuned slab size should be planned.", 1u, plan.m_SlabSize);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The tuned thread count should be planned.", 1u, plan.m_NumberOfThreads);
+		mitk::Image::Pointer expectedSPR = m_BlendingTool->ConvertToSPR(m_LowImage);
+		MITK_ASSERT_EQUAL(expectedSPR, tool.ConvertToSPR(m_LowImage), "The tuned SPR conversion should give the same result.");
+
+		// the tuning survives its string form on the same machine only
+		const std::string tuning = tool.GetTuningString();
+		mitk::AlphaBlendingTool restored;
+		CPPUNIT_ASSERT_MESSAGE("The tuning of this machine should be accepted.", restored.SetTuningString(tuning));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The restored tuning should have one entry.", std::size_t(1), restored.GetTuning().size());
+		const mitk::TunedParameters& restoredParameters = restored.GetTuning().begin()->second;
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The thread count should be restored.", 1u, restoredParameters.m_NumberOfThreads);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The slab size should be restored.", 1u, restoredParameters.m_SlabSize);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE("The throughput should be restored.", 12.5, restoredParameters.m_Throughput, 1e-9);
+		const std::string machine = mitk::ExecutionPlanner::GetMachineFingerprint();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The tuning should start with the machine.", machine, tuning.substr(0, machine.size()));
+		const std::string entries = tuning.substr(machine.size());
+		const std::string otherThreads = machine.substr(0, machine.find(";threads=")) + ";threads="
+			+ std::to_string(std::thread::hardware_concurrency() + 1) + entries;
+		CPPUNIT_ASSERT_MESSAGE("The tuning of another thread count should be rejected.", !restored.SetTuningString(otherThreads));
+		CPPUNIT_ASSERT_MESSAGE("A rejected tuning should clear the table.", restored.GetTuning().empty());
+		CPPUNIT_ASSERT_MESSAGE("The restored tuning should be accepted again.", restored.SetTuningString(tuning));
+		const std::string otherProcessor = "cpu=Other processor" + machine.substr(machine.find(";threads=")) + entries;
+		CPPUNIT_ASSERT_MESSAGE("The tuning of another processor should be rejected.", !restored.SetTuningString(otherProcessor));
+
+		// a canceled calibration keeps the previous tuning
+		std::size_t calls = 0;
+		CPPUNIT_ASSERT_MESSAGE("A canceled tuning should report it.", !tool.Autotune({ mitk::ExecutionPlanner::Operation::ConvertToRED }, { doubleType },
+			[&calls](std::size_t, std::size_t) { ++calls; return false; }));
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The progress should be asked once before tuning.", std::size_t(1), calls);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("A canceled tuning should keep the previous one.", tuning, tool.GetTuningString());
+
+		// the scoped thread limit is seen by the slab loops and restored afterwards
+		const unsigned int allThreads = mitk::GetNumberOfSlabThreads();
+		{
+			mitk::SlabThreadLimit limit(1);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE("The slab loops should be limited to one thread.", 1u, mitk::GetNumberOfSlabThreads());
+		}
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The thread limit should be lifted after its scope.", allThreads, mitk::GetNumberOfSlabThreads());
+
+		// a short calibration finds a configuration and leaves the tuning of the tool untouched
+		mitk::AutoTuner tuner;
+		tuner.m_Size[0] = 32;
+		tuner.m_Size[1] = 32;
+		tuner.m_Size[2] = 8;
+		tuner.m_Repetitions = 1;
+		mitk::TunedParameters tuned;
+		CPPUNIT_ASSERT_MESSAGE("Blending should be tunable.",
+			tuner.Tune(restored, mitk::ExecutionPlanner::Operation::AlphaBlending, mitk::MakeScalarPixelType<short>(), tuned));
+		CPPUNIT_ASSERT_MESSAGE("The tuned throughput should be positive.", tuned.m_Throughput > 0.);
+		CPPUNIT_ASSERT_MESSAGE("The calibration should not keep its candidates.", restored.GetTuning().empty());
+		CPPUNIT_ASSERT_MESSAGE("Fixed point blending of double images should not be tunable.",
+			!tuner.Tune(restored, mitk::ExecutionPlanner::Operation::FixedPointAlphaBlending, doubleType, tuned));
+	}
+
+	void TestPriorityThreadPool()
+	{
+		// dynamic scheduling on a single node, also on NUMA machines or with MITK_DECT_NUMA_NODES set
+		NumaTopologyGuard topology(mitk::NumaTopology::Simulate(1));
+		mitk::SlabThreadPool& pool = mitk::SlabThreadPool::GetInstance();
+		pool.ResetMetrics();
+
+		// every slab exactly once, nested loops run on the worker
+		std::vector<int> hits(1000, 0);
+		mitk::SlabParallelFor(1000, [&hits](unsigned int slab)
+		{
+			++hits[slab];
+			mitk::SlabParallelFor(2, [](unsigned int) {});
+		});
+		CPPUNIT_ASSERT_MESSAGE("Every slab should be processed once.", std::all_of(hits.begin(), hits.end(), [](int count) { return count == 1; }));
+		CPPUNIT_ASSERT_THROW_MESSAGE("A failing slab should throw on the calling thread.",
+			mitk::SlabParallelFor(100, [](unsigned int slab) { if (slab == 42) mitkThrow() << "slab failed"; }),
+			mitk::Exception);
+
+		// a thread limit bounds the chunks of the loop running at once
+		std::atomic<int> running(0);
+		std::atomic<int> maximum(0);
+		{
+			mitk::SlabThreadLimit limit(2);
+			mitk::SlabParallelFor(64, [&running, &maximum](unsigned int)
+			{
+				const int current = ++running;
+				int previous = maximum;
+				while (current > previous && !maximum.compare_exchange_weak(previous, current)) {}
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				--running;
+			});
+		}
+		CPPUNIT_ASSERT_MESSAGE("At most two slabs should run at once.", maximum <= 2);
+
+		// an interactive loop overtakes the queued chunks of a running batch loop
+		std::thread batch([]()
+		{
+			mitk::SlabPriorityScope priority(mitk::SlabPriority::Batch);
+			mitk::SlabParallelFor(400, [](unsigned int) { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+		});
+		while (pool.GetMetrics(mitk::SlabPriority::Batch).m_StartedLoops == 0)
+			std::this_thread::yield();
+		{
+			mitk::SlabPriorityScope priority(mitk::SlabPriority::Interactive);
+			CPPUNIT_ASSERT_MESSAGE("The priority should be set in its scope.", mitk::SlabPriority::Interactive == mitk::GetCurrentSlabPriority());
+			mitk::SlabParallelFor(8, [](unsigned int) {});
+		}
+		const mitk::SlabThreadPool::Metrics batchWhileInteractive = pool.GetMetrics(mitk::SlabPriority::Batch);
+		batch.join();
+		CPPUNIT_ASSERT_MESSAGE("The batch loop should still be queued after the interactive loop.", batchWhileInteractive.m_QueuedChunks > 0);
+		CPPUNIT_ASSERT_MESSAGE("The priority should be restored after its scope.", mitk::SlabPriority::Normal == mitk::GetCurrentSlabPriority());
+
+		const mitk::SlabThreadPool::Metrics interactive = pool.GetMetrics(mitk::SlabPriority::Interactive);
+		const mitk::SlabThreadPool::Metrics batchDone = pool.GetMetrics(mitk::SlabPriority::Batch);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("One interactive loop should be completed.", std::size_t(1), interactive.m_CompletedLoops);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("One batch loop should be completed.", std::size_t(1), batchDone.m_CompletedLoops);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("No batch chunks should be queued anymore.", std::size_t(0), batchDone.m_QueuedChunks);
+		CPPUNIT_ASSERT_MESSAGE("The interactive loop should finish long before the batch loop.", interactive.m_MaxLatency < batchDone.m_MaxLatency);
+		CPPUNIT_ASSERT_MESSAGE("The wait should not exceed the latency.", interactive.m_MaxWait <= interactive.m_MaxLatency);
+
+		// loops placed on NUMA nodes run on the pool with their priority as well
+		NumaTopologyGuard nodes(mitk::NumaTopology::Simulate(2));
+		pool.ResetMetrics();
+		{
+			mitk::SlabPriorityScope priority(mitk::SlabPriority::Batch);
+			mitk::SlabParallelFor(64, [](unsigned int) {});
+		}
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("A NUMA placed loop should run on the pool.", std::size_t(1), pool.GetMetrics(mitk::SlabPriority::Batch).m_CompletedLoops);
+	}
+
+	void TestBrickedVolume()
+	{
+		// bricks of 16 voxels do not divide the phantom, so the last bricks of every axis are partial
+		mitk::DECTPhantom phantom;
+		phantom.m_Size[0] = 72;
+		phantom.m_Size[1] = 60;
+		phantom.m_Size[2] = 20;
+		phantom.m_PixelType = mitk::MakeScalarPixelType<double>();
+		mitk::Image::Pointer clean = phantom.Generate().m_Low;
+		phantom.m_LowNoise = 15.;
+		mitk::Image::Pointer noisy = phantom.Generate().m_Low;
+		const std::size_t sliceSize = 72 * 60;
+
+		mitk::BrickedVolume lossless(noisy, 0., 16);
+		MITK_ASSERT_EQUAL(noisy, lossless.ToImage(), "Lossless bricks should restore the image exactly.");
+		mitk::ImageReadAccessor noisyAccessor(noisy);
+		const double* noisyValues = static_cast<const double*>(noisyAccessor.GetData());
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("A voxel should be read from its brick.", noisyValues[(7 * 60 + 33) * 72 + 70], lossless.GetValue(70, 33, 7));
+		std::vector<double> slice(sliceSize);
+		lossless.ReadSlice(7, 0, slice.data());
+		CPPUNIT_ASSERT_MESSAGE("A slice should be read from its bricks.", std::equal(slice.begin(), slice.end(), noisyValues + 7 * sliceSize));
+		const mitk::BrickedVolume::Statistics accessed = lossless.GetStatistics();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("The brick of the voxel should be reused by the slice.", std::size_t(1), accessed.m_CacheHits);
+		CPPUNIT_ASSERT_THROW_MESSAGE("Voxels outside of the volume should throw.", lossless.GetValue(72, 0, 0), mitk::Exception);
+
+		// air around the body is elided
+		const mitk::BrickedVolume::Statistics cleanStatistics = mitk::BrickedVolume(clean, 0., 16).GetStatistics();
+		CPPUNIT_ASSERT_MESSAGE("Air bricks should be constant.", cleanStatistics.m_ConstantBricks > 0);
+		CPPUNIT_ASSERT_MESSAGE("A noise free volume should compress well.", cleanStatistics.GetCompressionRatio() > 10.);
+
+		// quantized noisy values are restored within half a step
+		const double step = 0.1;
+		mitk::BrickedVolume quantized(noisy, step, 16);
+		mitk::Image::Pointer restored = quantized.ToImage();
+		mitk::ImageReadAccessor restoredAccessor(restored);
+		const double* restoredValues = static_cast<const double*>(restoredAccessor.GetData());
+		double maximumError = 0.;
+		for (std::size_t i = 0; i < sliceSize * 20; ++i)
+			maximumError = std::max(maximumError, std::abs(restoredValues[i] - noisyValues[i]));
+		CPPUNIT_ASSERT_MESSAGE("Quantized values should be restored within half a step.", maximumError <= step / 2 + 1e-9);
+		CPPUNIT_ASSERT_MESSAGE("Quantized noisy bricks should take at most a third of the memory.", quantized.GetStatistics().GetCompressionRatio() > 3.);
+
+		quantized.SetCacheCapacity(0);
+		quantized.GetValue(0, 0, 0);
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("A disabled cache should keep no bricks.", std::size_t(0), quantized.GetStatistics().m_CachedBytes);
+	}
+
+	void TestBrickedDataNode()
+	{
+		mitk::Image::Pointer image = createPhantomImage(nullptr, 1., 0.);
+		image->SetProperty("dect.test", mitk::StringProperty::New("HU"));
+
+		auto node = mitk::DataNode::New();
+		node->SetName("phantom (HU)");
+		node->SetData(image);
+		mitk::BrickedVolume::CompressNode(node, 0., 16);
+		auto storage = mitk::StandaloneDataStorage::New();
+		storage->Add(node);
+
+		mitk::DataNode::Pointer stored = storage->GetNamedNode("phantom (HU)");
+		CPPUNIT_ASSERT_MESSAGE("A compressed node should hold no image.", nullptr == stored->GetData());
+		CPPUNIT_ASSERT_MESSAGE("A compressed node should keep the bricks.", nullptr != mitk::BrickedVolume::GetFromNode(stored));
+		CPPUNIT_ASSERT_MESSAGE("A compressed node should be hidden until restored.", !stored->IsVisible(nullptr));
+
+		mitk::Image::Pointer restored = mitk::BrickedVolume::DecompressNode(stored);
+		MITK_ASSERT_EQUAL(image, restored, "A lossless node should restore the image with its geometry.");
+		CPPUNIT_ASSERT_MESSAGE("The restored image should be the node data.", restored.GetPointer() == storage->GetNamedNode("phantom (HU)")->GetData());
+		CPPUNIT_ASSERT_MESSAGE("The image properties should be restored.", nullptr != restored->GetProperty("dect.test"));
+		CPPUNIT_ASSERT_MESSAGE("A restored node should drop the bricks.", nullptr == mitk::BrickedVolume::GetFromNode(stored));
+		CPPUNIT_ASSERT_MESSAGE("A restored node should be returned as it is.", restored.GetPointer() == mitk::BrickedVolume::DecompressNode(stored));
+
+		CPPUNIT_ASSERT_THROW_MESSAGE("Nodes without an image should not be compressed.", mitk::BrickedVolume::CompressNode(mitk::DataNode::New()), mitk::Exception);
+	}
+
+	void TestAlphaMapBlending()
+	{
+		mitk::Image::Pointer low = createPhantomImage(nullptr, 1., 0.);
+		mitk::Image::Pointer high = createPhantomImage(nullptr, 0.7, 50.);
+
+		// a constant map on the grid of the images gives the scalar blend
+		mitk::Image::Pointer constantMap = createAlphaMap(32, 32, 24, 1., 0., [](double, double, double) { return 0.5; });
+		MITK_ASSERT_EQUAL(m_BlendingTool->AlphaBlending(high, low, 0.5), m_BlendingTool->AlphaBlending(high, low, constantMap),
+			"A constant alpha map should blend like its alpha.");
+
+		// a coarse map with voxels of 2 mm centered between the voxels of the images is interpolated, alpha is linear
+		// in world coordinates, so the interpolation is exact inside the map
+		auto alpha = [](double x, double y, double z) { return 0.2 + 0.01 * x + 0.015 * y + 0.005 * z; };
+		mitk::Image::Pointer coarseMap = createAlphaMap(16, 16, 12, 2., 0.5, alpha);
+		mitk::Image::Pointer hu = m_BlendingTool->AlphaBlending(high, low, coarseMap);
+		mitk::ImageReadAccessor highAccessor(high);
+		mitk::ImageReadAccessor lowAccessor(low);
+		mitk::ImageReadAccessor huAccessor(hu);
+		const double* highValues = static_cast<const double*>(highAccessor.GetData());
+		const double* lowValues = static_cast<const double*>(lowAccessor.GetData());
+		const double* values = static_cast<const double*>(huAccessor.GetData());
+		double maximumError = 0.;
+		for (unsigned int z = 1; z < 23; ++z)
+			for (unsigned int y = 1; y < 31; ++y)
+				for (unsigned int x = 1; x < 31; ++x)
+				{
+					const std::size_t i = (z * 32 + y) * 32 + x;
+					const double a = alpha(x, y, z);
+					maximumError = std::max(maximumError, std::abs(values[i] - (a * highValues[i] + (1. - a) * lowValues[i])));
+				}
+		CPPUNIT_ASSERT_MESSAGE("The coarse alpha map should be interpolated per voxel.", maximumError < 1e-3);
+
+		mitk::Image::Pointer vectorMap = mitk::Image::New();
+		unsigned int dimensions[3] = { 16, 16, 12 };
+		vectorMap->Initialize(mitk::MakePixelType<double, double, 2>(), 3, dimensions);
+		CPPUNIT_ASSERT_THROW_MESSAGE("Alpha maps with several components should throw.", m_BlendingTool->AlphaBlending(high, low, vectorMap), mitk::Exception);
+	}
+
+	void TestPipelineFilters()
+	{
+		mitk::Image::Pointer low = createPhantomImage(nullptr, 1., 0.);
+		mitk::Image::Pointer high = createPhantomImage(nullptr, 0.7, 50.);
+		mitk::AlphaBlendingFilter::Pointer blending = mitk::AlphaBlendingFilter::New();
+		blending->SetHighEnergyImage(high);
+		blending->SetLowEnergyImage(low);
+		blending->SetAlpha(0.6);
+		mitk::REDConversionFilter::Pointer red = mitk::REDConversionFilter::New();
+		red->SetInput(blending->GetOutput());
+		red->Update();
+
+		MITK_ASSERT_EQUAL(m_BlendingTool->AlphaBlending(high, low, 0.6), blending->GetOutput(), "The blending filter should blend like the tool.");
+		mitk::Image::Pointer hu = m_BlendingTool->AlphaBlending(high, low, 0.6);
+		MITK_ASSERT_EQUAL(m_BlendingTool->ConvertToRED(hu), red->GetOutput(), "The filter chain should convert to RED like the tool.");
+
+		// an unmodified pipeline is not recomputed, a new alpha is
+		const itk::ModifiedTimeType computed = red->GetOutput()->GetMTime();
+		red->Update();
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("An unmodified pipeline should not be recomputed.", computed, red->GetOutput()->GetMTime());
+		blending->SetAlpha(0.4);
+		red->Update();
+		CPPUNIT_ASSERT_MESSAGE("A new alpha should recompute the pipeline.", red->GetOutput()->GetMTime() > computed);
+		hu = m_BlendingTool->AlphaBlending(high, low, 0.4);
+		MITK_ASSERT_EQUAL(m_BlendingTool->ConvertToRED(hu), red->GetOutput(), "The recomputed chain should use the new alpha.");
+
+		// a request of a few slices is propagated through the chain and computes these slices
+		SliceCountingAlphaBlendingFilter::Pointer streamed = SliceCountingAlphaBlendingFilter::New();
+		streamed->SetHighEnergyImage(high);
+		streamed->SetLowEnergyImage(low);
+		streamed->SetAlpha(0.4);
+		mitk::REDConversionFilter::Pointer streamedRED = mitk::REDConversionFilter::New();
+		streamedRED->SetInput(streamed->GetOutput());
+		streamedRED->UpdateOutputInformation();
+		mitk::SlicedData::RegionType region = streamedRED->GetOutput()->GetLargestPossibleRegion();
+		region.SetIndex(2, 10);
+		region.SetSize(2, 3);
+		streamedRED->GetOutput()->SetRequestedRegion(&region);
+		streamedRED->GetOutput()->Update();
+		mitk::ImageReadAccessor expectedAccessor(red->GetOutput());
+		const double* expected = static_cast<const double*>(expectedAccessor.GetData());
+		for (unsigned int z = 10; z < 13; ++z)
+		{
+			mitk::ImageReadAccessor sliceAccessor(streamedRED->GetOutput(), streamedRED->GetOutput()->GetSliceData(z).GetPointer());
+			const double* slice = static_cast<const double*>(sliceAccessor.GetData());
+			CPPUNIT_ASSERT_MESSAGE("A requested slice should be computed.", std::equal(slice, slice + 32 * 32, expected + z * 32 * 32));
+		}
+		CPPUNIT_ASSERT_EQUAL_MESSAGE("Only the requested slices should be blended.", std::size_t(3), streamed->m_ComputedSlices.load());
+		CPPUNIT_ASSERT_MESSAGE("A slice outside of the request should not be set.", !streamedRED->GetOutput()->IsSliceSet(0));
+		CPPUNIT_ASSERT_MESSAGE("A slice outside of the request should not be set upstream.", !streamed->GetOutput()->IsSliceSet(13));
+
+		mitk::AlphaBlendingFilter::Pointer incomplete = mitk::AlphaBlendingFilter::New();
+		incomplete->SetLowEnergyImage(low);
+		CPPUNIT_ASSERT_THROW_MESSAGE("A filter with a missing input should throw.", incomplete->Update(), itk::ExceptionObject);
+	}
+
 	/**
 	 * @brief      Creates an 3d 2|2|2 mitk image with given values.
 	 *
@@ -203,6 +1696,200 @@ public:
 	}
 
 
+	/**
+	 * @brief      Creates an 3d 2|2|2 short mitk image with given values.
+	 *
+	 * @param      array of 8 short values which are written into the image
+	 *
+	 * @return     mitk image pointer
+	 */
+	static mitk::Image::Pointer createShortImage(short* vals)
+	{
+		typedef itk::Image<short, 3> ImageType;
+		ImageType::RegionType region;
+		ImageType::SizeType size;
+		size.Fill(2);
+		region.SetSize(size);
+
+		ImageType::Pointer image = ImageType::New();
+		image->SetRegions(region);
+		image->Allocate();
+		std::copy(vals, vals + 8, image->GetBufferPointer());
+
+		mitk::Image::Pointer mitkImage = mitk::Image::New();
+		mitkImage->InitializeByItk(image.GetPointer());
+		mitkImage->SetVolume(image->GetBufferPointer());
+		return mitkImage;
+	}
+
+
+	/**
+	 * @brief      Writes a CT series of one study with 0.5 mm pixels and 2 mm slices, one DICOM file per slice.
+	 */
+	template <typename TPixel>
+	static void writeDicomSeries(const std::string& directory, const std::string& seriesInstanceUID, double kvp, const unsigned int size[3],
+		const TPixel* voxels)
+	{
+		typedef itk::Image<TPixel, 2> SliceType;
+
+		for (unsigned int z = 0; z < size[2]; ++z)
+		{
+			typename SliceType::SizeType sliceSize;
+			sliceSize[0] = size[0];
+			sliceSize[1] = size[1];
+			typename SliceType::SpacingType spacing;
+			spacing.Fill(0.5);
+			auto slice = SliceType::New();
+			slice->SetRegions(sliceSize);
+			slice->SetSpacing(spacing);
+			slice->Allocate();
+			std::copy(voxels + z * size[0] * size[1], voxels + (z + 1) * size[0] * size[1], slice->GetBufferPointer());
+
+			auto io = itk::GDCMImageIO::New();
+			io->KeepOriginalUIDOn();
+			itk::MetaDataDictionary& dictionary = io->GetMetaDataDictionary();
+			itk::EncapsulateMetaData<std::string>(dictionary, "0008|0016", "1.2.840.10008.5.1.4.1.1.2");
+			itk::EncapsulateMetaData<std::string>(dictionary, "0008|0018", seriesInstanceUID + "." + std::to_string(z + 1));
+			itk::EncapsulateMetaData<std::string>(dictionary, "0008|0060", "CT");
+			itk::EncapsulateMetaData<std::string>(dictionary, "0020|000d", "1.2.826.0.1.3680043.9.7001");
+			itk::EncapsulateMetaData<std::string>(dictionary, "0020|000e", seriesInstanceUID);
+			itk::EncapsulateMetaData<std::string>(dictionary, "0020|0052", "1.2.826.0.1.3680043.9.7001.0");
+			itk::EncapsulateMetaData<std::string>(dictionary, "0018|0060", std::to_string(static_cast<int>(kvp)));
+			itk::EncapsulateMetaData<std::string>(dictionary, "0020|0013", std::to_string(z + 1));
+			itk::EncapsulateMetaData<std::string>(dictionary, "0020|0032", "0\\0\\" + std::to_string(2 * z));
+			itk::EncapsulateMetaData<std::string>(dictionary, "0020|0037", "1\\0\\0\\0\\1\\0");
+
+			auto writer = itk::ImageFileWriter<SliceType>::New();
+			writer->SetImageIO(io);
+			writer->SetInput(slice);
+			writer->SetFileName(directory + "/" + seriesInstanceUID + "." + std::to_string(z + 1) + ".dcm");
+			writer->Update();
+		}
+	}
+
+	/**
+	 * @brief      Creates a float alpha map with the given spacing and origin, alpha is evaluated at world coordinates.
+	 */
+	template <typename TAlpha>
+	static mitk::Image::Pointer createAlphaMap(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, double spacing, double origin, TAlpha alpha)
+	{
+		typedef itk::Image<float, 3> ImageType;
+		ImageType::RegionType region;
+		ImageType::SizeType size;
+		size[0] = sizeX;
+		size[1] = sizeY;
+		size[2] = sizeZ;
+		region.SetSize(size);
+
+		ImageType::Pointer image = ImageType::New();
+		image->SetRegions(region);
+		image->SetSpacing(spacing);
+		ImageType::PointType imageOrigin;
+		imageOrigin.Fill(origin);
+		image->SetOrigin(imageOrigin);
+		image->Allocate();
+		itk::ImageRegionIterator<ImageType> it(image, region);
+		for (; !it.IsAtEnd(); ++it)
+		{
+			ImageType::PointType point;
+			image->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+			it.Set(static_cast<float>(alpha(point[0], point[1], point[2])));
+		}
+
+		mitk::Image::Pointer mitkImage = mitk::Image::New();
+		mitkImage->InitializeByItk(image.GetPointer());
+		mitkImage->SetVolume(image->GetBufferPointer());
+		return mitkImage;
+	}
+
+	/**
+	 * @brief      Creates a 3d 32|32|24 mitk image of a smooth ellipsoid with an insert, scaled, offset and moved by shift.
+	 *
+	 * @return     mitk image pointer
+	 */
+	/**
+	 * @brief      Averages 2|2|2 blocks of a 3D volume, blocks at odd borders are smaller. size is set to the new size.
+	 */
+	static std::vector<double> downsampleReference(const std::vector<double>& values, unsigned int size[3])
+	{
+		const unsigned int target[3] = { (size[0] + 1) / 2, (size[1] + 1) / 2, (size[2] + 1) / 2 };
+		std::vector<double> sums(target[0] * target[1] * target[2], 0.);
+		std::vector<unsigned int> counts(sums.size(), 0);
+		for (unsigned int z = 0; z < size[2]; ++z)
+			for (unsigned int y = 0; y < size[1]; ++y)
+				for (unsigned int x = 0; x < size[0]; ++x)
+				{
+					const std::size_t block = ((z / 2) * target[1] + y / 2) * target[0] + x / 2;
+					sums[block] += values[(static_cast<std::size_t>(z) * size[1] + y) * size[0] + x];
+					++counts[block];
+				}
+		for (std::size_t i = 0; i < sums.size(); ++i)
+			sums[i] /= counts[i];
+		std::copy(target, target + 3, size);
+		return sums;
+	}
+
+	static mitk::Image::Pointer createPhantomImage(const double* shift, double scale, double offset)
+	{
+		typedef itk::Image<double, 3> ImageType;
+		ImageType::RegionType region;
+		ImageType::SizeType size;
+		size[0] = 32;
+		size[1] = 32;
+		size[2] = 24;
+		region.SetSize(size);
+
+		ImageType::Pointer image = ImageType::New();
+		image->SetRegions(region);
+		image->Allocate();
+		auto blob = [](double dx, double dy, double dz, double radius)
+		{
+			return 1. / (1. + std::exp((std::sqrt(dx * dx + dy * dy + dz * dz) - radius) / 1.5));
+		};
+		itk::ImageRegionIterator<ImageType> it(image, region);
+		for (; !it.IsAtEnd(); ++it)
+		{
+			double p[3];
+			for (int d = 0; d < 3; ++d)
+				p[d] = it.GetIndex()[d] - (nullptr != shift ? shift[d] : 0.);
+			const double value = -1000. + 1000. * blob((p[0] - 16.) / 1.2, p[1] - 15., (p[2] - 12.) * 1.4, 11.)
+				+ 800. * blob(p[0] - 12., p[1] - 13., p[2] - 10., 3.5);
+			it.Set(scale * value + offset);
+		}
+
+		mitk::Image::Pointer mitkImage = mitk::Image::New();
+		mitkImage->InitializeByItk(image.GetPointer());
+		mitkImage->SetVolume(image->GetBufferPointer());
+		return mitkImage;
+	}
+
+	/**
+	 * @brief      Creates a 4d 2|2|2|timeSteps mitk image, the voxels count up from offset.
+	 *
+	 * @return     mitk image pointer
+	 */
+	static mitk::Image::Pointer create4DImage(unsigned int timeSteps, double offset)
+	{
+		typedef itk::Image<double, 4> ImageType;
+		ImageType::RegionType region;
+		ImageType::SizeType size;
+		size.Fill(2);
+		size[3] = timeSteps;
+		region.SetSize(size);
+
+		ImageType::Pointer image = ImageType::New();
+		image->SetRegions(region);
+		image->Allocate();
+		const std::size_t n = region.GetNumberOfPixels();
+		for (std::size_t i = 0; i < n; ++i)
+			image->GetBufferPointer()[i] = offset + i;
+
+		mitk::Image::Pointer mitkImage = mitk::Image::New();
+		mitkImage->InitializeByItk(image.GetPointer());
+		mitkImage->SetImportChannel(image->GetBufferPointer(), 0, mitk::Image::CopyMemory);
+		return mitkImage;
+	}
+
 	/**
 	 * @brief      Creates an empty 2d mitk image.
 	 *
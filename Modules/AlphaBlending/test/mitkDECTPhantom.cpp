@@ -0,0 +1,255 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+#include "mitkDECTPhantom.h"
+
+#include <mitkExceptionMacro.h>
+#include <mitkImageWriteAccessor.h>
+#include <mitkSlabParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace
+{
+	const double WaterZeff = 7.45;
+	const double ZeffExponent = 3.3;
+	const double Pi = 3.14159265358979323846;
+
+	// splitmix64 finalizer, a counter based generator gives the same noise for any partitioning into threads
+	std::uint64_t Hash(std::uint64_t value)
+	{
+		value += 0x9E3779B97F4A7C15ull;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	// approximately standard normal sample, the sum of the four 16 bit uniforms of a hash with zero mean and unit variance
+	// avoids transcendental functions, which would dominate the generation time of large noisy phantoms
+	double Gaussian(std::uint64_t key)
+	{
+		const std::uint64_t bits = Hash(key);
+		const double sum = static_cast<double>((bits & 0xFFFF) + ((bits >> 16) & 0xFFFF) + ((bits >> 32) & 0xFFFF) + (bits >> 48)) + 2.;
+		return (sum / 65536. - 2.) * 1.7320508075688772;
+	}
+
+	// two independent samples of a voxel, one for each energy
+	void Gaussians(unsigned int seed, std::uint64_t voxel, double& low, double& high)
+	{
+		const std::uint64_t key = Hash(seed) ^ (voxel * 2);
+		low = Gaussian(key);
+		high = Gaussian(key ^ 1);
+	}
+
+	// inserts are evenly distributed on an ellipse at 60% of the body semi axes
+	void GetInsertPosition(const unsigned int size[3], std::size_t numberOfInserts, std::size_t insert, double position[2])
+	{
+		const double angle = 2. * Pi * insert / numberOfInserts;
+		position[0] = (size[0] - 1) / 2. + 0.6 * 0.45 * size[0] * std::cos(angle);
+		position[1] = (size[1] - 1) / 2. + 0.6 * 0.4 * size[1] * std::sin(angle);
+	}
+
+	template <typename TPixel>
+	TPixel ToPixel(double value)
+	{
+		if (!std::numeric_limits<TPixel>::is_integer)
+			return static_cast<TPixel>(value);
+		const double rounded = std::round(value);
+		return static_cast<TPixel>(std::min<double>(std::max<double>(rounded, std::numeric_limits<TPixel>::lowest()), std::numeric_limits<TPixel>::max()));
+	}
+
+	template <typename TPixel>
+	void WriteRow(void* data, std::size_t offset, const std::vector<double>& values)
+	{
+		TPixel* row = static_cast<TPixel*>(data) + offset;
+		for (std::size_t x = 0; x < values.size(); ++x)
+			row[x] = ToPixel<TPixel>(values[x]);
+	}
+
+	void WriteRow(const mitk::PixelType& pixelType, void* data, std::size_t offset, const std::vector<double>& values)
+	{
+		switch (pixelType.GetComponentType())
+		{
+		case itk::ImageIOBase::SHORT:
+			WriteRow<short>(data, offset, values);
+			break;
+		case itk::ImageIOBase::INT:
+			WriteRow<int>(data, offset, values);
+			break;
+		case itk::ImageIOBase::FLOAT:
+			WriteRow<float>(data, offset, values);
+			break;
+		default:
+			WriteRow<double>(data, offset, values);
+			break;
+		}
+	}
+}
+
+std::vector<mitk::DECTPhantom::Material> mitk::DECTPhantom::GetDefaultMaterials()
+{
+	std::vector<Material> materials(8);
+	materials[0].m_Name = "Air";
+	materials[0].m_RED = 0.001;
+	materials[0].m_Zeff = 7.64;
+	materials[1].m_Name = "Water";
+	materials[2].m_Name = "Lung";
+	materials[2].m_RED = 0.26;
+	materials[2].m_Zeff = 7.6;
+	materials[3].m_Name = "Adipose";
+	materials[3].m_RED = 0.95;
+	materials[3].m_Zeff = 6.3;
+	materials[4].m_Name = "Muscle";
+	materials[4].m_RED = 1.04;
+	materials[4].m_Zeff = 7.6;
+	materials[5].m_Name = "Liver";
+	materials[5].m_RED = 1.07;
+	materials[5].m_Zeff = 7.7;
+	materials[6].m_Name = "Trabecular bone";
+	materials[6].m_RED = 1.16;
+	materials[6].m_Zeff = 10.1;
+	materials[7].m_Name = "Cortical bone";
+	materials[7].m_RED = 1.69;
+	materials[7].m_Zeff = 12.6;
+	return materials;
+}
+
+void mitk::DECTPhantom::ComputeHU(const Material & material, double & lowHU, double & highHU) const
+{
+	if (m_Alpha <= 1. || m_LowPhotoelectricFraction <= 0. || m_LowPhotoelectricFraction >= 1.)
+	{
+		mitkThrow() << "The phantom needs an alpha above 1 and a photoelectric fraction in (0, 1).";
+	}
+	// the photoelectric coefficients are chosen such that alpha * high + (1 - alpha) * low cancels the Z_eff term
+	const double water = std::pow(WaterZeff, ZeffExponent);
+	const double lowCoefficient = m_LowPhotoelectricFraction / ((1. - m_LowPhotoelectricFraction) * water);
+	const double lowWeight = lowCoefficient / (1. + lowCoefficient * water);
+	const double highWeight = lowWeight * (1. - 1. / m_Alpha);
+	const double highCoefficient = highWeight / (1. - highWeight * water);
+
+	const double z = std::pow(material.m_Zeff, ZeffExponent);
+	lowHU = 1000. * (material.m_RED * (1. + lowCoefficient * z) / (1. + lowCoefficient * water) - 1.);
+	highHU = 1000. * (material.m_RED * (1. + highCoefficient * z) / (1. + highCoefficient * water) - 1.);
+}
+
+void mitk::DECTPhantom::GetInsertCenter(unsigned int label, unsigned int index[3]) const
+{
+	double center[2] = { (m_Size[0] - 1) / 2., (m_Size[1] - 1) / 2. };
+	if (label >= 2 && label < m_Materials.size())
+		GetInsertPosition(m_Size, m_Materials.size() - 2, label - 2, center);
+	index[0] = static_cast<unsigned int>(std::lround(center[0]));
+	index[1] = static_cast<unsigned int>(std::lround(center[1]));
+	index[2] = m_Size[2] / 2;
+}
+
+mitk::DECTPhantom::Images mitk::DECTPhantom::Generate()
+{
+	for (unsigned int d = 0; d < 3; ++d)
+	{
+		if (m_Size[d] < 1 || m_Size[d] > 1024)
+		{
+			mitkThrow() << "The phantom size has to be between 1 and 1024 voxels per dimension.";
+		}
+	}
+	if (m_TimeSteps < 1)
+	{
+		mitkThrow() << "The phantom needs at least one time step.";
+	}
+	const auto componentType = m_PixelType.GetComponentType();
+	if (m_PixelType.GetNumberOfComponents() != 1 || (componentType != itk::ImageIOBase::SHORT && componentType != itk::ImageIOBase::INT
+		&& componentType != itk::ImageIOBase::FLOAT && componentType != itk::ImageIOBase::DOUBLE))
+	{
+		mitkThrow() << "The phantom can be generated as short, int, float or double images only.";
+	}
+	if (m_Materials.size() < 2 || m_Materials.size() > 255)
+	{
+		mitkThrow() << "The phantom needs air, the body material and at most 253 inserts.";
+	}
+	for (auto& material : m_Materials)
+		ComputeHU(material, material.m_LowHU, material.m_HighHU);
+
+	unsigned int dimensions[4] = { m_Size[0], m_Size[1], m_Size[2], m_TimeSteps };
+	const unsigned int dimension = m_TimeSteps > 1 ? 4 : 3;
+	mitk::Vector3D spacing;
+	for (unsigned int d = 0; d < 3; ++d)
+		spacing[d] = m_Spacing[d];
+	Images images;
+	images.m_Low = mitk::Image::New();
+	images.m_High = mitk::Image::New();
+	images.m_Labels = mitk::Image::New();
+	images.m_Low->Initialize(m_PixelType, dimension, dimensions);
+	images.m_High->Initialize(m_PixelType, dimension, dimensions);
+	images.m_Labels->Initialize(mitk::MakeScalarPixelType<unsigned char>(), dimension, dimensions);
+	images.m_Low->SetSpacing(spacing);
+	images.m_High->SetSpacing(spacing);
+	images.m_Labels->SetSpacing(spacing);
+
+	mitk::ImageWriteAccessor lowAccessor(images.m_Low);
+	mitk::ImageWriteAccessor highAccessor(images.m_High);
+	mitk::ImageWriteAccessor labelAccessor(images.m_Labels);
+	unsigned char* labels = static_cast<unsigned char*>(labelAccessor.GetData());
+
+	const double center[2] = { (m_Size[0] - 1) / 2., (m_Size[1] - 1) / 2. };
+	const double semiAxes[2] = { 0.45 * m_Size[0], 0.4 * m_Size[1] };
+	const double insertRadius = 0.12 * std::min(semiAxes[0], semiAxes[1]);
+	std::vector<double> insertCenters(2 * (m_Materials.size() - 2));
+	for (std::size_t i = 0; i + 2 < m_Materials.size(); ++i)
+		GetInsertPosition(m_Size, m_Materials.size() - 2, i, &insertCenters[2 * i]);
+
+	const bool noisy = m_LowNoise > 0. || m_HighNoise > 0.;
+
+	// one slab per slice of every time step
+	SlabParallelFor(m_Size[2] * m_TimeSteps, [&](unsigned int slab)
+	{
+		const unsigned int t = slab / m_Size[2];
+		const double shift = m_TimeSteps > 1 ? m_MotionAmplitude / m_Spacing[1] * std::sin(2. * Pi * t / m_TimeSteps) : 0.;
+		std::vector<double> low(m_Size[0]);
+		std::vector<double> high(m_Size[0]);
+		for (unsigned int y = 0; y < m_Size[1]; ++y)
+		{
+			const std::size_t offset = (static_cast<std::size_t>(slab) * m_Size[1] + y) * m_Size[0];
+			const double dy = y - shift - center[1];
+			for (unsigned int x = 0; x < m_Size[0]; ++x)
+			{
+				const double dx = x - center[0];
+				unsigned char label = 0;
+				if (dx * dx / (semiAxes[0] * semiAxes[0]) + dy * dy / (semiAxes[1] * semiAxes[1]) <= 1.)
+				{
+					label = 1;
+					for (std::size_t i = 0; i < insertCenters.size(); i += 2)
+					{
+						const double ix = x - insertCenters[i];
+						const double iy = y - shift - insertCenters[i + 1];
+						if (ix * ix + iy * iy <= insertRadius * insertRadius)
+							label = static_cast<unsigned char>(2 + i / 2);
+					}
+				}
+				labels[offset + x] = label;
+				low[x] = m_Materials[label].m_LowHU;
+				high[x] = m_Materials[label].m_HighHU;
+				if (noisy)
+				{
+					double lowNoise;
+					double highNoise;
+					Gaussians(m_Seed, offset + x, lowNoise, highNoise);
+					low[x] += m_LowNoise * lowNoise;
+					high[x] += m_HighNoise * highNoise;
+				}
+			}
+			WriteRow(m_PixelType, lowAccessor.GetData(), offset, low);
+			WriteRow(m_PixelType, highAccessor.GetData(), offset, high);
+		}
+	});
+	return images;
+}
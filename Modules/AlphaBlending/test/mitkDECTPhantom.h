@@ -0,0 +1,95 @@
+/*============================================================================
+
+The Medical Imaging Interaction Toolkit (MITK)
+
+Copyright (c) German Cancer Research Center (DKFZ)
+All rights reserved.
+
+Use of this source code is governed by a 3-clause BSD license that can be
+found in the LICENSE file.
+
+============================================================================*/
+
+#ifndef mitkDECTPhantom_h
+#define mitkDECTPhantom_h
+
+#include <mitkImage.h>
+
+#include <string>
+#include <vector>
+
+namespace mitk
+{
+	/**
+	 * @brief      Synthetic low and high kV phantom pairs for tests and benchmarks, generated on the fly in parallel.
+	 *
+	 * The phantom is an elliptic water body in air, filled along z, with cylindrical tissue inserts on a ring around its
+	 * center. Every material is given by its relative electron density and effective atomic number, its HU values are
+	 * derived from a two term attenuation model, mu / (rho_e * mu_water) = (1 + c * Z_eff^3.3) / (1 + c * Z_water^3.3),
+	 * with one photoelectric coefficient c per energy. The coefficients are chosen such that blending with m_Alpha
+	 * cancels the photoelectric term, so alpha blending and rED conversion give the RED of every material exactly.
+	 *
+	 * The optional noise is approximately Gaussian and computed per voxel from a hash of the seed and the voxel index,
+	 * so a phantom is identical for any number of threads. 4D phantoms move the body sinusoidally in y over the time
+	 * steps, like breathing.
+	 */
+	class DECTPhantom
+	{
+	public:
+
+		struct Material
+		{
+			std::string m_Name;
+			double m_RED = 1.;         // relative electron density
+			double m_Zeff = 7.45;      // effective atomic number
+			double m_LowHU = 0.;       // derived by Generate
+			double m_HighHU = 0.;      // derived by Generate
+		};
+
+		struct Images
+		{
+			mitk::Image::Pointer m_Low;
+			mitk::Image::Pointer m_High;
+			mitk::Image::Pointer m_Labels;  // unsigned char index into m_Materials
+		};
+
+		unsigned int m_Size[3] = { 64, 64, 32 };  // voxels, up to 1024 each
+		unsigned int m_TimeSteps = 1;             // more than one gives a 4D phantom
+		double m_Spacing[3] = { 1., 1., 1. };     // mm
+		mitk::PixelType m_PixelType = mitk::MakeScalarPixelType<short>();  // short, int, float or double
+		double m_LowNoise = 0.;                   // standard deviation in HU
+		double m_HighNoise = 0.;                  // standard deviation in HU
+		unsigned int m_Seed = 1;
+		double m_MotionAmplitude = 0.;            // mm in y over the time steps
+
+		double m_Alpha = 1.45;                    // alpha blending to the RED of the materials
+		double m_LowPhotoelectricFraction = 0.15; // share of the photoelectric term in the low kV attenuation of water
+
+		/**
+		 * @brief      Air, the water body and the inserts, in label order. The default inserts cover lung, adipose,
+		 * soft tissue, liver, trabecular and cortical bone.
+		 */
+		std::vector<Material> m_Materials = GetDefaultMaterials();
+
+		static std::vector<Material> GetDefaultMaterials();
+
+		/**
+		 * @brief      Low and high kV images of the configured pixel type and the label image, all on the same grid.
+		 * The HU values of m_Materials are updated. Throws an mitk::Exception for invalid sizes, pixel types or more
+		 * than 255 materials.
+		 */
+		Images Generate();
+
+		/**
+		 * @brief      Low and high kV HU of a material without noise.
+		 */
+		void ComputeHU(const Material& material, double& lowHU, double& highHU) const;
+
+		/**
+		 * @brief      Voxel index of the center of an insert in the first time step, label 0 and 1 give the body center.
+		 */
+		void GetInsertCenter(unsigned int label, unsigned int index[3]) const;
+	};
+}
+
+#endif
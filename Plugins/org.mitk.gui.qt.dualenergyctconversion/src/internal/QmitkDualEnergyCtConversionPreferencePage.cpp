@@ -17,6 +17,8 @@ found in the LICENSE file.
 #include <berryIBerryPreferences.h>
 #include <berryPlatform.h>
 
+#include <mitkAlphaBlendingTool.h>
+
 #include <QLabel>
 #include <QPushButton>
 #include <QFormLayout>
@@ -24,18 +26,25 @@ found in the LICENSE file.
 #include <QGroupBox>
 #include <QRadioButton>
 #include <QLineEdit>
+#include <QSpinBox>
+#include <QComboBox>
 #include <QFileDialog>
 #include <QVBoxLayout>
+#include <QProgressDialog>
+#include <QtConcurrent>
 
 
 QmitkDualEnergyCtConversionPreferencePage::QmitkDualEnergyCtConversionPreferencePage()
-  : m_MainControl(nullptr)
+  : m_MainControl(nullptr), m_TuningCanceled(false)
 {
+	connect(&m_TuningWatcher, SIGNAL(finished()), this, SLOT(TuningFinished()));
 }
 
 QmitkDualEnergyCtConversionPreferencePage::~QmitkDualEnergyCtConversionPreferencePage()
 {
-	
+	// the worker uses m_TuningTool, so a running calibration is canceled and awaited
+	m_TuningCanceled = true;
+	m_TuningWatcher.waitForFinished();
 }
 
 void QmitkDualEnergyCtConversionPreferencePage::Init(berry::IWorkbench::Pointer)
@@ -74,12 +83,44 @@ void QmitkDualEnergyCtConversionPreferencePage::CreateQtControl(QWidget* widget)
 	readingOptionLayout->addWidget(m_RadioAppend);
 	formLayout->addRow("Reading mode:", readingOptionLayout);
 
+	m_MemoryBudgetSpinBox = new QSpinBox(m_MainControl);
+	m_MemoryBudgetSpinBox->setRange(0, 1 << 20);
+	m_MemoryBudgetSpinBox->setSuffix(" MB");
+	m_MemoryBudgetSpinBox->setSpecialValueText("unlimited");
+	m_MemoryBudgetSpinBox->setToolTip("Operations exceeding the budget are streamed slab by slab or refused. Inputs and results are always held completely.");
+	formLayout->addRow("Memory budget:", m_MemoryBudgetSpinBox);
+
+	m_DifferenceCacheComboBox = new QComboBox(m_MainControl);
+	m_DifferenceCacheComboBox->addItem("Off");
+	m_DifferenceCacheComboBox->addItem("Float");
+	m_DifferenceCacheComboBox->addItem("Double");
+	m_DifferenceCacheComboBox->setToolTip("Keeps the difference of the last blended images to re-blend them quickly on alpha change.\n"
+		"Float halves the memory of the cache and is exact for integer HU inputs, off keeps no extra image.");
+	formLayout->addRow("Re-blending cache:", m_DifferenceCacheComboBox);
+
+	m_ResultStorageComboBox = new QComboBox(m_MainControl);
+	m_ResultStorageComboBox->addItem("Full images");
+	m_ResultStorageComboBox->addItem("Compressed, lossless");
+	m_ResultStorageComboBox->addItem("Compressed, export precision");
+	m_ResultStorageComboBox->setToolTip("Keeps new HU, RED and SPR results block compressed and hidden in the data storage.\n"
+		"A result is restored once it is shown or used by a conversion, export precision keeps 0.1 HU or 1e-4 RED.");
+	formLayout->addRow("Result storage:", m_ResultStorageComboBox);
+
+	auto tuningLayout = new QHBoxLayout;
+	m_TuneButton = new QPushButton("Tune performance", m_MainControl);
+	m_TuneButton->setToolTip("Measures the fastest thread count, slab size and kernel of the conversions on this machine, takes a few seconds.");
+	tuningLayout->addWidget(m_TuneButton);
+	m_TuningLabel = new QLabel(m_MainControl);
+	tuningLayout->addWidget(m_TuningLabel);
+	formLayout->addRow("Performance tuning:", tuningLayout);
+
 	// set tooltip for xml file. Displays an example xml file
 	m_PathEdit->setToolTip("The xml file has to be in the following format: \n\n <AlphaBlendingTool>\n  <Mode description=\"descriptionTextOfMode\" alphaValue=\"1.0\"/>\n  <Mode description=\"descriptionTextOfMode\" alphaValue=\"1.5\"/>\n</AlphaBlendingTool>");
 
 	m_MainControl->setLayout(formLayout);
 
 	connect(m_PathSelect, SIGNAL(clicked()), this, SLOT(PathSelectButtonPushed()));
+	connect(m_TuneButton, SIGNAL(clicked()), this, SLOT(TuneButtonPushed()));
 	connect(m_EnableExternalCheckBox, SIGNAL(stateChanged(int)), this, SLOT(CheckboxChanged(int)));
 	
 	this->Update();	
@@ -101,6 +142,10 @@ bool QmitkDualEnergyCtConversionPreferencePage::PerformOk()
 	m_DualEnergyConversionPreferenceNode->PutBool("append values", m_RadioAppend->isChecked());
 	m_DualEnergyConversionPreferenceNode->PutBool("overwrite values", m_RadioOverwrite->isChecked());
 	m_DualEnergyConversionPreferenceNode->Put("alpha path", m_PathEdit->text());
+	m_DualEnergyConversionPreferenceNode->PutInt("memory budget", m_MemoryBudgetSpinBox->value());
+	m_DualEnergyConversionPreferenceNode->PutInt("difference cache", m_DifferenceCacheComboBox->currentIndex());
+	m_DualEnergyConversionPreferenceNode->PutInt("result storage", m_ResultStorageComboBox->currentIndex());
+	m_DualEnergyConversionPreferenceNode->Put("tuning", m_Tuning);
 	return true;
 }
 void QmitkDualEnergyCtConversionPreferencePage::Update()
@@ -119,6 +164,71 @@ void QmitkDualEnergyCtConversionPreferencePage::Update()
 
 	QString path = m_DualEnergyConversionPreferenceNode->Get("alpha path", "");
 	m_PathEdit->setText(path);
+
+	m_MemoryBudgetSpinBox->setValue(m_DualEnergyConversionPreferenceNode->GetInt("memory budget", 0));
+	m_DifferenceCacheComboBox->setCurrentIndex(m_DualEnergyConversionPreferenceNode->GetInt("difference cache", 1));
+	m_ResultStorageComboBox->setCurrentIndex(m_DualEnergyConversionPreferenceNode->GetInt("result storage", 0));
+
+	// a tuning of another machine is dropped by the tool, so the label only tells whether one is stored
+	m_Tuning = m_DualEnergyConversionPreferenceNode->Get("tuning", "");
+	m_TuningLabel->setText(m_Tuning.isEmpty() ? "not tuned" : "tuned");
+}
+
+void QmitkDualEnergyCtConversionPreferencePage::TuneButtonPushed()
+{
+	if (m_TuningWatcher.isRunning())
+		return;
+
+	m_TuningTool.reset(new mitk::AlphaBlendingTool);
+	m_TuningTool->SetMemoryBudget(static_cast<std::size_t>(m_MemoryBudgetSpinBox->value()) << 20);
+	m_TuningCanceled = false;
+
+	m_TuningProgress = new QProgressDialog("Measuring the conversions on this machine ...", "Cancel", 0, 0, m_MainControl);
+	m_TuningProgress->setWindowModality(Qt::WindowModal);
+	m_TuningProgress->setMinimumDuration(0);
+	m_TuningProgress->setAttribute(Qt::WA_DeleteOnClose);
+	connect(m_TuningProgress, &QProgressDialog::canceled, this, [this]() { m_TuningCanceled = true; });
+	m_TuneButton->setEnabled(false);
+	m_TuningLabel->setText("tuning ...");
+
+	// the progress callback runs in the worker, the dialog is updated through calls queued to the page, which
+	// outlives the worker
+	m_TuningWatcher.setFuture(QtConcurrent::run([this]()
+	{
+		return m_TuningTool->Autotune(std::vector<mitk::ExecutionPlanner::Operation>(), std::vector<mitk::PixelType>(),
+			[this](std::size_t tuned, std::size_t total)
+			{
+				QMetaObject::invokeMethod(this, [this, tuned, total]()
+				{
+					if (m_TuningProgress)
+					{
+						m_TuningProgress->setMaximum(static_cast<int>(total));
+						m_TuningProgress->setValue(static_cast<int>(tuned));
+					}
+				}, Qt::QueuedConnection);
+				return !m_TuningCanceled;
+			});
+	}));
+	m_TuningProgress->show();
+}
+
+void QmitkDualEnergyCtConversionPreferencePage::TuningFinished()
+{
+	if (m_TuningProgress)
+		m_TuningProgress->close();
+	m_TuneButton->setEnabled(true);
+
+	if (!m_TuningWatcher.result())
+	{
+		// the stored tuning stays until another one is measured
+		m_TuningLabel->setText(m_Tuning.isEmpty() ? "not tuned" : "tuned");
+	}
+	else
+	{
+		m_Tuning = QString::fromStdString(m_TuningTool->GetTuningString());
+		m_TuningLabel->setText(m_TuningTool->GetTuning().empty() ? "tuning failed" : "tuned, applied once accepted");
+	}
+	m_TuningTool.reset();
 }
 
 void QmitkDualEnergyCtConversionPreferencePage::PathSelectButtonPushed()
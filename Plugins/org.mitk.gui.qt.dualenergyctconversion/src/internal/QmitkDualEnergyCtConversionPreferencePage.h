@@ -15,13 +15,27 @@ found in the LICENSE file.
 
 #include <berryIQtPreferencePage.h>
 #include <org_mitk_gui_qt_dualenergyctconversion_Export.h>
+#include <QFutureWatcher>
+#include <QPointer>
 #include <QString>
 
+#include <atomic>
+#include <memory>
+
 class QWidget;
 class QLineEdit;
 class QPushButton;
 class QRadioButton;
 class QCheckBox;
+class QSpinBox;
+class QComboBox;
+class QLabel;
+class QProgressDialog;
+
+namespace mitk
+{
+	class AlphaBlendingTool;
+}
 
 /**
  * @brief      GUI class for the qmitk dual energy ct conversion preference page.
@@ -79,6 +93,18 @@ protected:
     QRadioButton* m_RadioOverwrite;
     QRadioButton* m_RadioAppend;
     QCheckBox* m_EnableExternalCheckBox;
+    QSpinBox* m_MemoryBudgetSpinBox;
+    QComboBox* m_DifferenceCacheComboBox;
+    QComboBox* m_ResultStorageComboBox;
+    QPushButton* m_TuneButton;
+    QLabel* m_TuningLabel;
+    QString m_Tuning;
+
+    // the calibration runs on its own tool in a worker thread, the dialog shows its progress and cancels it
+    std::unique_ptr<mitk::AlphaBlendingTool> m_TuningTool;
+    QFutureWatcher<bool> m_TuningWatcher;
+    QPointer<QProgressDialog> m_TuningProgress;
+    std::atomic<bool> m_TuningCanceled;
 
 protected slots:
 	/**
@@ -87,6 +113,17 @@ protected slots:
      */
     void PathSelectButtonPushed();
 
+    /**
+     * @brief      Function called once the gui button m_TuneButton is pressed, starts the calibration of
+     *             mitk::AlphaBlendingTool::Autotune in a worker thread with a cancelable progress dialog
+     */
+    void TuneButtonPushed();
+
+    /**
+     * @brief      Function called once the calibration finished or was canceled, keeps the result until the page is accepted
+     */
+    void TuningFinished();
+
 
     /**
      * @brief      Funktion called when the checkbox m_EnableExternalCheckBox is pressed.
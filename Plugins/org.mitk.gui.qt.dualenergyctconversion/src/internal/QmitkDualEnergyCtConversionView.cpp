@@ -23,13 +23,23 @@ found in the LICENSE file.
 #include <mitkNodePredicateOr.h>
 #include <mitkNodePredicateProperty.h>
 #include <mitkLevelWindowProperty.h>
+#include <mitkProperties.h>
+#include <mitkStringProperty.h>
 #include <mitkImage.h>
+#include <mitkRenderingManager.h>
 
 #include <usModuleRegistry.h>
 #include <string>
 #include <QMessageBox>
+#include <QFileDialog>
 // include alpha blending module
 #include <mitkAlphaBlendingTool.h>
+#include <mitkBrickedVolume.h>
+#include <mitkBufferPool.h>
+#include <mitkCompressedVolumeWriter.h>
+#include <mitkDECTSeriesLoader.h>
+#include <mitkSlabThreadPool.h>
+#include <mitkVoxelStatistics.h>
 
 #include "QmitkDualEnergyCtConversionView.h"
 
@@ -43,6 +53,10 @@ void QmitkDualEnergyCtConversionView::InitAlphaBlendingTool()
     {
         m_BlendingTool = mitk::AlphaBlendingTool();
         m_BlendingTool.Initialize();
+        // keep the difference of the last blended pair for the live re-blending on alpha change, as set in the preferences
+        berry::IPreferences::Pointer prefNode = berry::Platform::GetPreferencesService()->GetSystemPreferences()->Node("/org.mitk.views.dualenergyctconversion");
+        const int differenceCache = prefNode->GetInt("difference cache", 1);
+        m_BlendingTool.SetDifferenceCaching(differenceCache != 0, differenceCache == 1);
 
         MITK_INFO << "Alpha Blending module could be found and initialized";
 
@@ -71,8 +85,20 @@ void QmitkDualEnergyCtConversionView::UpdateModeBox()
     qlist << QString("custom alphaValue");
 
     m_Controls.modeBox->addItems(qlist);
+
+    m_Controls.binModeBox->clear();
+    for (const auto& mode : m_BlendingTool.m_WeightVectorMap)
+    {
+        m_Controls.binModeBox->addItem(QString::fromStdString(mode.first));
+    }
+    if (!m_BlendingTool.m_WeightVectorMap.empty())
+    {
+        m_Controls.binModeBox->addItem(AllBinModes);
+    }
 }
 
+const QString QmitkDualEnergyCtConversionView::AllBinModes = QStringLiteral("all matching weights");
+
 // Don't forget to initialize the VIEW_ID.
 const std::string QmitkDualEnergyCtConversionView::VIEW_ID = "org.mitk.views.dualenergyctconversion";
 
@@ -85,13 +111,18 @@ void QmitkDualEnergyCtConversionView::CreateQtPartControl(QWidget* parent)
 
     m_Controls.alphaSpinBox->setReadOnly(true);
 
+    // results kept compressed hold no image until they are used, see AddResultNode
+    auto imageNode = mitk::NodePredicateOr::New(
+        mitk::TNodePredicateDataType<mitk::Image>::New(),
+        mitk::NodePredicateProperty::New(mitk::BrickedVolume::NodePropertyName));
+
     m_Controls.selectionWidget_lowEnergy->SetDataStorage(this->GetDataStorage());
     m_Controls.selectionWidget_lowEnergy->SetSelectionIsOptional(true);
     m_Controls.selectionWidget_lowEnergy->SetEmptyInfo(QStringLiteral("Select an low energy image"));
 
 
     m_Controls.selectionWidget_lowEnergy->SetNodePredicate(mitk::NodePredicateAnd::New(
-        mitk::TNodePredicateDataType<mitk::Image>::New(),
+        imageNode,
         mitk::NodePredicateNot::New(mitk::NodePredicateOr::New(
             mitk::NodePredicateProperty::New("helper object"),
             mitk::NodePredicateProperty::New("hidden object")))));
@@ -101,7 +132,7 @@ void QmitkDualEnergyCtConversionView::CreateQtPartControl(QWidget* parent)
     m_Controls.selectionWidget_highEnergy->SetEmptyInfo(QStringLiteral("Select an high energy image"));
 
     m_Controls.selectionWidget_highEnergy->SetNodePredicate(mitk::NodePredicateAnd::New(
-        mitk::TNodePredicateDataType<mitk::Image>::New(),
+        imageNode,
         mitk::NodePredicateNot::New(mitk::NodePredicateOr::New(
             mitk::NodePredicateProperty::New("helper object"),
             mitk::NodePredicateProperty::New("hidden object")))));
@@ -111,7 +142,28 @@ void QmitkDualEnergyCtConversionView::CreateQtPartControl(QWidget* parent)
     m_Controls.selectionWidget_huCube->SetEmptyInfo(QStringLiteral("Select HU image"));
 
     m_Controls.selectionWidget_huCube->SetNodePredicate(mitk::NodePredicateAnd::New(
+        imageNode,
+        mitk::NodePredicateNot::New(mitk::NodePredicateOr::New(
+            mitk::NodePredicateProperty::New("helper object"),
+            mitk::NodePredicateProperty::New("hidden object")))));
+
+    m_Controls.selectionWidget_energyBins->SetDataStorage(this->GetDataStorage());
+    m_Controls.selectionWidget_energyBins->SetSelectionIsOptional(true);
+    m_Controls.selectionWidget_energyBins->SetEmptyInfo(QStringLiteral("Select the energy bins, they are ordered by their energy"));
+
+    m_Controls.selectionWidget_energyBins->SetNodePredicate(mitk::NodePredicateAnd::New(
+        imageNode,
+        mitk::NodePredicateNot::New(mitk::NodePredicateOr::New(
+            mitk::NodePredicateProperty::New("helper object"),
+            mitk::NodePredicateProperty::New("hidden object")))));
+
+    m_Controls.selectionWidget_bodyMask->SetDataStorage(this->GetDataStorage());
+    m_Controls.selectionWidget_bodyMask->SetSelectionIsOptional(true);
+    m_Controls.selectionWidget_bodyMask->SetEmptyInfo(QStringLiteral("Select an optional body mask"));
+
+    m_Controls.selectionWidget_bodyMask->SetNodePredicate(mitk::NodePredicateAnd::New(
         mitk::TNodePredicateDataType<mitk::Image>::New(),
+        mitk::NodePredicateProperty::New("binary", mitk::BoolProperty::New(true)),
         mitk::NodePredicateNot::New(mitk::NodePredicateOr::New(
             mitk::NodePredicateProperty::New("helper object"),
             mitk::NodePredicateProperty::New("hidden object")))));
@@ -131,20 +183,37 @@ void QmitkDualEnergyCtConversionView::CreateQtPartControl(QWidget* parent)
     connect(m_Controls.selectionWidget_lowEnergy, &QmitkSingleNodeSelectionWidget::CurrentSelectionChanged, this, &QmitkDualEnergyCtConversionView::OnImageChanged);
     connect(m_Controls.selectionWidget_highEnergy, &QmitkSingleNodeSelectionWidget::CurrentSelectionChanged, this, &QmitkDualEnergyCtConversionView::OnImageChanged);
     connect(m_Controls.selectionWidget_huCube, &QmitkSingleNodeSelectionWidget::CurrentSelectionChanged, this, &QmitkDualEnergyCtConversionView::OnHuImageChanged);
+    connect(m_Controls.selectionWidget_energyBins, &QmitkMultiNodeSelectionWidget::CurrentSelectionChanged, this, &QmitkDualEnergyCtConversionView::OnBinImagesChanged);
+    connect(m_Controls.binModeBox, SIGNAL(currentIndexChanged(int)), this, SLOT(OnBinModeChange(int)));
+    connect(m_Controls.selectionWidget_bodyMask, &QmitkSingleNodeSelectionWidget::CurrentSelectionChanged, this, &QmitkDualEnergyCtConversionView::UpdateBlendingOptions);
+    connect(m_Controls.autoMaskCheckBox, SIGNAL(toggled(bool)), this, SLOT(UpdateBlendingOptions()));
+    connect(m_Controls.adaptiveCheckBox, SIGNAL(toggled(bool)), this, SLOT(UpdateBlendingOptions()));
+    connect(m_Controls.motionCorrectionCheckBox, SIGNAL(toggled(bool)), this, SLOT(UpdateBlendingOptions()));
 
 
 
 	//Wire up the select mode Box and the alpha Values box
     connect(m_Controls.modeBox, SIGNAL(currentIndexChanged(int)), this, SLOT(OnModeChange(int)));
+    connect(m_Controls.alphaSpinBox, SIGNAL(valueChanged(double)), this, SLOT(OnAlphaChanged(double)));
     // Wire up the UI blend button with the correlating funtion
     connect(m_Controls.blendingImageButton, SIGNAL(clicked()), this, SLOT(BlendSelectedImages()));
 	// Wire up red conversion
     connect(m_Controls.redConversionButton, SIGNAL(clicked()), this, SLOT(ConvertToREDImage()));
+    // Wire up spr conversion
+    connect(m_Controls.sprConversionButton, SIGNAL(clicked()), this, SLOT(ConvertToSPRImage()));
+    // Wire up dicom series loading
+    connect(m_Controls.loadSeriesButton, SIGNAL(clicked()), this, SLOT(LoadDECTSeries()));
+    // Wire up energy bin combination
+    connect(m_Controls.binCombinationButton, SIGNAL(clicked()), this, SLOT(CombineEnergyBins()));
+    // Wire up compressed export
+    connect(m_Controls.exportButton, SIGNAL(clicked()), this, SLOT(ExportSelectedImage()));
 
     // Make sure to have a consistent UI state at the very beginning.
     this->OnImageChanged(m_Controls.selectionWidget_lowEnergy->GetSelectedNodes());
     this->OnImageChanged(m_Controls.selectionWidget_highEnergy->GetSelectedNodes());
     this->OnHuImageChanged(m_Controls.selectionWidget_huCube->GetSelectedNodes());
+    this->OnBinImagesChanged(m_Controls.selectionWidget_energyBins->GetSelectedNodes());
+    this->UpdateBlendingOptions();
 }
 
 void QmitkDualEnergyCtConversionView::SetFocus()
@@ -169,6 +238,38 @@ void QmitkDualEnergyCtConversionView::OnModeChange(int idx)
 	}
 }
 
+void QmitkDualEnergyCtConversionView::OnAlphaChanged(double alpha)
+{
+    auto huDataNode = m_LastHUNode.Lock();
+    auto selectedDataNodeLow = m_Controls.selectionWidget_lowEnergy->GetSelectedNode();
+    auto selectedDataNodeHigh = m_Controls.selectionWidget_highEnergy->GetSelectedNode();
+    if (huDataNode.IsNull() || selectedDataNodeLow.IsNull() || selectedDataNodeHigh.IsNull())
+        return;
+
+    mitk::Image::Pointer imageLow = dynamic_cast<mitk::Image*>(selectedDataNodeLow->GetData());
+    mitk::Image::Pointer imageHigh = dynamic_cast<mitk::Image*>(selectedDataNodeHigh->GetData());
+    // only the last blended pair is cached, any other selection needs the blending button
+    if (!m_BlendingTool.IsDifferenceCached(imageHigh, imageLow))
+        return;
+    mitk::Image::Pointer huCube = mitk::BrickedVolume::DecompressNode(huDataNode);
+    if (huCube.IsNull())
+        return;
+
+    try
+    {
+        // the preview runs ahead of queued batch work, e.g. of the watch folder service
+        mitk::SlabPriorityScope priority(mitk::SlabPriority::Interactive);
+        m_BlendingTool.AlphaBlendingInto(huCube, imageHigh, imageLow, alpha);
+    }
+    catch (const mitk::Exception& e)
+    {
+        MITK_WARN << "Re-blending failed: " << e.GetDescription();
+        m_LastHUNode = nullptr;
+        return;
+    }
+    mitk::RenderingManager::GetInstance()->RequestUpdateAll();
+}
+
 void QmitkDualEnergyCtConversionView::OnImageChanged(const QmitkSingleNodeSelectionWidget::NodeList&)
 {
     this->EnableBlendingButton(m_Controls.selectionWidget_lowEnergy->GetSelectedNode().IsNotNull() && m_Controls.selectionWidget_highEnergy->GetSelectedNode().IsNotNull() && (m_Controls.modeBox->currentIndex() != -1));
@@ -184,9 +285,36 @@ void QmitkDualEnergyCtConversionView::OnHuImageChanged(const QmitkSingleNodeSele
     this->EnableConversionButton(m_Controls.selectionWidget_huCube->GetSelectedNode().IsNotNull());
 }
 
+void QmitkDualEnergyCtConversionView::OnBinImagesChanged(const QmitkMultiNodeSelectionWidget::NodeList& nodes)
+{
+    // the selected weights need one weight per selected bin, all matching weights need at least one weight set of that size
+    bool matchingWeights = false;
+    for (const auto& mode : m_BlendingTool.m_WeightVectorMap)
+    {
+        const bool selected = m_Controls.binModeBox->currentText() == AllBinModes || m_Controls.binModeBox->currentText().toStdString() == mode.first;
+        matchingWeights = matchingWeights || (selected && mode.second.size() == static_cast<std::size_t>(nodes.size()));
+    }
+    m_Controls.binCombinationButton->setEnabled(nodes.size() >= 2 && matchingWeights);
+}
+
+void QmitkDualEnergyCtConversionView::OnBinModeChange(int)
+{
+    this->OnBinImagesChanged(m_Controls.selectionWidget_energyBins->GetSelectedNodes());
+}
+
+void QmitkDualEnergyCtConversionView::UpdateBlendingOptions()
+{
+    // adaptive blending neither corrects motion nor masks, so it excludes both
+    const bool masked = m_Controls.selectionWidget_bodyMask->GetSelectedNode().IsNotNull() || m_Controls.autoMaskCheckBox->isChecked();
+    m_Controls.adaptiveCheckBox->setEnabled(!masked && !m_Controls.motionCorrectionCheckBox->isChecked());
+    m_Controls.motionCorrectionCheckBox->setEnabled(!m_Controls.adaptiveCheckBox->isChecked());
+}
+
 void QmitkDualEnergyCtConversionView::EnableConversionButton(bool enable)
 {
     m_Controls.redConversionButton->setEnabled(enable);
+    m_Controls.sprConversionButton->setEnabled(enable);
+    m_Controls.exportButton->setEnabled(enable);
 }
 
 
@@ -196,12 +324,9 @@ void QmitkDualEnergyCtConversionView::BlendSelectedImages()
     auto selectedDataNodeLow = m_Controls.selectionWidget_lowEnergy->GetSelectedNode();
     auto selectedDataNodeHigh = m_Controls.selectionWidget_highEnergy->GetSelectedNode();
 
-    auto dataLow = selectedDataNodeLow->GetData();
-    auto dataHigh = selectedDataNodeHigh->GetData();
-
-    //Get selected images
-    mitk::Image::Pointer imageLow = dynamic_cast<mitk::Image*>(dataLow);
-    mitk::Image::Pointer imageHigh = dynamic_cast<mitk::Image*>(dataHigh);
+    //Get selected images, compressed ones are restored
+    mitk::Image::Pointer imageLow = mitk::BrickedVolume::DecompressNode(selectedDataNodeLow);
+    mitk::Image::Pointer imageHigh = mitk::BrickedVolume::DecompressNode(selectedDataNodeHigh);
 
     auto imageName = selectedDataNodeLow->GetName();
 
@@ -212,28 +337,79 @@ void QmitkDualEnergyCtConversionView::BlendSelectedImages()
     MITK_INFO << "Blending images \"" << imageName << "\" ... ";
 
     //call alpha blending method of coresponding module
-    mitk::Image::Pointer huCube  = m_BlendingTool.AlphaBlending(imageHigh, imageLow, m_Controls.alphaSpinBox->value());
-    //mitk::Image::Pointer huCube = mitk::ArithmeticOperation::Add(mitk::ArithmeticOperation::Multiply(imageHigh, m_Controls.alphaSpinBox->value()), mitk::ArithmeticOperation::Multiply(imageLow, (1. - m_Controls.alphaSpinBox->value())));
-    // create new datanode which contains the calculated alpha image
-
-	auto huDataNode = mitk::DataNode::New();
-    huDataNode->SetData(huCube);
-	
-
-    MITK_INFO << "  done";
+    bool adaptive = m_Controls.adaptiveCheckBox->isChecked() && m_Controls.adaptiveCheckBox->isEnabled();
+    if (!CheckExecutionPlan(adaptive ? mitk::ExecutionPlanner::Operation::AdaptiveAlphaBlending : mitk::ExecutionPlanner::Operation::AlphaBlending, imageHigh, imageLow))
+        return;
 
-    QString name = QString("%1 (rED)").arg(imageName.c_str());
-    name = QString("%1 (HU)").arg(imageName.c_str());
-	
-    // set the name of the new data node
+    QString name = QString("%1 (HU)").arg(imageName.c_str());
+    auto huDataNode = mitk::DataNode::New();
     huDataNode->SetName(name.toStdString());
-    // set the level window to the same as the lowenergy data node because they wont differ much
     huDataNode->SetLevelWindow(levelWindow);
-    // get the datastorage
     mitk::DataStorage::Pointer datastorage = this->GetDataStorage();
 
-    // add the image to the datastorage
-    datastorage->Add(huDataNode);
+    // show the first time step of dynamic series while the others are blended
+    m_BlendingTool.SetTimeStepCallback([&](unsigned int timeStep, const mitk::Image::Pointer& output)
+    {
+        if (0 != timeStep || output->GetTimeSteps() < 2 || nullptr != huDataNode->GetData())
+            return;
+        huDataNode->SetData(output);
+        datastorage->Add(huDataNode);
+        mitk::RenderingManager::GetInstance()->ForceImmediateUpdateAll();
+    });
+
+    mitk::Image::Pointer huCube;
+    mitk::BodyMask mask;
+    bool plain = false;
+    try
+    {
+        if (adaptive)
+            huCube = m_BlendingTool.AdaptiveAlphaBlending(imageHigh, imageLow, m_Controls.alphaSpinBox->value());
+        else if (m_Controls.motionCorrectionCheckBox->isChecked())
+        {
+            mitk::RigidAlignment alignment;
+            alignment.Align(imageLow, imageHigh);
+            const auto& transform = alignment.m_Transform;
+            MITK_INFO << "  aligned with translation (" << transform.m_Translation[0] << ", " << transform.m_Translation[1] << ", "
+                      << transform.m_Translation[2] << ") mm, correlation " << alignment.m_Correlation;
+            // the mask is given in the grid of the low image, which is also the grid of the result
+            const bool masked = GetBodyMask(imageLow, mask);
+            huCube = m_BlendingTool.AlphaBlending(imageHigh, imageLow, m_Controls.alphaSpinBox->value(), alignment, masked ? &mask : nullptr);
+        }
+        else if (GetBodyMask(imageLow, mask))
+            huCube = m_BlendingTool.AlphaBlending(imageHigh, imageLow, m_Controls.alphaSpinBox->value(), mask);
+        else
+        {
+            huCube = m_BlendingTool.AlphaBlending(imageHigh, imageLow, m_Controls.alphaSpinBox->value());
+            plain = true;
+        }
+    }
+    catch (const mitk::Exception& e)
+    {
+        m_BlendingTool.SetTimeStepCallback(nullptr);
+        if (nullptr != huDataNode->GetData())
+            datastorage->Remove(huDataNode);
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
+    m_BlendingTool.SetTimeStepCallback(nullptr);
+    //mitk::Image::Pointer huCube = mitk::ArithmeticOperation::Add(mitk::ArithmeticOperation::Multiply(imageHigh, m_Controls.alphaSpinBox->value()), mitk::ArithmeticOperation::Multiply(imageLow, (1. - m_Controls.alphaSpinBox->value())));
+
+    MITK_INFO << "  done";
+
+    // use the statistics computed during blending, otherwise keep the level window of the low energy data node
+    SetLevelWindowFromStatistics(huDataNode, huCube);
+    if (nullptr == huDataNode->GetData())
+    {
+        huDataNode->SetData(huCube);
+        // add the image to the datastorage, a time series shown while blending stays a full image
+        AddResultNode(huDataNode, "HU");
+    }
+    else
+    {
+        mitk::RenderingManager::GetInstance()->RequestUpdateAll();
+    }
+    // adaptive, motion corrected and masked results are not re-blended on alpha change
+    m_LastHUNode = plain ? huDataNode.GetPointer() : nullptr;
 
 	// set the newly calculated datanode into the red conversion
     m_Controls.selectionWidget_huCube->SetCurrentSelectedNode(huDataNode);
@@ -241,15 +417,117 @@ void QmitkDualEnergyCtConversionView::BlendSelectedImages()
 
 }
 
+void QmitkDualEnergyCtConversionView::CombineEnergyBins()
+{
+    auto nodes = m_Controls.selectionWidget_energyBins->GetSelectedNodes();
+
+    std::vector<mitk::Image::Pointer> selectedImages;
+    std::vector<const mitk::Image*> selectedInputs;
+    for (const auto& node : nodes)
+    {
+        selectedImages.push_back(mitk::BrickedVolume::DecompressNode(node));
+        selectedInputs.push_back(selectedImages.back());
+    }
+
+    // the weights follow the bins from the lowest energy, whatever the selection order
+    std::vector<std::size_t> order;
+    try
+    {
+        order = mitk::AlphaBlendingTool::SortEnergyBins(selectedInputs);
+    }
+    catch (const mitk::Exception& e)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
+    std::vector<mitk::Image::Pointer> binImages;
+    std::vector<const mitk::Image*> inputs;
+    for (std::size_t index : order)
+    {
+        binImages.push_back(selectedImages[index]);
+        inputs.push_back(selectedInputs[index]);
+    }
+
+    // either the selected weights or all weights with one weight per selected bin, computed in one pass
+    std::vector<std::string> modes;
+    std::vector<std::vector<double>> weightSets;
+    for (const auto& mode : m_BlendingTool.m_WeightVectorMap)
+    {
+        bool selected = m_Controls.binModeBox->currentText() == AllBinModes ? mode.second.size() == binImages.size()
+                                                                            : m_Controls.binModeBox->currentText().toStdString() == mode.first;
+        if (selected)
+        {
+            modes.push_back(mode.first);
+            weightSets.push_back(mode.second);
+        }
+    }
+    if (weightSets.empty() || weightSets.front().size() != binImages.size())
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", QString("No bin weights for %1 energy bins are selected.").arg(binImages.size()));
+        return;
+    }
+
+    mitk::ExecutionPlan plan = m_BlendingTool.Plan(mitk::ExecutionPlanner::Operation::WeightedCombination, inputs, weightSets.size());
+    if (plan.m_Strategy == mitk::ExecutionPlan::Strategy::Refused)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", QString::fromStdString(plan.m_Message + " Increase the memory budget in the DECT preferences."));
+        return;
+    }
+    MITK_INFO << plan.m_Message;
+
+    auto imageName = nodes[static_cast<int>(order.front())]->GetName();
+    MITK_INFO << "Combining " << binImages.size() << " energy bins \"" << imageName << "\" ... ";
+
+    std::vector<mitk::Image::Pointer> huCubes;
+    try
+    {
+        huCubes = m_BlendingTool.WeightedCombination(binImages, weightSets);
+    }
+    catch (const mitk::Exception& e)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
+
+    MITK_INFO << "  done";
+
+    for (std::size_t i = 0; i < huCubes.size(); ++i)
+    {
+        auto huDataNode = mitk::DataNode::New();
+        huDataNode->SetData(huCubes[i]);
+        huDataNode->SetName(QString("%1 %2 (HU)").arg(imageName.c_str()).arg(modes[i].c_str()).toStdString());
+        SetLevelWindowFromStatistics(huDataNode, huCubes[i]);
+        AddResultNode(huDataNode, "HU");
+
+        if (0 == i)
+            m_Controls.selectionWidget_huCube->SetCurrentSelectedNode(huDataNode);
+    }
+}
+
 void QmitkDualEnergyCtConversionView::ConvertToREDImage()
 {
     auto selectedDataNode = m_Controls.selectionWidget_huCube->GetSelectedNode();
-    auto data = selectedDataNode->GetData();
     auto imageName = selectedDataNode->GetName();
 
-    mitk::Image::Pointer huCube = dynamic_cast<mitk::Image*>(data);
+    mitk::Image::Pointer huCube = mitk::BrickedVolume::DecompressNode(selectedDataNode);
 
-    mitk::Image::Pointer rEDCube = m_BlendingTool.ConvertToRED(huCube);
+    if (!CheckExecutionPlan(mitk::ExecutionPlanner::Operation::ConvertToRED, huCube))
+        return;
+
+    mitk::Image::Pointer rEDCube;
+    mitk::BodyMask mask;
+    try
+    {
+        if (GetBodyMask(huCube, mask))
+            rEDCube = m_BlendingTool.ConvertToRED(huCube, mask);
+        else
+            rEDCube = m_BlendingTool.ConvertToRED(huCube);
+    }
+    catch (const mitk::Exception& e)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
 
 
     MITK_INFO << "convert to RED Image \"" << imageName << "\" ... ";
@@ -260,10 +538,217 @@ void QmitkDualEnergyCtConversionView::ConvertToREDImage()
 
     QString name = QString("%1 (rED)").arg(imageName.c_str());
     rEDDataNode->SetName(name.toStdString());	
+    SetLevelWindowFromStatistics(rEDDataNode, rEDCube);
+
+    AddResultNode(rEDDataNode, "RED");
+
+}
+
+void QmitkDualEnergyCtConversionView::ConvertToSPRImage()
+{
+    auto selectedDataNode = m_Controls.selectionWidget_huCube->GetSelectedNode();
+    auto imageName = selectedDataNode->GetName();
+
+    mitk::Image::Pointer huCube = mitk::BrickedVolume::DecompressNode(selectedDataNode);
+
+    if (!CheckExecutionPlan(mitk::ExecutionPlanner::Operation::ConvertToSPR, huCube))
+        return;
+
+    MITK_INFO << "convert to SPR Image \"" << imageName << "\" ... ";
+
+    mitk::Image::Pointer sprCube = m_BlendingTool.ConvertToSPR(huCube);
+
+    // create datanode containing the new spr image
+    auto sprDataNode = mitk::DataNode::New();
+    sprDataNode->SetData(sprCube);
+
+    QString name = QString("%1 (SPR)").arg(imageName.c_str());
+    sprDataNode->SetName(name.toStdString());
+
+    AddResultNode(sprDataNode, "SPR");
+}
 
-	mitk::DataStorage::Pointer datastorage = this->GetDataStorage();
-    datastorage->Add(rEDDataNode);
+void QmitkDualEnergyCtConversionView::LoadDECTSeries()
+{
+    QString directory = QFileDialog::getExistingDirectory(nullptr, "Select DECT DICOM directory");
+    if (directory.isEmpty())
+        return;
 
+    mitk::DECTSeriesLoader loader;
+    std::vector<mitk::DECTSeriesLoader::SeriesPair> pairs;
+    try
+    {
+        pairs = loader.PairSeries(loader.ScanDirectory(directory.toStdString()), m_BlendingTool.m_AlphaValueMap);
+    }
+    catch (const mitk::Exception& e)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
+
+    if (pairs.empty())
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", "No pair of low and high kVp series was found in the selected directory.");
+        return;
+    }
+
+    const auto& pair = pairs.front();
+
+    // select the mode matching the kVp combination, this updates the alpha spin box
+    bool blend = false;
+    if (!pair.m_Modes.empty())
+    {
+        int idx = m_Controls.modeBox->findText(QString::fromStdString(pair.m_Modes.front()));
+        if (idx != -1)
+        {
+            m_Controls.modeBox->setCurrentIndex(idx);
+            blend = true;
+        }
+    }
+
+    MITK_INFO << "Loading DECT series " << pair.m_Low.m_KVP << "kV / " << pair.m_High.m_KVP << "kV ... ";
+
+    mitk::DECTSeriesLoader::LoadResult result;
+    try
+    {
+        result = loader.LoadPair(pair, blend, m_Controls.alphaSpinBox->value());
+    }
+    catch (const mitk::Exception& e)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
+
+    MITK_INFO << "  done";
+
+    mitk::DataStorage::Pointer datastorage = this->GetDataStorage();
+
+    auto lowDataNode = mitk::DataNode::New();
+    lowDataNode->SetData(result.m_LowImage);
+    lowDataNode->SetName(QString("%1 (%2kV)").arg(pair.m_Low.m_Description.c_str()).arg(pair.m_Low.m_KVP).toStdString());
+    datastorage->Add(lowDataNode);
+
+    auto highDataNode = mitk::DataNode::New();
+    highDataNode->SetData(result.m_HighImage);
+    highDataNode->SetName(QString("%1 (%2kV)").arg(pair.m_High.m_Description.c_str()).arg(pair.m_High.m_KVP).toStdString());
+    datastorage->Add(highDataNode);
+
+    m_Controls.selectionWidget_lowEnergy->SetCurrentSelectedNode(lowDataNode);
+    m_Controls.selectionWidget_highEnergy->SetCurrentSelectedNode(highDataNode);
+
+    if (result.m_BlendedImage.IsNotNull())
+    {
+        auto huDataNode = mitk::DataNode::New();
+        huDataNode->SetData(result.m_BlendedImage);
+        huDataNode->SetName(QString("%1 (HU)").arg(lowDataNode->GetName().c_str()).toStdString());
+        AddResultNode(huDataNode, "HU");
+
+        m_Controls.selectionWidget_huCube->SetCurrentSelectedNode(huDataNode);
+    }
+}
+
+void QmitkDualEnergyCtConversionView::ExportSelectedImage()
+{
+    auto selectedDataNode = m_Controls.selectionWidget_huCube->GetSelectedNode();
+    auto imageName = selectedDataNode->GetName();
+    mitk::Image::Pointer image = mitk::BrickedVolume::DecompressNode(selectedDataNode);
+
+    QString filename = QFileDialog::getSaveFileName(nullptr, "Export compressed volume", QString("%1.nrrd").arg(imageName.c_str()), "NRRD Files (*.nrrd)");
+    if (filename.isEmpty())
+        return;
+
+    MITK_INFO << "export Image \"" << imageName << "\" ... ";
+
+    try
+    {
+        // results of this view state their quantity, everything else is treated as HU image
+        mitk::CompressedVolumeWriter::ForImage(image).Write(image, filename.toStdString());
+    }
+    catch (const mitk::Exception& e)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", e.GetDescription());
+        return;
+    }
+
+    MITK_INFO << "  done";
+}
+
+bool QmitkDualEnergyCtConversionView::GetBodyMask(const mitk::Image* image, mitk::BodyMask& mask)
+{
+    auto maskNode = m_Controls.selectionWidget_bodyMask->GetSelectedNode();
+    if (maskNode.IsNotNull())
+    {
+        mask = mitk::BodyMask::FromSegmentation(dynamic_cast<mitk::Image*>(maskNode->GetData()));
+    }
+    else if (m_Controls.autoMaskCheckBox->isChecked())
+    {
+        mask = mitk::BodyMask::FromThreshold(image);
+    }
+    else
+    {
+        return false;
+    }
+
+    MITK_INFO << "Body mask covers " << mask.GetNumberOfMaskedVoxels() << " of " << mask.m_NumberOfVoxels << " voxels";
+    return true;
+}
+
+bool QmitkDualEnergyCtConversionView::SetLevelWindowFromStatistics(mitk::DataNode* node, const mitk::Image* image)
+{
+    mitk::VoxelStatistics statistics;
+    if (!mitk::VoxelStatistics::ReadFrom(image, statistics))
+        return false;
+
+    // window over the central 99% of the voxels, so single outliers do not flatten the contrast
+    mitk::LevelWindow levelWindow;
+    levelWindow.SetRangeMinMax(statistics.m_Minimum, statistics.m_Maximum);
+    levelWindow.SetWindowBounds(statistics.GetPercentile(0.005), statistics.GetPercentile(0.995));
+    node->SetLevelWindow(levelWindow);
+    return true;
+}
+
+bool QmitkDualEnergyCtConversionView::CheckExecutionPlan(mitk::ExecutionPlanner::Operation operation, const mitk::Image* imageA, const mitk::Image* imageB)
+{
+    mitk::ExecutionPlan plan = m_BlendingTool.Plan(operation, imageA, imageB);
+    if (plan.m_Strategy == mitk::ExecutionPlan::Strategy::Refused)
+    {
+        QMessageBox::warning(nullptr, "DECT Conversion", QString::fromStdString(plan.m_Message + " Increase the memory budget in the DECT preferences."));
+        return false;
+    }
+
+    MITK_INFO << plan.m_Message;
+    return true;
+}
+
+void QmitkDualEnergyCtConversionView::AddResultNode(mitk::DataNode* node, const std::string& quantity)
+{
+    mitk::Image* image = dynamic_cast<mitk::Image*>(node->GetData());
+    if (nullptr != image)
+        image->SetProperty(mitk::CompressedVolumeWriter::QuantityPropertyName, mitk::StringProperty::New(quantity));
+    if (0 != m_ResultStorage)
+    {
+        // the export precision of 1 HU or 1e-4 RED, SPR values are of the order of RED values
+        const double step = 1 == m_ResultStorage ? 0. : mitk::CompressedVolumeWriter::ForImage(image).m_RescaleSlope;
+        try
+        {
+            mitk::BrickedVolume::CompressNode(node, step);
+        }
+        catch (const mitk::Exception& e)
+        {
+            // the node is unchanged and keeps the full image
+            MITK_WARN << "Result \"" << node->GetName() << "\" is not compressed: " << e.GetDescription();
+        }
+    }
+    this->GetDataStorage()->Add(node);
+}
+
+void QmitkDualEnergyCtConversionView::NodeChanged(const mitk::DataNode* node)
+{
+    // compressed results are hidden, showing one e.g. in the data manager restores its image for rendering
+    if (nullptr == mitk::BrickedVolume::GetFromNode(node) || !node->IsVisible(nullptr))
+        return;
+    mitk::BrickedVolume::DecompressNode(const_cast<mitk::DataNode*>(node));
+    mitk::RenderingManager::GetInstance()->RequestUpdateAll();
 }
 
 void QmitkDualEnergyCtConversionView::OnPreferencesChanged(const berry::IBerryPreferences*)
@@ -272,6 +757,23 @@ void QmitkDualEnergyCtConversionView::OnPreferencesChanged(const berry::IBerryPr
 	// get the node for the preference page
     berry::IPreferences::Pointer prefNode = berry::Platform::GetPreferencesService()->GetSystemPreferences()->Node("/org.mitk.views.dualenergyctconversion");
 
+    // memory budget is stored in MB, 0 means unlimited
+    m_BlendingTool.SetMemoryBudget(static_cast<std::size_t>(prefNode->GetInt("memory budget", 0)) << 20);
+    // idle temporaries may keep an eighth of a budget, without a budget the default capacity of the pool
+    mitk::BufferPool::GetInstance().SetCapacityForMemoryBudget(m_BlendingTool.GetMemoryBudget());
+
+    // 0 disables the re-blending cache, 1 keeps the difference in float, 2 in double
+    const int differenceCache = prefNode->GetInt("difference cache", 1);
+    m_BlendingTool.SetDifferenceCaching(differenceCache != 0, differenceCache == 1);
+
+    m_ResultStorage = prefNode->GetInt("result storage", 0);
+
+    // thread counts, slab sizes and kernels of the preference page calibration, ignored if measured on another machine
+    if (!m_BlendingTool.SetTuningString(prefNode->Get("tuning", "").toStdString()))
+    {
+        MITK_INFO << "No performance tuning of this machine in the preferences, using the default execution plans.";
+    }
+
     bool enableExternal = prefNode->GetBool("enable external", false);
 
     if (enableExternal)
@@ -308,5 +810,6 @@ void QmitkDualEnergyCtConversionView::OnPreferencesChanged(const berry::IBerryPr
 
 	//update the mode box with the newly loaded values from the alpha tool
     UpdateModeBox();
+    this->OnBinImagesChanged(m_Controls.selectionWidget_energyBins->GetSelectedNodes());
 }
 
@@ -15,8 +15,10 @@ found in the LICENSE file.
 
 #include <berryISelectionListener.h>
 #include <QmitkAbstractView.h>
+#include <QmitkMultiNodeSelectionWidget.h>
 #include <QmitkSingleNodeSelectionWidget.h>
 #include <mitkAlphaBlendingTool.h>
+#include <mitkWeakPointer.h>
 
 
 // Include the Qt UI file which contains all the gui information for this plugin
@@ -45,20 +47,52 @@ public:
    */
   void OnPreferencesChanged(const berry::IBerryPreferences* prefs) override;
 
+  /**
+   * @brief      Called when a node changed. Restores a compressed result once it is made visible.
+   */
+  void NodeChanged(const mitk::DataNode* node) override;
+
 
 private slots:
   void OnImageChanged(const QmitkSingleNodeSelectionWidget::NodeList& nodes);
   void OnHuImageChanged(const QmitkSingleNodeSelectionWidget::NodeList&);
+  void OnBinImagesChanged(const QmitkMultiNodeSelectionWidget::NodeList&);
+  void OnBinModeChange(int);
+
+  /**
+   * @brief      Keeps the blending options consistent, adaptive blending is not available with motion correction or a body mask.
+   */
+  void UpdateBlendingOptions();
 
   /**
    * @brief      Blend the two selected images togheter with the help of the alpha blending module.
    */
   void BlendSelectedImages();
   
+  /**
+   * @brief      Combine the selected energy bins of a photon counting scan with the selected bin weights.
+   */
+  void CombineEnergyBins();
+
   /**
    * @brief      Covnert the selected HU image to a RED image, with the help of the alpha blending module.
    */
   void ConvertToREDImage();
+
+  /**
+   * @brief      Convert the selected HU image to a stopping power ratio image, with the help of the alpha blending module.
+   */
+  void ConvertToSPRImage();
+
+  /**
+   * @brief      Load a DICOM directory, pair the low and high kVp series and blend them with the matching mode.
+   */
+  void LoadDECTSeries();
+
+  /**
+   * @brief      Export the selected image as compact compressed volume with the help of the alpha blending module.
+   */
+  void ExportSelectedImage();
   
   /**
    * @brief      Called on mode change. Write the new alpha value in the spin box. 
@@ -67,6 +101,12 @@ private slots:
    */
   void OnModeChange(int idx);
 
+  /**
+   * @brief      Called on alpha change. Re-blends the last blended HU image in place while its inputs are still selected,
+   * from the difference cached by the blending tool.
+   */
+  void OnAlphaChanged(double alpha);
+
 private:
   // Typically a one-liner. Set the focus to the default widget.
   void SetFocus() override;
@@ -89,8 +129,43 @@ private:
    */
   void UpdateModeBox();
 
+  /**
+   * @brief      Get the body mask for an image, from the selected segmentation or by thresholding when
+   * the automatic body mask is enabled.
+   *
+   * @return     true if a mask should be used
+   */
+  bool GetBodyMask(const mitk::Image* image, mitk::BodyMask& mask);
+
+  /**
+   * @brief      Set the level window of a node from the statistics attached to its image by the alpha blending module.
+   *
+   * @return     false if the image has no statistics attached
+   */
+  bool SetLevelWindowFromStatistics(mitk::DataNode* node, const mitk::Image* image);
+
+  /**
+   * @brief      Plan the operation with the memory budget of the preferences and warn when it is refused.
+   *
+   * @return     true if the operation can be started
+   */
+  bool CheckExecutionPlan(mitk::ExecutionPlanner::Operation operation, const mitk::Image* imageA, const mitk::Image* imageB = nullptr);
+
+  /**
+   * @brief      Add a result to the data storage, block compressed and hidden if set in the preferences. Compressed
+   * results are restored when they are shown or used, see mitk::BrickedVolume::DecompressNode.
+   *
+   * @param[in]  quantity  "HU", "RED" or "SPR", stored as mitk::CompressedVolumeWriter::QuantityPropertyName of the
+   * image, which selects the precision of the compression and the export
+   */
+  void AddResultNode(mitk::DataNode* node, const std::string& quantity);
+
+  static const QString AllBinModes; // bin mode box entry combining the bins with all matching weight vectors
+
   mitk::AlphaBlendingTool m_BlendingTool; // object of blendingTool from alphaBlending module performing all the arithmetic.
   bool initializeBool = true; // bool if the blending tool needs to be initialized
+  mitk::WeakPointer<mitk::DataNode> m_LastHUNode; // result of the last plain alpha blending, re-blended on alpha change
+  int m_ResultStorage = 0; // 0 keeps full result images, 1 compresses them losslessly, 2 with the export precision
   
 
   // Generated from the associated UI file, it encapsulates all the widgets